@@ -0,0 +1,225 @@
+//
+//  BatchRender.hpp
+//  AR_Framework
+//
+
+#ifndef BatchRender_hpp
+#define BatchRender_hpp
+
+#include "Renderer.hpp"
+#include "FrameBuffer.hpp"
+#include <stb_image_write.h>
+#include <chrono>
+#include <cstdlib>
+
+namespace AR {
+
+struct BatchRenderOptions {
+	std::string output = "frame_%04d.png";	// printf pattern, .png, .jpg or .hdr; _%04d is added before the extension when it has no %d
+	int frames = 36;
+	int width = 1280, height = 720;
+	int supersample = 2;					// rendered at (width,height)*supersample and box filtered
+	float elevation = 15.f;					// degrees, the orbit keeps the current distance
+	int jpegQuality = 95;
+	int maxWarmupFrames = 2000;				// frames spent waiting for textures and IBL
+
+	// --batch [--frames N] [--size WxH] [--ss K] [--out pattern] [--elevation deg]
+	// Other arguments are returned as files to load. Returns true when --batch was given.
+	bool parse( int argc, const char* argv[], std::vector<std::string>& files ) {
+		bool batch = false;
+		for( int i=1; i<argc; i++ ) {
+			std::string a = argv[i];
+			bool hasValue = i+1<argc;
+			if( a=="--batch" )							batch = true;
+			else if( a=="--frames" && hasValue )		frames = std::max( 1, atoi( argv[++i] ) );
+			else if( a=="--size" && hasValue )			sscanf( argv[++i], "%dx%d", &width, &height );
+			else if( a=="--ss" && hasValue )			supersample = std::max( 1, atoi( argv[++i] ) );
+			else if( a=="--out" && hasValue )			output = argv[++i];
+			else if( a=="--elevation" && hasValue )		elevation = float(atof( argv[++i] ));
+			else if( a=="--quality" && hasValue )		jpegQuality = atoi( argv[++i] );
+			else if( a.size()>2 && a[0]=='-' && a[1]=='-' )
+				fprintf( stderr, "[ERROR] Unknown option %s\n", a.c_str() );
+			else										files.push_back( a );
+		}
+		return batch;
+	}
+};
+
+// Renders a turntable around renderer.camera.center into an offscreen
+// framebuffer. Frames are read back through the PBO ring and filtered and
+// encoded on their own pool, so the GL thread keeps rendering while earlier
+// frames are written.
+struct BatchRender {
+	enum class Encoding { PNG, JPG, HDR };
+
+	// 'sceneReady' is polled between warm-up frames until asynchronous loads are done.
+	static bool run( Renderer& renderer, const BatchRenderOptions& opt, const std::function<bool()>& sceneReady=[](){ return true; } ) {
+		Encoding enc = encodingOf( opt.output );
+		std::string pattern = framePattern( opt.output );
+		if( pattern.empty() ) {
+			fprintf( stderr, "[ERROR] Output pattern %s needs exactly one %%d frame field\n", opt.output.c_str() );
+			return false;
+		}
+		int ss = std::max( 1, opt.supersample );
+		int maxSize = Texture::maxTextureSize();
+		while( ss>1 && std::max( opt.width, opt.height )*ss>maxSize ) ss--;
+		if( std::max( opt.width, opt.height )>maxSize || opt.width<1 || opt.height<1 ) {
+			fprintf( stderr, "[ERROR] Batch frame size %dx%d is not supported\n", opt.width, opt.height );
+			return false;
+		}
+		int W = opt.width*ss, H = opt.height*ss;
+		// The shader writes sRGB; float targets keep values above one for .hdr.
+		Framebuffer fb;
+		fb.create( W, H, enc==Encoding::HDR?GL_FLOAT:GL_UNSIGNED_BYTE, 4, true );
+		if( fb.fbID<1 ) return false;
+
+		int warmup = 0;
+		for( ; !sceneReady() && warmup<opt.maxWarmupFrames; warmup++ ) {
+			renderFrame( renderer, fb );
+			glFinish();
+			std::this_thread::sleep_for( std::chrono::milliseconds( 5 ) );
+		}
+		if( warmup>=opt.maxWarmupFrames )
+			fprintf( stderr, "[ERROR] Scene still loading after %d frames, rendering anyway\n", warmup );
+
+		Camera saved = renderer.camera;
+		vec3 d = saved.position-saved.center;
+		float dist = length( d );
+		float theta0 = atan2f( d.x, d.z );
+		float phi = opt.elevation*PI/180.f;
+
+		ThreadPool encoders;
+		std::deque<std::pair<int,std::future<PixelBuffer>>> readbacks;
+		std::deque<std::future<bool>> encodes;
+		int failed = 0;
+		size_t maxEncodes = size_t( encoders.size()*2+2 );	// bounds the frames held in memory
+		auto dispatch = [&]( bool wait ) {
+			while( !readbacks.empty() && (wait || readbacks.front().second.wait_for( std::chrono::seconds(0) )==std::future_status::ready) ) {
+				int index = readbacks.front().first;
+				PixelBuffer pb = readbacks.front().second.get();
+				readbacks.pop_front();
+				std::string fn = frameName( pattern, index );
+				auto pixels = std::make_shared<PixelBuffer>( std::move( pb ) );
+				encodes.push_back( encoders.push( [pixels, fn, ss, enc, &opt](){
+					return encode( *pixels, ss, enc, fn, opt.jpegQuality );
+				} ) );
+			}
+			while( encodes.size()>maxEncodes || (wait && !encodes.empty()) ) {
+				if( !encodes.front().get() ) failed++;
+				encodes.pop_front();
+			}
+		};
+
+		auto t0 = std::chrono::steady_clock::now();
+		double renderTime = 0;
+		for( int i=0; i<opt.frames; i++ ) {
+			float theta = theta0+2*PI*i/opt.frames;
+			renderer.camera.position = saved.center+dist*vec3( cosf(phi)*sinf(theta), sinf(phi), cosf(phi)*cosf(theta) );
+			auto r0 = std::chrono::steady_clock::now();
+			renderFrame( renderer, fb );
+			readbacks.push_back( { i, fb.readPixelsAsync() } );
+			renderTime += std::chrono::duration<double>( std::chrono::steady_clock::now()-r0 ).count();
+			fb.updateReadback();
+			dispatch( false );
+		}
+		fb.readback.flush();
+		dispatch( true );
+		double total = std::chrono::duration<double>( std::chrono::steady_clock::now()-t0 ).count();
+		renderer.camera = saved;
+
+		printf( "batch: %d frames of %dx%d (x%d supersampled) in %.2f s, %.2f fps end to end, %.1f ms GL per frame, %d warm-up frames\n",
+			   opt.frames, opt.width, opt.height, ss, total, opt.frames/std::max( total, 1e-6 ),
+			   renderTime*1000/opt.frames, warmup );
+		if( failed ) fprintf( stderr, "[ERROR] %d frames could not be written\n", failed );
+		return failed==0;
+	}
+
+	static Encoding encodingOf( const std::string& fn ) {
+		std::string ext = getExtension( fn );
+		std::transform( ext.begin(), ext.end(), ext.begin(), [](unsigned char c){ return std::tolower(c); } );
+		if( ext=="jpg" || ext=="jpeg" )	return Encoding::JPG;
+		if( ext=="hdr" )				return Encoding::HDR;
+		return Encoding::PNG;
+	}
+	// Adds _%04d before the extension of a name without a frame field. Returns an
+	// empty string for anything snprintf cannot take a single int for.
+	static std::string framePattern( const std::string& output ) {
+		int fields = 0;
+		for( size_t i=0; i<output.size(); i++ ) {
+			if( output[i]!='%' ) continue;
+			if( i+1<output.size() && output[i+1]=='%' ) { i++; continue; }
+			size_t j = output.find_first_not_of( "0123456789-+ #", i+1 );
+			if( j==std::string::npos || (output[j]!='d' && output[j]!='i') ) return "";
+			fields++;
+			i = j;
+		}
+		if( fields>1 ) return "";
+		if( fields==1 ) return output;
+		size_t dot = output.find_last_of( '.' ), slash = output.find_last_of( "/\\" );
+		if( dot==std::string::npos || (slash!=std::string::npos && dot<slash) ) dot = output.size();
+		return output.substr( 0, dot )+"_%04d"+output.substr( dot );
+	}
+	static std::string frameName( const std::string& pattern, int index ) {
+		char buf[1024];
+		snprintf( buf, sizeof(buf), pattern.c_str(), index );
+		return buf;
+	}
+
+	static float srgbToLinear( float v ) {
+		return v<=0.04045f ? v/12.92f : powf( (v+0.055f)/1.055f, 2.4f );
+	}
+	static float linearToSrgb( float v ) {
+		return v<=0.0031308f ? v*12.92f : 1.055f*powf( v, 1/2.4f )-0.055f;
+	}
+
+	// Averages ss x ss blocks in linear light and flips the rows top-down.
+	// 8-bit output is sRGB again, .hdr output stays linear.
+	static bool encode( const PixelBuffer& pb, int ss, Encoding enc, const std::string& fn, int quality ) {
+		if( pb.empty() ) return false;
+		int w = pb.width/ss, h = pb.height/ss, n = pb.nChannels;
+		int nOut = enc==Encoding::PNG ? 4 : 3;
+		float norm = 1.f/(ss*ss);
+		float lut[256];
+		for( int i=0; i<256; i++ ) lut[i] = srgbToLinear( i/255.f );
+		auto texel = [&]( int x, int y, int c ) {
+			size_t i = (size_t(y)*pb.width+x)*n+c;
+			if( pb.type==GL_FLOAT )	return c<3 ? srgbToLinear( pb.as<float>()[i] ) : pb.as<float>()[i];
+			unsigned char v = pb.as<unsigned char>()[i];
+			return c<3 ? lut[v] : v/255.f;
+		};
+		std::vector<float> linear( size_t(w)*h*nOut );
+		for( int y=0; y<h; y++ ) for( int x=0; x<w; x++ ) {
+			float* dst = linear.data()+(size_t(h-1-y)*w+x)*nOut;
+			for( int c=0; c<nOut; c++ ) {
+				float sum = 0;
+				for( int j=0; j<ss; j++ ) for( int i=0; i<ss; i++ ) sum += texel( x*ss+i, y*ss+j, std::min( c, n-1 ) );
+				dst[c] = sum*norm;
+			}
+		}
+		int ok = 0;
+		if( enc==Encoding::HDR )
+			ok = stbi_write_hdr( fn.c_str(), w, h, nOut, linear.data() );
+		else {
+			std::vector<unsigned char> ldr( linear.size() );
+			for( size_t i=0; i<linear.size(); i++ ) {
+				float v = (i%nOut)<3 ? linearToSrgb( linear[i] ) : linear[i];
+				ldr[i] = (unsigned char)std::min( 255.f, std::max( 0.f, v*255.f+0.5f ) );
+			}
+			if( enc==Encoding::JPG )	ok = stbi_write_jpg( fn.c_str(), w, h, nOut, ldr.data(), quality );
+			else					ok = stbi_write_png( fn.c_str(), w, h, nOut, ldr.data(), w*nOut );
+		}
+		if( !ok ) fprintf( stderr, "[ERROR] Cannot write %s\n", fn.c_str() );
+		return ok!=0;
+	}
+
+protected:
+	static void renderFrame( Renderer& renderer, Framebuffer& fb ) {
+		fb.use();
+		renderer.render( fb.width, fb.height );
+		fb.unuse();
+	}
+};
+
+}
+
+#endif /* BatchRender_hpp */
@@ -31,6 +31,27 @@ struct Camera {
 	
 };
 
+// Six planes of a view-projection, normals pointing inside.
+struct Frustum {
+	vec4 planes[6];
+
+	Frustum() {}
+	Frustum( const mat4& viewProj ) {
+		vec4 row[4];
+		for( int i=0; i<4; i++ ) row[i] = vec4( viewProj[0][i], viewProj[1][i], viewProj[2][i], viewProj[3][i] );
+		for( int i=0; i<3; i++ ) {
+			planes[i*2  ] = row[3]+row[i];
+			planes[i*2+1] = row[3]-row[i];
+		}
+		for( auto& p: planes ) p /= length( vec3( p ) );
+	}
+	Frustum( const Camera& camera ) : Frustum( camera.projMat()*camera.viewMat() ) {}
+	bool intersectsSphere( const vec3& center, float radius ) const {
+		for( auto& p: planes ) if( dot( vec3( p ), center )+p.w<-radius ) return false;
+		return true;
+	}
+};
+
 
 
 }
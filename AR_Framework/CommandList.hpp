@@ -0,0 +1,184 @@
+//
+//  CommandList.hpp
+//  AR_Framework
+//
+
+#ifndef CommandList_hpp
+#define CommandList_hpp
+
+#include "Tools/gl.hpp"
+#include "Tools/Hash.hpp"
+#include <vector>
+#include <algorithm>
+
+namespace AR {
+
+// Recorded draw submission. The list is split in items (one per mesh, say),
+// each with its own commands and a slice of a shared uniform buffer. Every
+// frame the caller passes the item's signature to changed(); only items whose
+// signature differs are recorded again, everything else replays as it was:
+//
+//	list.resize( meshes.size() );
+//	for( i ) if( list.changed( i, sig=signatureOf( mesh ) ) ) {
+//		auto rec = list.record( i, sig );
+//		rec.bindTexture( 0, GL_TEXTURE_2D, tex ); rec.uniforms( &params, 0 ); ...
+//	}
+//	list.replay();
+//
+// Replay skips binds that match the state it last set, which is reset at the
+// start of every replay.
+struct CommandList {
+	enum class Op : uint32_t { UseProgram, BindTexture, BindUniforms, BindVertexArray, DrawElements };
+	struct Command {
+		Op op;
+		GLuint id;				// program, texture, vertex array or index count
+		GLuint unit;			// texture unit or uniform buffer binding
+		GLenum target;			// texture target or index type
+	};
+	struct Item {
+		std::vector<Command> cmds;
+		uint64_t signature = 0;
+		bool recorded = false;
+	};
+	struct Stats {
+		int recorded = 0, commands = 0, issued = 0, draws = 0;
+	};
+	struct Recorder {
+		CommandList& list;
+		int item;
+		void useProgram( GLuint program )						{ add( { Op::UseProgram, program, 0, 0 } ); }
+		void bindTexture( int unit, GLenum target, GLuint tex )	{ add( { Op::BindTexture, tex, GLuint(unit), target } ); }
+		void bindVertexArray( GLuint vao )						{ add( { Op::BindVertexArray, vao, 0, 0 } ); }
+		void drawElements( GLsizei count, GLenum type=GL_UNSIGNED_INT ) { add( { Op::DrawElements, GLuint(count), 0, type } ); }
+		// Copies blockSize bytes into the item's slice, bound to 'binding' on replay.
+		void uniforms( const void* data, GLuint binding ) {
+			list.setUniformData( item, data );
+			add( { Op::BindUniforms, 0, binding, 0 } );
+		}
+	protected:
+		void add( const Command& c ) { list.items[item].cmds.push_back( c ); }
+	};
+
+	std::vector<Item> items;
+	size_t blockSize = 0, stride = 0;	// stride is blockSize rounded to the offset alignment
+	jm::aligned_vector<unsigned char,64> uniformData;	// so the slices start on cache lines
+	size_t dirtyBegin = 0, dirtyEnd = 0;
+	GLuint ubo = 0;
+	size_t uboSize = 0;
+	Stats stats;
+
+	CommandList( size_t uniformBlockSize ) : blockSize( uniformBlockSize ) {}
+	CommandList( const CommandList& ) = delete;
+	~CommandList() { release(); }
+
+	void release() {
+		if( ubo ) glDeleteBuffers( 1, &ubo );
+		ubo = 0;
+		uboSize = 0;
+		invalidate();
+	}
+	// Forces every item to be recorded again.
+	void invalidate() {
+		for( auto& it: items ) it.recorded = false;
+	}
+	void resize( int n ) {
+		if( n!=int(items.size()) ) items.resize( n );
+	}
+	bool changed( int item, uint64_t signature ) const {
+		return !items[item].recorded || items[item].signature!=signature;
+	}
+	// Starts the item over; the signature is the one passed to changed().
+	Recorder record( int item, uint64_t signature ) {
+		Item& it = items[item];
+		it.cmds.clear();
+		it.signature = signature;
+		it.recorded = true;
+		stats.recorded++;
+		return { *this, item };
+	}
+
+	void replay() { replay( nullptr, int(items.size()) ); }
+	// Replays only the listed items, in that order.
+	void replay( const std::vector<int>& order ) { replay( order.data(), int(order.size()) ); }
+	void resetStats() { stats = Stats(); }
+
+protected:
+	void replay( const int* order, int n ) {
+		upload();
+		GLuint program = 0, vao = 0, boundUniforms = GLuint(-1);
+		GLuint textures[32] = {0};
+		GLint activeUnit = -1;
+		GLint oldProgram = 0;
+		glGetIntegerv( GL_CURRENT_PROGRAM, &oldProgram );
+		program = GLuint(oldProgram);
+		for( int k=0; k<n; k++ ) {
+			int i = order?order[k]:k;
+			for( auto& c: items[i].cmds ) {
+				stats.commands++;
+				switch( c.op ) {
+					case Op::UseProgram:
+						if( c.id==program ) continue;
+						glUseProgram( program = c.id );
+						break;
+					case Op::BindTexture:
+						if( c.unit<32 && textures[c.unit]==c.id ) continue;
+						if( activeUnit!=GLint(c.unit) ) glActiveTexture( GL_TEXTURE0+(activeUnit=c.unit) );
+						glBindTexture( c.target, c.id );
+						if( c.unit<32 ) textures[c.unit] = c.id;
+						break;
+					case Op::BindUniforms:
+						if( boundUniforms==GLuint(i) ) continue;
+						glBindBufferRange( GL_UNIFORM_BUFFER, c.unit, ubo, GLintptr( i*stride ), GLsizeiptr( blockSize ) );
+						boundUniforms = i;
+						break;
+					case Op::BindVertexArray:
+						if( c.id==vao ) continue;
+						glBindVertexArray( vao = c.id );
+						break;
+					case Op::DrawElements:
+						glDrawElements( GL_TRIANGLES, GLsizei(c.id), c.target, 0 );
+						stats.draws++;
+						break;
+				}
+				stats.issued++;
+			}
+		}
+		glBindVertexArray( 0 );
+	}
+	void setUniformData( int item, const void* data ) {
+		if( stride==0 ) {
+			GLint align = 256;
+			glGetIntegerv( GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &align );
+			align = std::max( align, 1 );
+			stride = (blockSize+align-1)/align*align;
+		}
+		size_t need = items.size()*stride;
+		if( uniformData.size()<need ) uniformData.resize( need );
+		size_t offset = item*stride;
+		if( memcmp( uniformData.data()+offset, data, blockSize )==0 && offset+blockSize<=uboSize ) return;
+		memcpy( uniformData.data()+offset, data, blockSize );
+		if( dirtyBegin==dirtyEnd ) dirtyBegin = offset, dirtyEnd = offset+blockSize;
+		dirtyBegin = std::min( dirtyBegin, offset );
+		dirtyEnd = std::max( dirtyEnd, offset+blockSize );
+	}
+	// Sends the changed slices, the whole buffer when it has to grow.
+	void upload() {
+		if( uniformData.empty() ) return;
+		GLint oldUBO = 0;
+		glGetIntegerv( GL_UNIFORM_BUFFER_BINDING, &oldUBO );
+		if( !ubo ) glGenBuffers( 1, &ubo );
+		glBindBuffer( GL_UNIFORM_BUFFER, ubo );
+		if( uboSize<uniformData.size() ) {
+			glBufferData( GL_UNIFORM_BUFFER, uniformData.size(), uniformData.data(), GL_DYNAMIC_DRAW );
+			uboSize = uniformData.size();
+		}
+		else if( dirtyEnd>dirtyBegin )
+			glBufferSubData( GL_UNIFORM_BUFFER, dirtyBegin, dirtyEnd-dirtyBegin, uniformData.data()+dirtyBegin );
+		dirtyBegin = dirtyEnd = 0;
+		glBindBuffer( GL_UNIFORM_BUFFER, oldUBO );
+	}
+};
+
+}
+
+#endif /* CommandList_hpp */
@@ -12,6 +12,7 @@
 #include <assimp/postprocess.h>
 #include <assimp/DefaultLogger.hpp>
 #include <assimp/LogStream.hpp>
+#include <cfloat>
 #ifdef _DEBUG
 #pragma comment (lib,"IrrXMLd")
 #pragma comment (lib,"zlibstaticd")
@@ -92,7 +93,7 @@ static void convertMaterial( Material& mat, const aiMaterial* mtl, const std::st
 		mat.bumpMapID = texLib.testAndLoadTexture( path+std::string(file.C_Str()), true );
 	}
 	if( mtl->GetTexture(aiTextureType_NORMALS, 0, &file) == AI_SUCCESS ) {
-		mat.normMapID = texLib.testAndLoadTexture( path+std::string(file.C_Str()), false );
+		mat.normMapID = texLib.testAndLoadTexture( path+std::string(file.C_Str()), false, TexUsage::Normal );
 	}
 	if( mtl->GetTexture(aiTextureType_SHININESS, 0, &file) == AI_SUCCESS ) {
 		mat.roughnessMapID = texLib.testAndLoadTexture( path+std::string(file.C_Str()), true );
@@ -114,20 +115,20 @@ static void convertMaterial( Material& mat, const aiMaterial* mtl, const std::st
 		mat.diffTexID = texLib.testAndLoadTexture( path+std::string(file.C_Str()), true );
 	}
 	if( mtl->GetTexture(aiTextureType_NORMAL_CAMERA, 0, &file) == AI_SUCCESS ) {
-		mat.normMapID = texLib.testAndLoadTexture( path+std::string(file.C_Str()), false );
+		mat.normMapID = texLib.testAndLoadTexture( path+std::string(file.C_Str()), false, TexUsage::Normal );
 	}
 	if( mtl->GetTexture(aiTextureType_EMISSION_COLOR, 0, &file) == AI_SUCCESS ) {
 		mat.emissionMapID = texLib.testAndLoadTexture( path+std::string(file.C_Str()), true );
 	}
 	if( mtl->GetTexture(aiTextureType_METALNESS, 0, &file) == AI_SUCCESS ) {
-		mat.metalnessMapID = texLib.testAndLoadTexture( path+std::string(file.C_Str()), false );
+		mat.metalnessMapID = texLib.testAndLoadTexture( path+std::string(file.C_Str()), false, TexUsage::Mask );
 	}
 	if( mtl->GetTexture(aiTextureType_DIFFUSE_ROUGHNESS, 0, &file) == AI_SUCCESS ) {
-		mat.roughnessMapID = texLib.testAndLoadTexture( path+std::string(file.C_Str()), false );
+		mat.roughnessMapID = texLib.testAndLoadTexture( path+std::string(file.C_Str()), false, TexUsage::Mask );
 		mat.roughnessMapInverse = false;
 	}
 	if( mtl->GetTexture(aiTextureType_AMBIENT_OCCLUSION, 0, &file) == AI_SUCCESS ) {
-		mat.ambOccMatID = texLib.testAndLoadTexture( path+std::string(file.C_Str()), false );
+		mat.ambOccMatID = texLib.testAndLoadTexture( path+std::string(file.C_Str()), false, TexUsage::Mask );
 	}
 }
 
@@ -139,16 +140,10 @@ Range3 convertMesh( aiMesh* mesh, aiMaterial** materials, const std::string& pat
 	tris.emplace_back();
 	TriMesh& obj = tris.back();
 	
+	static_assert( sizeof(aiVector3D)==sizeof(vec3), "assimp vectors are read as vec3 arrays" );
 	obj.data.verts.resize( mesh->mNumVertices );
-	for( size_t t = 0; t < mesh->mNumVertices; ++t) {
-		vec3 v = toVec3( mesh->mVertices[t] );
-		obj.data.verts[t] = vec3(mat*vec4(v,1));
-	}
-	
-	Range3 rr = {obj.data.verts[0],obj.data.verts[0]};
-	for( size_t t=0; t<mesh->mNumVertices; t++ ) {
-		rr+=  obj.data.verts[t];
-	}
+	Range3 rr( vec3( FLT_MAX ), vec3( -FLT_MAX ) );
+	transformPoints( mat, (const vec3*)mesh->mVertices, obj.data.verts.data(), mesh->mNumVertices, rr.minVal, rr.maxVal );
 	for (size_t t = 0; t < mesh->mNumFaces; ++t) {
 		const aiFace* face = &mesh->mFaces[t];
 		for( int k=0; k<int(face->mNumIndices)-2; k++ ) // This only act for vertices
@@ -157,8 +152,7 @@ Range3 convertMesh( aiMesh* mesh, aiMaterial** materials, const std::string& pat
 	}
 	if( mesh->HasNormals() ) {
 		obj.data.norms.resize( mesh->mNumVertices );
-		for( size_t t = 0; t < mesh->mNumVertices; ++t)
-		obj.data.norms[t] = toVec3( mesh->mNormals[t] );
+		transformNormals( mat, (const vec3*)mesh->mNormals, obj.data.norms.data(), mesh->mNumVertices );
 	}
 	else {
 		MeshData::computeNormals( obj.data.verts, obj.data.tris, obj.data.norms );
@@ -176,21 +170,168 @@ Range3 convertMesh( aiMesh* mesh, aiMaterial** materials, const std::string& pat
 }
 
 
-Range3 convertMeshRecursive( aiNode* node, aiMesh** meshes, aiMaterial** materials, const std::string& path, MeshSet& meshSet, TextureLib& texLib, const mat4& parentMat ) {
+// Bind pose bounds of mesh space vertices placed by 'mat'.
+static Range3 transformRange( const mat4& mat, const Range3& r ) {
+	Range3 ret( vec3( FLT_MAX ), vec3( -FLT_MAX ) );
+	for( int i=0; i<8; i++ )
+		ret += vec3( mat*vec4( i&1?r.maxVal.x:r.minVal.x, i&2?r.maxVal.y:r.minVal.y, i&4?r.maxVal.z:r.minVal.z, 1 ) );
+	return ret;
+}
+
+// Fills the mesh's per vertex influences and its Skin. Vertices without bones,
+// and every vertex of an unskinned mesh under an animated node, follow the
+// mesh's own node through an extra slot.
+static bool convertSkin( const aiMesh* mesh, MeshData& data, Character& character, int node, int meshIndex ) {
+	const int MAX_BONES = 256;		// VertexSkin stores 8-bit slots
+	Skin skin;
+	skin.mesh = meshIndex;
+	std::vector<vec4> weights( mesh->mNumVertices, vec4( 0 ) );
+	std::vector<ivec4> slots( mesh->mNumVertices, ivec4( 0 ) );
+	for( unsigned int b=0; b<mesh->mNumBones; b++ ) {
+		const aiBone* bone = mesh->mBones[b];
+		int joint = character.skeleton.find( bone->mName.C_Str() );
+		if( joint<0 ) {
+			fprintf( stderr, "[ERROR] Bone %s has no node, its vertices stay in place\n", bone->mName.C_Str() );
+			continue;
+		}
+		int slot = int(skin.joints.size());
+		skin.joints.push_back( joint );
+		skin.offsets.push_back( toMat4( bone->mOffsetMatrix ) );
+		for( unsigned int k=0; k<bone->mNumWeights; k++ ) {
+			const aiVertexWeight& vw = bone->mWeights[k];
+			if( vw.mVertexId>=mesh->mNumVertices || vw.mWeight<=0 ) continue;
+			vec4& w = weights[vw.mVertexId];
+			int smallest = 0;									// keep the four largest
+			for( int i=1; i<4; i++ ) if( w[i]<w[smallest] ) smallest = i;
+			if( vw.mWeight>w[smallest] ) {
+				w[smallest] = vw.mWeight;
+				slots[vw.mVertexId][smallest] = slot;
+			}
+		}
+	}
+	int rigid = -1;
+	data.skin.resize( mesh->mNumVertices );
+	for( unsigned int v=0; v<mesh->mNumVertices; v++ ) {
+		vec4 w = weights[v];
+		float sum = w.x+w.y+w.z+w.w;
+		if( sum<=0 ) {
+			if( rigid<0 ) {
+				rigid = int(skin.joints.size());
+				skin.joints.push_back( node );
+				skin.offsets.push_back( mat4( 1 ) );
+			}
+			w = vec4( 1, 0, 0, 0 );
+			slots[v] = ivec4( rigid, 0, 0, 0 );
+			sum = 1;
+		}
+		VertexSkin& vs = data.skin[v];
+		int total = 0, largest = 0;
+		for( int i=0; i<4; i++ ) {
+			vs.bones[i] = uint8_t( std::min( slots[v][i], MAX_BONES-1 ) );
+			vs.weights[i] = uint8_t( w[i]/sum*255+.5f );
+			total += vs.weights[i];
+			if( w[i]>w[largest] ) largest = i;
+		}
+		vs.weights[largest] = uint8_t( vs.weights[largest]+255-total );		// exact sum, rounding goes to the largest
+	}
+	if( int(skin.joints.size())>MAX_BONES ) {
+		fprintf( stderr, "[ERROR] %s has %d bones, only %d can be skinned; drawing it in the bind pose\n",
+				mesh->mName.C_Str(), int(skin.joints.size()), MAX_BONES );
+		data.skin.clear();
+		return false;
+	}
+	skin.reach.assign( skin.joints.size(), -1.f );
+	for( unsigned int v=0; v<mesh->mNumVertices; v++ ) {
+		const VertexSkin& vs = data.skin[v];
+		int dominant = 0;
+		for( int i=1; i<4; i++ ) if( vs.weights[i]>vs.weights[dominant] ) dominant = i;
+		int b = vs.bones[dominant];
+		skin.reach[b] = std::max( skin.reach[b], length( vec3( skin.offsets[b]*vec4( data.verts[v], 1 ) ) ) );
+	}
+	character.skins.push_back( std::move( skin ) );
+	return true;
+}
+
+Range3 convertMeshRecursive( aiNode* node, aiMesh** meshes, aiMaterial** materials, const std::string& path, MeshSet& meshSet, TextureLib& texLib, const mat4& parentMat,
+							Character* character, int& nodeIndex, SceneGraph* graph, int parentNode ) {
 	Range3 range;
-	mat4 mat = parentMat * toMat4( node->mTransformation );
+	mat4 local = toMat4( node->mTransformation );
+	mat4 mat = parentMat * local;
+	int joint = nodeIndex++;
+	int graphNode = graph?graph->add( node->mName.C_Str(), parentNode, local, int(meshSet.size()) ):-1;
 	for( size_t i=0; i<node->mNumMeshes; i++ ) {
-		range += convertMesh( meshes[node->mMeshes[i]], materials, path, meshSet, texLib, mat );
+		aiMesh* mesh = meshes[node->mMeshes[i]];
+		int index = int(meshSet.size());
+		if( character && (mesh->HasBones() || character->skeleton.animated[joint]) ) {
+			// Skinned meshes stay in mesh space, the palette places them within the file.
+			Range3 bind = convertMesh( mesh, materials, path, meshSet, texLib, mat4(1) );
+			MeshData& data = meshSet[index].data;
+			if( convertSkin( mesh, data, *character, joint, index ) ) {
+				if( graph ) meshSet[index].node = graph->root( graphNode );
+			}
+			else if( graph ) meshSet[index].node = graphNode;			// drawn in the bind pose instead
+			else {
+				transformPoints( mat, data.verts.data(), data.verts.data(), data.verts.size() );
+				transformNormals( mat, data.norms.data(), data.norms.data(), data.norms.size() );
+			}
+			range += transformRange( mat, bind );
+		}
+		else if( graph ) {
+			range += transformRange( mat, convertMesh( mesh, materials, path, meshSet, texLib, mat4(1) ) );
+			meshSet[index].node = graphNode;
+		}
+		else range += convertMesh( mesh, materials, path, meshSet, texLib, mat );
+		if( meshSet[index].node>=0 ) meshSet[index].modelMat = graph->worlds[meshSet[index].node];
 	}
 	for( size_t i=0; i<node->mNumChildren; i++ ) {
-		range+=convertMeshRecursive( node->mChildren[i], meshes, materials, path, meshSet, texLib, mat);
+		range+=convertMeshRecursive( node->mChildren[i], meshes, materials, path, meshSet, texLib, mat, character, nodeIndex, graph, graphNode );
 	}
+	if( graph ) graph->close( graphNode, int(meshSet.size()) );
 	return range;
 }
 
+// Same depth first order as convertMeshRecursive().
+static void convertSkeleton( const aiNode* node, int parent, Skeleton& skeleton ) {
+	int index = skeleton.size();
+	skeleton.names.push_back( node->mName.C_Str() );
+	skeleton.parents.push_back( parent );
+	skeleton.rest.push_back( toMat4( node->mTransformation ) );
+	skeleton.animated.push_back( false );
+	for( unsigned int i=0; i<node->mNumChildren; i++ ) convertSkeleton( node->mChildren[i], index, skeleton );
+}
 
+static void convertAnimation( const aiAnimation* anim, const Skeleton& skeleton, AnimClip& clip ) {
+	double tps = anim->mTicksPerSecond>0?anim->mTicksPerSecond:25.0;
+	clip.name = anim->mName.C_Str();
+	clip.duration = float( anim->mDuration/tps );
+	for( unsigned int c=0; c<anim->mNumChannels; c++ ) {
+		const aiNodeAnim* na = anim->mChannels[c];
+		AnimChannel ch;
+		ch.joint = skeleton.find( na->mNodeName.C_Str() );
+		if( ch.joint<0 ) continue;
+		for( unsigned int k=0; k<na->mNumPositionKeys; k++ ) {
+			ch.posTimes.push_back( float( na->mPositionKeys[k].mTime/tps ) );
+			ch.positions.push_back( toVec3( na->mPositionKeys[k].mValue ) );
+		}
+		for( unsigned int k=0; k<na->mNumRotationKeys; k++ ) {
+			const aiQuaternion& q = na->mRotationKeys[k].mValue;
+			ch.rotTimes.push_back( float( na->mRotationKeys[k].mTime/tps ) );
+			ch.rotations.push_back( vec4( q.x, q.y, q.z, q.w ) );
+		}
+		for( unsigned int k=0; k<na->mNumScalingKeys; k++ ) {
+			ch.scaleTimes.push_back( float( na->mScalingKeys[k].mTime/tps ) );
+			ch.scales.push_back( toVec3( na->mScalingKeys[k].mValue ) );
+		}
+		clip.channels.push_back( std::move( ch ) );
+	}
+}
+
+static bool hasBones( const aiScene* scene ) {
+	for( unsigned int i=0; i<scene->mNumMeshes; i++ ) if( scene->mMeshes[i]->HasBones() ) return true;
+	return false;
+}
 
-Range3 loadMesh(const std::string& fn, MeshSet& set, TextureLib& texLib ){
+Range3 loadMesh(const std::string& fn, MeshSet& set, TextureLib& texLib, std::vector<Character>* characters, SceneGraph* graph ){
 	Range3 range;
 	std::string path = getPath( fn );
 	Assimp::Logger::LogSeverity severity = Assimp::Logger::NORMAL;
@@ -200,7 +341,24 @@ Range3 loadMesh(const std::string& fn, MeshSet& set, TextureLib& texLib ){
 	aiAttachLogStream(&stream);
 	const aiScene* scene = aiImportFile(fn.c_str(),0);
 	if( !scene ) return range;
-	range = convertMeshRecursive( scene->mRootNode, scene->mMeshes, scene->mMaterials, path, set, texLib, mat4(1));
+	Character* character = nullptr;
+	if( characters && (scene->mNumAnimations>0 || hasBones( scene )) ) {
+		characters->emplace_back();
+		character = &characters->back();
+		convertSkeleton( scene->mRootNode, -1, character->skeleton );
+		Skeleton& sk = character->skeleton;
+		character->clips.resize( scene->mNumAnimations );
+		for( unsigned int i=0; i<scene->mNumAnimations; i++ ) {
+			convertAnimation( scene->mAnimations[i], sk, character->clips[i] );
+			for( auto& ch: character->clips[i].channels ) sk.animated[ch.joint] = true;
+		}
+		for( int i=0; i<sk.size(); i++ ) if( sk.parents[i]>=0 && sk.animated[sk.parents[i]] ) sk.animated[i] = true;
+	}
+	int nodeIndex = 0, fileNode = -1;
+	if( graph ) fileNode = graph->add( getFilenameFromAbsPath( fn ), -1, mat4(1), int(set.size()) );
+	range = convertMeshRecursive( scene->mRootNode, scene->mMeshes, scene->mMaterials, path, set, texLib, mat4(1), character, nodeIndex, graph, fileNode );
+	if( graph ) graph->close( fileNode, int(set.size()) );
+	if( character && character->skins.empty() ) characters->pop_back();
 //	for( size_t i=0; i<scene->mNumMeshes; i++ ) {
 //		Range3 rr = convertMesh( set, scene->mMeshes[i], scene->mMaterials, path, texLib, mat4(1) );
 //		range+= rr;
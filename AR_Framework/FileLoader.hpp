@@ -10,6 +10,8 @@
 
 #include "Model/TriMesh.hpp"
 #include "Model/Texture.hpp"
+#include "Model/Animation.hpp"
+#include "Model/SceneGraph.hpp"
 #include <tuple>
 
 
@@ -37,7 +39,13 @@ using Range3 = Range<vec3>;
 
 using MeshSet = std::vector<AR::TriMesh>;
 
-extern Range3 loadMesh( const std::string& fn, MeshSet& meshSet, TextureLib& texLib );
+// Files with bones or animations add a Character to 'characters' when given;
+// its skinned meshes keep their vertices in mesh space and are posed by it.
+// With a graph, the file's nodes are appended under one root named after the
+// file and the meshes take their modelMat from their node; without, node
+// transforms are baked into the vertices.
+extern Range3 loadMesh( const std::string& fn, MeshSet& meshSet, TextureLib& texLib, std::vector<Character>* characters=nullptr,
+					   SceneGraph* graph=nullptr );
 
 }
 #endif /* FileLoader_hpp */
@@ -7,8 +7,11 @@
 
 #ifndef FrameBuffer_hpp
 #define FrameBuffer_hpp
-#include "gl.hpp"
-#include "texture.hpp"
+#include "Tools/gl.hpp"
+#include "Model/Texture.hpp"
+#include "Model/FrameReadback.hpp"
+
+namespace AR {
 
 struct _PREV_STATE_ {
 	GLint  drawFboId, readFboId;
@@ -52,9 +55,11 @@ struct Framebuffer : Texture {
 	
 	GLuint fbID=0, depthID=0;
 	_PREV_STATE_ prevState;
+	FrameReadback readback;				// see readPixelsAsync()
 	
 	Framebuffer(): fbID(0), depthID(0) {}
-	Framebuffer(Framebuffer&&a): Texture(std::forward<Texture>(a)), fbID(a.fbID), depthID(a.depthID) {
+	Framebuffer(Framebuffer&&a): Texture(std::forward<Texture>(a)), fbID(a.fbID), depthID(a.depthID),
+	readback(std::move(a.readback)) {
 		a.depthID = a.fbID = 0;
 	}
 	void storeFramebufferState() {
@@ -128,6 +133,7 @@ struct Framebuffer : Texture {
 		restoreFramebufferState();
 	}
 	virtual void clear() {
+		readback.release();
 		if( fbID>0   ) glDeleteFramebuffers( 1, &fbID ); fbID=0;
 		if( depthID>0 ) glDeleteTextures( 1, &depthID ); depthID=0;
 		Texture::clear();
@@ -176,9 +182,38 @@ struct Framebuffer : Texture {
 		return buf;
 	}
 
+	// Non-blocking readPixels: the copy goes through a pixel pack buffer and the
+	// future is fulfilled a few frames later, once updateReadback() sees the fence.
+	std::future<PixelBuffer> readPixelsAsync() {
+		auto [internal,format,type] = getTextureType( dataType, nChannels, false );
+		return readAsync( GL_COLOR_ATTACHMENT0, format, type, nChannels );
+	}
+	std::future<PixelBuffer> readDepthAsync() {
+		if( depthID<1 ) return {};
+		return readAsync( GL_NONE, GL_DEPTH_COMPONENT, GL_FLOAT, 1 );
+	}
+	// Call once a frame on the GL thread.
+	void updateReadback() {
+		readback.update();
+	}
+
 	~Framebuffer() {
 		clear();
 	}
+protected:
+	std::future<PixelBuffer> readAsync( GLenum attachment, GLenum format, GLenum type, int n ) {
+		GLint readFboId, readBuffer;
+		glGetIntegerv( GL_READ_FRAMEBUFFER_BINDING, &readFboId );
+		glBindFramebuffer( GL_READ_FRAMEBUFFER, fbID );
+		glGetIntegerv( GL_READ_BUFFER, &readBuffer );
+		if( attachment!=GL_NONE ) glReadBuffer( attachment );
+		auto ret = readback.read( 0, 0, width, height, format, type, n );
+		if( attachment!=GL_NONE ) glReadBuffer( readBuffer );
+		glBindFramebuffer( GL_READ_FRAMEBUFFER, readFboId );
+		return ret;
+	}
 };
 
+}
+
 #endif /* FrameBuffer_hpp */
@@ -0,0 +1,75 @@
+//
+//  FramePipeline.hpp
+//  AR_Framework
+//
+
+#ifndef FramePipeline_hpp
+#define FramePipeline_hpp
+
+#include "Tools/ThreadPool.hpp"
+#include <chrono>
+#include <cstdint>
+
+namespace AR {
+
+// Builds a frame's draw records on the pool. The item range is split in
+// chunks of 'grain'; each chunk appends its records to its own array and sorts
+// references to them by key, then the sorted runs are merged pairwise, also
+// on the pool. The GL thread only walks 'order'. Record needs a uint64_t key.
+template<typename Record> struct FramePipeline {
+	struct Ref {
+		uint64_t key;
+		uint32_t chunk, index;
+		bool operator<( const Ref& b ) const { return key<b.key; }
+	};
+	int grain = 512;
+	std::vector<std::vector<Record>> chunks;	// kept between frames, so steady state does not allocate
+	std::vector<std::vector<Ref>> runs;
+	std::vector<Ref> order, scratch;
+	double buildMs = 0, mergeMs = 0;
+
+	// func( begin, end, out ) appends the records of items [begin,end) to 'out'.
+	template<typename F> const std::vector<Ref>& build( int n, F&& func, ThreadPool& pool=ThreadPool::shared() ) {
+		auto t0 = std::chrono::steady_clock::now();
+		int nChunks = std::max( 0, (n+grain-1)/grain );
+		if( int(chunks.size())<nChunks ) {
+			chunks.resize( nChunks );
+			runs.resize( nChunks );
+		}
+		pool.parallelFor( 0, nChunks, [&]( int c ) {
+			std::vector<Record>& out = chunks[c];
+			out.clear();
+			func( c*grain, std::min( n, (c+1)*grain ), out );
+			std::vector<Ref>& run = runs[c];
+			run.resize( out.size() );
+			for( size_t i=0; i<out.size(); i++ ) run[i] = { out[i].key, uint32_t(c), uint32_t(i) };
+			std::sort( run.begin(), run.end() );
+		} );
+		auto t1 = std::chrono::steady_clock::now();
+
+		std::vector<size_t> offsets( nChunks+1, 0 );
+		for( int c=0; c<nChunks; c++ ) offsets[c+1] = offsets[c]+runs[c].size();
+		order.resize( offsets[nChunks] );
+		scratch.resize( offsets[nChunks] );
+		for( int c=0; c<nChunks; c++ ) std::copy( runs[c].begin(), runs[c].end(), order.begin()+offsets[c] );
+		for( int width=1; width<nChunks; width*=2 ) {
+			int pairs = (nChunks+2*width-1)/(2*width);
+			pool.parallelFor( 0, pairs, [&]( int p ) {
+				int a = p*2*width, m = std::min( a+width, nChunks ), e = std::min( a+2*width, nChunks );
+				std::merge( order.begin()+offsets[a], order.begin()+offsets[m],
+						   order.begin()+offsets[m], order.begin()+offsets[e], scratch.begin()+offsets[a] );
+			} );
+			std::swap( order, scratch );
+		}
+		auto t2 = std::chrono::steady_clock::now();
+		buildMs = std::chrono::duration<double,std::milli>( t1-t0 ).count();
+		mergeMs = std::chrono::duration<double,std::milli>( t2-t1 ).count();
+		return order;
+	}
+	Record& operator[]( const Ref& r ) { return chunks[r.chunk][r.index]; }
+	const Record& operator[]( const Ref& r ) const { return chunks[r.chunk][r.index]; }
+};
+
+}
+
+#endif /* FramePipeline_hpp */
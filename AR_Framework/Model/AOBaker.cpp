@@ -0,0 +1,109 @@
+//
+//  AOBaker.cpp
+//  AR_Framework
+//
+
+#include "AOBaker.hpp"
+#include "KTX2.hpp"
+#include <algorithm>
+
+namespace AR {
+
+static float radicalInverse( uint32_t b ) {
+	b = (b<<16) | (b>>16);
+	b = ((b&0x55555555u)<<1) | ((b&0xAAAAAAAAu)>>1);
+	b = ((b&0x33333333u)<<2) | ((b&0xCCCCCCCCu)>>2);
+	b = ((b&0x0F0F0F0Fu)<<4) | ((b&0xF0F0F0F0u)>>4);
+	b = ((b&0x00FF00FFu)<<8) | ((b&0xFF00FF00u)>>8);
+	return b*2.3283064365386963e-10f;
+}
+
+static uint32_t hash( uint32_t x ) {
+	x ^= x>>16; x *= 0x7feb352du;
+	x ^= x>>15; x *= 0x846ca68bu;
+	return x^(x>>16);
+}
+
+VertexAO bakeVertexAO( const SceneBVH& bvh, const std::vector<AOBakeMesh>& meshes, const AOOptions& opt,
+					   const std::atomic<bool>* cancel, ThreadPool& pool ) {
+	VertexAO ao;
+	if( bvh.top.empty() ) return ao;
+	float sceneSize = length( bvh.top.boundMax-bvh.top.boundMin );
+	float distance = opt.distance>0?opt.distance:sceneSize*.1f;
+	float offset = sceneSize*1e-5f;
+	// Cosine weighted Hammersley directions around z; each vertex turns them by
+	// its own angle so neighbours do not band.
+	int n = std::max( 1, opt.samples );
+	std::vector<vec3> dirs( n );
+	for( int k=0; k<n; k++ ) {
+		float u = (k+.5f)/n, phi = 2*PI*radicalInverse( k ), r = sqrtf( u );
+		dirs[k] = vec3( r*cosf( phi ), r*sinf( phi ), sqrtf( 1-u ) );
+	}
+	// Work items are runs of vertices, so large meshes spread over the pool too.
+	const int RUN = 256;
+	struct Run { int mesh, begin, end; };
+	std::vector<Run> runs;
+	for( size_t m=0; m<meshes.size(); m++ ) {
+		int nVerts = int( meshes[m].verts.size() );
+		ao.meshes.push_back( meshes[m].mesh );
+		ao.values.emplace_back( nVerts, uint8_t( 255 ) );
+		if( meshes[m].norms.size()!=meshes[m].verts.size() ) continue;
+		for( int b=0; b<nVerts; b+=RUN ) runs.push_back( { int( m ), b, std::min( nVerts, b+RUN ) } );
+	}
+	pool.parallelFor( 0, int( runs.size() ), [&]( int i ) {
+		if( cancel && cancel->load() ) return;
+		const Run& run = runs[i];
+		const AOBakeMesh& mesh = meshes[run.mesh];
+		mat3 normalMat = transpose( inverse( mat3( mesh.modelMat ) ) );
+		uint8_t* out = ao.values[run.mesh].data();
+		for( int v=run.begin; v<run.end; v++ ) {
+			vec3 nrm = normalMat*mesh.norms[v];
+			float len = length( nrm );
+			if( !(len>0) ) continue;
+			nrm /= len;
+			// Orthonormal basis around the normal (Duff et al. 2017).
+			float sign = copysignf( 1.f, nrm.z ), a = -1/(sign+nrm.z), b = nrm.x*nrm.y*a;
+			vec3 t( 1+sign*nrm.x*nrm.x*a, sign*b, -sign*nrm.x ), bt( b, sign+nrm.y*nrm.y*a, -nrm.y );
+			float s, c;
+			fast::sincos( 2*PI*(hash( uint32_t( v )*977u+uint32_t( run.mesh ) )>>8)*(1.f/16777216), s, c );
+			vec3 org = vec3( mesh.modelMat*vec4( mesh.verts[v], 1 ) )+nrm*offset;
+			int open = 0;
+			for( auto& d: dirs ) {
+				float x = d.x*c-d.y*s, y = d.x*s+d.y*c;
+				if( !bvh.raycast( Ray( org, t*x+bt*y+nrm*d.z, distance ) ) ) open++;
+			}
+			out[v] = uint8_t( (open*255+n/2)/n );
+		}
+	}, 4 );
+	if( cancel && cancel->load() ) return VertexAO();
+	return ao;
+}
+
+bool loadVertexAO( const std::string& filename, const std::vector<AOBakeMesh>& meshes, VertexAO& ao ) {
+	std::string cacheName = filename+".ao.ktx2";
+	size_t total = 0;
+	for( auto& m: meshes ) total += m.verts.size();
+	KTX2Image image;
+	uint32_t r8 = findPixelFormat( GL_UNSIGNED_BYTE, 1, false )->vkFormat;
+	if( !isCacheFresh( cacheName, filename ) || !readKTX2( cacheName, image ) || image.vkFormat!=r8
+	   || image.faces!=1 || size_t( image.width )!=total || image.height!=1 ) return false;
+	const uint8_t* p = image.levels[0].data.data();
+	ao = VertexAO();
+	for( auto& m: meshes ) {
+		ao.meshes.push_back( m.mesh );
+		ao.values.emplace_back( p, p+m.verts.size() );
+		p += m.verts.size();
+	}
+	return true;
+}
+
+bool saveVertexAO( const std::string& filename, const VertexAO& ao ) {
+	MipLevel level;
+	for( auto& v: ao.values ) level.data.insert( level.data.end(), v.begin(), v.end() );
+	if( level.data.empty() ) return false;
+	level.width = GLsizei( level.data.size() );
+	level.height = 1;
+	return writeKTX2( filename+".ao.ktx2", findPixelFormat( GL_UNSIGNED_BYTE, 1, false )->vkFormat, { level } );
+}
+
+}
@@ -0,0 +1,46 @@
+//
+//  AOBaker.hpp
+//  AR_Framework
+//
+
+#ifndef AOBaker_hpp
+#define AOBaker_hpp
+
+#include "BVH.hpp"
+#include <atomic>
+#include <string>
+
+namespace AR {
+
+struct AOOptions {
+	int samples = 64;						// rays per vertex, cosine weighted
+	float distance = 0;						// occluders further away do not count, 0 for a tenth of the scene
+};
+
+// What the bake needs of one mesh, copied so the mesh can be uploaded meanwhile.
+struct AOBakeMesh {
+	int mesh = -1;							// index in the MeshSet
+	mat4 modelMat = mat4(1);
+	std::vector<vec3> verts, norms;
+};
+
+// Per-vertex occlusion of some meshes of a MeshSet, 255 unoccluded.
+struct VertexAO {
+	std::vector<int> meshes;
+	std::vector<std::vector<uint8_t>> values;	// per mesh, one per vertex
+	bool empty() const { return meshes.empty(); }
+};
+
+// Traces the hemisphere above every vertex against the scene on the pool.
+// Returns nothing if cancel is raised before the end.
+extern VertexAO bakeVertexAO( const SceneBVH& bvh, const std::vector<AOBakeMesh>& meshes, const AOOptions& opt=AOOptions(),
+							  const std::atomic<bool>* cancel=nullptr, ThreadPool& pool=ThreadPool::shared() );
+
+// Cached next to the model as <file>.ao.ktx2, one R8 row over the meshes'
+// vertices in order. Loading checks the vertex counts of 'meshes'.
+extern bool loadVertexAO( const std::string& filename, const std::vector<AOBakeMesh>& meshes, VertexAO& ao );
+extern bool saveVertexAO( const std::string& filename, const VertexAO& ao );
+
+}
+
+#endif /* AOBaker_hpp */
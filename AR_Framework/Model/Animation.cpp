@@ -0,0 +1,149 @@
+//
+//  Animation.cpp
+//  AR_Framework
+//
+
+#include "Animation.hpp"
+#include "Tools/SIMD.hpp"
+#include <algorithm>
+#include <cfloat>
+
+namespace AR {
+
+// Keys around t and the fraction between them; clamps outside the keys.
+template<typename T> static void keyPair( const std::vector<float>& times, const std::vector<T>& values, float t, T& a, T& b, float& f ) {
+	size_t i = std::upper_bound( times.begin(), times.end(), t )-times.begin();
+	if( i==0 || i==times.size() ) {
+		a = b = i==0?values.front():values.back();
+		f = 0;
+		return;
+	}
+	a = values[i-1];
+	b = values[i];
+	float span = times[i]-times[i-1];
+	f = span>0?(t-times[i-1])/span:0.f;
+}
+
+// Rotation part of a rest transform, scale divided out.
+static vec4 rotationOf( const mat4& m ) {
+	vec3 c0 = normalize( vec3( m[0] ) ), c1 = normalize( vec3( m[1] ) ), c2 = normalize( vec3( m[2] ) );
+	float tr = c0.x+c1.y+c2.z;
+	vec4 q;
+	if( tr>0 ) {
+		float s = sqrtf( tr+1 )*2;
+		q = vec4( c1.z-c2.y, c2.x-c0.z, c0.y-c1.x, s*s*.25f )/s;
+	}
+	else if( c0.x>c1.y && c0.x>c2.z ) {
+		float s = sqrtf( 1+c0.x-c1.y-c2.z )*2;
+		q = vec4( s*s*.25f, c1.x+c0.y, c2.x+c0.z, c1.z-c2.y )/s;
+	}
+	else if( c1.y>c2.z ) {
+		float s = sqrtf( 1+c1.y-c0.x-c2.z )*2;
+		q = vec4( c1.x+c0.y, s*s*.25f, c2.y+c1.z, c2.x-c0.z )/s;
+	}
+	else {
+		float s = sqrtf( 1+c2.z-c0.x-c1.y )*2;
+		q = vec4( c2.x+c0.z, c2.y+c1.z, s*s*.25f, c0.y-c1.x )/s;
+	}
+	return q;
+}
+
+// Four channels at once, one per lane: lerp of position and scale, nlerp of
+// the rotation along the shorter arc, then the TRS matrix.
+static void sampleChannels( const AnimChannel* const* ch, int n, float t, std::vector<mat4>& locals ) {
+	float pa[3][4], pb[3][4], pf[4], sa[3][4], sb[3][4], sf[4], qa[4][4], qb[4][4], qf[4];
+	for( int k=0; k<4; k++ ) {
+		vec3 p0( 0 ), p1( 0 ), s0( 1 ), s1( 1 );
+		vec4 q0( 0, 0, 0, 1 ), q1( 0, 0, 0, 1 );
+		pf[k] = sf[k] = qf[k] = 0;
+		if( k<n ) {
+			const AnimChannel& c = *ch[k];
+			const mat4& rest = locals[c.joint];
+			if( c.positions.size() ) keyPair( c.posTimes, c.positions, t, p0, p1, pf[k] );
+			else p0 = p1 = vec3( rest[3] );
+			if( c.scales.size() ) keyPair( c.scaleTimes, c.scales, t, s0, s1, sf[k] );
+			else s0 = s1 = vec3( length( vec3( rest[0] ) ), length( vec3( rest[1] ) ), length( vec3( rest[2] ) ) );
+			if( c.rotations.size() ) keyPair( c.rotTimes, c.rotations, t, q0, q1, qf[k] );
+			else q0 = q1 = rotationOf( rest );
+		}
+		for( int i=0; i<3; i++ ) {
+			pa[i][k] = p0[i]; pb[i][k] = p1[i];
+			sa[i][k] = s0[i]; sb[i][k] = s1[i];
+		}
+		for( int i=0; i<4; i++ ) {
+			qa[i][k] = q0[i]; qb[i][k] = q1[i];
+		}
+	}
+	float4 zero( 0.f ), one( 1.f ), two( 2.f );
+	float4 p[3], s[3], q[4];
+	float4 fp = float4::load( pf ), fs = float4::load( sf ), fq = float4::load( qf );
+	for( int i=0; i<3; i++ ) {
+		float4 a = float4::load( pa[i] ), b = float4::load( pb[i] );
+		p[i] = a+(b-a)*fp;
+		a = float4::load( sa[i] ); b = float4::load( sb[i] );
+		s[i] = a+(b-a)*fs;
+	}
+	float4 a[4], b[4];
+	for( int i=0; i<4; i++ ) {
+		a[i] = float4::load( qa[i] );
+		b[i] = float4::load( qb[i] );
+	}
+	float4 flip = lessThan( a[0]*b[0]+a[1]*b[1]+a[2]*b[2]+a[3]*b[3], zero );
+	for( int i=0; i<4; i++ ) q[i] = a[i]+(select( b[i], zero-b[i], flip )-a[i])*fq;
+	float4 inv = one/sqrt( q[0]*q[0]+q[1]*q[1]+q[2]*q[2]+q[3]*q[3] );
+	float4 x = q[0]*inv, y = q[1]*inv, z = q[2]*inv, w = q[3]*inv;
+	float4 xx = x*x, yy = y*y, zz = z*z, xy = x*y, xz = x*z, yz = y*z, wx = w*x, wy = w*y, wz = w*z;
+	float4 cols[3][3] = {
+		{ (one-two*(yy+zz))*s[0], two*(xy+wz)*s[0], two*(xz-wy)*s[0] },
+		{ two*(xy-wz)*s[1], (one-two*(xx+zz))*s[1], two*(yz+wx)*s[1] },
+		{ two*(xz+wy)*s[2], two*(yz-wx)*s[2], (one-two*(xx+yy))*s[2] } };
+	float m[3][3][4], tr[3][4];
+	for( int c=0; c<3; c++ ) for( int r=0; r<3; r++ ) cols[c][r].store( m[c][r] );
+	for( int r=0; r<3; r++ ) p[r].store( tr[r] );
+	for( int k=0; k<n; k++ ) {
+		mat4& l = locals[ch[k]->joint];
+		for( int c=0; c<3; c++ ) l[c] = vec4( m[c][0][k], m[c][1][k], m[c][2][k], 0 );
+		l[3] = vec4( tr[0][k], tr[1][k], tr[2][k], 1 );
+	}
+}
+
+void Character::pose( vec4* palette ) {
+	int nJoints = skeleton.size();
+	locals = skeleton.rest;
+	globals.resize( nJoints );
+	if( !clips.empty() ) {
+		const AnimClip& c = clips[std::min( std::max( clip, 0 ), int(clips.size())-1 )];
+		const AnimChannel* group[4];
+		int n = 0;
+		for( auto& ch: c.channels ) {
+			if( ch.joint<0 || ch.joint>=nJoints ) continue;
+			group[n++] = &ch;
+			if( n==4 ) {
+				sampleChannels( group, n, time, locals );
+				n = 0;
+			}
+		}
+		if( n ) sampleChannels( group, n, time, locals );
+	}
+	for( int i=0; i<nJoints; i++ ) {
+		int parent = skeleton.parents[i];
+		globals[i] = parent<0?locals[i]:globals[parent]*locals[i];
+	}
+	for( auto& s: skins ) {
+		vec4* rows = palette+size_t(s.paletteOffset)*3;
+		s.boundMin = vec3( FLT_MAX );
+		s.boundMax = vec3( -FLT_MAX );
+		for( size_t b=0; b<s.joints.size(); b++ ) {
+			const mat4& g = globals[s.joints[b]];
+			mat4 m = g*s.offsets[b];
+			for( int r=0; r<3; r++ ) rows[b*3+r] = vec4( m[0][r], m[1][r], m[2][r], m[3][r] );
+			if( s.reach[b]<0 ) continue;
+			float scale = std::max( length( vec3( g[0] ) ), std::max( length( vec3( g[1] ) ), length( vec3( g[2] ) ) ) );
+			vec3 center = vec3( g[3] ), extent = vec3( s.reach[b]*scale );
+			s.boundMin = min( s.boundMin, center-extent );
+			s.boundMax = max( s.boundMax, center+extent );
+		}
+	}
+}
+
+}
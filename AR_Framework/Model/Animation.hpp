@@ -0,0 +1,152 @@
+//
+//  Animation.hpp
+//  AR_Framework
+//
+
+#ifndef Animation_hpp
+#define Animation_hpp
+
+#include "Tools/gl.hpp"
+#include "Tools/ThreadPool.hpp"
+#include "TriMesh.hpp"
+#include <string>
+#include <vector>
+
+namespace AR {
+
+// Node hierarchy of a loaded file in depth first order, so parents come
+// before their children.
+struct Skeleton {
+	std::vector<std::string> names;
+	std::vector<int> parents;			// -1 for the root
+	std::vector<mat4> rest;				// relative to the parent
+	std::vector<bool> animated;			// the node or one of its ancestors has a channel
+
+	int size() const { return int(parents.size()); }
+	int find( const std::string& name ) const {
+		for( int i=0; i<size(); i++ ) if( names[i]==name ) return i;
+		return -1;
+	}
+};
+
+// Keys of one node, times in seconds. A node without keys of some kind keeps
+// that part of its rest transform.
+struct AnimChannel {
+	int joint = -1;
+	std::vector<float> posTimes, rotTimes, scaleTimes;
+	std::vector<vec3> positions, scales;
+	std::vector<vec4> rotations;		// quaternions, xyzw
+};
+
+struct AnimClip {
+	std::string name;
+	float duration = 0;					// seconds
+	std::vector<AnimChannel> channels;
+};
+
+// Bone palette of one mesh. Slot i moves the mesh's vertices (mesh space) by
+// global(joints[i])*offsets[i]; MeshData::skin refers to the slots.
+struct Skin {
+	int mesh = -1;						// index in the MeshSet
+	std::vector<int> joints;
+	std::vector<mat4> offsets;
+	std::vector<float> reach;			// furthest bind pose vertex from each bone, for the bounds; -1 if unused
+	int paletteOffset = 0;				// first bone in Animator's buffer
+	vec3 boundMin = vec3(0), boundMax = vec3(0);
+};
+
+// One animated file: its hierarchy, clips and the meshes they move.
+struct Character {
+	Skeleton skeleton;
+	std::vector<AnimClip> clips;
+	std::vector<Skin> skins;
+	int clip = 0;
+	float time = 0, speed = 1;
+	bool playing = true;
+	std::vector<mat4> locals, globals;	// of the last pose()
+
+	void advance( float dt ) {
+		if( !playing || clips.empty() ) return;
+		float duration = clips[clip].duration;
+		time += dt*speed;
+		if( duration>0 ) time = fmodf( fmodf( time, duration )+duration, duration );
+	}
+	// Samples the current clip and writes three rows per bone of every skin to
+	// palette+3*skin.paletteOffset, along with the skins' world bounds.
+	void pose( vec4* palette );
+};
+
+// Animates all characters on the pool and keeps their bone palettes in one
+// texture buffer, three RGBA32F texels (the rows of a 3x4 matrix) per bone.
+// The work per frame depends on the number of bones, not on the vertices,
+// which are skinned by render.vert.
+struct Animator {
+	std::vector<Character> characters;
+	std::vector<vec4> palette;
+	GLuint buffer = 0, texture = 0;
+	size_t capacity = 0;
+
+	Animator() {}
+	Animator( const Animator& ) = delete;
+	~Animator() { release(); }
+
+	bool empty() const { return characters.empty(); }
+	void clear() {
+		characters.clear();
+		palette.clear();
+	}
+	void release() {
+		if( texture ) glDeleteTextures( 1, &texture );
+		if( buffer ) glDeleteBuffers( 1, &buffer );
+		texture = buffer = 0;
+		capacity = 0;
+	}
+	// Advances every character by dt seconds, then sets the meshes' palette
+	// offsets and bounds. Any thread, as long as the meshes are not drawn meanwhile.
+	void update( float dt, std::vector<TriMesh>& meshes, ThreadPool& pool=ThreadPool::shared() ) {
+		int n = 0;
+		for( auto& c: characters ) for( auto& s: c.skins ) {
+			s.paletteOffset = n;
+			n += int(s.joints.size());
+		}
+		palette.resize( size_t(n)*3 );
+		pool.parallelFor( 0, int(characters.size()), [&]( int i ) {
+			characters[i].advance( dt );
+			characters[i].pose( palette.data() );
+		} );
+		for( auto& c: characters ) for( auto& s: c.skins ) {
+			if( s.mesh<0 || s.mesh>=int(meshes.size()) ) continue;
+			TriMesh& mesh = meshes[s.mesh];
+			mesh.boneOffset = s.paletteOffset;
+			mesh.boundMin = s.boundMin;
+			mesh.boundMax = s.boundMax;
+		}
+	}
+	// GL thread.
+	void upload() {
+		if( palette.empty() ) return;
+		size_t bytes = palette.size()*sizeof(vec4);
+		if( !buffer ) {
+			glGenBuffers( 1, &buffer );
+			glGenTextures( 1, &texture );
+		}
+		glBindBuffer( GL_TEXTURE_BUFFER, buffer );
+		if( bytes>capacity ) {
+			capacity = bytes;
+			glBufferData( GL_TEXTURE_BUFFER, capacity, palette.data(), GL_STREAM_DRAW );
+			glBindTexture( GL_TEXTURE_BUFFER, texture );
+			glTexBuffer( GL_TEXTURE_BUFFER, GL_RGBA32F, buffer );
+			glBindTexture( GL_TEXTURE_BUFFER, 0 );
+		}
+		else {
+			glBufferData( GL_TEXTURE_BUFFER, capacity, nullptr, GL_STREAM_DRAW );		// orphan, last frame may still read it
+			glBufferSubData( GL_TEXTURE_BUFFER, 0, bytes, palette.data() );
+		}
+		glBindBuffer( GL_TEXTURE_BUFFER, 0 );
+		glErr("Upload bone palettes");
+	}
+};
+
+}
+
+#endif /* Animation_hpp */
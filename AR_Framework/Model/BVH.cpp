@@ -0,0 +1,453 @@
+//
+//  BVH.cpp
+//  AR_Framework
+//
+
+#include "BVH.hpp"
+#include "Tools/SIMD.hpp"
+#include <algorithm>
+
+namespace AR {
+
+namespace {
+
+enum { BINS = 16, LEAF_SIZE = 4, MIN_TASK = 4096, SAH_DEPTH = 48, STACK = 256 };
+
+// Below SAH_DEPTH ranges are split at the median, which halves the largest
+// child per level, so no tree is deeper than SAH_DEPTH+31. Traversal pops one
+// node and pushes at most four per level.
+static_assert( STACK>=3*(SAH_DEPTH+31)+1, "traversal stack too small for the deepest tree" );
+
+struct Range {
+	int begin, end;
+	float4 bmin, bmax;						// of the boxes, xyz
+	float4 cmin, cmax;						// of the doubled centroids
+	int size() const { return end-begin; }
+};
+
+float halfArea( const float4& bmin, const float4& bmax ) {
+	float d[4];
+	max( bmax-bmin, float4( 0.f ) ).store( d );
+	return d[0]*d[1]+d[1]*d[2]+d[2]*d[0];
+}
+
+// Splits ranges of primitives in place. The boxes move with their index so
+// every pass reads memory in order; centroids are doubled, lo+hi, which bins
+// the same.
+struct Builder {
+	struct Prim {
+		float4 lo, hi;
+		int index;
+	};
+	std::vector<Prim> prims;
+
+	// Binned SAH, or the median of the widest centroid axis when asked; falls
+	// back to halving the range when the centroids coincide.
+	void split( const Range& r, Range& left, Range& right, bool median ) {
+		struct Bin { float4 bmin, bmax, cmin, cmax; int count; };
+		Bin bins[3][BINS];
+		int nBins = std::min( int( BINS ), r.size() );		// small ranges are most of the calls
+		float extent[4], s[4] = { 0, 0, 0, 0 };
+		(r.cmax-r.cmin).store( extent );
+		for( int a=0; a<3; a++ ) {
+			if( extent[a]>0 ) s[a] = nBins*(1-1e-5f)/extent[a];
+			for( int b=0; b<nBins; b++ ) bins[a][b] = { float4( FLT_MAX ), float4( -FLT_MAX ), float4( FLT_MAX ), float4( -FLT_MAX ), 0 };
+		}
+		float4 scale = float4::load( s );
+		auto binOf = [&]( const float4& c, int bin[4] ) {
+			float f[4];
+			((c-r.cmin)*scale).store( f );
+			for( int a=0; a<3; a++ ) bin[a] = std::min( nBins-1, int( f[a] ) );
+		};
+		for( int i=r.begin; i<r.end && !median; i++ ) {
+			const Prim& p = prims[i];
+			float4 c = p.lo+p.hi;
+			int bin[4];
+			binOf( c, bin );
+			for( int a=0; a<3; a++ ) {
+				Bin& b = bins[a][bin[a]];
+				b.bmin = min( b.bmin, p.lo );
+				b.bmax = max( b.bmax, p.hi );
+				b.cmin = min( b.cmin, c );
+				b.cmax = max( b.cmax, c );
+				b.count++;
+			}
+		}
+		int bestAxis = -1, bestBin = 0;
+		float bestCost = FLT_MAX;
+		Bin best[2];
+		for( int a=0; a<3 && !median; a++ ) {
+			if( s[a]<=0 ) continue;
+			Bin rights[BINS];
+			Bin acc = { float4( FLT_MAX ), float4( -FLT_MAX ), float4( FLT_MAX ), float4( -FLT_MAX ), 0 };
+			for( int b=nBins-1; b>0; b-- ) {
+				const Bin& x = bins[a][b];
+				acc = { min( acc.bmin, x.bmin ), max( acc.bmax, x.bmax ), min( acc.cmin, x.cmin ), max( acc.cmax, x.cmax ), acc.count+x.count };
+				rights[b] = acc;
+			}
+			acc = { float4( FLT_MAX ), float4( -FLT_MAX ), float4( FLT_MAX ), float4( -FLT_MAX ), 0 };
+			for( int b=1; b<nBins; b++ ) {
+				const Bin& x = bins[a][b-1];
+				acc = { min( acc.bmin, x.bmin ), max( acc.bmax, x.bmax ), min( acc.cmin, x.cmin ), max( acc.cmax, x.cmax ), acc.count+x.count };
+				if( acc.count==0 || rights[b].count==0 ) continue;
+				float cost = halfArea( acc.bmin, acc.bmax )*acc.count+halfArea( rights[b].bmin, rights[b].bmax )*rights[b].count;
+				if( cost<bestCost ) {
+					bestCost = cost; bestAxis = a; bestBin = b;
+					best[0] = acc;
+					best[1] = rights[b];
+				}
+			}
+		}
+		int mid;
+		if( bestAxis>=0 ) {
+			mid = int( std::partition( prims.begin()+r.begin, prims.begin()+r.end, [&]( const Prim& p ) {
+				int bin[4];
+				binOf( p.lo+p.hi, bin );
+				return bin[bestAxis]<bestBin;
+			} )-prims.begin() );
+		}
+		else {
+			mid = (r.begin+r.end)/2;
+			int axis = extent[1]>extent[0]?1:0;
+			if( extent[2]>extent[axis] ) axis = 2;
+			if( median && extent[axis]>0 ) {
+				std::nth_element( prims.begin()+r.begin, prims.begin()+mid, prims.begin()+r.end, [&]( const Prim& a, const Prim& b ) {
+					float ca[4], cb[4];
+					(a.lo+a.hi).store( ca );
+					(b.lo+b.hi).store( cb );
+					return ca[axis]<cb[axis];
+				} );
+			}
+			for( int h=0; h<2; h++ ) {
+				best[h].bmin = float4( FLT_MAX ); best[h].bmax = float4( -FLT_MAX );
+				for( int i=h?mid:r.begin; i<(h?r.end:mid); i++ ) {
+					best[h].bmin = min( best[h].bmin, prims[i].lo );
+					best[h].bmax = max( best[h].bmax, prims[i].hi );
+				}
+				best[h].cmin = r.cmin;
+				best[h].cmax = r.cmax;
+			}
+		}
+		left = { r.begin, mid, best[0].bmin, best[0].bmax, best[0].cmin, best[0].cmax };
+		right = { mid, r.end, best[1].bmin, best[1].bmax, best[1].cmin, best[1].cmax };
+	}
+
+	struct Task {
+		int node;							// slot reserved in the parent tree
+		int depth;
+		Range range;
+	};
+
+	// Fills out.nodes[index] by splitting the largest children until there are
+	// four. Ranges of at most taskSize primitives go to tasks when given.
+	void build( BVH4& out, int index, int depth, const Range& r, std::vector<Task>* tasks, int taskSize ) {
+		Range parts[4] = { r };
+		int n = 1;
+		while( n<4 ) {
+			int pick = -1;
+			float largest = -1;
+			for( int k=0; k<n; k++ ) {
+				float area = halfArea( parts[k].bmin, parts[k].bmax );
+				if( parts[k].size()>LEAF_SIZE && area>largest ) { largest = area; pick = k; }
+			}
+			if( pick<0 ) break;
+			Range left, right;
+			split( parts[pick], left, right, depth>=SAH_DEPTH );
+			parts[pick] = left;
+			parts[n++] = right;
+		}
+		BVH4::Node node;
+		for( int k=0; k<4; k++ ) {
+			bool used = k<n;
+			for( int a=0; a<3; a++ ) {
+				node.bmin[a][k] = used?parts[k].bmin[a]:FLT_MAX;	// inverted, never hit
+				node.bmax[a][k] = used?parts[k].bmax[a]:-FLT_MAX;
+			}
+			node.child[k] = BVH4::EMPTY;
+			if( !used ) continue;
+			if( parts[k].size()<=LEAF_SIZE ) {
+				BVH4::Leaf leaf = { { -1, -1, -1, -1 } };
+				for( int i=0; i<parts[k].size(); i++ ) leaf.prims[i] = prims[parts[k].begin+i].index;
+				node.child[k] = ~int( out.leaves.size() );
+				out.leaves.push_back( leaf );
+			}
+			else {
+				node.child[k] = int( out.nodes.size() );
+				out.nodes.emplace_back();
+			}
+		}
+		out.nodes[index] = node;
+		for( int k=0; k<n; k++ ) {
+			if( node.child[k]<0 ) continue;
+			if( tasks && parts[k].size()<=taskSize ) tasks->push_back( { node.child[k], depth+1, parts[k] } );
+			else build( out, node.child[k], depth+1, parts[k], tasks, taskSize );
+		}
+	}
+};
+
+// Near-to-far traversal; leaf( i, tMax ) may shorten tMax and returns true to stop.
+template<typename LeafFunc> void traverse( const std::vector<BVH4::Node>& nodes, const vec3& org, const vec3& dir, float& tMax, LeafFunc leaf ) {
+	if( nodes.empty() ) return;
+	float4 o[3], inv[3];
+	int nearSide[3];
+	for( int a=0; a<3; a++ ) {
+		float d = fabsf( dir[a] )>1e-20f?dir[a]:copysignf( 1e-20f, dir[a] );
+		o[a] = float4( org[a] );
+		inv[a] = float4( 1/d );
+		nearSide[a] = d<0;
+	}
+	float4 zero( 0.f );
+	int stack[STACK];
+	float stackT[STACK];
+	int top = 0;
+	stack[top] = 0;
+	stackT[top++] = 0;
+	while( top>0 ) {
+		top--;
+		if( stackT[top]>tMax ) continue;
+		int index = stack[top];
+		if( index<0 ) {
+			if( leaf( ~index, tMax ) ) return;
+			continue;
+		}
+		const BVH4::Node& node = nodes[index];
+		float4 tNear = zero, tFar( tMax );
+		for( int a=0; a<3; a++ ) {
+			const float* planes[2] = { node.bmin[a], node.bmax[a] };
+			tNear = max( tNear, (float4::load( planes[nearSide[a]] )-o[a])*inv[a] );
+			tFar = min( tFar, (float4::load( planes[1-nearSide[a]] )-o[a])*inv[a] );
+		}
+		int mask = ~moveMask( lessThan( tFar, tNear ) ) & 15;
+		if( !mask ) continue;
+		float t[4];
+		tNear.store( t );
+		int child[4], n = 0;
+		float childT[4];
+		for( int k=0; k<4; k++ ) {
+			if( !(mask>>k&1) ) continue;
+			int j = n++;
+			for( ; j>0 && childT[j-1]<t[k]; j-- ) {		// far first, so the nearest pops next
+				child[j] = child[j-1];
+				childT[j] = childT[j-1];
+			}
+			child[j] = node.child[k];
+			childT[j] = t[k];
+		}
+		for( int k=0; k<n; k++ ) {
+			stack[top] = child[k];
+			stackT[top++] = childT[k];
+		}
+	}
+}
+
+// Möller-Trumbore against the four triangles of a pack; returns the lanes hit.
+int intersectPack( const MeshBVH::TriPack& p, const float4 o[3], const float4 d[3], float tMax, float t[4], float u[4], float v[4] ) {
+	float4 zero( 0.f ), one( 1.f );
+	float4 e1x = float4::load( p.e1[0] ), e1y = float4::load( p.e1[1] ), e1z = float4::load( p.e1[2] );
+	float4 e2x = float4::load( p.e2[0] ), e2y = float4::load( p.e2[1] ), e2z = float4::load( p.e2[2] );
+	float4 px = d[1]*e2z-d[2]*e2y, py = d[2]*e2x-d[0]*e2z, pz = d[0]*e2y-d[1]*e2x;
+	float4 det = e1x*px+e1y*py+e1z*pz;
+	float4 invDet = one/det;
+	float4 sx = o[0]-float4::load( p.v0[0] ), sy = o[1]-float4::load( p.v0[1] ), sz = o[2]-float4::load( p.v0[2] );
+	float4 bu = (sx*px+sy*py+sz*pz)*invDet;
+	float4 qx = sy*e1z-sz*e1y, qy = sz*e1x-sx*e1z, qz = sx*e1y-sy*e1x;
+	float4 bv = (d[0]*qx+d[1]*qy+d[2]*qz)*invDet;
+	float4 bt = (e2x*qx+e2y*qy+e2z*qz)*invDet;
+	int hit = moveMask( lessThan( zero, max( det, zero-det ) ) )		// padding is degenerate
+		& ~moveMask( lessThan( bu, zero ) ) & ~moveMask( lessThan( bv, zero ) ) & ~moveMask( lessThan( one, bu+bv ) )
+		& moveMask( lessThan( zero, bt ) ) & moveMask( lessThan( bt, float4( tMax ) ) );
+	bt.store( t );
+	bu.store( u );
+	bv.store( v );
+	return hit & 15;
+}
+
+}
+
+void BVH4::build( const vec3* primMin, const vec3* primMax, int count, ThreadPool& pool ) {
+	clear();
+	if( count<=0 ) return;
+	Builder builder;
+	builder.prims.resize( count );
+	Range root = { 0, count, float4( FLT_MAX ), float4( -FLT_MAX ), float4( FLT_MAX ), float4( -FLT_MAX ) };
+	for( int i=0; i<count; i++ ) {
+		Builder::Prim& p = builder.prims[i];
+		p.lo = float4( primMin[i].x, primMin[i].y, primMin[i].z, 0 );
+		p.hi = float4( primMax[i].x, primMax[i].y, primMax[i].z, 0 );
+		p.index = i;
+		root.bmin = min( root.bmin, p.lo );
+		root.bmax = max( root.bmax, p.hi );
+		root.cmin = min( root.cmin, p.lo+p.hi );
+		root.cmax = max( root.cmax, p.lo+p.hi );
+	}
+	boundMin = vec3( root.bmin[0], root.bmin[1], root.bmin[2] );
+	boundMax = vec3( root.bmax[0], root.bmax[1], root.bmax[2] );
+	// Top levels here, the subtrees below taskSize on the pool into trees of
+	// their own, spliced in afterwards.
+	int taskSize = std::max( int( MIN_TASK ), count/(8*(pool.size()+1)) );
+	std::vector<Builder::Task> tasks;
+	nodes.emplace_back();
+	builder.build( *this, 0, 0, root, count>taskSize?&tasks:nullptr, taskSize );
+	std::vector<BVH4> subtrees( tasks.size() );
+	pool.parallelFor( 0, int( tasks.size() ), [&]( int i ) {
+		BVH4& sub = subtrees[i];
+		sub.nodes.emplace_back();
+		builder.build( sub, 0, tasks[i].depth, tasks[i].range, nullptr, 0 );
+	} );
+	for( size_t i=0; i<tasks.size(); i++ ) {
+		const BVH4& sub = subtrees[i];
+		int nodeBase = int( nodes.size() )-1, leafBase = int( leaves.size() );
+		for( size_t j=0; j<sub.nodes.size(); j++ ) {
+			Node node = sub.nodes[j];
+			for( int& c: node.child ) {
+				if( c==EMPTY ) continue;
+				c = c<0?~(~c+leafBase):c+nodeBase;		// the subtree's root is never a child
+			}
+			if( j==0 ) nodes[tasks[i].node] = node;
+			else nodes.push_back( node );
+		}
+		leaves.insert( leaves.end(), sub.leaves.begin(), sub.leaves.end() );
+	}
+	nodes.shrink_to_fit();
+	leaves.shrink_to_fit();
+}
+
+void MeshBVH::build( const MeshData& data, ThreadPool& pool ) {
+	triCount = int( data.tris.size() );
+	std::vector<vec3> triMin( triCount ), triMax( triCount );
+	pool.parallelFor( 0, triCount, [&]( int i ) {
+		const uvec3& t = data.tris[i];
+		const vec3 &a = data.verts[t.x], &b = data.verts[t.y], &c = data.verts[t.z];
+		triMin[i] = min( a, min( b, c ) );
+		triMax[i] = max( a, max( b, c ) );
+	}, 1<<14 );
+	BVH4 tree;
+	tree.build( triMin.data(), triMax.data(), triCount, pool );
+	nodes = std::move( tree.nodes );
+	boundMin = tree.boundMin;
+	boundMax = tree.boundMax;
+	packs.resize( tree.leaves.size() );
+	pool.parallelFor( 0, int( packs.size() ), [&]( int i ) {
+		TriPack& p = packs[i];
+		for( int k=0; k<4; k++ ) {
+			int tri = tree.leaves[i].prims[k];
+			vec3 v0( 0 ), e1( 0 ), e2( 0 );
+			if( tri>=0 ) {
+				const uvec3& t = data.tris[tri];
+				v0 = data.verts[t.x];
+				e1 = data.verts[t.y]-v0;
+				e2 = data.verts[t.z]-v0;
+			}
+			for( int a=0; a<3; a++ ) {
+				p.v0[a][k] = v0[a];
+				p.e1[a][k] = e1[a];
+				p.e2[a][k] = e2[a];
+			}
+			p.tris[k] = tri;
+		}
+	}, 1<<12 );
+}
+
+bool MeshBVH::intersect( Ray& ray, Hit& hit, bool anyHit ) const {
+	float4 o[3] = { float4( ray.org.x ), float4( ray.org.y ), float4( ray.org.z ) };
+	float4 d[3] = { float4( ray.dir.x ), float4( ray.dir.y ), float4( ray.dir.z ) };
+	bool found = false;
+	traverse( nodes, ray.org, ray.dir, ray.tMax, [&]( int leaf, float& tMax ) {
+		float t[4], u[4], v[4];
+		int lanes = intersectPack( packs[leaf], o, d, tMax, t, u, v );
+		for( int k=0; k<4; k++ ) {
+			if( !(lanes>>k&1) || t[k]>=tMax ) continue;
+			tMax = t[k];
+			hit.t = t[k];
+			hit.tri = packs[leaf].tris[k];
+			hit.bary = vec2( u[k], v[k] );
+			found = true;
+		}
+		return found && anyHit;
+	} );
+	return found;
+}
+
+void SceneBVH::add( const std::vector<TriMesh>& meshSet, int first, ThreadPool& pool ) {
+	meshes.resize( meshSet.size() );
+	std::vector<int> order;
+	for( int i=std::max( first, 0 ); i<int( meshSet.size() ); i++ ) {
+		const MeshData& data = meshSet[i].data;
+		meshes[i] = nullptr;
+		if( data.tris.size() && data.verts.size() && data.skin.empty() ) order.push_back( i );
+	}
+	// Largest first, so a big mesh does not start last and run alone.
+	std::sort( order.begin(), order.end(), [&]( int a, int b ) { return meshSet[a].data.tris.size()>meshSet[b].data.tris.size(); } );
+	pool.parallelFor( 0, int( order.size() ), [&]( int k ) {
+		auto bvh = std::make_shared<MeshBVH>();
+		bvh->build( meshSet[order[k]].data, pool );
+		meshes[order[k]] = bvh;
+	} );
+}
+
+void SceneBVH::update( const std::vector<TriMesh>& meshSet ) {
+	instances.clear();
+	std::vector<vec3> boxMin, boxMax;
+	for( int i=0; i<int( std::min( meshes.size(), meshSet.size() ) ); i++ ) {
+		if( !meshes[i] || meshes[i]->empty() || !meshSet[i].visible ) continue;
+		const mat4& m = meshSet[i].modelMat;
+		vec3 bmin( FLT_MAX ), bmax( -FLT_MAX );
+		for( int c=0; c<8; c++ ) {
+			vec3 corner( c&1?meshes[i]->boundMax.x:meshes[i]->boundMin.x,
+						 c&2?meshes[i]->boundMax.y:meshes[i]->boundMin.y,
+						 c&4?meshes[i]->boundMax.z:meshes[i]->boundMin.z );
+			vec3 p = vec3( m*vec4( corner, 1 ) );
+			bmin = min( bmin, p );
+			bmax = max( bmax, p );
+		}
+		boxMin.push_back( bmin );
+		boxMax.push_back( bmax );
+		instances.push_back( { inverse( m ), i } );
+	}
+	top.build( boxMin.data(), boxMax.data(), int( instances.size() ) );
+}
+
+bool SceneBVH::trace( Ray ray, Hit& hit, bool anyHit ) const {
+	bool found = false;
+	traverse( top.nodes, ray.org, ray.dir, ray.tMax, [&]( int leaf, float& tMax ) {
+		for( int p: top.leaves[leaf].prims ) {
+			if( p<0 ) break;
+			const Instance& inst = instances[p];
+			Ray local( vec3( inst.worldToMesh*vec4( ray.org, 1 ) ), vec3( inst.worldToMesh*vec4( ray.dir, 0 ) ), tMax );
+			if( !meshes[inst.mesh]->intersect( local, hit, anyHit ) ) continue;
+			hit.mesh = inst.mesh;
+			tMax = local.tMax;					// t is the same in both spaces, dir is not normalized
+			found = true;
+			if( anyHit ) return true;
+		}
+		return false;
+	} );
+	return found;
+}
+
+Hit SceneBVH::closestHit( const Ray& ray ) const {
+	Hit hit;
+	trace( ray, hit, false );
+	return hit;
+}
+
+bool SceneBVH::raycast( const Ray& ray ) const {
+	Hit hit;
+	return trace( ray, hit, true );
+}
+
+void SceneBVH::closestHit( const Ray* rays, Hit* hits, int count, ThreadPool& pool ) const {
+	pool.parallelFor( 0, count, [&]( int i ) {
+		hits[i] = Hit();
+		trace( rays[i], hits[i], false );
+	}, 64 );
+}
+
+void SceneBVH::raycast( const Ray* rays, bool* hits, int count, ThreadPool& pool ) const {
+	pool.parallelFor( 0, count, [&]( int i ) {
+		Hit hit;
+		hits[i] = trace( rays[i], hit, true );
+	}, 64 );
+}
+
+}
@@ -0,0 +1,106 @@
+//
+//  BVH.hpp
+//  AR_Framework
+//
+
+#ifndef BVH_hpp
+#define BVH_hpp
+
+#include "Tools/ThreadPool.hpp"
+#include "TriMesh.hpp"
+#include <cfloat>
+#include <memory>
+#include <vector>
+
+namespace AR {
+
+struct Ray {
+	vec3 org = vec3(0), dir = vec3(0,0,-1);
+	float tMax = FLT_MAX;					// hits at 0<t<tMax, t in units of dir
+	Ray() {}
+	Ray( const vec3& o, const vec3& d, float t=FLT_MAX ): org(o), dir(d), tMax(t) {}
+};
+
+// Position = (1-bary.x-bary.y)*v0 + bary.x*v1 + bary.y*v2 of triangle tri.
+struct Hit {
+	float t = FLT_MAX;
+	int mesh = -1;							// index in the MeshSet
+	int tri = -1;							// index in the mesh's MeshData::tris
+	vec2 bary = vec2(0);
+	bool valid() const { return tri>=0; }
+};
+
+// Four-wide tree: a node holds the boxes of its four children, one per SIMD
+// lane, so a ray tests them together. Leaves hold up to four primitives.
+struct BVH4 {
+	enum { EMPTY = int(0x80000000) };
+	struct Node {
+		float bmin[3][4], bmax[3][4];
+		int child[4];						// >=0 a node, ~i leaf i, EMPTY an unused lane
+	};
+	struct Leaf {
+		int prims[4];						// -1 padded
+	};
+	std::vector<Node> nodes;				// nodes[0] is the root
+	std::vector<Leaf> leaves;
+	vec3 boundMin = vec3(0), boundMax = vec3(0);
+
+	bool empty() const { return nodes.empty(); }
+	void clear() { nodes.clear(); leaves.clear(); }
+	// Binned SAH over the primitives' boxes, large subtrees built in parallel.
+	void build( const vec3* primMin, const vec3* primMax, int count, ThreadPool& pool=ThreadPool::shared() );
+};
+
+// Tree over the triangles of one mesh, in mesh space. Keeps its own copy of
+// the triangles, four per leaf in SIMD layout, since the MeshData goes away
+// once uploaded.
+struct MeshBVH {
+	struct TriPack {
+		float v0[3][4], e1[3][4], e2[3][4];
+		int tris[4];						// -1 padded, degenerate
+	};
+	std::vector<BVH4::Node> nodes;
+	std::vector<TriPack> packs;				// packs[i] is leaf i
+	vec3 boundMin = vec3(0), boundMax = vec3(0);
+	int triCount = 0;
+
+	bool empty() const { return nodes.empty(); }
+	void build( const MeshData& data, ThreadPool& pool=ThreadPool::shared() );
+	// Closest hit below ray.tMax (then shortened), or any hit when anyHit.
+	bool intersect( Ray& ray, Hit& hit, bool anyHit=false ) const;
+};
+
+// Meshes' trees plus a top level tree over their world boxes. Meshes need
+// their trees added while their data is still on the CPU, right after loading;
+// update() then takes their current modelMat, cheaply enough to run per pick.
+// Skinned meshes are left out: their bind pose is not what is drawn.
+//
+//	bvh.add( meshSet, firstNewMesh );
+//	bvh.update( meshSet );
+//	Hit hit = bvh.closestHit( Ray( eye, dir ) );
+struct SceneBVH {
+	struct Instance {
+		mat4 worldToMesh;
+		int mesh;
+	};
+	std::vector<std::shared_ptr<const MeshBVH>> meshes;	// per MeshSet entry, null when left out
+	std::vector<Instance> instances;
+	BVH4 top;
+
+	void clear() { meshes.clear(); instances.clear(); top.clear(); }
+	void add( const std::vector<TriMesh>& meshSet, int first=0, ThreadPool& pool=ThreadPool::shared() );
+	void update( const std::vector<TriMesh>& meshSet );
+
+	Hit closestHit( const Ray& ray ) const;
+	bool raycast( const Ray& ray ) const;	// anything below ray.tMax, for shadows and occlusion
+	// Batches, spread over the pool.
+	void closestHit( const Ray* rays, Hit* hits, int count, ThreadPool& pool=ThreadPool::shared() ) const;
+	void raycast( const Ray* rays, bool* hits, int count, ThreadPool& pool=ThreadPool::shared() ) const;
+
+protected:
+	bool trace( Ray ray, Hit& hit, bool anyHit ) const;
+};
+
+}
+
+#endif /* BVH_hpp */
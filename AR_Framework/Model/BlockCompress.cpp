@@ -0,0 +1,354 @@
+//
+//  BlockCompress.cpp
+//  AR_Framework
+//
+
+#include "BlockCompress.hpp"
+#include "Tools/SIMD.hpp"
+#include <cmath>
+#include <cstring>
+
+namespace AR {
+
+static inline int clampi( int v, int lo, int hi ) { return v<lo?lo:(v>hi?hi:v); }
+
+// Principal axis of 16 points by power iteration on the covariance matrix.
+static void principalAxis( const float px[4][16], int dim, float mean[4], float axis[4] ) {
+	for( int c=0; c<4; c++ ) {
+		mean[c] = 0;
+		axis[c] = 0;
+		if( c>=dim ) continue;
+		for( int i=0; i<16; i++ ) mean[c] += px[c][i];
+		mean[c] /= 16.f;
+	}
+	float cov[4][4] = {};
+	for( int i=0; i<16; i++ ) for( int a=0; a<dim; a++ ) for( int b=a; b<dim; b++ )
+		cov[a][b] += (px[a][i]-mean[a])*(px[b][i]-mean[b]);
+	for( int a=0; a<dim; a++ ) for( int b=0; b<a; b++ ) cov[a][b] = cov[b][a];
+
+	int k = 0;
+	for( int a=1; a<dim; a++ ) if( cov[a][a]>cov[k][k] ) k = a;
+	for( int a=0; a<dim; a++ ) axis[a] = cov[k][a];
+	for( int iter=0; iter<8; iter++ ) {
+		float v[4] = {};
+		for( int a=0; a<dim; a++ ) for( int b=0; b<dim; b++ ) v[a] += cov[a][b]*axis[b];
+		float len = 0;
+		for( int a=0; a<dim; a++ ) len += v[a]*v[a];
+		if( len<1e-12f ) break;
+		len = 1.f/sqrtf( len );
+		for( int a=0; a<dim; a++ ) axis[a] = v[a]*len;
+	}
+}
+
+// Picks the nearest palette entry for every pixel, four pixels at a time.
+// Returns the summed squared error.
+static float fitIndices( const float px[4][16], int dim, const float pal[][4], int nPal, unsigned char idx[16] ) {
+	float err = 0;
+	for( int i=0; i<16; i+=4 ) {
+		float4 ch[4];
+		for( int c=0; c<dim; c++ ) ch[c] = float4::load( px[c]+i );
+		float4 bestD( 1e30f ), bestI( 0.f );
+		for( int k=0; k<nPal; k++ ) {
+			float4 d( 0.f );
+			for( int c=0; c<dim; c++ ) {
+				float4 t = ch[c]-float4( pal[k][c] );
+				d = d+t*t;
+			}
+			float4 m = lessThan( d, bestD );
+			bestD = select( bestD, d, m );
+			bestI = select( bestI, float4( float(k) ), m );
+		}
+		float dd[4], ii[4];
+		bestD.store( dd );
+		bestI.store( ii );
+		for( int j=0; j<4; j++ ) {
+			idx[i+j] = (unsigned char)ii[j];
+			err += dd[j];
+		}
+	}
+	return err;
+}
+
+// Least squares endpoints for fixed indices; w[i] is the weight of endpoint 1.
+static bool refineEndpoints( const float px[4][16], int dim, const float w[16], float e0[4], float e1[4] ) {
+	float A=0, B=0, C=0, X0[4]={}, X1[4]={};
+	for( int i=0; i<16; i++ ) {
+		float a = 1-w[i], b = w[i];
+		A += a*a; B += a*b; C += b*b;
+		for( int c=0; c<dim; c++ ) { X0[c] += a*px[c][i]; X1[c] += b*px[c][i]; }
+	}
+	float det = A*C-B*B;
+	if( fabsf(det)<1e-6f ) return false;
+	det = 1.f/det;
+	for( int c=0; c<dim; c++ ) {
+		e0[c] = fminf( 255.f, fmaxf( 0.f, (C*X0[c]-B*X1[c])*det ) );
+		e1[c] = fminf( 255.f, fmaxf( 0.f, (A*X1[c]-B*X0[c])*det ) );
+	}
+	return true;
+}
+
+struct BitWriter {
+	unsigned char* out;
+	int pos = 0;
+	BitWriter( unsigned char* o, int nBytes ): out(o) { memset( out, 0, nBytes ); }
+	void put( uint32_t v, int nBits ) {
+		for( int i=0; i<nBits; i++, pos++ )
+			if( (v>>i)&1 ) out[pos>>3] |= (unsigned char)(1<<(pos&7));
+	}
+};
+
+static void splitChannels( const unsigned char* rgba, float px[4][16] ) {
+	for( int i=0; i<16; i++ ) for( int c=0; c<4; c++ ) px[c][i] = rgba[i*4+c];
+}
+
+
+
+//***************************************************
+//                      BC1
+//***************************************************
+static inline uint16_t pack565( const float c[3] ) {
+	int r = clampi( int(c[0]*31.f/255.f+.5f), 0, 31 );
+	int g = clampi( int(c[1]*63.f/255.f+.5f), 0, 63 );
+	int b = clampi( int(c[2]*31.f/255.f+.5f), 0, 31 );
+	return uint16_t( (r<<11)|(g<<5)|b );
+}
+static inline void unpack565( uint16_t v, float c[4] ) {
+	int r = (v>>11)&31, g = (v>>5)&63, b = v&31;
+	c[0] = float( (r<<3)|(r>>2) );
+	c[1] = float( (g<<2)|(g>>4) );
+	c[2] = float( (b<<3)|(b>>2) );
+	c[3] = 0;
+}
+
+static float tryBC1( const float px[4][16], const float e0[3], const float e1[3], uint16_t& q0, uint16_t& q1, unsigned char idx[16] ) {
+	q0 = pack565( e0 );
+	q1 = pack565( e1 );
+	if( q0<q1 ) std::swap( q0, q1 );
+	float pal[4][4];
+	unpack565( q0, pal[0] );
+	unpack565( q1, pal[1] );
+	for( int c=0; c<3; c++ ) {
+		pal[2][c] = (2*pal[0][c]+pal[1][c])/3.f;
+		pal[3][c] = (pal[0][c]+2*pal[1][c])/3.f;
+	}
+	if( q0==q1 ) {
+		memset( idx, 0, 16 );
+		float err = 0;
+		for( int i=0; i<16; i++ ) for( int c=0; c<3; c++ ) err += (px[c][i]-pal[0][c])*(px[c][i]-pal[0][c]);
+		return err;
+	}
+	return fitIndices( px, 3, pal, 4, idx );
+}
+
+static void writeBC1( uint16_t q0, uint16_t q1, const unsigned char idx[16], unsigned char* out ) {
+	BitWriter bw( out, 8 );
+	bw.put( q0, 16 );
+	bw.put( q1, 16 );
+	for( int i=0; i<16; i++ ) bw.put( idx[i], 2 );
+}
+
+void encodeBlockBC1( const unsigned char* rgba, unsigned char* out ) {
+	float px[4][16], mean[4], axis[4];
+	splitChannels( rgba, px );
+	principalAxis( px, 3, mean, axis );
+	float tMin = 1e30f, tMax = -1e30f;
+	for( int i=0; i<16; i++ ) {
+		float t = 0;
+		for( int c=0; c<3; c++ ) t += (px[c][i]-mean[c])*axis[c];
+		tMin = fminf( tMin, t );
+		tMax = fmaxf( tMax, t );
+	}
+	float inset = (tMax-tMin)/32.f;
+	float e0[4], e1[4];
+	for( int c=0; c<3; c++ ) {
+		e0[c] = fminf( 255.f, fmaxf( 0.f, mean[c]+axis[c]*(tMax-inset) ) );
+		e1[c] = fminf( 255.f, fmaxf( 0.f, mean[c]+axis[c]*(tMin+inset) ) );
+	}
+	uint16_t q0, q1;
+	unsigned char idx[16];
+	float err = tryBC1( px, e0, e1, q0, q1, idx );
+
+	static const float weights[4] = { 0.f, 1.f, 1/3.f, 2/3.f };
+	float w[16];
+	for( int i=0; i<16; i++ ) w[i] = weights[idx[i]];
+	if( q0!=q1 && refineEndpoints( px, 3, w, e0, e1 ) ) {
+		uint16_t r0, r1;
+		unsigned char ridx[16];
+		float rerr = tryBC1( px, e0, e1, r0, r1, ridx );
+		if( rerr<err ) {
+			q0 = r0; q1 = r1;
+			memcpy( idx, ridx, 16 );
+		}
+	}
+	writeBC1( q0, q1, idx, out );
+}
+
+
+
+//***************************************************
+//                   BC4 / BC5 / BC3
+//***************************************************
+void encodeBlockBC4( const unsigned char* rgba, int channel, unsigned char* out ) {
+	int mn = 255, mx = 0;
+	for( int i=0; i<16; i++ ) {
+		mn = std::min( mn, int(rgba[i*4+channel]) );
+		mx = std::max( mx, int(rgba[i*4+channel]) );
+	}
+	BitWriter bw( out, 8 );
+	bw.put( mx, 8 );
+	bw.put( mn, 8 );
+	if( mx==mn ) return;
+	// Eight-level mode: index 0/1 are the endpoints, 2..7 interpolate from max to min.
+	float scale = 7.f/float(mx-mn);
+	for( int i=0; i<16; i++ ) {
+		int p = clampi( int( (rgba[i*4+channel]-mn)*scale+.5f ), 0, 7 );
+		int code = p==7?0:(p==0?1:8-p);
+		bw.put( code, 3 );
+	}
+}
+
+void encodeBlockBC5( const unsigned char* rgba, unsigned char* out ) {
+	encodeBlockBC4( rgba, 0, out );
+	encodeBlockBC4( rgba, 1, out+8 );
+}
+
+void encodeBlockBC3( const unsigned char* rgba, unsigned char* out ) {
+	encodeBlockBC4( rgba, 3, out );
+	encodeBlockBC1( rgba, out+8 );
+}
+
+
+
+//***************************************************
+//                 BC7 (mode 6 only)
+//***************************************************
+// Mode 6 has one subset, RGBA 7-bit endpoints with a p-bit each and 4-bit indices,
+// which is what most real-time encoders use for smooth colour and alpha content.
+static const int bc7Weights4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+static float tryBC7( const float px[4][16], const float e0[4], const float e1[4], bool opaque,
+					int q0[4], int q1[4], int& p0, int& p1, unsigned char idx[16] ) {
+	float best = 1e30f;
+	for( int pp=0; pp<4; pp++ ) {
+		int a = pp&1, b = pp>>1;
+		if( opaque && (a==0 || b==0) ) continue;
+		int t0[4], t1[4];
+		float pal[16][4], u0[4], u1[4];
+		for( int c=0; c<4; c++ ) {
+			t0[c] = clampi( int( (e0[c]-a)/2.f+.5f ), 0, 127 );
+			t1[c] = clampi( int( (e1[c]-b)/2.f+.5f ), 0, 127 );
+			u0[c] = float( t0[c]*2+a );
+			u1[c] = float( t1[c]*2+b );
+		}
+		for( int k=0; k<16; k++ ) for( int c=0; c<4; c++ )
+			pal[k][c] = float( ( (64-bc7Weights4[k])*int(u0[c]) + bc7Weights4[k]*int(u1[c]) + 32 )>>6 );
+		unsigned char tidx[16];
+		float err = fitIndices( px, 4, pal, 16, tidx );
+		if( err<best ) {
+			best = err;
+			memcpy( q0, t0, sizeof(t0) );
+			memcpy( q1, t1, sizeof(t1) );
+			p0 = a; p1 = b;
+			memcpy( idx, tidx, 16 );
+		}
+	}
+	return best;
+}
+
+void encodeBlockBC7( const unsigned char* rgba, unsigned char* out ) {
+	float px[4][16], mean[4], axis[4];
+	splitChannels( rgba, px );
+	bool opaque = true;
+	for( int i=0; i<16; i++ ) if( rgba[i*4+3]<255 ) opaque = false;
+	principalAxis( px, opaque?3:4, mean, axis );
+	if( opaque ) mean[3] = 255;
+	float tMin = 1e30f, tMax = -1e30f;
+	for( int i=0; i<16; i++ ) {
+		float t = 0;
+		for( int c=0; c<4; c++ ) t += (px[c][i]-mean[c])*axis[c];
+		tMin = fminf( tMin, t );
+		tMax = fmaxf( tMax, t );
+	}
+	float e0[4], e1[4];
+	for( int c=0; c<4; c++ ) {
+		e0[c] = fminf( 255.f, fmaxf( 0.f, mean[c]+axis[c]*tMin ) );
+		e1[c] = fminf( 255.f, fmaxf( 0.f, mean[c]+axis[c]*tMax ) );
+	}
+	int q0[4], q1[4], p0, p1;
+	unsigned char idx[16];
+	float err = tryBC7( px, e0, e1, opaque, q0, q1, p0, p1, idx );
+
+	float w[16];
+	for( int i=0; i<16; i++ ) w[i] = bc7Weights4[idx[i]]/64.f;
+	if( refineEndpoints( px, opaque?3:4, w, e0, e1 ) ) {
+		int r0[4], r1[4], rp0, rp1;
+		unsigned char ridx[16];
+		if( tryBC7( px, e0, e1, opaque, r0, r1, rp0, rp1, ridx )<err ) {
+			memcpy( q0, r0, sizeof(r0) );
+			memcpy( q1, r1, sizeof(r1) );
+			p0 = rp0; p1 = rp1;
+			memcpy( idx, ridx, 16 );
+		}
+	}
+	// The anchor (pixel 0) index is stored with an implicit zero MSB.
+	if( idx[0]>=8 ) {
+		for( int c=0; c<4; c++ ) std::swap( q0[c], q1[c] );
+		std::swap( p0, p1 );
+		for( int i=0; i<16; i++ ) idx[i] = 15-idx[i];
+	}
+	BitWriter bw( out, 16 );
+	bw.put( 1<<6, 7 );
+	for( int c=0; c<4; c++ ) {
+		bw.put( q0[c], 7 );
+		bw.put( q1[c], 7 );
+	}
+	bw.put( p0, 1 );
+	bw.put( p1, 1 );
+	bw.put( idx[0], 3 );
+	for( int i=1; i<16; i++ ) bw.put( idx[i], 4 );
+}
+
+
+
+//***************************************************
+//                    Image level
+//***************************************************
+static void fetchBlock( const unsigned char* src, int w, int h, int n, int bx, int by, bool expandGrey, unsigned char* rgba ) {
+	for( int y=0; y<4; y++ ) for( int x=0; x<4; x++ ) {
+		int sx = std::min( bx*4+x, w-1 ), sy = std::min( by*4+y, h-1 );
+		const unsigned char* p = src + (size_t(sy)*w+sx)*n;
+		unsigned char* d = rgba + (y*4+x)*4;
+		if( expandGrey && n<3 ) {
+			d[0] = d[1] = d[2] = p[0];
+			d[3] = n==2?p[1]:255;
+		}
+		else for( int c=0; c<4; c++ ) d[c] = c<n?p[c]:(c==3?255:0);
+	}
+}
+
+std::vector<unsigned char> encodeBlocks( const unsigned char* src, int w, int h, int nChannels,
+										BCFormat format, ThreadPool& pool ) {
+	const PixelFormat* pf = findPixelFormat( format, false );
+	if( !pf || !src || w<1 || h<1 ) return {};
+	int bw = (w+3)/4, bh = (h+3)/4;
+	std::vector<unsigned char> out( size_t(bw)*bh*pf->blockBytes );
+	bool expandGrey = format!=BCFormat::BC4 && format!=BCFormat::BC5;
+	pool.parallelFor( 0, bh, [&]( int by ) {
+		unsigned char rgba[64];
+		for( int bx=0; bx<bw; bx++ ) {
+			unsigned char* dst = out.data() + (size_t(by)*bw+bx)*pf->blockBytes;
+			fetchBlock( src, w, h, nChannels, bx, by, expandGrey, rgba );
+			switch( format ) {
+				case BCFormat::BC1: encodeBlockBC1( rgba, dst ); break;
+				case BCFormat::BC3: encodeBlockBC3( rgba, dst ); break;
+				case BCFormat::BC4: encodeBlockBC4( rgba, 0, dst ); break;
+				case BCFormat::BC5: encodeBlockBC5( rgba, dst ); break;
+				case BCFormat::BC7: encodeBlockBC7( rgba, dst ); break;
+				default: break;
+			}
+		}
+	} );
+	return out;
+}
+
+}
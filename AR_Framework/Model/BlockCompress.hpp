@@ -0,0 +1,28 @@
+//
+//  BlockCompress.hpp
+//  AR_Framework
+//
+
+#ifndef BlockCompress_hpp
+#define BlockCompress_hpp
+
+#include "TextureFormat.hpp"
+#include "Tools/ThreadPool.hpp"
+
+namespace AR {
+
+// Single 4x4 block encoders. 'rgba' holds 16 pixels, 4 bytes each, row major.
+extern void encodeBlockBC1( const unsigned char* rgba, unsigned char* out );
+extern void encodeBlockBC3( const unsigned char* rgba, unsigned char* out );
+extern void encodeBlockBC4( const unsigned char* rgba, int channel, unsigned char* out );
+extern void encodeBlockBC5( const unsigned char* rgba, unsigned char* out );
+extern void encodeBlockBC7( const unsigned char* rgba, unsigned char* out );
+
+// Encodes an 8-bit image with 1-4 channels. Block rows are spread over the pool.
+// Grey and grey+alpha images are expanded to RGB(A) for the colour formats.
+extern std::vector<unsigned char> encodeBlocks( const unsigned char* src, int w, int h, int nChannels,
+											   BCFormat format, ThreadPool& pool=ThreadPool::shared() );
+
+}
+
+#endif /* BlockCompress_hpp */
@@ -0,0 +1,521 @@
+//
+//  EXR.cpp
+//  AR_Framework
+//
+
+#include "EXR.hpp"
+#include "HDRFormat.hpp"
+#include <stb_image.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace AR {
+
+enum { EXR_UINT = 0, EXR_HALF = 1, EXR_FLOAT = 2 };
+enum { EXR_NONE = 0, EXR_RLE = 1, EXR_ZIPS = 2, EXR_ZIP = 3, EXR_PIZ = 4 };
+
+struct EXRChannel {
+	std::string name;
+	int type = EXR_HALF;
+	int bytes() const { return type==EXR_HALF?2:4; }
+};
+
+struct EXRHeader {
+	std::vector<EXRChannel> channels;		// in file order, sorted by name
+	int compression = EXR_NONE;
+	int xMin = 0, yMin = 0, width = 0, height = 0;
+	int linesPerChunk = 1;
+	int pick[4] = { -1, -1, -1, -1 };		// channel index of R, G, B, A
+	int nPicked = 0;
+	size_t offsetTable = 0;					// chunk offsets follow the header
+	size_t lineBytes() const {
+		size_t n = 0;
+		for( auto& c: channels ) n += size_t(width)*c.bytes();
+		return n;
+	}
+};
+
+template<typename T> static T readLE( const unsigned char* p ) {
+	T v;
+	memcpy( &v, p, sizeof(T) );
+	return v;
+}
+
+static thread_local const char* exrError = "";
+
+static bool parseHeader( const unsigned char* data, size_t size, EXRHeader& hd ) {
+	if( !isEXR( data, size ) || size<8 ) { exrError = "not an OpenEXR file"; return false; }
+	uint32_t version = readLE<uint32_t>( data+4 );
+	if( version&0x1a00 ) { exrError = "tiled, deep and multi-part files are not supported"; return false; }
+	size_t pos = 8;
+	bool haveChannels = false, haveWindow = false;
+	auto readString = [&]( std::string& s ) {
+		size_t end = pos;
+		while( end<size && data[end] ) end++;
+		if( end>=size ) return false;
+		s.assign( (const char*)data+pos, end-pos );
+		pos = end+1;
+		return true;
+	};
+	while( true ) {
+		std::string name, type;
+		if( !readString( name ) ) { exrError = "truncated header"; return false; }
+		if( name.empty() ) break;
+		if( !readString( type ) || pos+4>size ) { exrError = "truncated header"; return false; }
+		uint32_t attrSize = readLE<uint32_t>( data+pos );
+		pos += 4;
+		if( pos+attrSize>size ) { exrError = "truncated header"; return false; }
+		const unsigned char* a = data+pos;
+		if( name=="channels" && type=="chlist" ) {
+			size_t p = 0;
+			while( p<attrSize && a[p] ) {
+				EXRChannel c;
+				size_t end = p;
+				while( end<attrSize && a[end] ) end++;
+				if( end+17>attrSize ) { exrError = "bad channel list"; return false; }
+				c.name.assign( (const char*)a+p, end-p );
+				c.type = readLE<int32_t>( a+end+1 );
+				int xs = readLE<int32_t>( a+end+9 ), ys = readLE<int32_t>( a+end+13 );
+				if( xs!=1 || ys!=1 || c.type<EXR_UINT || c.type>EXR_FLOAT ) { exrError = "subsampled channels are not supported"; return false; }
+				hd.channels.push_back( c );
+				p = end+17;
+			}
+			haveChannels = true;
+		}
+		else if( name=="compression" && attrSize>=1 ) hd.compression = a[0];
+		else if( name=="dataWindow" && attrSize>=16 ) {
+			hd.xMin = readLE<int32_t>( a );
+			hd.yMin = readLE<int32_t>( a+4 );
+			hd.width = readLE<int32_t>( a+8 )-hd.xMin+1;
+			hd.height = readLE<int32_t>( a+12 )-hd.yMin+1;
+			haveWindow = true;
+		}
+		pos += attrSize;
+	}
+	if( !haveChannels || !haveWindow || hd.channels.empty() || hd.width<1 || hd.height<1 ) { exrError = "missing channels or data window"; return false; }
+	switch( hd.compression ) {
+		case EXR_NONE: case EXR_RLE: case EXR_ZIPS:	hd.linesPerChunk = 1; break;
+		case EXR_ZIP:								hd.linesPerChunk = 16; break;
+		case EXR_PIZ:								hd.linesPerChunk = 32; break;
+		default: exrError = "compression is not supported (only NONE, RLE, ZIP, ZIPS, PIZ)"; return false;
+	}
+	static const char* names[4] = { "R", "G", "B", "A" };
+	for( int i=0; i<int(hd.channels.size()); i++ )
+		for( int k=0; k<4; k++ ) if( hd.channels[i].name==names[k] ) hd.pick[k] = i;
+	if( hd.pick[0]>=0 && hd.pick[1]>=0 && hd.pick[2]>=0 ) hd.nPicked = hd.pick[3]>=0?4:3;
+	else {
+		hd.pick[0] = 0;
+		for( int i=0; i<int(hd.channels.size()); i++ ) if( hd.channels[i].name=="Y" ) hd.pick[0] = i;
+		hd.nPicked = 1;
+	}
+	hd.offsetTable = pos;
+	return true;
+}
+
+bool isEXR( const unsigned char* data, size_t size ) {
+	return size>=4 && data[0]==0x76 && data[1]==0x2f && data[2]==0x31 && data[3]==0x01;
+}
+
+bool infoEXR( const unsigned char* data, size_t size, int* w, int* h, int* nChannels ) {
+	EXRHeader hd;
+	if( !parseHeader( data, size, hd ) ) return false;
+	*w = hd.width;
+	*h = hd.height;
+	*nChannels = hd.nPicked;
+	return true;
+}
+
+// ZIP and RLE store the bytes delta coded, first halves then second halves of every value.
+static void undoPredictor( std::vector<unsigned char>& tmp, unsigned char* out, size_t n ) {
+	for( size_t i=1; i<n; i++ ) tmp[i] = (unsigned char)( int(tmp[i-1])+int(tmp[i])-128 );
+	const unsigned char* t1 = tmp.data();
+	const unsigned char* t2 = tmp.data()+(n+1)/2;
+	for( size_t i=0; i<n; i++ ) out[i] = (i&1)?*t2++:*t1++;
+}
+
+static bool decodeRLE( const unsigned char* in, size_t inSize, std::vector<unsigned char>& tmp ) {
+	size_t o = 0;
+	const unsigned char* end = in+inSize;
+	while( in<end ) {
+		int count = int( (signed char)*in++ );
+		if( count<0 ) {
+			if( in+(-count)>end || o+(-count)>tmp.size() ) return false;
+			memcpy( tmp.data()+o, in, -count );
+			in += -count;
+			o += -count;
+		}
+		else {
+			if( in>=end || o+count+1>tmp.size() ) return false;
+			memset( tmp.data()+o, *in++, count+1 );
+			o += count+1;
+		}
+	}
+	return o==tmp.size();
+}
+
+// PIZ: wavelet transformed 16-bit values, remapped through a bitmap LUT and Huffman coded.
+namespace piz {
+
+const int encBits = 16, decBits = 14;
+const int encSize = (1<<encBits)+1, decSize = 1<<decBits, decMask = decSize-1;
+const int shortZeroRun = 59, longZeroRun = 63, shortestLongRun = 2+longZeroRun-shortZeroRun;
+const int bitmapSize = 8192, ushortRange = 1<<16;
+
+struct HufDec {
+	int len = 0, lit = 0;
+	std::vector<int> p;			// long codes sharing this prefix
+};
+
+static int hufLength( uint64_t code ) { return int(code&63); }
+static uint64_t hufCode( uint64_t code ) { return code>>6; }
+
+struct BitReader {
+	const unsigned char* in;
+	const unsigned char* end;
+	uint64_t c = 0;
+	int lc = 0;
+	void getChar() { c = (c<<8)|(in<end?*in:0); in++; lc += 8; }
+	uint64_t getBits( int n ) {
+		while( lc<n ) getChar();
+		lc -= n;
+		return (c>>lc)&((1ull<<n)-1);
+	}
+};
+
+static void canonicalCodeTable( uint64_t* hcode ) {
+	uint64_t n[59] = {};
+	for( int i=0; i<encSize; i++ ) n[hcode[i]]++;
+	uint64_t c = 0;
+	for( int i=58; i>0; i-- ) {
+		uint64_t nc = (c+n[i])>>1;
+		n[i] = c;
+		c = nc;
+	}
+	for( int i=0; i<encSize; i++ ) {
+		int l = int(hcode[i]);
+		if( l>0 ) hcode[i] = l|(n[l]++<<6);
+	}
+}
+
+static bool unpackEncTable( BitReader& br, int im, int iM, uint64_t* hcode ) {
+	for( ; im<=iM; im++ ) {
+		if( br.in>br.end ) return false;
+		uint64_t l = hcode[im] = br.getBits( 6 );
+		int zerun = 0;
+		if( l==longZeroRun )		zerun = int(br.getBits( 8 ))+shortestLongRun;
+		else if( l>=shortZeroRun )	zerun = int(l)-shortZeroRun+2;
+		else continue;
+		if( im+zerun>iM+1 ) return false;
+		while( zerun-- ) hcode[im++] = 0;
+		im--;
+	}
+	canonicalCodeTable( hcode );
+	return true;
+}
+
+static bool buildDecTable( const uint64_t* hcode, int im, int iM, HufDec* hdec ) {
+	for( ; im<=iM; im++ ) {
+		uint64_t c = hufCode( hcode[im] );
+		int l = hufLength( hcode[im] );
+		if( c>>l ) return false;
+		if( l>decBits ) {
+			HufDec& pl = hdec[c>>(l-decBits)];
+			if( pl.len ) return false;
+			pl.lit++;
+			pl.p.push_back( im );
+		}
+		else if( l ) {
+			HufDec* pl = hdec+(c<<(decBits-l));
+			for( uint64_t i=1ull<<(decBits-l); i>0; i--, pl++ ) {
+				if( pl->len || !pl->p.empty() ) return false;
+				pl->len = l;
+				pl->lit = im;
+			}
+		}
+	}
+	return true;
+}
+
+static bool getCode( int po, int rlc, BitReader& br, uint16_t*& out, uint16_t* ob, uint16_t* oe ) {
+	if( po==rlc ) {
+		if( br.lc<8 ) br.getChar();
+		br.lc -= 8;
+		unsigned char cs = (unsigned char)( br.c>>br.lc );
+		if( out+cs>oe || out==ob ) return false;
+		uint16_t s = out[-1];
+		while( cs-->0 ) *out++ = s;
+	}
+	else if( out<oe ) *out++ = uint16_t(po);
+	else return false;
+	return true;
+}
+
+static bool decode( const uint64_t* hcode, const HufDec* hdec, const unsigned char* in, int nBits, int rlc,
+				   uint16_t* out, size_t nOut ) {
+	BitReader br{ in, in+(nBits+7)/8 };
+	uint16_t* ob = out;
+	uint16_t* oe = out+nOut;
+	while( br.in<br.end ) {
+		br.getChar();
+		while( br.lc>=decBits ) {
+			const HufDec& pl = hdec[(br.c>>(br.lc-decBits))&decMask];
+			if( pl.len ) {
+				br.lc -= pl.len;
+				if( !getCode( pl.lit, rlc, br, out, ob, oe ) ) return false;
+			}
+			else {
+				if( pl.p.empty() ) return false;
+				int j = 0;
+				for( ; j<pl.lit; j++ ) {
+					int l = hufLength( hcode[pl.p[j]] );
+					while( br.lc<l && br.in<br.end ) br.getChar();
+					if( br.lc>=l && hufCode( hcode[pl.p[j]] )==((br.c>>(br.lc-l))&((1ull<<l)-1)) ) {
+						br.lc -= l;
+						if( !getCode( pl.p[j], rlc, br, out, ob, oe ) ) return false;
+						break;
+					}
+				}
+				if( j==pl.lit ) return false;
+			}
+		}
+	}
+	int i = (8-nBits)&7;
+	br.c >>= i;
+	br.lc -= i;
+	while( br.lc>0 ) {
+		const HufDec& pl = hdec[(br.c<<(decBits-br.lc))&decMask];
+		if( !pl.len ) return false;
+		br.lc -= pl.len;
+		if( !getCode( pl.lit, rlc, br, out, ob, oe ) ) return false;
+	}
+	return size_t(out-ob)==nOut;
+}
+
+static bool hufUncompress( const unsigned char* in, size_t nIn, uint16_t* out, size_t nOut ) {
+	if( nIn==0 ) return nOut==0;
+	if( nIn<20 ) return false;
+	int im = readLE<int32_t>( in ), iM = readLE<int32_t>( in+4 );
+	int nBits = readLE<int32_t>( in+12 );
+	if( im<0 || im>=encSize || iM<0 || iM>=encSize ) return false;
+	BitReader br{ in+20, in+nIn };
+	std::vector<uint64_t> hcode( encSize, 0 );
+	if( !unpackEncTable( br, im, iM, hcode.data() ) ) return false;
+	const unsigned char* ptr = br.in;
+	if( nBits<0 || size_t(nBits)>8*size_t( in+nIn-ptr ) ) return false;
+	std::vector<HufDec> hdec( decSize );
+	if( !buildDecTable( hcode.data(), im, iM, hdec.data() ) ) return false;
+	return decode( hcode.data(), hdec.data(), ptr, nBits, iM, out, nOut );
+}
+
+static void wdec14( uint16_t l, uint16_t h, uint16_t& a, uint16_t& b ) {
+	int16_t ls = int16_t(l), hs = int16_t(h);
+	int hi = hs;
+	int ai = ls+(hi&1)+(hi>>1);
+	a = uint16_t( int16_t(ai) );
+	b = uint16_t( int16_t(ai-hi) );
+}
+
+static void wdec16( uint16_t l, uint16_t h, uint16_t& a, uint16_t& b ) {
+	int m = l, d = h;
+	int bb = (m-(d>>1))&0xffff;
+	int aa = (d+bb-0x8000)&0xffff;
+	b = uint16_t(bb);
+	a = uint16_t(aa);
+}
+
+static void wav2Decode( uint16_t* in, int nx, int ox, int ny, int oy, uint16_t mx ) {
+	bool w14 = mx<(1<<14);
+	auto dec = [w14]( uint16_t l, uint16_t h, uint16_t& a, uint16_t& b ) {
+		if( w14 ) wdec14( l, h, a, b ); else wdec16( l, h, a, b );
+	};
+	int n = nx>ny?ny:nx;
+	int p = 1;
+	while( p<=n ) p <<= 1;
+	p >>= 1;
+	int p2 = p;
+	p >>= 1;
+	while( p>=1 ) {
+		uint16_t* py = in;
+		uint16_t* ey = in+ptrdiff_t(oy)*(ny-p2);
+		int oy1 = oy*p, oy2 = oy*p2, ox1 = ox*p, ox2 = ox*p2;
+		uint16_t i00, i01, i10, i11;
+		for( ; py<=ey; py+=oy2 ) {
+			uint16_t* px = py;
+			uint16_t* ex = py+ptrdiff_t(ox)*(nx-p2);
+			for( ; px<=ex; px+=ox2 ) {
+				uint16_t* p01 = px+ox1;
+				uint16_t* p10 = px+oy1;
+				uint16_t* p11 = p10+ox1;
+				dec( *px, *p10, i00, i10 );
+				dec( *p01, *p11, i01, i11 );
+				dec( i00, i01, *px, *p01 );
+				dec( i10, i11, *p10, *p11 );
+			}
+			if( nx&p ) {
+				uint16_t* p10 = px+oy1;
+				dec( *px, *p10, i00, *p10 );
+				*px = i00;
+			}
+		}
+		if( ny&p ) {
+			uint16_t* px = py;
+			uint16_t* ex = py+ptrdiff_t(ox)*(nx-p2);
+			for( ; px<=ex; px+=ox2 ) {
+				uint16_t* p01 = px+ox1;
+				dec( *px, *p01, i00, *p01 );
+				*px = i00;
+			}
+		}
+		p2 = p;
+		p >>= 1;
+	}
+}
+
+static bool uncompress( const unsigned char* in, size_t nIn, const EXRHeader& hd, int nLines, unsigned char* out, size_t nOut ) {
+	if( nIn<4 ) return false;
+	uint8_t bitmap[bitmapSize] = {};
+	uint16_t minNonZero = readLE<uint16_t>( in ), maxNonZero = readLE<uint16_t>( in+2 );
+	if( maxNonZero>=bitmapSize ) return false;
+	const unsigned char* p = in+4;
+	const unsigned char* end = in+nIn;
+	if( minNonZero<=maxNonZero ) {
+		if( p+maxNonZero-minNonZero+1>end ) return false;
+		memcpy( bitmap+minNonZero, p, maxNonZero-minNonZero+1 );
+		p += maxNonZero-minNonZero+1;
+	}
+	std::vector<uint16_t> lut( ushortRange );
+	int k = 0;
+	for( int i=0; i<ushortRange; i++ ) if( i==0 || (bitmap[i>>3]&(1<<(i&7))) ) lut[k++] = uint16_t(i);
+	uint16_t maxValue = uint16_t(k-1);
+	if( p+4>end ) return false;
+	uint32_t length = readLE<uint32_t>( p );
+	p += 4;
+	if( p+length>end ) return false;
+	std::vector<uint16_t> tmp( nOut/2 );
+	if( !hufUncompress( p, length, tmp.data(), tmp.size() ) ) return false;
+
+	// every channel is one plane of nLines rows; 32-bit samples are two 16-bit values
+	std::vector<uint16_t*> planes;
+	uint16_t* q = tmp.data();
+	for( auto& c: hd.channels ) {
+		int size = c.bytes()/2;
+		planes.push_back( q );
+		for( int j=0; j<size; j++ ) wav2Decode( q+j, hd.width, size, nLines, hd.width*size, maxValue );
+		q += size_t(hd.width)*nLines*size;
+	}
+	for( auto& v: tmp ) v = lut[v];
+	for( int y=0; y<nLines; y++ ) {
+		for( size_t i=0; i<hd.channels.size(); i++ ) {
+			size_t n = size_t(hd.width)*hd.channels[i].bytes()/2;
+			memcpy( out, planes[i], n*2 );
+			out += n*2;
+			planes[i] += n;
+		}
+	}
+	return true;
+}
+
+}
+
+// Chunk into 'lines': nLines scanlines, each with every channel's row in turn.
+static bool decompressChunk( const EXRHeader& hd, const unsigned char* in, size_t nIn, int nLines,
+							std::vector<unsigned char>& lines, std::vector<unsigned char>& tmp ) {
+	size_t nOut = hd.lineBytes()*nLines;
+	lines.resize( nOut );
+	if( nIn==nOut ) {				// stored when compression would not pay off
+		memcpy( lines.data(), in, nIn );
+		return true;
+	}
+	switch( hd.compression ) {
+		case EXR_RLE:
+			tmp.resize( nOut );
+			if( !decodeRLE( in, nIn, tmp ) ) return false;
+			undoPredictor( tmp, lines.data(), nOut );
+			return true;
+		case EXR_ZIPS: case EXR_ZIP:
+			tmp.resize( nOut );
+			if( stbi_zlib_decode_buffer( (char*)tmp.data(), int(nOut), (const char*)in, int(nIn) )!=int(nOut) ) return false;
+			undoPredictor( tmp, lines.data(), nOut );
+			return true;
+		case EXR_PIZ:
+			return piz::uncompress( in, nIn, hd, nLines, lines.data(), nOut );
+		default:
+			return false;
+	}
+}
+
+void* loadEXRFromMemory( const unsigned char* data, size_t size, int* w, int* h, int* nChannels,
+						bool* isHalf, ThreadPool& pool ) {
+	EXRHeader hd;
+	if( !parseHeader( data, size, hd ) ) {
+		fprintf( stderr, "[ERROR] EXR: %s\n", exrError );
+		return nullptr;
+	}
+	int n = hd.nPicked;
+	bool half = true;
+	for( int k=0; k<n; k++ ) half = half && hd.channels[hd.pick[k]].type==EXR_HALF;
+	int nChunks = (hd.height+hd.linesPerChunk-1)/hd.linesPerChunk;
+	if( hd.offsetTable+size_t(nChunks)*8>size ) {
+		fprintf( stderr, "[ERROR] EXR: truncated offset table\n" );
+		return nullptr;
+	}
+	size_t sampleBytes = half?2:4;
+	size_t rowBytes = size_t(hd.width)*n*sampleBytes;
+	unsigned char* pixels = (unsigned char*)malloc( rowBytes*hd.height );
+	if( !pixels ) return nullptr;
+	// byte offset of every picked channel inside a decoded scanline
+	size_t chanOffset[4] = {};
+	for( int k=0; k<n; k++ ) {
+		for( int i=0; i<hd.pick[k]; i++ ) chanOffset[k] += size_t(hd.width)*hd.channels[i].bytes();
+	}
+
+	std::atomic<int> failed( 0 );
+	pool.parallelFor( 0, nChunks, [&]( int i ) {
+		if( failed ) return;
+		uint64_t offset = readLE<uint64_t>( data+hd.offsetTable+size_t(i)*8 );
+		if( offset+8>size ) { failed = 1; return; }
+		int y0 = readLE<int32_t>( data+offset )-hd.yMin;
+		uint32_t nIn = readLE<uint32_t>( data+offset+4 );
+		if( y0<0 || y0>=hd.height || offset+8+nIn>size ) { failed = 1; return; }
+		int nLines = std::min( hd.linesPerChunk, hd.height-y0 );
+		std::vector<unsigned char> lines, tmp;
+		if( !decompressChunk( hd, data+offset+8, nIn, nLines, lines, tmp ) ) { failed = 1; return; }
+		for( int l=0; l<nLines; l++ ) {
+			const unsigned char* line = lines.data()+hd.lineBytes()*l;
+			unsigned char* dst = pixels+rowBytes*(hd.height-1-(y0+l));
+			for( int k=0; k<n; k++ ) {
+				const unsigned char* src = line+chanOffset[k];
+				int type = hd.channels[hd.pick[k]].type;
+				if( half ) {
+					uint16_t* d = (uint16_t*)dst+k;
+					for( int x=0; x<hd.width; x++, d+=n ) memcpy( d, src+x*2, 2 );
+				}
+				else {
+					float* d = (float*)dst+k;
+					for( int x=0; x<hd.width; x++, d+=n ) {
+						if( type==EXR_HALF )		*d = halfToFloat( readLE<uint16_t>( src+x*2 ) );
+						else if( type==EXR_FLOAT )	memcpy( d, src+x*4, 4 );
+						else						*d = float( readLE<uint32_t>( src+x*4 ) );
+					}
+				}
+			}
+		}
+	} );
+	if( failed ) {
+		fprintf( stderr, "[ERROR] EXR: corrupt or unsupported chunk\n" );
+		free( pixels );
+		return nullptr;
+	}
+	*w = hd.width;
+	*h = hd.height;
+	*nChannels = n;
+	*isHalf = half;
+	return pixels;
+}
+
+}
@@ -0,0 +1,29 @@
+//
+//  EXR.hpp
+//  AR_Framework
+//
+
+#ifndef EXR_hpp
+#define EXR_hpp
+
+#include "Tools/ThreadPool.hpp"
+#include <cstddef>
+
+namespace AR {
+
+// OpenEXR reader for single-part scanline images with NONE, RLE, ZIPS, ZIP or
+// PIZ compression. Picks the R, G, B and A channels (or Y) of the first layer.
+
+extern bool isEXR( const unsigned char* data, size_t size );
+extern bool infoEXR( const unsigned char* data, size_t size, int* w, int* h, int* nChannels );
+
+// Works like stbi_loadf_from_memory: returns interleaved pixels from malloc,
+// bottom row first. When every picked channel is HALF the pixels stay 16-bit
+// halves and 'isHalf' is set, otherwise they are 32-bit floats. Chunks are
+// decompressed over the pool.
+extern void* loadEXRFromMemory( const unsigned char* data, size_t size, int* w, int* h, int* nChannels,
+							   bool* isHalf, ThreadPool& pool=ThreadPool::shared() );
+
+}
+
+#endif /* EXR_hpp */
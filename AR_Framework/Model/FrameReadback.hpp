@@ -0,0 +1,228 @@
+//
+//  FrameReadback.hpp
+//  AR_Framework
+//
+
+#ifndef FrameReadback_hpp
+#define FrameReadback_hpp
+
+#include "Tools/gl.hpp"
+#include "Tools/ThreadPool.hpp"
+#include <cstring>
+
+namespace AR {
+
+// Host buffers recycled between readbacks, so capturing every frame does not
+// allocate. Shared with the PixelBuffers handed out, which may outlive the ring.
+struct HostBufferPool {
+	std::mutex mtx;
+	std::vector<std::vector<unsigned char>> free;
+	size_t maxFree = 8;
+
+	std::vector<unsigned char> acquire( size_t bytes ) {
+		std::lock_guard<std::mutex> lock( mtx );
+		for( size_t i=0; i<free.size(); i++ ) {
+			if( free[i].capacity()<bytes ) continue;
+			std::vector<unsigned char> b = std::move( free[i] );
+			free.erase( free.begin()+i );
+			b.resize( bytes );
+			return b;
+		}
+		return std::vector<unsigned char>( bytes );
+	}
+	void release( std::vector<unsigned char>&& b ) {
+		if( b.empty() ) return;
+		std::lock_guard<std::mutex> lock( mtx );
+		if( free.size()<maxFree ) free.push_back( std::move( b ) );
+	}
+};
+
+// Result of one readback, rows bottom-up and tightly packed, empty when the
+// pack buffer could not be mapped. The memory goes back to the pool when the
+// buffer is destroyed.
+struct PixelBuffer {
+	int width = 0, height = 0, nChannels = 0;
+	GLenum format = 0, type = 0;
+	std::vector<unsigned char> data;
+	std::shared_ptr<HostBufferPool> pool;
+
+	PixelBuffer() {}
+	PixelBuffer( PixelBuffer&& a ) = default;
+	PixelBuffer& operator=( PixelBuffer&& a ) {
+		recycle();
+		width = a.width; height = a.height; nChannels = a.nChannels;
+		format = a.format; type = a.type;
+		data = std::move( a.data ); pool = std::move( a.pool );
+		return *this;
+	}
+	~PixelBuffer() { recycle(); }
+	bool empty() const { return data.empty(); }
+	template<typename T> const T* as() const { return (const T*)data.data(); }
+	template<typename T> T* as() { return (T*)data.data(); }
+protected:
+	void recycle() { if( pool ) pool->release( std::move( data ) ); }
+};
+
+// Ring of pixel pack buffers. read() queues glReadPixels into a free slot and
+// returns a future; update(), called once a frame on the GL thread, maps the
+// slots whose fence has signalled and copies them out on the thread pool, so
+// neither the GL thread nor the GPU waits for the other.
+struct FrameReadback {
+	struct Slot {
+		GLuint pbo = 0;
+		size_t size = 0;
+		GLsync fence = 0;
+		bool busy = false;
+	};
+	struct Job {
+		int slot;
+		PixelBuffer result;
+		size_t bytes;
+		std::shared_ptr<std::promise<PixelBuffer>> promise;
+		std::future<void> copied;		// valid once the copy has started
+		bool mapped = false;
+	};
+	int maxSlots = 6;					// beyond this read() waits for the oldest fence
+	std::vector<Slot> slots;
+	std::deque<Job> jobs;
+	std::shared_ptr<HostBufferPool> pool = std::make_shared<HostBufferPool>();
+
+	FrameReadback() {}
+	FrameReadback( FrameReadback&& a ) = default;
+	~FrameReadback() { release(); }
+
+	void release() {
+		for( auto& j: jobs ) if( j.copied.valid() ) j.copied.wait();
+		for( auto& s: slots ) {
+			if( s.fence ) glDeleteSync( s.fence );
+			if( s.pbo ) glDeleteBuffers( 1, &s.pbo );
+		}
+		jobs.clear();			// broken promises for whatever was still queued
+		slots.clear();
+	}
+
+	// Reads a region of the bound read framebuffer, GL_DEPTH_COMPONENT for depth.
+	std::future<PixelBuffer> read( GLint x, GLint y, GLsizei w, GLsizei h, GLenum format, GLenum type, int nChannels ) {
+		size_t bytes = size_t(w)*h*nChannels*bytesPerComponent( type );
+		GLint oldAlign = 4, oldPack = 0;
+		glGetIntegerv( GL_PACK_ALIGNMENT, &oldAlign );
+		glGetIntegerv( GL_PIXEL_PACK_BUFFER_BINDING, &oldPack );
+		int si = freeSlot();
+		Slot& s = slots[si];
+		glPixelStorei( GL_PACK_ALIGNMENT, 1 );
+		glBindBuffer( GL_PIXEL_PACK_BUFFER, s.pbo );
+		if( s.size<bytes ) {
+			glBufferData( GL_PIXEL_PACK_BUFFER, bytes, nullptr, GL_STREAM_READ );
+			s.size = bytes;
+		}
+		glReadPixels( x, y, w, h, format, type, nullptr );
+		glBindBuffer( GL_PIXEL_PACK_BUFFER, oldPack );
+		glPixelStorei( GL_PACK_ALIGNMENT, oldAlign );
+		s.fence = glFenceSync( GL_SYNC_GPU_COMMANDS_COMPLETE, 0 );
+		s.busy = true;
+
+		Job j;
+		j.slot = si;
+		j.bytes = bytes;
+		j.result.width = w;
+		j.result.height = h;
+		j.result.nChannels = nChannels;
+		j.result.format = format;
+		j.result.type = type;
+		j.promise = std::make_shared<std::promise<PixelBuffer>>();
+		std::future<PixelBuffer> ret = j.promise->get_future();
+		jobs.push_back( std::move( j ) );
+		return ret;
+	}
+
+	// Polls the fences without blocking. Copies start in queue order.
+	void update() {
+		GLint oldPack = 0;
+		glGetIntegerv( GL_PIXEL_PACK_BUFFER_BINDING, &oldPack );
+		for( auto& j: jobs ) {
+			if( j.copied.valid() ) continue;
+			Slot& s = slots[j.slot];
+			if( glClientWaitSync( s.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0 )==GL_TIMEOUT_EXPIRED ) break;
+			startCopy( j );
+		}
+		while( !jobs.empty() && jobs.front().copied.valid()
+			  && jobs.front().copied.wait_for( std::chrono::seconds(0) )==std::future_status::ready ) {
+			finish( jobs.front() );
+			jobs.pop_front();
+		}
+		glBindBuffer( GL_PIXEL_PACK_BUFFER, oldPack );
+	}
+	// Blocks until every queued readback has been delivered.
+	void flush() {
+		GLint oldPack = 0;
+		glGetIntegerv( GL_PIXEL_PACK_BUFFER_BINDING, &oldPack );
+		while( !jobs.empty() ) flushFront();
+		glBindBuffer( GL_PIXEL_PACK_BUFFER, oldPack );
+	}
+	size_t pending() const { return jobs.size(); }
+
+	static size_t bytesPerComponent( GLenum type ) {
+		switch( type ) {
+			case GL_FLOAT: case GL_INT: case GL_UNSIGNED_INT:	return 4;
+			case GL_HALF_FLOAT: case GL_SHORT: case GL_UNSIGNED_SHORT:	return 2;
+			default:											return 1;
+		}
+	}
+
+protected:
+	int freeSlot() {
+		for( int i=0; i<int(slots.size()); i++ ) if( !slots[i].busy ) return i;
+		if( int(slots.size())<maxSlots ) {
+			slots.emplace_back();
+			glGenBuffers( 1, &slots.back().pbo );
+			return int(slots.size())-1;
+		}
+		// Ring exhausted: the caller reads faster than the GPU delivers.
+		int si = jobs.front().slot;
+		flushFront();
+		return si;
+	}
+	void flushFront() {
+		Job& j = jobs.front();
+		if( !j.copied.valid() ) {
+			glClientWaitSync( slots[j.slot].fence, GL_SYNC_FLUSH_COMMANDS_BIT, GLuint64(1e10) );
+			startCopy( j );
+		}
+		j.copied.wait();
+		finish( j );
+		jobs.pop_front();
+	}
+	void startCopy( Job& j ) {
+		Slot& s = slots[j.slot];
+		glDeleteSync( s.fence );
+		s.fence = 0;
+		glBindBuffer( GL_PIXEL_PACK_BUFFER, s.pbo );
+		const unsigned char* src = (const unsigned char*)glMapBufferRange( GL_PIXEL_PACK_BUFFER, 0, j.bytes, GL_MAP_READ_BIT );
+		if( !src ) {				// delivered without data, see PixelBuffer::empty()
+			fprintf( stderr, "[ERROR] Cannot map the readback buffer\n" );
+			std::promise<void> done;
+			done.set_value();
+			j.copied = done.get_future();
+			return;
+		}
+		j.mapped = true;
+		j.result.data = pool->acquire( j.bytes );
+		j.result.pool = pool;
+		unsigned char* dst = j.result.data.data();
+		size_t bytes = j.bytes;
+		j.copied = ThreadPool::shared().push( [src, dst, bytes](){ memcpy( dst, src, bytes ); } );
+	}
+	void finish( Job& j ) {
+		Slot& s = slots[j.slot];
+		if( j.mapped ) {
+			glBindBuffer( GL_PIXEL_PACK_BUFFER, s.pbo );
+			glUnmapBuffer( GL_PIXEL_PACK_BUFFER );
+		}
+		s.busy = false;
+		j.promise->set_value( std::move( j.result ) );
+	}
+};
+
+}
+
+#endif /* FrameReadback_hpp */
@@ -0,0 +1,284 @@
+//
+//  HDRFormat.cpp
+//  AR_Framework
+//
+
+#include "HDRFormat.hpp"
+#include "Tools/SIMD.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#if defined(AR_SIMD_SSE) && defined(__F16C__)
+#include <immintrin.h>
+#endif
+
+namespace AR {
+
+static const float halfMax = 65504.f;
+
+static uint32_t asUint( float f ) { uint32_t u; memcpy( &u, &f, 4 ); return u; }
+static float asFloat( uint32_t u ) { float f; memcpy( &f, &u, 4 ); return f; }
+
+const PixelFormat* hdrPixelFormat( HDRFormat format, int nChannels ) {
+	if( nChannels!=3 && format!=HDRFormat::Float ) format = HDRFormat::Half;
+	switch( format ) {
+		case HDRFormat::R11G11B10F:	return findPixelFormat( 122 );
+		case HDRFormat::RGB9E5:		return findPixelFormat( 123 );
+		case HDRFormat::Half:		return findPixelFormat( GL_HALF_FLOAT, nChannels, false );
+		case HDRFormat::Float:
+		default:					return findPixelFormat( GL_FLOAT, nChannels, false );
+	}
+}
+
+const char* hdrFormatName( HDRFormat format ) {
+	switch( format ) {
+		case HDRFormat::Half:		return "RGB16F";
+		case HDRFormat::R11G11B10F:	return "R11G11B10F";
+		case HDRFormat::RGB9E5:		return "RGB9E5";
+		case HDRFormat::Float:
+		default:					return "RGB32F";
+	}
+}
+
+void HDRPackReport::add( const HDRPackReport& r ) {
+	size_t n = pixels+r.pixels;
+	if( n>0 ) meanRelError = float( (double(meanRelError)*pixels+double(r.meanRelError)*r.pixels)/n );
+	maxRelError = std::max( maxRelError, r.maxRelError );
+	clamped += r.clamped;
+	pixels = n;
+	srcBytes += r.srcBytes;
+	dstBytes += r.dstBytes;
+}
+
+void HDRPackReport::print( const char* name, HDRFormat format ) const {
+	printf("packed:%s %s %.2f MB -> %.2f MB, rel. error max %.2e mean %.2e, %zu clamped\n", name, hdrFormatName( format ),
+		   srcBytes/1048576.0, dstBytes/1048576.0, maxRelError, meanRelError, clamped );
+}
+
+// Round to nearest even, finite values above the range become Inf, NaN stays NaN.
+uint16_t floatToHalf( float f ) {
+	const uint32_t f32infty = 255u<<23, f16max = (127u+16)<<23;
+	const uint32_t denormMagic = ((127u-15)+(23-10)+1)<<23;
+	uint32_t u = asUint( f );
+	uint32_t sign = u&0x80000000u;
+	u ^= sign;
+	uint16_t o;
+	if( u>=f16max )
+		o = u>f32infty?0x7e00:0x7c00;
+	else if( u<(113u<<23) )			// subnormal or zero: let the FPU round
+		o = uint16_t( asUint( asFloat( u )+asFloat( denormMagic ) )-denormMagic );
+	else {
+		uint32_t mantOdd = (u>>13)&1;
+		u += (uint32_t(15-127)<<23)+0xfff;
+		u += mantOdd;
+		o = uint16_t( u>>13 );
+	}
+	return o|uint16_t( sign>>16 );
+}
+
+float halfToFloat( uint16_t h ) {
+	const uint32_t shiftedExp = 0x7c00u<<13;
+	uint32_t o = uint32_t(h&0x7fff)<<13;
+	uint32_t exp = shiftedExp&o;
+	o += uint32_t(127-15)<<23;
+	if( exp==shiftedExp )	o += uint32_t(128-16)<<23;
+	else if( exp==0 )		o = asUint( asFloat( o+(1u<<23) )-asFloat( 113u<<23 ) );
+	return asFloat( o|(uint32_t(h&0x8000)<<16) );
+}
+
+// Finite and inside the half range, NaN becomes 0.
+static float sanitizeHalf( float f ) {
+	return f==f?std::min( std::max( f, -halfMax ), halfMax ):0.f;
+}
+
+void floatToHalf( const float* src, uint16_t* dst, size_t n ) {
+	size_t i = 0;
+#if defined(AR_SIMD_SSE)
+	const __m128 lo = _mm_set1_ps( -halfMax ), hi = _mm_set1_ps( halfMax );
+	for( ; i+4<=n; i+=4 ) {
+		__m128 x = _mm_loadu_ps( src+i );
+		x = _mm_and_ps( x, _mm_cmpord_ps( x, x ) );
+		x = _mm_min_ps( _mm_max_ps( x, lo ), hi );
+#if defined(__F16C__)
+		_mm_storel_epi64( (__m128i*)(dst+i), _mm_cvtps_ph( x, _MM_FROUND_TO_NEAREST_INT ) );
+#else
+		// Same as floatToHalf() without the Inf/NaN branch, which the clamp rules out.
+		const __m128i denormMagic = _mm_set1_epi32( ((127-15)+(23-10)+1)<<23 );
+		__m128i u = _mm_castps_si128( x );
+		__m128i sign = _mm_and_si128( u, _mm_set1_epi32( int(0x80000000u) ) );
+		u = _mm_xor_si128( u, sign );
+		__m128i sub = _mm_sub_epi32( _mm_castps_si128( _mm_add_ps( _mm_castsi128_ps( u ), _mm_castsi128_ps( denormMagic ) ) ), denormMagic );
+		__m128i mantOdd = _mm_and_si128( _mm_srli_epi32( u, 13 ), _mm_set1_epi32( 1 ) );
+		__m128i nrm = _mm_add_epi32( u, _mm_set1_epi32( int( (uint32_t(15-127)<<23)+0xfff ) ) );
+		nrm = _mm_srli_epi32( _mm_add_epi32( nrm, mantOdd ), 13 );
+		__m128i isSub = _mm_cmplt_epi32( u, _mm_set1_epi32( 113<<23 ) );
+		__m128i o = _mm_or_si128( _mm_and_si128( isSub, sub ), _mm_andnot_si128( isSub, nrm ) );
+		o = _mm_or_si128( o, _mm_srli_epi32( sign, 16 ) );
+		// packs_epi32 saturates signed, so bias into the signed range and back
+		o = _mm_packs_epi32( _mm_sub_epi32( o, _mm_set1_epi32( 0x8000 ) ), _mm_setzero_si128() );
+		_mm_storel_epi64( (__m128i*)(dst+i), _mm_add_epi16( o, _mm_set1_epi16( short(0x8000) ) ) );
+#endif
+	}
+#elif defined(AR_SIMD_NEON) && defined(__aarch64__)
+	const float32x4_t lo = vdupq_n_f32( -halfMax ), hi = vdupq_n_f32( halfMax );
+	for( ; i+4<=n; i+=4 ) {
+		float32x4_t x = vld1q_f32( src+i );
+		x = vreinterpretq_f32_u32( vandq_u32( vreinterpretq_u32_f32( x ), vceqq_f32( x, x ) ) );
+		x = vminq_f32( vmaxq_f32( x, lo ), hi );
+		vst1_u16( dst+i, vreinterpret_u16_f16( vcvt_f16_f32( x ) ) );
+	}
+#endif
+	for( ; i<n; i++ ) dst[i] = floatToHalf( sanitizeHalf( src[i] ) );
+}
+
+void halfToFloat( const uint16_t* src, float* dst, size_t n ) {
+	size_t i = 0;
+#if defined(AR_SIMD_SSE) && defined(__F16C__)
+	for( ; i+4<=n; i+=4 ) _mm_storeu_ps( dst+i, _mm_cvtph_ps( _mm_loadl_epi64( (const __m128i*)(src+i) ) ) );
+#elif defined(AR_SIMD_NEON) && defined(__aarch64__)
+	for( ; i+4<=n; i+=4 ) vst1q_f32( dst+i, vcvt_f32_f16( vreinterpret_f16_u16( vld1_u16( src+i ) ) ) );
+#endif
+	for( ; i<n; i++ ) dst[i] = halfToFloat( src[i] );
+}
+
+// Unsigned float with a 5-bit exponent (bias 15) and 'm' mantissa bits.
+static uint32_t packUFloat( float f, int m ) {
+	if( !(f>0) ) return 0;
+	uint32_t maxCode = (30u<<m)|((1u<<m)-1);
+	uint32_t u = asUint( f );
+	int e = int(u>>23)-127;
+	if( e>15 ) return maxCode;
+	if( e<-14 ) return uint32_t( lrintf( ldexpf( f, 14+m ) ) );		// may round up into the first normal
+	int shift = 23-m;
+	uint32_t v = (u&0x7fffff)|(uint32_t(e+15)<<23);
+	v += ((1u<<(shift-1))-1)+((v>>shift)&1);
+	return std::min( v>>shift, maxCode );
+}
+
+static float unpackUFloat( uint32_t v, int m ) {
+	uint32_t e = v>>m, mant = v&((1u<<m)-1);
+	if( e==0 ) return ldexpf( float(mant), -14-m );
+	return ldexpf( 1.f+mant/float(1u<<m), int(e)-15 );
+}
+
+static float ufloatMax( int m ) { return ldexpf( 2.f-ldexpf( 1.f, -m ), 15 ); }
+
+static uint32_t packR11G11B10F( const float* c ) {
+	return packUFloat( c[0], 6 )|(packUFloat( c[1], 6 )<<11)|(packUFloat( c[2], 5 )<<22);
+}
+
+static void unpackR11G11B10F( uint32_t v, float* c ) {
+	c[0] = unpackUFloat( v&0x7ff, 6 );
+	c[1] = unpackUFloat( (v>>11)&0x7ff, 6 );
+	c[2] = unpackUFloat( v>>22, 5 );
+}
+
+// EXT_texture_shared_exponent, N=9 mantissa bits, exponent bias 15.
+static const float rgb9e5Max = 511.f/512.f*65536.f;
+
+static uint32_t packRGB9E5( const float* c ) {
+	float rc[3];
+	for( int i=0; i<3; i++ ) rc[i] = c[i]>0?std::min( c[i], rgb9e5Max ):0.f;		// NaN fails c>0
+	float maxc = std::max( rc[0], std::max( rc[1], rc[2] ) );
+	int expShared = 0;
+	if( maxc>0 ) {
+		int floorLog2 = int(asUint( maxc )>>23)-127;
+		expShared = std::max( -16, floorLog2 )+1+15;
+		if( floorf( maxc*asFloat( uint32_t(127+9+15-expShared)<<23 )+0.5f )==512 ) expShared++;
+	}
+	float scale = asFloat( uint32_t(127+9+15-expShared)<<23 );
+	uint32_t v = uint32_t(expShared)<<27;
+	for( int i=0; i<3; i++ )
+		v |= uint32_t( floorf( rc[i]*scale+0.5f ) )<<(9*i);
+	return v;
+}
+
+static void unpackRGB9E5( uint32_t v, float* c ) {
+	float scale = asFloat( uint32_t(127-15-9+int(v>>27))<<23 );
+	for( int i=0; i<3; i++ ) c[i] = float( (v>>(9*i))&0x1ff )*scale;
+}
+
+std::vector<unsigned char> packHDR( const float* src, int w, int h, int nChannels, HDRFormat format,
+								   HDRPackReport* report, ThreadPool& pool ) {
+	const PixelFormat* pf = hdrPixelFormat( format, nChannels );
+	if( !pf || w<1 || h<1 ) return {};
+	if( pf->type==GL_HALF_FLOAT ) format = HDRFormat::Half;
+	size_t rowValues = size_t(w)*nChannels;
+	size_t rowBytes = size_t(w)*pf->blockBytes;
+	std::vector<unsigned char> out( rowBytes*h );
+	struct RowStats { float maxErr = 0; double sumErr = 0; size_t clamped = 0; };
+	std::vector<RowStats> stats( report?h:0 );
+	float hi = format==HDRFormat::Half?halfMax:format==HDRFormat::RGB9E5?rgb9e5Max:ufloatMax( 6 );
+	float lo = format==HDRFormat::Half?-halfMax:0.f;
+
+	pool.parallelFor( 0, h, [&]( int y ) {
+		const float* s = src+y*rowValues;
+		unsigned char* d = out.data()+y*rowBytes;
+		switch( format ) {
+			case HDRFormat::Float:		memcpy( d, s, rowBytes ); break;
+			case HDRFormat::Half:		floatToHalf( s, (uint16_t*)d, rowValues ); break;
+			case HDRFormat::R11G11B10F:
+				for( int x=0; x<w; x++ ) { uint32_t v = packR11G11B10F( s+x*3 ); memcpy( d+x*4, &v, 4 ); }
+				break;
+			case HDRFormat::RGB9E5:
+				for( int x=0; x<w; x++ ) { uint32_t v = packRGB9E5( s+x*3 ); memcpy( d+x*4, &v, 4 ); }
+				break;
+		}
+		if( !report ) return;
+		RowStats& st = stats[y];
+		for( int x=0; x<w; x++ ) {
+			const float* p = s+x*nChannels;
+			float c[4] = { 0, 0, 0, 0 };
+			if( format==HDRFormat::Float ) memcpy( c, p, nChannels*sizeof(float) );
+			else if( format==HDRFormat::Half ) {
+				const uint16_t* hp = (const uint16_t*)d+x*nChannels;
+				for( int i=0; i<nChannels; i++ ) c[i] = halfToFloat( hp[i] );
+			}
+			else {
+				uint32_t v;
+				memcpy( &v, d+x*4, 4 );
+				if( format==HDRFormat::RGB9E5 ) unpackRGB9E5( v, c );
+				else unpackR11G11B10F( v, c );
+			}
+			float peak = 0, err = 0;
+			for( int i=0; i<nChannels; i++ ) {
+				if( !(p[i]>=lo && p[i]<=hi) ) st.clamped++;
+				float ref = std::min( std::max( p[i], lo ), hi );
+				peak = std::max( peak, fabsf( ref ) );
+				err = std::max( err, fabsf( c[i]-ref ) );
+			}
+			float rel = err/std::max( peak, 6.1035e-5f );		// below the smallest normal half it is absolute
+			st.maxErr = std::max( st.maxErr, rel );
+			st.sumErr += rel;
+		}
+	}, 8 );
+
+	if( report ) {
+		HDRPackReport r;
+		double sum = 0;
+		for( auto& st: stats ) {
+			r.maxRelError = std::max( r.maxRelError, st.maxErr );
+			r.clamped += st.clamped;
+			sum += st.sumErr;
+		}
+		r.pixels = size_t(w)*h;
+		r.meanRelError = float( sum/r.pixels );
+		r.srcBytes = rowValues*h*sizeof(float);
+		r.dstBytes = out.size();
+		report->add( r );
+	}
+	return out;
+}
+
+uint32_t packHDR( std::vector<MipLevel>& levels, int nChannels, HDRFormat format, HDRPackReport* report, ThreadPool& pool ) {
+	const PixelFormat* pf = hdrPixelFormat( format, nChannels );
+	if( !pf ) return 0;
+	for( auto& l: levels ) {
+		if( l.data.size()!=size_t(l.width)*l.height*nChannels*sizeof(float) ) return 0;
+	}
+	for( auto& l: levels )
+		l.data = packHDR( (const float*)l.data.data(), l.width, l.height, nChannels, format, report, pool );
+	return pf->vkFormat;
+}
+
+}
@@ -0,0 +1,50 @@
+//
+//  HDRFormat.hpp
+//  AR_Framework
+//
+
+#ifndef HDRFormat_hpp
+#define HDRFormat_hpp
+
+#include "TextureFormat.hpp"
+#include "Tools/ThreadPool.hpp"
+
+namespace AR {
+
+// GPU storage of float images. The packed formats drop alpha and negatives:
+//   Half		 16 bits per channel, 11 significant bits, up to 65504
+//   R11G11B10F 32 bits per pixel, 7/7/6 significant bits, up to 65024
+//   RGB9E5		 32 bits per pixel, 9-bit mantissas sharing one exponent, up to 65408
+enum class HDRFormat { Float, Half, R11G11B10F, RGB9E5 };
+
+// Formats with alpha (or fewer than three channels) fall back to Half.
+extern const PixelFormat* hdrPixelFormat( HDRFormat format, int nChannels );
+extern const char* hdrFormatName( HDRFormat format );
+
+// Error of the packed data against the float source. Errors are relative to the
+// brightest channel of each pixel (at least 2^-14); 'clamped' counts values
+// outside the range.
+struct HDRPackReport {
+	float maxRelError = 0, meanRelError = 0;
+	size_t clamped = 0, pixels = 0;
+	size_t srcBytes = 0, dstBytes = 0;
+	void add( const HDRPackReport& r );
+	void print( const char* name, HDRFormat format ) const;
+};
+
+extern uint16_t floatToHalf( float f );
+extern float halfToFloat( uint16_t h );
+// Half conversion of n floats, four at a time with F16C/NEON or SSE2 integer code.
+extern void floatToHalf( const float* src, uint16_t* dst, size_t n );
+extern void halfToFloat( const uint16_t* src, float* dst, size_t n );
+
+// Packs a float image, rows are spread over the pool. 'report' may be null.
+extern std::vector<unsigned char> packHDR( const float* src, int w, int h, int nChannels, HDRFormat format,
+										  HDRPackReport* report=nullptr, ThreadPool& pool=ThreadPool::shared() );
+// Converts a float mip chain (2D or cube) in place, returns its new vkFormat or 0.
+extern uint32_t packHDR( std::vector<MipLevel>& levels, int nChannels, HDRFormat format,
+						HDRPackReport* report=nullptr, ThreadPool& pool=ThreadPool::shared() );
+
+}
+
+#endif /* HDRFormat_hpp */
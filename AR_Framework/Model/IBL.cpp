@@ -0,0 +1,403 @@
+//
+//  IBL.cpp
+//  AR_Framework
+//
+
+#include "IBL.hpp"
+#include "Tools/SIMD.hpp"
+#include <chrono>
+
+namespace AR {
+
+static constexpr vec2 hammersley( uint32_t i, uint32_t n ) {
+	uint32_t b = i;
+	b = (b<<16) | (b>>16);
+	b = ((b&0x55555555u)<<1) | ((b&0xAAAAAAAAu)>>1);
+	b = ((b&0x33333333u)<<2) | ((b&0xCCCCCCCCu)>>2);
+	b = ((b&0x0F0F0F0Fu)<<4) | ((b&0xF0F0F0F0u)>>4);
+	b = ((b&0x00FF00FFu)<<8) | ((b&0xFF00FF00u)>>8);
+	return vec2( i/float(n), b*2.3283064365386963e-10f );
+}
+
+// The point sets of the default sample counts, filled in at compile time.
+template<int N> struct HammersleySet {
+	vec2 p[N];
+	constexpr HammersleySet(): p{} { for( int i=0; i<N; i++ ) p[i] = hammersley( i, N ); }
+};
+static constexpr HammersleySet<256> hammersley256;
+static constexpr HammersleySet<512> hammersley512;
+static_assert( hammersley256.p[1].y==.5f && hammersley512.p[6].y==.375f, "bit reversal" );
+
+static const vec2* hammersleySet( int n ) {
+	return n==256?hammersley256.p:n==512?hammersley512.p:nullptr;
+}
+
+// Equirect layout of the loaded HDRs: u follows atan2(z,x), v goes from +y down to -y.
+static void dirToUV( float x, float y, float z, float& u, float& v ) {
+	u = (atan2f( z, x )+float(PI))/(2*float(PI));
+	v = acosf( std::min( std::max( y, -1.f ), 1.f ) )/float(PI);
+}
+
+// Four directions at once through jm::fast, acos(y) taken as atan2(sqrt(1-y*y),y).
+static void dirToUV( const float4& x, const float4& y, const float4& z, float u[4], float v[4] ) {
+#if (defined(AR_SIMD_SSE) && defined(JM_SIMD_SSE)) || (defined(AR_SIMD_NEON) && defined(JM_SIMD_NEON))
+	float4 s = sqrt( max( float4( 1.f )-y*y, float4( 0.f ) ) );
+	((float4( fast::atan2( z.v, x.v ) )+float4( float(PI) ))*float4( .5f/float(PI) )).store( u );
+	(float4( fast::atan2( s.v, y.v ) )*float4( 1/float(PI) )).store( v );
+#else
+	float dx[4], dy[4], dz[4];
+	x.store( dx ); y.store( dy ); z.store( dz );
+	for( int k=0; k<4; k++ ) dirToUV( dx[k], dy[k], dz[k], u[k], v[k] );
+#endif
+}
+
+static float4 loadRGB( const float* p, int n ) {
+	return n>=4?float4::load( p ):float4( p[0], p[1], p[2], 0 );
+}
+static float sum( const float4& a ) {
+	float t[4];
+	a.store( t );
+	return t[0]+t[1]+t[2]+t[3];
+}
+
+// Trilinear lookups into the float mip chain of an equirectangular map.
+struct EnvSampler {
+	const std::vector<MipLevel>& levels;
+	int n;
+	float4 texel( int l, int x, int y ) const {
+		const MipLevel& m = levels[l];
+		x = ((x%m.width)+m.width)%m.width;
+		y = std::min( std::max( y, 0 ), m.height-1 );
+		return loadRGB( (const float*)m.data.data()+(size_t(y)*m.width+x)*n, n );
+	}
+	float4 bilinear( int l, float u, float v ) const {
+		const MipLevel& m = levels[l];
+		float fx = u*m.width-.5f, fy = v*m.height-.5f;
+		int x = int( floorf( fx ) ), y = int( floorf( fy ) );
+		float4 tx( fx-x ), ty( fy-y );
+		float4 a = texel( l, x, y ), b = texel( l, x+1, y );
+		float4 c = texel( l, x, y+1 ), d = texel( l, x+1, y+1 );
+		float4 top = a+(b-a)*tx, bottom = c+(d-c)*tx;
+		return top+(bottom-top)*ty;
+	}
+	float4 sample( float u, float v, float lod ) const {
+		lod = std::min( std::max( lod, 0.f ), float(levels.size()-1) );
+		int l = int( lod );
+		float f = lod-l;
+		float4 a = bilinear( l, u, v );
+		if( f<=0 || l+1>=int(levels.size()) ) return a;
+		return a+(bilinear( l+1, u, v )-a)*float4( f );
+	}
+};
+
+void projectIrradianceSH( const float* src, int w, int h, int n, vec3 sh[9], ThreadPool& pool ) {
+	std::vector<float> cosPhi( w ), sinPhi( w );
+	for( int x=0; x<w; x++ ) {
+		float phi = (x+.5f)/w*2*float(PI)-float(PI);
+		cosPhi[x] = cosf( phi );
+		sinPhi[x] = sinf( phi );
+	}
+	std::vector<float> rows( size_t(h)*9*4 );
+	pool.parallelFor( 0, h, [&]( int y ) {
+		float theta = (y+.5f)/h*float(PI);
+		float sinT = sinf( theta ), cosT = cosf( theta );
+		float4 dOmega( (2*float(PI)/w)*(float(PI)/h)*sinT );
+		float4 acc[9];
+		for( auto& a: acc ) a = float4( 0.f );
+		for( int x=0; x<w; x++ ) {
+			float dx = sinT*cosPhi[x], dy = cosT, dz = sinT*sinPhi[x];
+			const float Y[9] = { 0.282095f,
+				0.488603f*dy, 0.488603f*dz, 0.488603f*dx,
+				1.092548f*dx*dy, 1.092548f*dy*dz, 0.315392f*(3*dz*dz-1), 1.092548f*dx*dz, 0.546274f*(dx*dx-dy*dy) };
+			float4 c = loadRGB( src+(size_t(y)*w+x)*n, n )*dOmega;
+			for( int k=0; k<9; k++ ) acc[k] = acc[k]+c*float4( Y[k] );
+		}
+		for( int k=0; k<9; k++ ) acc[k].store( &rows[(size_t(y)*9+k)*4] );
+	}, 4 );
+	// Summed in row order so the result does not depend on the thread count.
+	double total[9][3] = {};
+	for( int y=0; y<h; y++ ) for( int k=0; k<9; k++ ) for( int c=0; c<3; c++ )
+		total[k][c] += rows[(size_t(y)*9+k)*4+c];
+	// Clamped cosine convolution (PI, 2PI/3, PI/4 per band), divided by PI.
+	static const float band[9] = { 1, 2/3.f, 2/3.f, 2/3.f, .25f, .25f, .25f, .25f, .25f };
+	for( int k=0; k<9; k++ )
+		sh[k] = vec3( float(total[k][0]), float(total[k][1]), float(total[k][2]) )*band[k];
+}
+
+// Reflected directions around N=V=+z for GGX half vectors, with the source mip
+// each one reads from (GPU Gems 3, ch. 20). Padded to a multiple of four.
+struct Lobe {
+	std::vector<float> x, y, z, weight, lod;
+	float totalWeight = 0;
+};
+
+static Lobe ggxLobe( float a, int count, float texelSolidAngle ) {
+	Lobe lobe;
+	const vec2* set = hammersleySet( count );
+	for( int i=0; i<count; i++ ) {
+		vec2 xi = set?set[i]:hammersley( i, count );
+		float phi = 2*float(PI)*xi.x;
+		float cosT = sqrtf( (1-xi.y)/(1+(a*a-1)*xi.y) ), sinT = sqrtf( 1-cosT*cosT );
+		float lz = 2*cosT*cosT-1;
+		if( lz<=0 ) continue;
+		float d = (a*a-1)*cosT*cosT+1;
+		float pdf = a*a/(float(PI)*d*d)/4;
+		float sampleSolidAngle = 1/(count*pdf+1e-6f);
+		lobe.x.push_back( 2*cosT*sinT*cosf( phi ) );
+		lobe.y.push_back( 2*cosT*sinT*sinf( phi ) );
+		lobe.z.push_back( lz );
+		lobe.weight.push_back( lz );
+		lobe.lod.push_back( .5f*log2f( sampleSolidAngle/texelSolidAngle )+1 );
+		lobe.totalWeight += lz;
+	}
+	while( lobe.x.size()%4 ) {
+		lobe.x.push_back( 0 ); lobe.y.push_back( 0 ); lobe.z.push_back( 1 );
+		lobe.weight.push_back( 0 ); lobe.lod.push_back( 0 );
+	}
+	return lobe;
+}
+
+static int levelCount( int size, int maxLevels ) {
+	int n = 1;
+	while( n<maxLevels && (size>>n)>0 ) n++;
+	return n;
+}
+
+// Direction through texel (sc,tc) in [-1,1] of a face, in GL face order and orientation.
+static vec3 cubeDir( int face, float sc, float tc ) {
+	switch( face ) {
+		case 0:		return normalize( vec3( 1, -tc, -sc ) );
+		case 1:		return normalize( vec3( -1, -tc, sc ) );
+		case 2:		return normalize( vec3( sc, 1, tc ) );
+		case 3:		return normalize( vec3( sc, -1, -tc ) );
+		case 4:		return normalize( vec3( sc, -tc, 1 ) );
+		default:	return normalize( vec3( -sc, -tc, -1 ) );
+	}
+}
+
+// Allocates the six RGB32F faces of level l and fills them with func(direction),
+// one face row per job.
+template<typename F> static void fillCubeLevel( std::vector<MipLevel>& cube, int l, int size, ThreadPool& pool, F func ) {
+	for( int f=0; f<6; f++ ) {
+		MipLevel& face = cube[l*6+f];
+		face.width = face.height = size;
+		face.data.resize( size_t(size)*size*3*sizeof(float) );
+	}
+	pool.parallelFor( 0, 6*size, [&]( int row ) {
+		int f = row/size, y = row%size;
+		float* d = (float*)cube[l*6+f].data.data()+size_t(y)*size*3;
+		for( int x=0; x<size; x++ ) {
+			float c[4];
+			func( cubeDir( f, 2*(x+.5f)/size-1, 2*(y+.5f)/size-1 ) ).store( c );
+			d[x*3+0] = c[0];
+			d[x*3+1] = c[1];
+			d[x*3+2] = c[2];
+		}
+	}, 1 );
+}
+
+std::vector<MipLevel> equirectToCube( const std::vector<MipLevel>& env, int n, int faceSize, int maxLevels, ThreadPool& pool ) {
+	std::vector<MipLevel> cube;
+	if( env.empty() || n<3 || faceSize<1 ) return cube;
+	EnvSampler sampler{ env, n };
+	int nLevels = levelCount( faceSize, maxLevels );
+	cube.resize( nLevels*6 );
+	for( int l=0; l<nLevels; l++ ) {
+		int size = std::max( 1, faceSize>>l );
+		float lod = log2f( env[0].width/(4.f*size) );		// a face spans a quarter of the width
+		fillCubeLevel( cube, l, size, pool, [&]( const vec3& d ) {
+			float u, v;
+			dirToUV( d.x, d.y, d.z, u, v );
+			return sampler.sample( u, v, lod );
+		} );
+	}
+	return cube;
+}
+
+std::vector<MipLevel> prefilterGGX( const std::vector<MipLevel>& env, int n, const IBLOptions& opt, ThreadPool& pool ) {
+	std::vector<MipLevel> cube;
+	if( env.empty() || n<3 ) return cube;
+	EnvSampler sampler{ env, n };
+	int nLevels = levelCount( opt.prefilterSize, opt.prefilterLevels );
+	float texelSolidAngle = 4*float(PI)/(float(env[0].width)*env[0].height);
+	cube.resize( nLevels*6 );
+	for( int l=0; l<nLevels; l++ ) {
+		int size = std::max( 1, opt.prefilterSize>>l );
+		float rough = nLevels>1?l/float(nLevels-1):0.f;
+		float baseLod = log2f( env[0].width/(4.f*size) );
+		if( l==0 ) {
+			fillCubeLevel( cube, l, size, pool, [&]( const vec3& d ) {
+				float u, v;
+				dirToUV( d.x, d.y, d.z, u, v );
+				return sampler.sample( u, v, baseLod );
+			} );
+			continue;
+		}
+		Lobe lobe = ggxLobe( rough, opt.prefilterSamples, texelSolidAngle );
+		fillCubeLevel( cube, l, size, pool, [&]( const vec3& N ) {
+			vec3 T = normalize( cross( fabsf( N.y )<.999f?vec3( 0, 1, 0 ):vec3( 1, 0, 0 ), N ) );
+			vec3 B = cross( N, T );
+			float4 acc( 0.f );
+			for( size_t i=0; i<lobe.x.size(); i+=4 ) {
+				float4 lx = float4::load( &lobe.x[i] ), ly = float4::load( &lobe.y[i] ), lz = float4::load( &lobe.z[i] );
+				float u[4], v[4];
+				dirToUV( float4( T.x )*lx+float4( B.x )*ly+float4( N.x )*lz,
+						 float4( T.y )*lx+float4( B.y )*ly+float4( N.y )*lz,
+						 float4( T.z )*lx+float4( B.z )*ly+float4( N.z )*lz, u, v );
+				for( int k=0; k<4; k++ ) {
+					if( lobe.weight[i+k]<=0 ) continue;
+					acc = acc+sampler.sample( u[k], v[k], std::max( lobe.lod[i+k], baseLod ) )*float4( lobe.weight[i+k] );
+				}
+			}
+			return acc/float4( std::max( lobe.totalWeight, 1e-6f ) );
+		} );
+	}
+	return cube;
+}
+
+// Split-sum scale and bias of F0 (Karis 2013) with the roughness convention of
+// render.frag (alpha = roughness, Smith-Schlick k = alpha/2). Four samples per lane.
+MipLevel integrateBRDF( int size, int samples, ThreadPool& pool ) {
+	MipLevel lut;
+	lut.width = lut.height = size;
+	lut.data.resize( size_t(size)*size*2*sizeof(float) );
+	samples = (samples+3)/4*4;
+	pool.parallelFor( 0, size, [&]( int y ) {
+		float a = (y+.5f)/size, k = a/2;
+		std::vector<float> hx( samples ), hz( samples );
+		const vec2* set = hammersleySet( samples );
+		for( int i=0; i<samples; i++ ) {
+			vec2 xi = set?set[i]:hammersley( i, samples );
+			float cosT = sqrtf( (1-xi.y)/(1+(a*a-1)*xi.y) );
+			hx[i] = sqrtf( 1-cosT*cosT )*cosf( 2*float(PI)*xi.x );
+			hz[i] = cosT;
+		}
+		float* d = (float*)lut.data.data()+size_t(y)*size*2;
+		for( int x=0; x<size; x++ ) {
+			float NdotV = (x+.5f)/size;
+			float4 vx( sqrtf( 1-NdotV*NdotV ) ), vz( NdotV ), zero( 0.f ), one( 1.f );
+			float4 gv( NdotV/(NdotV*(1-k)+k) ), A( 0.f ), B( 0.f );
+			for( int i=0; i<samples; i+=4 ) {
+				float4 Hx = float4::load( &hx[i] ), Hz = float4::load( &hz[i] );
+				float4 VdotH = max( vx*Hx+vz*Hz, zero );
+				float4 NdotL = float4( 2.f )*VdotH*Hz-vz;
+				float4 NL = max( NdotL, zero );
+				float4 gl = NL/(NL*float4( 1-k )+float4( k ));
+				float4 Gvis = select( zero, gv*gl*VdotH/(Hz*vz), lessThan( zero, NdotL ) );
+				float4 f = one-VdotH, f2 = f*f, Fc = f2*f2*f;
+				A = A+(one-Fc)*Gvis;
+				B = B+Fc*Gvis;
+			}
+			d[x*2+0] = sum( A )/samples;
+			d[x*2+1] = sum( B )/samples;
+		}
+	}, 1 );
+	return lut;
+}
+
+// Decodes an HDR equirect into a float mip chain, clamped at the poles.
+static bool decodeEquirect( const std::string& filename, int maxSize, Texture& env ) {
+	std::vector<unsigned char> bytes = loadBinary( filename );
+	if( bytes.empty() || !env.loadFromMemory( bytes.data(), bytes.size(), filename, false, -1, maxSize ) ) return false;
+	if( env.dataType==GL_HALF_FLOAT ) {		// the precomputation works in float
+		size_t n = size_t(env.width)*env.height*env.nChannels;
+		float* wide = (float*)malloc( n*sizeof(float) );
+		halfToFloat( (const uint16_t*)env.buf, wide, n );
+		free( env.buf );
+		env.buf = (unsigned char*)wide;
+		env.dataType = GL_FLOAT;
+	}
+	if( env.dataType!=GL_FLOAT || env.nChannels<3 ) {
+		fprintf( stderr, "[ERROR] Environment has to be an RGB HDR image: %s\n", filename.c_str() );
+		return false;
+	}
+	env.wrap_t = GL_CLAMP_TO_EDGE;
+	return env.generateMips();
+}
+
+bool loadEquirectCube( const std::string& filename, int maxSize, int faceSize, std::vector<MipLevel>& cube ) {
+	Texture env;
+	if( !decodeEquirect( filename, maxSize, env ) ) return false;
+	if( faceSize<1 ) faceSize = std::max( 1, env.width/4 );
+	cube = equirectToCube( env.levels, env.nChannels, faceSize );
+	return !cube.empty();
+}
+
+IBLResult loadIBL( const std::string& filename, int maxSize, const IBLOptions& opt ) {
+	IBLResult r;
+	auto t0 = std::chrono::steady_clock::now();
+	uint32_t rgb32f = findPixelFormat( GL_FLOAT, 3, false )->vkFormat;
+	uint32_t cubeFormat = hdrPixelFormat( opt.format, 3 )->vkFormat;
+	uint32_t lutFormat = hdrPixelFormat( HDRFormat::Half, 2 )->vkFormat;
+	r.environmentFormat = r.maps.prefilteredFormat = cubeFormat;
+	r.maps.brdfFormat = lutFormat;
+	HDRPackReport report;
+	std::string cubeName = filename+".cube.ktx2";
+	std::string shName = filename+".sh9.ktx2";
+	std::string prefilterName = filename+".prefilter.ktx2";
+	std::string lutName = getPath( filename )+"brdf_lut.ktx2";
+	std::string cached = "";
+	KTX2Image image;
+
+	bool haveCube = isCacheFresh( cubeName, filename ) && readKTX2( cubeName, image )
+		&& image.vkFormat==cubeFormat && image.faces==6;
+	if( haveCube ) {
+		r.environment = std::move( image.levels );
+		cached += " environment";
+	}
+	bool haveSH = isCacheFresh( shName, filename ) && readKTX2( shName, image )
+		&& image.vkFormat==rgb32f && image.faces==1 && image.width==9;
+	if( haveSH ) {
+		memcpy( r.maps.sh, image.levels[0].data.data(), sizeof(r.maps.sh) );
+		cached += " SH9";
+	}
+	bool havePrefilter = isCacheFresh( prefilterName, filename ) && readKTX2( prefilterName, image )
+		&& image.vkFormat==cubeFormat && image.faces==6 && image.width==opt.prefilterSize
+		&& int(image.levels.size())==6*levelCount( opt.prefilterSize, opt.prefilterLevels );
+	if( havePrefilter ) {
+		r.maps.prefiltered = std::move( image.levels );
+		cached += " prefilter";
+	}
+	bool haveLUT = readKTX2( lutName, image ) && image.vkFormat==lutFormat && image.faces==1 && image.width==opt.brdfSize;
+	if( haveLUT ) {
+		r.maps.brdfLUT = std::move( image.levels );
+		cached += " BRDF";
+	}
+
+	if( !haveCube || !haveSH || !havePrefilter ) {
+		Texture env;
+		if( !decodeEquirect( filename, maxSize, env ) ) return IBLResult();
+		const std::vector<MipLevel>& chain = env.levels;
+		int n = env.nChannels;
+		if( !haveCube ) {
+			r.environment = equirectToCube( chain, n, std::min( opt.environmentSize, std::max( 1, chain[0].width/4 ) ) );
+			r.environmentFormat = packHDR( r.environment, 3, opt.format, &report );	// cube faces are RGB whatever the source
+			writeKTX2( cubeName, r.environmentFormat, r.environment, 6 );
+		}
+		if( !haveSH ) {
+			projectIrradianceSH( (const float*)chain[0].data.data(), chain[0].width, chain[0].height, n, r.maps.sh );
+			MipLevel level;
+			level.width = 9;
+			level.height = 1;
+			level.data.assign( (const unsigned char*)r.maps.sh, (const unsigned char*)(r.maps.sh+9) );
+			writeKTX2( shName, rgb32f, { level } );
+		}
+		if( !havePrefilter ) {
+			r.maps.prefiltered = prefilterGGX( chain, n, opt );
+			r.maps.prefilteredFormat = packHDR( r.maps.prefiltered, 3, opt.format, &report );
+			writeKTX2( prefilterName, r.maps.prefilteredFormat, r.maps.prefiltered, 6 );
+		}
+	}
+	if( !haveLUT ) {
+		r.maps.brdfLUT = { integrateBRDF( opt.brdfSize, opt.brdfSamples ) };
+		packHDR( r.maps.brdfLUT, 2, HDRFormat::Half );
+		writeKTX2( lutName, lutFormat, r.maps.brdfLUT );
+	}
+	if( report.pixels>0 ) report.print( getFilenameFromAbsPath( filename ).c_str(), opt.format );
+	float ms = std::chrono::duration<float,std::milli>( std::chrono::steady_clock::now()-t0 ).count();
+	printf("IBL: %s in %.0f ms%s%s\n", getFilenameFromAbsPath( filename ).c_str(), ms,
+		   cached.empty()?"":", cached:", cached.c_str() );
+	return r;
+}
+
+}
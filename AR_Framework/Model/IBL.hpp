@@ -0,0 +1,62 @@
+//
+//  IBL.hpp
+//  AR_Framework
+//
+
+#ifndef IBL_hpp
+#define IBL_hpp
+
+#include "Texture.hpp"
+#include "HDRFormat.hpp"
+#include "Tools/ThreadPool.hpp"
+
+namespace AR {
+
+struct IBLOptions {
+	int environmentSize = 512;		// largest cube face of the environment
+	int prefilterSize = 128;		// cube face of the prefiltered map
+	int prefilterLevels = 6;		// roughness of level i is i/(levels-1)
+	int prefilterSamples = 256;
+	int brdfSize = 128;
+	int brdfSamples = 512;
+	HDRFormat format = HDRFormat::R11G11B10F;	// storage of both cube maps; the BRDF LUT is RG16F
+};
+
+// Image based lighting derived from one equirectangular environment. Cube maps
+// have the six faces of every level in a row, see TextureCube.
+struct IBLMaps {
+	vec3 sh[9];								// irradiance/PI, times the SH basis gives the diffuse term
+	std::vector<MipLevel> prefiltered;		// cube, GGX prefiltered, one roughness per level
+	std::vector<MipLevel> brdfLUT;			// split-sum scale and bias, x: NdotV, y: roughness
+	uint32_t prefilteredFormat = 0, brdfFormat = 0;		// vkFormat of the levels
+};
+
+struct IBLResult {
+	std::vector<MipLevel> environment;		// cube with a full mip chain
+	uint32_t environmentFormat = 0;
+	IBLMaps maps;
+};
+
+// Resamples the mip chain of an equirect map into a cube with up to maxLevels levels.
+extern std::vector<MipLevel> equirectToCube( const std::vector<MipLevel>& env, int nChannels, int faceSize,
+											int maxLevels=32, ThreadPool& pool=ThreadPool::shared() );
+// Float environment with 3 or 4 channels. Rows go over the pool.
+extern void projectIrradianceSH( const float* src, int w, int h, int nChannels, vec3 sh[9],
+								ThreadPool& pool=ThreadPool::shared() );
+// 'env' is the mip chain of the environment; coarser levels are sampled for
+// wide lobes (filtered importance sampling) to keep the sample count low.
+extern std::vector<MipLevel> prefilterGGX( const std::vector<MipLevel>& env, int nChannels, const IBLOptions& opt,
+										  ThreadPool& pool=ThreadPool::shared() );
+extern MipLevel integrateBRDF( int size, int samples, ThreadPool& pool=ThreadPool::shared() );
+
+// Decodes an equirect HDR straight into a cube; faceSize 0 picks a quarter of its width.
+extern bool loadEquirectCube( const std::string& filename, int maxSize, int faceSize, std::vector<MipLevel>& cube );
+// Loads an HDR environment and computes its maps. Results are cached next to the
+// source as <file>.cube.ktx2, <file>.sh9.ktx2 and <file>.prefilter.ktx2, the BRDF
+// LUT as brdf_lut.ktx2 in the same folder. Only decodes the source when one of the
+// caches is missing or stale. Safe to run off the GL thread.
+extern IBLResult loadIBL( const std::string& filename, int maxSize, const IBLOptions& opt=IBLOptions() );
+
+}
+
+#endif /* IBL_hpp */
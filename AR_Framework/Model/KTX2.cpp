@@ -0,0 +1,190 @@
+//
+//  KTX2.cpp
+//  AR_Framework
+//
+
+#include "KTX2.hpp"
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+
+namespace AR {
+
+static const unsigned char KTX2_IDENTIFIER[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+
+struct KTX2Header {
+	uint32_t vkFormat, typeSize, pixelWidth, pixelHeight, pixelDepth;
+	uint32_t layerCount, faceCount, levelCount, supercompressionScheme;
+	uint32_t dfdByteOffset, dfdByteLength, kvdByteOffset, kvdByteLength;
+	uint32_t sgdByteOffset[2], sgdByteLength[2];		// 64 bit in the file, kept unaligned
+};
+static_assert( sizeof(KTX2Header)==68, "KTX2 header must be packed" );
+
+struct KTX2LevelIndex {
+	uint64_t byteOffset, byteLength, uncompressedByteLength;
+};
+
+static void put32( std::vector<unsigned char>& b, uint32_t v ) {
+	for( int i=0; i<4; i++ ) b.push_back( (unsigned char)(v>>(8*i)) );
+}
+
+// Basic data format descriptor, enough for other KTX2 tools to identify the data.
+static std::vector<unsigned char> buildDFD( const PixelFormat& pf ) {
+	struct Sample { uint32_t offset, length, channel, lower, upper; };
+	std::vector<Sample> samples;
+	uint8_t model = 1;		// RGBSDA
+	switch( pf.bc ) {
+		case BCFormat::BC1: model = 128; samples = { {0, 64, 0, 0, ~0u} }; break;
+		case BCFormat::BC3: model = 130; samples = { {0, 64, 15, 0, ~0u}, {64, 64, 0, 0, ~0u} }; break;
+		case BCFormat::BC4: model = 131; samples = { {0, 64, 0, 0, ~0u} }; break;
+		case BCFormat::BC5: model = 132; samples = { {0, 64, 0, 0, ~0u}, {64, 64, 1, 0, ~0u} }; break;
+		case BCFormat::BC7: model = 134; samples = { {0, 128, 0, 0, ~0u} }; break;
+		default:
+			if( pf.type==GL_UNSIGNED_INT_10F_11F_11F_REV ) {
+				samples = { {0, 11, 0x80, 0, 0x3F800000u}, {11, 11, 0x81, 0, 0x3F800000u}, {22, 10, 0x82, 0, 0x3F800000u} };
+			}
+			else if( pf.type==GL_UNSIGNED_INT_5_9_9_9_REV ) {		// mantissas, each with the shared exponent
+				for( uint32_t c=0; c<3; c++ ) {
+					samples.push_back( {c*9, 9, c, 0, 256} );
+					samples.push_back( {27, 5, c|0x20, 15, 31} );
+				}
+			}
+			else {
+				static const uint32_t ids[4] = { 0, 1, 2, 15 };
+				int bits = pf.blockBytes*8/pf.nChannels;
+				bool isFloat = pf.isFloat();
+				for( int c=0; c<pf.nChannels; c++ ) {
+					uint32_t channel = ids[c] | (isFloat?0xC0:0) | ((pf.sRGB && c==3)?0x10:0);
+					samples.push_back( { uint32_t(c*bits), uint32_t(bits), channel,
+						isFloat?0xBF800000u:0u, isFloat?0x3F800000u:((1u<<bits)-1) } );
+				}
+			}
+	}
+	std::vector<unsigned char> b;
+	uint32_t blockSize = 24+16*uint32_t(samples.size());
+	put32( b, 4+blockSize );
+	put32( b, 0 );									// vendor 0, descriptor type 0
+	put32( b, 2 | (blockSize<<16) );				// version 2
+	b.push_back( model );
+	b.push_back( 1 );								// BT.709 primaries
+	b.push_back( pf.sRGB?2:1 );						// sRGB or linear transfer
+	b.push_back( 0 );
+	b.push_back( uint8_t(pf.blockDim-1) );
+	b.push_back( uint8_t(pf.blockDim-1) );
+	b.push_back( 0 );
+	b.push_back( 0 );
+	b.push_back( uint8_t(pf.blockBytes) );
+	for( int i=1; i<8; i++ ) b.push_back( 0 );
+	for( auto& s: samples ) {
+		put32( b, s.offset | ((s.length-1)<<16) | (s.channel<<24) );
+		put32( b, 0 );
+		put32( b, s.lower );
+		put32( b, s.upper );
+	}
+	return b;
+}
+
+bool writeKTX2( const std::string& fn, uint32_t vkFormat, const std::vector<MipLevel>& levels, int faces ) {
+	const PixelFormat* pf = findPixelFormat( vkFormat );
+	if( !pf || levels.empty() || (faces!=1 && faces!=6) || levels.size()%faces ) return false;
+	int nLevels = int(levels.size())/faces;
+	std::vector<unsigned char> dfd = buildDFD( *pf );
+
+	KTX2Header header = {};
+	header.vkFormat = vkFormat;
+	header.typeSize = pf->compressed()?1:pf->type==GL_FLOAT?4:pf->type==GL_HALF_FLOAT?2:pf->isFloat()?4:1;
+	header.pixelWidth = levels[0].width;
+	header.pixelHeight = levels[0].height;
+	header.faceCount = faces;
+	header.levelCount = uint32_t(nLevels);
+	header.dfdByteOffset = uint32_t( sizeof(KTX2_IDENTIFIER)+sizeof(KTX2Header)+sizeof(KTX2LevelIndex)*nLevels );
+	header.dfdByteLength = uint32_t( dfd.size() );
+
+	// Level data goes smallest first, each level aligned to the block size.
+	// The faces of a level follow each other.
+	std::vector<KTX2LevelIndex> index( nLevels );
+	uint64_t offset = header.dfdByteOffset+header.dfdByteLength;
+	uint64_t align = pf->blockBytes%4==0?pf->blockBytes:(pf->blockBytes*4);
+	for( int i=nLevels-1; i>=0; i-- ) {
+		offset = (offset+align-1)/align*align;
+		index[i].byteOffset = offset;
+		index[i].byteLength = 0;
+		for( int f=0; f<faces; f++ ) index[i].byteLength += levels[i*faces+f].data.size();
+		index[i].uncompressedByteLength = index[i].byteLength;
+		offset += index[i].byteLength;
+	}
+
+	std::string temp = fn+".tmp";
+	FILE* fp = fopen( temp.c_str(), "wb" );
+	if( !fp ) {
+		fprintf( stderr, "[ERROR] Cannot write texture cache: %s\n", fn.c_str() );
+		return false;
+	}
+	fwrite( KTX2_IDENTIFIER, 1, sizeof(KTX2_IDENTIFIER), fp );
+	fwrite( &header, sizeof(header), 1, fp );
+	fwrite( index.data(), sizeof(KTX2LevelIndex), index.size(), fp );
+	fwrite( dfd.data(), 1, dfd.size(), fp );
+	long pos = long( header.dfdByteOffset+header.dfdByteLength );
+	for( int i=nLevels-1; i>=0; i-- ) {
+		static const unsigned char zeros[16] = {};
+		while( pos<long(index[i].byteOffset) ) pos += long( fwrite( zeros, 1, std::min<long>( 16, long(index[i].byteOffset)-pos ), fp ) );
+		for( int f=0; f<faces; f++ )
+			pos += long( fwrite( levels[i*faces+f].data.data(), 1, levels[i*faces+f].data.size(), fp ) );
+	}
+	bool ok = !ferror( fp );
+	fclose( fp );
+	std::error_code ec;
+	if( ok ) std::filesystem::rename( temp, fn, ec );
+	if( !ok || ec ) {
+		std::filesystem::remove( temp, ec );
+		return false;
+	}
+	return true;
+}
+
+bool readKTX2( const std::string& fn, KTX2Image& image ) {
+	FILE* fp = fopen( fn.c_str(), "rb" );
+	if( !fp ) return false;
+	unsigned char ident[12];
+	KTX2Header header;
+	bool ok = fread( ident, 1, 12, fp )==12 && memcmp( ident, KTX2_IDENTIFIER, 12 )==0
+			&& fread( &header, sizeof(header), 1, fp )==1;
+	const PixelFormat* pf = ok?findPixelFormat( header.vkFormat ):nullptr;
+	if( !pf || header.pixelDepth>1 || header.layerCount>1 || (header.faceCount!=1 && header.faceCount!=6)
+	   || header.supercompressionScheme!=0 || header.levelCount<1 || header.levelCount>32 ) {
+		fclose( fp );
+		return false;
+	}
+	std::vector<KTX2LevelIndex> index( header.levelCount );
+	ok = fread( index.data(), sizeof(KTX2LevelIndex), index.size(), fp )==index.size();
+	image.vkFormat = header.vkFormat;
+	image.width = header.pixelWidth;
+	image.height = header.pixelHeight;
+	image.faces = int(header.faceCount);
+	image.levels.resize( header.levelCount*header.faceCount );
+	for( uint32_t i=0; ok && i<header.levelCount; i++ ) {
+		GLsizei w = std::max( 1, image.width>>i ), h = std::max( 1, image.height>>i );
+		size_t faceBytes = pf->levelBytes( w, h );
+		if( index[i].byteLength!=faceBytes*header.faceCount ) { ok = false; break; }
+		ok = fseek( fp, long(index[i].byteOffset), SEEK_SET )==0;
+		for( int f=0; ok && f<image.faces; f++ ) {
+			MipLevel& level = image.levels[i*image.faces+f];
+			level.width = w;
+			level.height = h;
+			level.data.resize( faceBytes );
+			ok = fread( level.data.data(), 1, faceBytes, fp )==faceBytes;
+		}
+	}
+	fclose( fp );
+	if( !ok ) image.levels.clear();
+	return ok;
+}
+
+bool isCacheFresh( const std::string& cache, const std::string& source ) {
+	std::error_code ec1, ec2;
+	auto tc = std::filesystem::last_write_time( cache, ec1 );
+	auto ts = std::filesystem::last_write_time( source, ec2 );
+	return !ec1 && !ec2 && tc>=ts;
+}
+
+}
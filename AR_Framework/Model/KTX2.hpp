@@ -0,0 +1,31 @@
+//
+//  KTX2.hpp
+//  AR_Framework
+//
+
+#ifndef KTX2_hpp
+#define KTX2_hpp
+
+#include "TextureFormat.hpp"
+#include <string>
+
+namespace AR {
+
+// KTX2 container with precomputed mips. Only the subset we write is read back:
+// 2D or cube, single layer, no supercompression.
+struct KTX2Image {
+	uint32_t vkFormat = 0;
+	GLsizei width = 0, height = 0;
+	int faces = 1;
+	std::vector<MipLevel> levels;		// cube maps: faces of level i at [i*6, i*6+6)
+};
+
+extern bool writeKTX2( const std::string& fn, uint32_t vkFormat, const std::vector<MipLevel>& levels, int faces=1 );
+extern bool readKTX2( const std::string& fn, KTX2Image& image );
+
+// True if 'cache' exists and is not older than 'source'.
+extern bool isCacheFresh( const std::string& cache, const std::string& source );
+
+}
+
+#endif /* KTX2_hpp */
@@ -0,0 +1,203 @@
+//
+//  MipGen.cpp
+//  AR_Framework
+//
+
+#include "MipGen.hpp"
+#include "HDRFormat.hpp"
+#include "Tools/SIMD.hpp"
+#include <algorithm>
+#include <cstring>
+#include <type_traits>
+
+namespace AR {
+
+// Working image, always four floats per pixel.
+struct Image4 {
+	int w = 0, h = 0;
+	std::vector<float> p;
+	void resize( int w_, int h_ ) { w = w_; h = h_; p.resize( size_t(w)*h*4 ); }
+	float* row( int y ) { return p.data()+size_t(y)*w*4; }
+	const float* row( int y ) const { return p.data()+size_t(y)*w*4; }
+};
+
+static float srgbToLinear( float c ) {
+	return c<=0.04045f?c/12.92f:powf( (c+0.055f)/1.055f, 2.4f );
+}
+static float linearToSRGB( float c ) {
+	return c<=0.0031308f?c*12.92f:1.055f*powf( c, 1/2.4f )-0.055f;
+}
+
+static double besselI0( double x ) {
+	double sum = 1, term = 1, q = x*x/4;
+	for( int k=1; k<32 && term>sum*1e-12; k++ ) {
+		term *= q/(double(k)*k);
+		sum += term;
+	}
+	return sum;
+}
+
+// Windowed sinc, u in destination texels. Two lobes, Kaiser window with alpha 4.
+static float kaiserWeight( float u ) {
+	const float radius = 2, alpha = 4;
+	float t = u/radius;
+	if( fabsf( t )>=1 ) return 0;
+	float sinc = fabsf( u )<1e-6f?1.f:sinf( float(PI)*u )/(float(PI)*u);
+	return sinc*float( besselI0( alpha*sqrt( 1.0-t*t ) )/besselI0( alpha ) );
+}
+
+// Per destination texel: K source indices and weights, zero padded.
+struct Taps {
+	int K = 1;
+	std::vector<int> index;
+	std::vector<float> weight;
+};
+
+static Taps buildTaps( int srcN, int dstN, MipFilter filter, bool wrap ) {
+	Taps taps;
+	if( srcN==dstN ) {
+		taps.index.resize( dstN );
+		taps.weight.assign( dstN, 1.f );
+		for( int i=0; i<dstN; i++ ) taps.index[i] = i;
+		return taps;
+	}
+	float s = srcN/float(dstN);
+	float support = filter==MipFilter::Box?0.5f:2.f;
+	taps.K = int( ceilf( 2*support*s ) )+2;
+	taps.index.assign( size_t(dstN)*taps.K, 0 );
+	taps.weight.assign( size_t(dstN)*taps.K, 0.f );
+	for( int x=0; x<dstN; x++ ) {
+		float c = (x+0.5f)*s;
+		int lo = int( floorf( c-support*s ) ), hi = int( ceilf( c+support*s ) );
+		float sum = 0;
+		int k = 0;
+		for( int i=lo; i<=hi && k<taps.K; i++ ) {
+			float w;
+			if( filter==MipFilter::Box )
+				w = std::max( 0.f, std::min( i+1.f, c+s*.5f )-std::max( float(i), c-s*.5f ) );
+			else
+				w = kaiserWeight( (i+0.5f-c)/s );
+			if( w==0 ) continue;
+			int j = wrap?((i%srcN)+srcN)%srcN:std::min( std::max( i, 0 ), srcN-1 );
+			taps.index[size_t(x)*taps.K+k] = j;
+			taps.weight[size_t(x)*taps.K+k] = w;
+			sum += w;
+			k++;
+		}
+		for( int i=0; i<k; i++ ) taps.weight[size_t(x)*taps.K+i] /= sum;
+	}
+	return taps;
+}
+
+static void downsample( const Image4& src, Image4& dst, const MipOptions& opt, ThreadPool& pool ) {
+	Taps tx = buildTaps( src.w, dst.w, opt.filter, opt.wrapS );
+	Taps ty = buildTaps( src.h, dst.h, opt.filter, opt.wrapT );
+	Image4 tmp;
+	tmp.resize( dst.w, src.h );
+	pool.parallelFor( 0, src.h, [&]( int y ) {
+		const float* s = src.row( y );
+		float* d = tmp.row( y );
+		for( int x=0; x<dst.w; x++ ) {
+			const int* idx = tx.index.data()+size_t(x)*tx.K;
+			const float* wt = tx.weight.data()+size_t(x)*tx.K;
+			float4 acc( 0.f );
+			for( int k=0; k<tx.K; k++ )
+				acc = acc+float4::load( s+idx[k]*4 )*float4( wt[k] );
+			acc.store( d+x*4 );
+		}
+	}, 4 );
+	pool.parallelFor( 0, dst.h, [&]( int y ) {
+		const int* idx = ty.index.data()+size_t(y)*ty.K;
+		const float* wt = ty.weight.data()+size_t(y)*ty.K;
+		float* d = dst.row( y );
+		for( int x=0; x<dst.w; x++ ) {
+			float4 acc( 0.f );
+			for( int k=0; k<ty.K; k++ )
+				acc = acc+float4::load( tmp.row( idx[k] )+x*4 )*float4( wt[k] );
+			if( opt.normalMap ) {
+				float t[4];
+				acc.store( t );
+				float nx = t[0]*2-1, ny = t[1]*2-1, nz = t[2]*2-1;
+				float len = sqrtf( nx*nx+ny*ny+nz*nz );
+				if( len>1e-6f ) {
+					t[0] = nx/len*.5f+.5f;
+					t[1] = ny/len*.5f+.5f;
+					t[2] = nz/len*.5f+.5f;
+				}
+				acc = float4::load( t );
+			}
+			acc.store( d+x*4 );
+		}
+	}, 4 );
+}
+
+template<typename T> static void expand( const T* src, int w, int h, int n, const MipOptions& opt, Image4& img ) {
+	img.resize( w, h );
+	float lut[256];
+	for( int i=0; i<256; i++ ) lut[i] = (opt.sRGB && n>=3)?srgbToLinear( i/255.f ):i/255.f;
+	for( size_t i=0; i<size_t(w)*h; i++ ) {
+		float* d = img.p.data()+i*4;
+		d[0] = d[1] = d[2] = 0;
+		d[3] = 1;
+		for( int c=0; c<n; c++ ) {
+			if constexpr( std::is_same_v<T,float> ) d[c] = src[i*n+c];
+			else if constexpr( std::is_same_v<T,uint16_t> ) d[c] = halfToFloat( src[i*n+c] );
+			else d[c] = c<3?lut[src[i*n+c]]:src[i*n+c]/255.f;
+		}
+		if( opt.normalMap && n==2 ) {		// z of a unit normal, so renormalising keeps xy
+			float nx = d[0]*2-1, ny = d[1]*2-1;
+			d[2] = sqrtf( std::max( 0.f, 1-nx*nx-ny*ny ) )*.5f+.5f;
+		}
+	}
+}
+
+template<typename T> static void quantize( const Image4& img, int n, const MipOptions& opt, MipLevel& level ) {
+	level.width = img.w;
+	level.height = img.h;
+	level.data.resize( size_t(img.w)*img.h*n*sizeof(T) );
+	T* d = (T*)level.data.data();
+	bool sRGB = opt.sRGB && n>=3;
+	for( size_t i=0; i<size_t(img.w)*img.h; i++ ) {
+		const float* s = img.p.data()+i*4;
+		for( int c=0; c<n; c++ ) {
+			if constexpr( std::is_same_v<T,float> ) d[i*n+c] = opt.normalMap?s[c]:std::max( s[c], 0.f );	// no negative ringing around HDR highlights
+			else if constexpr( std::is_same_v<T,uint16_t> ) d[i*n+c] = floatToHalf( std::min( std::max( s[c], 0.f ), 65504.f ) );
+			else {
+				float v = std::min( std::max( s[c], 0.f ), 1.f );
+				if( sRGB && c<3 ) v = linearToSRGB( v );
+				d[i*n+c] = (unsigned char)( v*255.f+0.5f );
+			}
+		}
+	}
+}
+
+template<typename T> static std::vector<MipLevel> generate( const T* src, int w, int h, int n, const MipOptions& opt, ThreadPool& pool ) {
+	std::vector<MipLevel> levels( 1 );
+	levels[0].width = w;
+	levels[0].height = h;
+	levels[0].data.assign( (const unsigned char*)src, (const unsigned char*)(src+size_t(w)*h*n) );
+	Image4 cur, next;
+	expand( src, w, h, n, opt, cur );
+	while( cur.w>1 || cur.h>1 ) {
+		next.resize( std::max( 1, cur.w/2 ), std::max( 1, cur.h/2 ) );
+		downsample( cur, next, opt, pool );
+		levels.emplace_back();
+		quantize<T>( next, n, opt, levels.back() );
+		std::swap( cur, next );
+	}
+	return levels;
+}
+
+std::vector<MipLevel> generateMips( const unsigned char* src, int w, int h, int nChannels, const MipOptions& opt, ThreadPool& pool ) {
+	return generate( src, w, h, nChannels, opt, pool );
+}
+
+std::vector<MipLevel> generateMips( const float* src, int w, int h, int nChannels, const MipOptions& opt, ThreadPool& pool ) {
+	return generate( src, w, h, nChannels, opt, pool );
+}
+
+std::vector<MipLevel> generateMipsHalf( const uint16_t* src, int w, int h, int nChannels, const MipOptions& opt, ThreadPool& pool ) {
+	return generate( src, w, h, nChannels, opt, pool );
+}
+
+}
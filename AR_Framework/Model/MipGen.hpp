@@ -0,0 +1,36 @@
+//
+//  MipGen.hpp
+//  AR_Framework
+//
+
+#ifndef MipGen_hpp
+#define MipGen_hpp
+
+#include "TextureFormat.hpp"
+#include "Tools/ThreadPool.hpp"
+
+namespace AR {
+
+enum class MipFilter { Box, Kaiser };
+
+struct MipOptions {
+	MipFilter filter = MipFilter::Kaiser;
+	bool sRGB = false;			// filter the colour channels in linear light
+	bool normalMap = false;		// renormalise xyz after every level
+	bool wrapS = true;			// sample across the edges, for tiling textures
+	bool wrapT = true;
+};
+
+// Full mip chain down to 1x1, level 0 included, in the format of the source
+// (8-bit, half or float). Levels are filtered from the previous level in float,
+// separably, with rows spread over the pool.
+extern std::vector<MipLevel> generateMips( const unsigned char* src, int w, int h, int nChannels,
+										  const MipOptions& opt, ThreadPool& pool=ThreadPool::shared() );
+extern std::vector<MipLevel> generateMips( const float* src, int w, int h, int nChannels,
+										  const MipOptions& opt, ThreadPool& pool=ThreadPool::shared() );
+extern std::vector<MipLevel> generateMipsHalf( const uint16_t* src, int w, int h, int nChannels,
+											  const MipOptions& opt, ThreadPool& pool=ThreadPool::shared() );
+
+}
+
+#endif /* MipGen_hpp */
@@ -0,0 +1,99 @@
+//
+//  SceneGraph.hpp
+//  AR_Framework
+//
+
+#ifndef SceneGraph_hpp
+#define SceneGraph_hpp
+
+#include "TriMesh.hpp"
+#include <algorithm>
+#include <string>
+#include <vector>
+
+namespace AR {
+
+// Node hierarchy of the loaded scene, flat and in depth first order: a node's
+// subtree is the range [i, subtreeEnd[i]) and its parent comes before it.
+// Meshes are added in the same order, so the meshes below a node are a range
+// of the MeshSet too. setLocal() marks a node; update() recomputes the world
+// matrices of the marked subtrees only, in one pass over each range, and
+// copies them to TriMesh::modelMat.
+//
+//	int n = graph.add( "arm", parent, local, int(meshes.size()) );
+//	... meshes.emplace_back(), meshes.back().node = n, children ...
+//	graph.close( n, int(meshes.size()) );
+//	graph.setLocal( n, rotate( angle, axis )*local );
+//	graph.update( meshes );
+struct SceneGraph {
+	std::vector<std::string> names;
+	std::vector<int> parents;				// -1 for roots
+	std::vector<int> subtreeEnd;
+	std::vector<int> meshBegin;				// first mesh of the node's subtree
+	std::vector<mat4> locals, worlds;
+	std::vector<bool> dirty;
+	std::vector<int> changed;				// marked nodes, in any order
+	int meshCount = 0;
+
+	int size() const { return int(parents.size()); }
+	bool empty() const { return parents.empty(); }
+	void clear() {
+		names.clear(); parents.clear(); subtreeEnd.clear(); meshBegin.clear();
+		locals.clear(); worlds.clear(); dirty.clear(); changed.clear();
+		meshCount = 0;
+	}
+	// Appends a node; its children are added next, then close() ends its subtree.
+	int add( const std::string& name, int parent, const mat4& local, int firstMesh ) {
+		int i = size();
+		names.push_back( name );
+		parents.push_back( parent );
+		subtreeEnd.push_back( i+1 );
+		meshBegin.push_back( firstMesh );
+		locals.push_back( local );
+		worlds.push_back( parent<0?local:worlds[parent]*local );
+		dirty.push_back( false );
+		return i;
+	}
+	void close( int node, int meshEnd ) {
+		subtreeEnd[node] = size();
+		meshCount = std::max( meshCount, meshEnd );
+	}
+	int find( const std::string& name ) const {
+		for( int i=0; i<size(); i++ ) if( names[i]==name ) return i;
+		return -1;
+	}
+	int root( int node ) const {
+		while( node>=0 && parents[node]>=0 ) node = parents[node];
+		return node;
+	}
+	void setLocal( int node, const mat4& local ) {
+		locals[node] = local;
+		if( dirty[node] ) return;
+		dirty[node] = true;
+		changed.push_back( node );
+	}
+	// Costs the size of the marked subtrees, whatever the size of the scene.
+	void update( std::vector<TriMesh>& meshes ) {
+		if( changed.empty() ) return;
+		std::sort( changed.begin(), changed.end() );
+		int done = 0;							// everything before is up to date
+		for( int node: changed ) {
+			if( node<done ) continue;			// inside a subtree recomputed already
+			int end = subtreeEnd[node];
+			for( int i=node; i<end; i++ ) {
+				int parent = parents[i];
+				worlds[i] = parent<0?locals[i]:worlds[parent]*locals[i];
+				dirty[i] = false;
+			}
+			int meshEnd = std::min( end<size()?meshBegin[end]:meshCount, int(meshes.size()) );
+			for( int m=meshBegin[node]; m<meshEnd; m++ )
+				if( meshes[m].node>=0 ) meshes[m].modelMat = worlds[meshes[m].node];
+			done = end;
+		}
+		changed.clear();
+	}
+};
+
+}
+
+#endif /* SceneGraph_hpp */
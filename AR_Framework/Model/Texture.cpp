@@ -11,9 +11,18 @@
 #include "stb_image.h"
 #define STB_IMAGE_RESIZE_IMPLEMENTATION
 #include "stb_image_resize.h"
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "stb_image_write.h"
 
 namespace AR {
 
+// stb v2.19 has no per-thread variants of these, and decodes run on pool workers.
+static const bool __stbi_settings = [](){
+	stbi_set_flip_vertically_on_load( true );
+	stbi_convert_iphone_png_to_rgb( 1 );
+	return true;
+}();
+
 const char* __blit_vert = ""
 "#version 410\n"
 "layout(location=0) in vec3 inPosition;\n"
@@ -13,6 +13,15 @@
 #include "Tools/gl.hpp"
 #include "Tools/Program.hpp"
 #include "TriMesh.hpp"
+#include "KTX2.hpp"
+#include "BlockCompress.hpp"
+#include "MipGen.hpp"
+#include "HDRFormat.hpp"
+#include "EXR.hpp"
+#include "TextureUploader.hpp"
+#include "UploadWorker.hpp"
+#include "Tools/Hash.hpp"
+#include <unordered_map>
 
 namespace AR {
 
@@ -52,6 +61,15 @@ struct Texture {
 					default:	return {GL_RGB32F, GL_RGB, type};
 				}
 				break;
+			case GL_HALF_FLOAT:
+				switch( nChannels ) {
+					case 1:		return {GL_R16F, GL_RED, type};
+					case 2:		return {GL_RG16F, GL_RG, type};
+					case 4:		return {GL_RGBA16F, GL_RGBA, type};
+					case 3:
+					default:	return {GL_RGB16F, GL_RGB, type};
+				}
+				break;
 			case GL_UNSIGNED_BYTE:
 			default:
 				switch( nChannels ) {
@@ -88,6 +106,17 @@ struct Texture {
 	GLuint wrap_t = GL_REPEAT;
 	GLuint wrap_s = GL_REPEAT;
 	GLuint inter= GL_LINEAR_MIPMAP_LINEAR;
+	uint32_t vkFormat = 0;				// set when the data lives in 'levels'
+	std::vector<MipLevel> levels;		// precomputed mips, freed after upload unless streamed
+	bool streamed = false;
+	int residentBase = 0;				// finest level on the GPU
+	int requestedBase = 0;				// finest level on the GPU or queued for upload
+	int wantedBase = 0;					// finest level requested this frame
+	int mipCount = 0;					// levels of the GL texture
+	bool asyncUpload = false;			// levels arrive through TextureLib::uploader
+	uint64_t lastUsed = 0;				// frame of the last request
+	MipFilter mipFilter = MipFilter::Kaiser;
+	bool normalMap = false;				// mips are renormalised
 	
 	
 	Texture()
@@ -100,11 +129,33 @@ struct Texture {
 	}
 	Texture( Texture&&a )
 	: texID(a.texID), width(a.width), height(a.height), nChannels(a.nChannels), dataType(a.dataType), SRGB(a.SRGB), hdr(a.hdr),
-	name(a.name), buf(a.buf), ownBuf(a.ownBuf), texDataDirty(a.texDataDirty) {
+	name(a.name), buf(a.buf), ownBuf(a.ownBuf), texDataDirty(a.texDataDirty),
+	vkFormat(a.vkFormat), levels(std::move(a.levels)), streamed(a.streamed), residentBase(a.residentBase),
+	requestedBase(a.requestedBase), mipCount(a.mipCount), asyncUpload(a.asyncUpload),
+	mipFilter(a.mipFilter), normalMap(a.normalMap) {
+		a.texID = 0;
+		a.ownBuf = false;
+		a.buf = nullptr;
+		a.nChannels = 0;
+	}
+	Texture& operator=( Texture&& a ) {
+		if( this==&a ) return *this;
+		clear();
+		if( buf && ownBuf ) free( buf );
+		texID = a.texID; width = a.width; height = a.height; nChannels = a.nChannels;
+		glW = a.glW; glH = a.glH; glN = a.glN;
+		dataType = a.dataType; SRGB = a.SRGB; hdr = a.hdr; name = a.name;
+		buf = a.buf; ownBuf = a.ownBuf; texDataDirty = a.texDataDirty;
+		wrap_s = a.wrap_s; wrap_t = a.wrap_t; inter = a.inter;
+		vkFormat = a.vkFormat; levels = std::move( a.levels );
+		streamed = a.streamed; residentBase = a.residentBase; requestedBase = a.requestedBase;
+		mipCount = a.mipCount; asyncUpload = a.asyncUpload;
+		mipFilter = a.mipFilter; normalMap = a.normalMap;
 		a.texID = 0;
 		a.ownBuf = false;
 		a.buf = nullptr;
 		a.nChannels = 0;
+		return *this;
 	}
 	
 	~Texture(){ clear(); }
@@ -112,12 +163,21 @@ struct Texture {
 		if( texID ) glDeleteTextures(1, &texID); texID = 0;
 	}
 	virtual void createGL() {
+		if( !levels.empty() ) {
+			if( texID<1 || texDataDirty ) createGLFromLevels();
+			return;
+		}
 		if( glW==width && glH==height && glN==nChannels && texID>0 ) {
 			if( texDataDirty && buf && glW>0 )
 				update( buf );
 			if( buf && ownBuf ) free(buf); buf = nullptr;
 			return;
 		}
+		// Loaded images get their mips on the CPU; buffers owned by the caller keep glGenerateMipmap.
+		if( buf && ownBuf && inter!=GL_LINEAR && inter!=GL_NEAREST && generateMips() ) {
+			createGLFromLevels();
+			return;
+		}
 		if( texID>0 ) clear();
 		auto [internal,format,type] = getTextureType( dataType, nChannels, SRGB );
 		GLint oldTex = Texture::getBinding();
@@ -133,6 +193,89 @@ struct Texture {
 		texDataDirty = false;
 		if( buf && ownBuf ) free( buf ); buf = nullptr;
 	}
+	virtual void createGLFromLevels() {
+		if( !findPixelFormat( vkFormat ) ) return;
+		if( texID>0 ) clear();
+		GLint oldTex = Texture::getBinding();
+		glGenTextures( 1, &texID );
+		glBindTexture( GL_TEXTURE_2D, texID );
+		setTexParam(inter,wrap_s,wrap_t);
+		residentBase = requestedBase = streamed?tailBase():0;
+		mipCount = int(levels.size());
+		glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, residentBase );
+		glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, GLint(levels.size()-1) );
+		for( int i=residentBase; i<int(levels.size()); i++ )
+			uploadLevel( i );
+		Texture::restoreBinding( oldTex );
+		glW = width;
+		glH = height;
+		glN = nChannels;
+		texDataDirty = false;
+		if( !streamed ) {
+			levels.clear();
+			levels.shrink_to_fit();
+		}
+		if( buf && ownBuf ) free( buf ); buf = nullptr;
+	}
+	// Uploads levels[i] to the bound texture; an empty level releases its storage.
+	void uploadLevel( int i, bool release=false ) {
+		const PixelFormat* pf = findPixelFormat( vkFormat );
+		const MipLevel& l = levels[i];
+		GLsizei w = release?0:l.width, h = release?0:l.height;
+		const void* data = release?nullptr:l.data.data();
+		GLint oldAlign = 4;
+		glGetIntegerv( GL_UNPACK_ALIGNMENT, &oldAlign );
+		glPixelStorei( GL_UNPACK_ALIGNMENT, 1 );
+		if( pf->compressed() )
+			glCompressedTexImage2D( GL_TEXTURE_2D, i, pf->internal, w, h, 0, release?0:GLsizei(l.data.size()), data );
+		else
+			glTexImage2D( GL_TEXTURE_2D, i, pf->internal, w, h, 0, pf->format, pf->type, data );
+		glPixelStorei( GL_UNPACK_ALIGNMENT, oldAlign );
+	}
+	
+	// Mip streaming: the full chain stays in 'levels' and only [residentBase,end)
+	// lives on the GPU. TextureStreamer moves residentBase.
+	int tailBase( int tailSize=64 ) const {
+		int base = int(levels.size())-1;
+		while( base>0 && std::max( levels[base-1].width, levels[base-1].height )<=tailSize ) base--;
+		return std::max( base, 0 );
+	}
+	size_t levelBytes( int i ) const {
+		return levels[i].data.size();
+	}
+	// Includes levels still queued for upload.
+	size_t residentBytes() const {
+		size_t bytes = 0;
+		for( int i=requestedBase; i<int(levels.size()); i++ ) bytes += levelBytes( i );
+		return bytes;
+	}
+	void setResidentBase( int base ) {
+		if( texID<1 || base==residentBase || base<0 || base>=int(levels.size()) ) return;
+		GLint oldTex = Texture::getBinding();
+		glBindTexture( GL_TEXTURE_2D, texID );
+		if( base<residentBase ) {
+			for( int i=base; i<residentBase; i++ ) uploadLevel( i );
+			glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, base );
+		}
+		else {
+			glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, base );
+			for( int i=residentBase; i<base; i++ ) uploadLevel( i, true );
+		}
+		Texture::restoreBinding( oldTex );
+		residentBase = requestedBase = base;
+	}
+	// Turns the decoded buffer into a single level so that it can go through the uploader.
+	bool bufferToLevel() {
+		const PixelFormat* pf = findPixelFormat( dataType, nChannels, SRGB );
+		if( !buf || !levels.empty() || !pf ) return false;
+		levels.resize( 1 );
+		levels[0].width = width;
+		levels[0].height = height;
+		levels[0].data.assign( buf, buf+pf->levelBytes( width, height ) );
+		vkFormat = pf->vkFormat;
+		if( ownBuf ) free( buf ); buf = nullptr;
+		return true;
+	}
 	virtual void create( int w, int h, int n, GLuint type, void* data, bool sRGB=false ) {
 		if( w!=width || h!=height || n!=nChannels || type!=dataType || sRGB!=SRGB) {
 			
@@ -159,26 +302,37 @@ struct Texture {
 		texDataDirty = false;
 	}
 	
-	virtual bool load( const std::string& fn, bool sRGB=false, int targetWidth=-1 ) {
-		SRGB = sRGB;
+	// Only touches GL to query the size limit, so it runs on worker threads when maxTexWidth is given.
+	virtual bool load( const std::string& fn, bool sRGB=false, int targetWidth=-1, int maxTexWidth=0 ) {
 		std::string filename = backToFrontSlash( fn );
-		std::string extension = getExtension( filename );
 		if( !testFile( filename ) ) return false;
-		if( stbi_is_hdr( filename.c_str() ) ) {
+		std::vector<unsigned char> bytes = loadBinary( filename );
+		return loadFromMemory( bytes.data(), bytes.size(), filename, sRGB, targetWidth, maxTexWidth );
+	}
+	virtual bool loadFromMemory( const unsigned char* data, size_t size, const std::string& filename,
+								bool sRGB=false, int targetWidth=-1, int maxTexWidth=0 ) {
+		SRGB = sRGB;
+		bool exr = isEXR( data, size );
+		if( exr || stbi_is_hdr_from_memory( data, int(size) ) ) {
 			hdr  = true;
 			SRGB = false;
 			dataType = GL_FLOAT;
 		}
-		stbi_set_flip_vertically_on_load(true);
-		
+		// stb's flip and iPhone PNG settings are globals, set once in Texture.cpp
+		// before main() since decodes run on the pool.
 		if( buf && ownBuf ) free(buf); buf = nullptr;
 		name = filename;
-		printf("loading:%s ", getFilenameFromAbsPath(name).c_str());
 		int w=0, h=0, n=0;
-		stbi_convert_iphone_png_to_rgb(1);
-		if( hdr )	buf = (unsigned char*)stbi_loadf( filename.c_str(), &w, &h, &n, 0);
-		else		buf = stbi_load( filename.c_str(), &w, &h, &n, 0);
-		printf("(%d x %d x %d)", w, h, n);
+		bool half = false;
+		if( exr )		buf = (unsigned char*)loadEXRFromMemory( data, size, &w, &h, &n, &half );
+		else if( hdr )	buf = (unsigned char*)stbi_loadf_from_memory( data, int(size), &w, &h, &n, 0);
+		else			buf = stbi_load_from_memory( data, int(size), &w, &h, &n, 0);
+		if( !buf ) {
+			fprintf( stderr, "[ERROR] Cannot decode %s\n", filename.c_str() );
+			return false;
+		}
+		int srcW = w, srcH = h;
+		char resized[64] = "";
 		
 		int desiredTexWidth = w, desiredTexHeight = h;
 		if( targetWidth>0 ) {
@@ -186,8 +340,7 @@ struct Texture {
 			desiredTexHeight= int(h/float(w)*targetWidth);
 		}
 		
-		int maxTexWidth = 0;
-		glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTexWidth );
+		if( maxTexWidth<=0 ) maxTexWidth = maxTextureSize();
 		if( maxTexWidth<desiredTexWidth ) {
 			desiredTexHeight = int(h/float(w)*maxTexWidth);
 			desiredTexWidth = maxTexWidth;
@@ -198,8 +351,15 @@ struct Texture {
 		}
 		if( w!=desiredTexWidth || h!=desiredTexHeight ) {
 			int ww =desiredTexWidth, hh = desiredTexHeight;
-			printf("--> (%d x %d)", ww, hh );
+			snprintf( resized, sizeof(resized), "--> (%d x %d)", ww, hh );
 			void* temp;
+			if( half ) {			// stb_image_resize has no half path
+				float* wide = (float*)malloc( size_t(w)*h*n*sizeof(float) );
+				halfToFloat( (const uint16_t*)buf, wide, size_t(w)*h*n );
+				free( buf );
+				buf = (unsigned char*)wide;
+				half = false;
+			}
 			if( hdr )	{
 				temp = (float*)malloc(ww*hh*n*sizeof(float));
 				stbir_resize_float( (float*)buf, w, h, 0, (float*)temp, ww, hh, 0, n );
@@ -221,11 +381,105 @@ struct Texture {
 		texDataDirty = true;
 		width = w;
 		height = h;
-		dataType = hdr?GL_FLOAT:GL_UNSIGNED_BYTE;
+		dataType = half?GL_HALF_FLOAT:hdr?GL_FLOAT:GL_UNSIGNED_BYTE;
 		nChannels = n;
-		printf("\n");
+		printf("loading:%s (%d x %d x %d)%s\n", getFilenameFromAbsPath(name).c_str(), srcW, srcH, n, resized );
+		return true;
+	}
+	static int maxTextureSize() {
+		static GLint maxSize = 0;
+		if( maxSize<1 ) glGetIntegerv( GL_MAX_TEXTURE_SIZE, &maxSize );
+		return maxSize;
+	}
+	virtual bool loadKTX2( const std::string& fn ) {
+		KTX2Image image;
+		if( !readKTX2( fn, image ) || image.faces!=1 ) return false;
+		printf("loading:%s (%d x %d, %zu levels)\n", getFilenameFromAbsPath(fn).c_str(), image.width, image.height, image.levels.size() );
+		return setLevels( image.vkFormat, std::move( image.levels ) );
+	}
+	// Takes over a mip chain stored in one of pixelFormats().
+	virtual bool setLevels( uint32_t vk, std::vector<MipLevel>&& chain ) {
+		const PixelFormat* pf = findPixelFormat( vk );
+		if( !pf || chain.empty() ) return false;
+		if( buf && ownBuf ) free(buf); buf = nullptr;
+		width = chain[0].width;
+		height = chain[0].height;
+		nChannels = pf->nChannels;
+		hdr = pf->isFloat();
+		dataType = hdr?GL_FLOAT:GL_UNSIGNED_BYTE;
+		SRGB = pf->sRGB;
+		vkFormat = vk;
+		levels = std::move( chain );
+		texDataDirty = true;
 		return true;
 	}
+	virtual bool saveKTX2( const std::string& fn ) const {
+		return !levels.empty() && writeKTX2( fn, vkFormat, levels );
+	}
+	// Replaces the pixel buffer by a full mip chain in 'levels'.
+	virtual bool generateMips() {
+		const PixelFormat* pf = findPixelFormat( dataType, nChannels, SRGB );
+		if( !buf || !pf || (dataType!=GL_UNSIGNED_BYTE && dataType!=GL_FLOAT && dataType!=GL_HALF_FLOAT) ) return false;
+		MipOptions opt;
+		opt.filter = mipFilter;
+		opt.sRGB = pf->sRGB;
+		opt.normalMap = normalMap;
+		opt.wrapS = wrap_s==GL_REPEAT;
+		opt.wrapT = wrap_t==GL_REPEAT;
+		if( dataType==GL_FLOAT )			levels = AR::generateMips( (const float*)buf, width, height, nChannels, opt );
+		else if( dataType==GL_HALF_FLOAT )	levels = AR::generateMipsHalf( (const uint16_t*)buf, width, height, nChannels, opt );
+		else								levels = AR::generateMips( buf, width, height, nChannels, opt );
+		vkFormat = pf->vkFormat;
+		if( ownBuf ) free(buf); buf = nullptr;
+		texDataDirty = true;
+		return true;
+	}
+	// Replaces the 8-bit pixel buffer or mip chain by a block compressed mip chain.
+	virtual bool compress( BCFormat bc ) {
+		const PixelFormat* pf = findPixelFormat( bc, SRGB );
+		if( dataType!=GL_UNSIGNED_BYTE || !pf ) return false;
+		if( levels.empty() && !generateMips() ) return false;
+		const PixelFormat* src = findPixelFormat( vkFormat );
+		if( !src || src->compressed() ) return false;
+		for( auto& l: levels )
+			l.data = encodeBlocks( l.data.data(), l.width, l.height, src->nChannels, bc );
+		vkFormat = pf->vkFormat;
+		nChannels = pf->nChannels;
+		texDataDirty = true;
+		return true;
+	}
+	// Converts a float mip chain to a smaller HDR storage format and reports the error.
+	virtual bool packHDR( HDRFormat format ) {
+		if( levels.empty() && !generateMips() ) return false;
+		const PixelFormat* pf = findPixelFormat( vkFormat );
+		if( !pf || (pf->type!=GL_FLOAT && pf->type!=GL_HALF_FLOAT) ) return false;
+		if( pf->nChannels!=3 && format!=HDRFormat::Float ) format = HDRFormat::Half;
+		if( format==HDRFormat::Float || (format==HDRFormat::Half && pf->type==GL_HALF_FLOAT) ) return true;
+		if( pf->type==GL_HALF_FLOAT ) {		// half sources (EXR) only widen on the way to a packed format
+			for( auto& l: levels ) {
+				std::vector<unsigned char> wide( l.data.size()*2 );
+				halfToFloat( (const uint16_t*)l.data.data(), (float*)wide.data(), l.data.size()/2 );
+				l.data = std::move( wide );
+			}
+		}
+		HDRPackReport report;
+		uint32_t vk = AR::packHDR( levels, pf->nChannels, format, &report );
+		if( !vk ) return false;
+		report.print( getFilenameFromAbsPath(name).c_str(), format );
+		vkFormat = vk;
+		texDataDirty = true;
+		return true;
+	}
+	bool hasAlpha() const {
+		if( !buf || dataType!=GL_UNSIGNED_BYTE || (nChannels!=2 && nChannels!=4) ) return false;
+		for( size_t i=nChannels-1; i<size_t(width)*height*nChannels; i+=nChannels )
+			if( buf[i]<255 ) return true;
+		return false;
+	}
+	BCFormat compressedFormat() const {
+		const PixelFormat* pf = findPixelFormat( vkFormat );
+		return pf?pf->bc:BCFormat::None;
+	}
 	virtual void bind( int slot ) {
 		if( texID<1 || texDataDirty ) {
 			glErr("Before Texture Create GL\n");
@@ -264,36 +518,336 @@ struct Texture {
 };
 
 
+// Shared with the decode jobs so that one image found under several paths
+// ends up in a single Texture.
+struct TextureDedup {
+	std::mutex mtx;
+	std::unordered_map<uint64_t,int> contentIndex;	// hash of file bytes or pixels -> texture ID
+	int pathHits = 0, fileHits = 0, pixelHits = 0;
+	size_t bytesSaved = 0;							// decoded bytes that were not kept twice
+
+	// Returns the ID already holding 'key', or registers 'texID' for it and returns -1.
+	int findOrAdd( uint64_t key, int texID, size_t bytes, int& hits ) {
+		std::lock_guard<std::mutex> lock( mtx );
+		auto [it,added] = contentIndex.emplace( key, texID );
+		if( added ) return -1;
+		hits++;
+		bytesSaved += bytes;
+		return it->second;
+	}
+};
+
 struct TextureLib {
 	std::vector<Texture> textures;
+	std::vector<int> aliases;						// slot -> slot holding the data, possibly through other aliases
+	std::unordered_map<std::string,int> pathIndex;	// keyed by path and usage tag, see pathKey()
+	std::shared_ptr<TextureDedup> dedup = std::make_shared<TextureDedup>();
+	bool useCompression = true;
+	bool asyncLoading = true;
+	bool streamMips = true;				// see TextureStreamer
+	bool asyncUploads = true;			// levels go through the PBO ring instead of bind()
+	HDRFormat hdrFormat = HDRFormat::Half;	// storage of float images, see HDRFormat.hpp
+	TextureUploader uploader;
+	UploadWorker* worker = nullptr;		// when set, storage and levels are created on its context instead
+	struct LevelUpload {
+		int texID, level;
+	};
+	std::deque<LevelUpload> uploadQueue;
+	
+	// Decodes run on the shared pool; IDs are valid immediately and the slot stays
+	// empty (nChannels==0) until resolve() moves the result in.
+	struct LoadResult {
+		std::unique_ptr<Texture> tex;
+		int aliasOf = -1;
+	};
+	struct Pending {
+		int texID;
+		std::future<LoadResult> result;
+	};
+	std::vector<Pending> pending;
+	
 	void clear() {
+		if( worker ) worker->finish();	// its jobs read the levels
+		pending.clear();
+		uploader.cancel();
+		uploadQueue.clear();
 		textures.clear();
+		aliases.clear();
+		pathIndex.clear();
+		dedup = std::make_shared<TextureDedup>();
 	}
-	int searchTexture( const std::string& fn ) {
-		std::string filename = backToFrontSlash( fn );
-		for( auto i=0; i<textures.size(); i++ )
-			if( filename.compare( textures[i].name ) == 0 )
-				return int(i);
-		return -1;
+	// Same file with another usage or color space is another texture.
+	static const char* usageTag( TexUsage usage, bool sRGB ) {
+		if( usage==TexUsage::Mask && sRGB ) usage = TexUsage::Color;	// BC4 has no sRGB variant
+		return usage==TexUsage::Normal?"normal":usage==TexUsage::Mask?"mask":sRGB?"srgb":"color";
+	}
+	static std::string pathKey( const std::string& fn, bool sRGB, TexUsage usage ) {
+		return backToFrontSlash( fn ) + "." + usageTag( usage, sRGB );
 	}
-	int testAndLoadTexture( const std::string& fn, bool sRGB ) {
+	int searchTexture( const std::string& fn, bool sRGB, TexUsage usage=TexUsage::Color ) {
+		auto it = pathIndex.find( pathKey( fn, sRGB, usage ) );
+		return it==pathIndex.end()?-1:it->second;
+	}
+	int testAndLoadTexture( const std::string& fn, bool sRGB, TexUsage usage=TexUsage::Color ) {
 		std::string filename = backToFrontSlash( fn );
-		int ret = searchTexture( filename );
-		if( ret<0 && testFile( filename ) ) {
+		int ret = searchTexture( filename, sRGB, usage );
+		if( ret>=0 )
+			dedup->pathHits++;
+		else if( testFile( filename ) ) {
+			ret = int(textures.size());
 			textures.emplace_back();
-			textures.back().load( filename, sRGB );
-			ret = int(textures.size()-1);
+			textures.back().name = filename;
+			aliases.push_back( ret );
+			pathIndex[pathKey( filename, sRGB, usage )] = ret;
+			// GL queries have to happen here, on the context thread.
+			bool compress = useCompression;
+			bool bptc = compress && isBPTCSupported();
+			int maxSize = Texture::maxTextureSize();
+			HDRFormat hdr = hdrFormat;
+			auto job = [=, shared=dedup]() {
+				return loadTexture( filename, sRGB, usage, compress, bptc, hdr, maxSize, ret, *shared );
+			};
+			if( !asyncLoading )	finish( ret, job() );
+			else				pending.push_back( { ret, ThreadPool::shared().push( job ) } );
 		}
 		return ret;
 	}
+	void finish( int texID, LoadResult&& r ) {
+		// The target may itself be an alias already, or become one later; root()
+		// follows the rest of the chain.
+		if( r.aliasOf>=0 )	aliases[texID] = root( r.aliasOf );
+		else if( r.tex ) {
+			textures[texID] = std::move( *r.tex );
+			textures[texID].streamed = streamMips && textures[texID].levels.size()>1;
+			if( asyncUploads ) createStorage( texID );
+			if( worker && textures[texID].texID<1 ) createOnWorker( texID );
+		}
+	}
+	// Whatever createStorage() does not take is created whole on the worker; the
+	// slot stays empty meanwhile so bind() never creates it on the render thread.
+	void createOnWorker( int i ) {
+		auto tex = std::make_shared<Texture>();
+		*tex = std::move( textures[i] );
+		worker->push( [tex](){
+			tex->createGL();
+			glBindTexture( GL_TEXTURE_2D, 0 );
+		}, [this, i, tex](){
+			if( i<int(textures.size()) && textures[i].nChannels==0 ) textures[i] = std::move( *tex );
+		} );
+	}
+	// Creates the GL texture without data; the levels follow through the uploader,
+	// coarsest first, so the texture sharpens as they arrive.
+	void createStorage( int i ) {
+		Texture& tex = textures[i];
+		tex.bufferToLevel();
+		if( tex.levels.empty() || !findPixelFormat( tex.vkFormat ) ) return;
+		if( tex.texID>0 ) tex.clear();
+		tex.mipCount = int(tex.levels.size());
+		// Streamed textures evict single levels, so only the others get immutable storage;
+		// a single level gets room for the chain glGenerateMipmap adds.
+		const PixelFormat* pf = findPixelFormat( tex.vkFormat );
+		GLsizei w = tex.levels[0].width, h = tex.levels[0].height;
+		GLsizei allocLevels = tex.streamed?0:tex.mipCount;
+		if( allocLevels==1 && !pf->compressed() )
+			for( GLsizei s=std::max( w, h ); s>1; s/=2 ) allocLevels++;
+		auto setup = [inter=tex.inter, wrap_s=tex.wrap_s, wrap_t=tex.wrap_t, mipCount=tex.mipCount, pf, w, h, allocLevels]( GLuint id ) {
+			glBindTexture( GL_TEXTURE_2D, id );
+			Texture::setTexParam( inter, wrap_s, wrap_t );
+			if( mipCount>1 ) glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, mipCount-1 );
+			if( allocLevels>0 ) TextureUploader::allocate( pf, allocLevels, w, h );
+		};
+		glGenTextures( 1, &tex.texID );
+		if( worker ) {
+			// Only the name is taken here, the object is created by the worker's first bind.
+			GLuint id = tex.texID;
+			worker->push( [setup, id](){
+				setup( id );
+				glBindTexture( GL_TEXTURE_2D, 0 );
+			} );
+		}
+		else {
+			GLint oldTex = Texture::getBinding();
+			setup( tex.texID );
+			Texture::restoreBinding( oldTex );
+		}
+		tex.residentBase = tex.requestedBase = tex.mipCount;
+		tex.asyncUpload = true;
+		tex.texDataDirty = false;
+		tex.glW = tex.width;
+		tex.glH = tex.height;
+		tex.glN = tex.nChannels;
+		int target = tex.streamed?tex.tailBase():0;
+		for( int l=tex.mipCount-1; l>=target; l-- )
+			requestLevel( i, l );
+	}
+	void requestLevel( int i, int level ) {
+		textures[i].requestedBase = std::min( textures[i].requestedBase, level );
+		uploadQueue.push_back( { i, level } );
+	}
+	// Per frame on the GL thread: feeds queued levels to the ring and hands the
+	// finished copies to GL within the uploader's byte budget.
+	void pumpUploads() {
+		if( worker ) {
+			pushUploads();
+			return;
+		}
+		while( !uploadQueue.empty() ) {
+			auto [i, level] = uploadQueue.front();
+			Texture& tex = textures[i];
+			if( tex.texID<1 || level>=int(tex.levels.size()) ) {
+				uploadQueue.pop_front();
+				continue;
+			}
+			if( !uploader.enqueue( tex.texID, level, tex.levels[level], findPixelFormat( tex.vkFormat ), !tex.streamed,
+								  [this, i, level](){ levelUploaded( i, level ); } ) ) break;
+			uploadQueue.pop_front();
+		}
+		uploader.update();
+	}
+	// Hands every queued level to the worker. The job reads the level in place, it
+	// stays allocated until levelResident() runs on the render thread.
+	void pushUploads() {
+		for( ; !uploadQueue.empty(); uploadQueue.pop_front() ) {
+			auto [i, level] = uploadQueue.front();
+			Texture& tex = textures[i];
+			if( tex.texID<1 || level>=int(tex.levels.size()) ) continue;
+			const MipLevel& src = tex.levels[level];
+			const PixelFormat* pf = findPixelFormat( tex.vkFormat );
+			GLuint id = tex.texID;
+			GLsizei w = src.width, h = src.height;
+			const unsigned char* data = src.data.data();
+			size_t bytes = src.data.size();
+			bool genMips = level==0 && tex.mipCount==1;
+			bool allocated = !tex.streamed;
+			// Levels of a texture come coarsest first, so the base only goes down.
+			worker->push( [=](){
+				glBindTexture( GL_TEXTURE_2D, id );
+				TextureUploader::specify( pf, level, w, h, data, bytes, allocated );
+				glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level );
+				if( genMips ) glGenerateMipmap( GL_TEXTURE_2D );
+				glBindTexture( GL_TEXTURE_2D, 0 );
+			}, [this, i, level, id](){
+				if( i<int(textures.size()) && textures[i].texID==id ) levelResident( i, level );
+			} );
+		}
+	}
+	// Runs with the texture bound.
+	void levelUploaded( int i, int level ) {
+		Texture& tex = textures[i];
+		if( level<tex.residentBase )
+			glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level );
+		if( level==0 && tex.mipCount==1 ) glGenerateMipmap( GL_TEXTURE_2D );
+		levelResident( i, level );
+	}
+	void levelResident( int i, int level ) {
+		Texture& tex = textures[i];
+		tex.residentBase = std::min( tex.residentBase, level );
+		if( level==0 && !tex.streamed ) {
+			tex.levels.clear();
+			tex.levels.shrink_to_fit();
+		}
+	}
+	// Moves finished decodes into their slots. Returns the number still in flight.
+	int resolve( bool wait=false ) {
+		if( pending.empty() ) return 0;
+		for( auto it=pending.begin(); it!=pending.end(); ) {
+			if( wait || it->result.wait_for( std::chrono::seconds(0) )==std::future_status::ready ) {
+				finish( it->texID, it->result.get() );
+				it = pending.erase( it );
+			}
+			else it++;
+		}
+		if( pending.empty() ) printStats();
+		return int(pending.size());
+	}
+	int root( int i ) const {
+		while( aliases[i]!=i ) i = aliases[i];
+		return i;
+	}
+	bool ready( int i ) const {
+		if( i<0 || i>=int(textures.size()) ) return false;
+		const Texture& tex = textures[root( i )];
+		return tex.nChannels>0 && (!tex.asyncUpload || tex.residentBase<tex.mipCount);
+	}
+	void printStats() const {
+		int unique = 0;
+		for( int i=0; i<int(aliases.size()); i++ ) if( aliases[i]==i ) unique++;
+		std::lock_guard<std::mutex> lock( dedup->mtx );
+		printf("textures: %d unique, duplicates by path %d, by file %d, by pixels %d, saved %.1f MB\n",
+			   unique, dedup->pathHits, dedup->fileHits, dedup->pixelHits, dedup->bytesSaved/1048576.0 );
+	}
+	static BCFormat chooseFormat( const Texture& tex, TexUsage usage, bool bptc ) {
+		switch( usage ) {
+			case TexUsage::Normal:	return BCFormat::BC5;
+			case TexUsage::Mask:	return BCFormat::BC4;
+			case TexUsage::Color:
+			default:
+				if( bptc ) return BCFormat::BC7;
+				return tex.hasAlpha()?BCFormat::BC3:BCFormat::BC1;
+		}
+	}
+	// Mip chains are cached next to the source as <file>.<usage>[.raw].ktx2
+	// and reused while newer than the source. Safe to run off the GL thread.
+	static LoadResult loadTexture( const std::string& filename, bool sRGB, TexUsage usage,
+								  bool compress, bool bptc, HDRFormat hdrFormat, int maxSize, int texID, TextureDedup& dedup ) {
+		LoadResult r;
+		std::vector<unsigned char> bytes = loadBinary( filename );
+		if( bytes.empty() ) return r;
+		bool exr = isEXR( bytes.data(), bytes.size() );
+		bool isHDR = exr || stbi_is_hdr_from_memory( bytes.data(), int(bytes.size()) );
+		if( usage==TexUsage::Mask && sRGB ) usage = TexUsage::Color;
+		uint64_t variant = uint64_t(usage)*2+(sRGB?1:0);
+		
+		int w=0, h=0, n=0;
+		if( exr )	infoEXR( bytes.data(), bytes.size(), &w, &h, &n );
+		else		stbi_info_from_memory( bytes.data(), int(bytes.size()), &w, &h, &n );
+		r.aliasOf = dedup.findOrAdd( hashBytes( bytes.data(), bytes.size(), variant ), texID,
+									size_t(w)*h*n*(isHDR?4:1), dedup.fileHits );
+		if( r.aliasOf>=0 ) return r;
+		
+		r.tex = std::make_unique<Texture>();
+		Texture& tex = *r.tex;
+		tex.name = filename;
+		tex.normalMap = usage==TexUsage::Normal;
+		compress = compress && !isHDR;
+		std::string cacheName = filename + "." + usageTag( usage, sRGB ) + (compress?"":".raw") + ".ktx2";
+		if( isCacheFresh( cacheName, filename ) && tex.loadKTX2( cacheName ) ) {
+			auto hdrVkFormat = [&]( HDRFormat f ) {
+				const PixelFormat* pf = hdrPixelFormat( f, tex.nChannels );
+				return pf?pf->vkFormat:0u;
+			};
+			bool formatOK = isHDR?tex.vkFormat==hdrVkFormat( hdrFormat )
+								  || (exr && hdrFormat==HDRFormat::Float && tex.vkFormat==hdrVkFormat( HDRFormat::Half ))	// half EXRs are never widened
+								 :tex.compressedFormat()!=BCFormat::BC7 || bptc;
+			if( formatOK ) {
+				tex.name = filename;
+				return r;
+			}
+			tex.levels.clear();
+		}
+		if( !tex.loadFromMemory( bytes.data(), bytes.size(), filename, sRGB, -1, maxSize ) ) return r;
+		if( tex.buf ) {
+			size_t pixelBytes = size_t(tex.width)*tex.height*tex.nChannels*(tex.dataType==GL_FLOAT?4:tex.dataType==GL_HALF_FLOAT?2:1);
+			int aliasOf = dedup.findOrAdd( hashBytes( tex.buf, pixelBytes, ~variant ), texID, pixelBytes, dedup.pixelHits );
+			if( aliasOf>=0 ) {
+				r.tex.reset();
+				r.aliasOf = aliasOf;
+				return r;
+			}
+		}
+		bool ok = compress?tex.compress( chooseFormat( tex, usage, bptc ) )
+						  :isHDR?tex.packHDR( hdrFormat ):tex.generateMips();
+		if( ok ) tex.saveKTX2( cacheName );
+		return r;
+	}
 	size_t size() const {
 		return textures.size();
 	}
 	Texture& operator[] (int i) {
-		return textures[i];
+		return textures[root( i )];
 	}
 	const Texture& operator[] (int i) const {
-		return textures[i];
+		return textures[root( i )];
 	}
 };
 
@@ -382,6 +936,72 @@ struct Texture3D: Texture {
 
 
 
+// Cube map whose faces come as precomputed mip chains, e.g. from Model/IBL.
+// 'levels' holds the six faces of each level in GL order (+X,-X,+Y,-Y,+Z,-Z).
+// Seamless filtering is context state, the render context enables it (see main.cpp).
+struct TextureCube: Texture {
+	
+	TextureCube() : Texture() {
+		inter = GL_LINEAR_MIPMAP_LINEAR;
+		wrap_s = wrap_t = GL_CLAMP_TO_EDGE;
+	}
+	TextureCube( TextureCube&&a ): Texture( std::move(a) ) { }
+	
+	virtual bool setLevels( uint32_t vk, std::vector<MipLevel>&& faces ) {
+		if( faces.size()%6 ) return false;
+		return Texture::setLevels( vk, std::move( faces ) );
+	}
+	virtual void createGL() {
+		const PixelFormat* pf = findPixelFormat( vkFormat );
+		if( !pf || levels.empty() ) return;
+		if( texID>0 ) clear();
+		GLint oldTex = 0, oldAlign = 4;
+		glGetIntegerv( GL_TEXTURE_BINDING_CUBE_MAP, &oldTex );
+		glGetIntegerv( GL_UNPACK_ALIGNMENT, &oldAlign );
+		glPixelStorei( GL_UNPACK_ALIGNMENT, 1 );
+		glGenTextures( 1, &texID );
+		glBindTexture( GL_TEXTURE_CUBE_MAP, texID );
+		mipCount = int(levels.size()/6);
+		glTexParameteri( GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR );
+		glTexParameteri( GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, mipCount>1?inter:GL_LINEAR );
+		glTexParameteri( GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE );
+		glTexParameteri( GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE );
+		glTexParameteri( GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE );
+		glTexParameteri( GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, mipCount-1 );
+		for( int i=0; i<int(levels.size()); i++ ) {
+			const MipLevel& l = levels[i];
+			GLenum target = GL_TEXTURE_CUBE_MAP_POSITIVE_X+i%6;
+			if( pf->compressed() )
+				glCompressedTexImage2D( target, i/6, pf->internal, l.width, l.height, 0, GLsizei(l.data.size()), l.data.data() );
+			else
+				glTexImage2D( target, i/6, pf->internal, l.width, l.height, 0, pf->format, pf->type, l.data.data() );
+		}
+		glPixelStorei( GL_UNPACK_ALIGNMENT, oldAlign );
+		glBindTexture( GL_TEXTURE_CUBE_MAP, oldTex );
+		glW = width;
+		glH = height;
+		glN = nChannels;
+		texDataDirty = false;
+		levels.clear();
+		levels.shrink_to_fit();
+	}
+	virtual void bind( int slot ) {
+		if( texID<1 || texDataDirty ) {
+			glErr("Before Texture Create GL\n");
+			if( nChannels>0 ) createGL();
+			else return;
+			glErr("Texture Create GL\n");
+		}
+		glActiveTexture( GL_TEXTURE0 + slot );
+		glBindTexture( GL_TEXTURE_CUBE_MAP, texID );
+	}
+	virtual void bind( int slot, const Program& program, const std::string& name ) {
+		bind( slot );
+		program.setUniform( name, slot );
+	}
+};
+
+
 }
 
 #endif /* Texture_h */
@@ -0,0 +1,144 @@
+//
+//  TextureFormat.hpp
+//  AR_Framework
+//
+
+#ifndef TextureFormat_hpp
+#define TextureFormat_hpp
+
+#include "Tools/gl.hpp"
+#include <vector>
+#include <cstdint>
+
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT			0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT		0x83F3
+#endif
+#ifndef GL_COMPRESSED_SRGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_SRGB_S3TC_DXT1_EXT		0x8C4C
+#endif
+#ifndef GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT	0x8C4F
+#endif
+#ifndef GL_COMPRESSED_RED_RGTC1
+#define GL_COMPRESSED_RED_RGTC1					0x8DBB
+#endif
+#ifndef GL_COMPRESSED_RG_RGTC2
+#define GL_COMPRESSED_RG_RGTC2					0x8DBD
+#endif
+#ifndef GL_COMPRESSED_RGBA_BPTC_UNORM
+#define GL_COMPRESSED_RGBA_BPTC_UNORM			0x8E8C
+#endif
+#ifndef GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM
+#define GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM		0x8E8D
+#endif
+#ifndef GL_R11F_G11F_B10F
+#define GL_R11F_G11F_B10F						0x8C3A
+#define GL_UNSIGNED_INT_10F_11F_11F_REV			0x8C3B
+#endif
+#ifndef GL_RGB9_E5
+#define GL_RGB9_E5								0x8C3D
+#define GL_UNSIGNED_INT_5_9_9_9_REV				0x8C3E
+#endif
+
+namespace AR {
+
+enum class BCFormat { None, BC1, BC3, BC4, BC5, BC7 };
+
+// How a texture slot is sampled by render.frag; decides the block format.
+enum class TexUsage { Color, Normal, Mask };
+
+// One level of a precomputed mip chain, tightly packed.
+struct MipLevel {
+	GLsizei width=0, height=0;
+	std::vector<unsigned char> data;
+};
+
+// Storage format shared by the KTX2 cache and the GL upload path.
+struct PixelFormat {
+	uint32_t vkFormat;
+	GLenum internal, format, type;
+	int blockDim;			// 1 for plain formats, 4 for BCn
+	int blockBytes;			// bytes per block (or per pixel)
+	int nChannels;
+	bool sRGB;
+	BCFormat bc;
+	bool compressed() const { return bc!=BCFormat::None; }
+	bool isFloat() const {
+		return type==GL_FLOAT || type==GL_HALF_FLOAT || type==GL_UNSIGNED_INT_10F_11F_11F_REV || type==GL_UNSIGNED_INT_5_9_9_9_REV;
+	}
+	size_t levelBytes( int w, int h ) const {
+		size_t bw = (w+blockDim-1)/blockDim, bh = (h+blockDim-1)/blockDim;
+		return bw*bh*blockBytes;
+	}
+};
+
+inline const std::vector<PixelFormat>& pixelFormats() {
+	static const std::vector<PixelFormat> table = {
+		{   9, GL_R8,			GL_RED,	 GL_UNSIGNED_BYTE, 1, 1, 1, false, BCFormat::None },
+		{  16, GL_RG8,			GL_RG,	 GL_UNSIGNED_BYTE, 1, 2, 2, false, BCFormat::None },
+		{  23, GL_RGB8,			GL_RGB,	 GL_UNSIGNED_BYTE, 1, 3, 3, false, BCFormat::None },
+		{  29, GL_SRGB8,		GL_RGB,	 GL_UNSIGNED_BYTE, 1, 3, 3, true,  BCFormat::None },
+		{  37, GL_RGBA8,		GL_RGBA, GL_UNSIGNED_BYTE, 1, 4, 4, false, BCFormat::None },
+		{  43, GL_SRGB8_ALPHA8,	GL_RGBA, GL_UNSIGNED_BYTE, 1, 4, 4, true,  BCFormat::None },
+		{ 100, GL_R32F,			GL_RED,	 GL_FLOAT,		   1, 4, 1, false, BCFormat::None },
+		{ 103, GL_RG32F,		GL_RG,	 GL_FLOAT,		   1, 8, 2, false, BCFormat::None },
+		{ 106, GL_RGB32F,		GL_RGB,	 GL_FLOAT,		   1,12, 3, false, BCFormat::None },
+		{ 109, GL_RGBA32F,		GL_RGBA, GL_FLOAT,		   1,16, 4, false, BCFormat::None },
+		{  76, GL_R16F,			GL_RED,	 GL_HALF_FLOAT,	   1, 2, 1, false, BCFormat::None },
+		{  83, GL_RG16F,		GL_RG,	 GL_HALF_FLOAT,	   1, 4, 2, false, BCFormat::None },
+		{  90, GL_RGB16F,		GL_RGB,	 GL_HALF_FLOAT,	   1, 6, 3, false, BCFormat::None },
+		{  97, GL_RGBA16F,		GL_RGBA, GL_HALF_FLOAT,	   1, 8, 4, false, BCFormat::None },
+		{ 122, GL_R11F_G11F_B10F,	GL_RGB,	 GL_UNSIGNED_INT_10F_11F_11F_REV, 1, 4, 3, false, BCFormat::None },
+		{ 123, GL_RGB9_E5,			GL_RGB,	 GL_UNSIGNED_INT_5_9_9_9_REV,	  1, 4, 3, false, BCFormat::None },
+		{ 131, GL_COMPRESSED_RGB_S3TC_DXT1_EXT,			GL_RGB,	 0, 4,  8, 3, false, BCFormat::BC1 },
+		{ 132, GL_COMPRESSED_SRGB_S3TC_DXT1_EXT,		GL_RGB,	 0, 4,  8, 3, true,  BCFormat::BC1 },
+		{ 137, GL_COMPRESSED_RGBA_S3TC_DXT5_EXT,		GL_RGBA, 0, 4, 16, 4, false, BCFormat::BC3 },
+		{ 138, GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT,	GL_RGBA, 0, 4, 16, 4, true,  BCFormat::BC3 },
+		{ 139, GL_COMPRESSED_RED_RGTC1,					GL_RED,	 0, 4,  8, 1, false, BCFormat::BC4 },
+		{ 141, GL_COMPRESSED_RG_RGTC2,					GL_RG,	 0, 4, 16, 2, false, BCFormat::BC5 },
+		{ 145, GL_COMPRESSED_RGBA_BPTC_UNORM,			GL_RGBA, 0, 4, 16, 4, false, BCFormat::BC7 },
+		{ 146, GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM,		GL_RGBA, 0, 4, 16, 4, true,  BCFormat::BC7 },
+	};
+	return table;
+}
+
+inline const PixelFormat* findPixelFormat( uint32_t vkFormat ) {
+	for( auto& f: pixelFormats() ) if( f.vkFormat==vkFormat ) return &f;
+	return nullptr;
+}
+
+inline const PixelFormat* findPixelFormat( BCFormat bc, bool sRGB ) {
+	if( bc==BCFormat::BC4 || bc==BCFormat::BC5 ) sRGB = false;
+	for( auto& f: pixelFormats() ) if( f.bc==bc && f.sRGB==sRGB ) return &f;
+	return nullptr;
+}
+
+inline const PixelFormat* findPixelFormat( GLenum type, int nChannels, bool sRGB ) {
+	if( type!=GL_UNSIGNED_BYTE || nChannels<3 ) sRGB = false;
+	for( auto& f: pixelFormats() )
+		if( f.bc==BCFormat::None && f.type==type && f.nChannels==nChannels && f.sRGB==sRGB ) return &f;
+	return nullptr;
+}
+
+// BC7 is core only from GL 4.2, so macOS (4.1) falls back to BC1/BC3.
+inline bool isBPTCSupported() {
+#ifdef __APPLE__
+	return false;
+#else
+	static int supported = -1;
+	if( supported<0 ) {
+		GLint major=0, minor=0;
+		glGetIntegerv( GL_MAJOR_VERSION, &major );
+		glGetIntegerv( GL_MINOR_VERSION, &minor );
+		supported = ( major>4 || (major==4 && minor>=2) || GLEW_ARB_texture_compression_bptc )?1:0;
+	}
+	return supported>0;
+#endif
+}
+
+}
+
+#endif /* TextureFormat_hpp */
@@ -0,0 +1,121 @@
+//
+//  TextureStreamer.hpp
+//  AR_Framework
+//
+
+#ifndef TextureStreamer_hpp
+#define TextureStreamer_hpp
+
+#include "Texture.hpp"
+#include "TriMesh.hpp"
+#include "Camera.hpp"
+#include <algorithm>
+
+namespace AR {
+
+// Keeps streamed textures at the mip level their on-screen footprint needs.
+// Per frame: beginFrame(), request() for every drawn mesh, then update().
+struct TextureStreamer {
+	size_t budget = size_t(512)<<20;				// resident bytes of streamed textures
+	size_t uploadBytesPerFrame = size_t(16)<<20;
+	int tailSize = 64;								// levels up to this size are always resident
+	uint64_t frame = 0;
+	size_t residentBytes = 0;
+
+	void beginFrame( TextureLib& lib ) {
+		frame++;
+		for( auto& tex: lib.textures )
+			if( tex.streamed ) tex.wantedBase = tex.tailBase( tailSize );
+	}
+
+	// Finest mip the mesh needs for a texture of the given size, or -1 when off screen.
+	static float mipLevel( const TriMesh& mesh, const Camera& camera, int texSize ) {
+		if( mesh.uvDensity<=0 || texSize<1 ) return -1;
+		vec3 center = vec3( mesh.modelMat*vec4( (mesh.boundMin+mesh.boundMax)*.5f, 1 ) );
+		float scale = cbrtf( fabsf( determinant( mat3( mesh.modelMat ) ) ) );
+		float radius = length( mesh.boundMax-mesh.boundMin )*.5f*scale;
+
+		vec4 viewCenter = camera.viewMat()*vec4( center, 1 );
+		float t = tanf( camera.fov*.5f ), aspect = camera.viewport.x/camera.viewport.y;
+		float depth = -viewCenter.z;
+		if( depth+radius<camera.zNear || depth-radius>camera.zFar ) return -1;
+		float slack = radius*sqrtf( 1+t*t*aspect*aspect );
+		if( fabsf( viewCenter.x )>depth*t*aspect+slack || fabsf( viewCenter.y )>depth*t+radius*sqrtf( 1+t*t ) ) return -1;
+
+		float dist = std::max( length( center-camera.position )-radius, camera.zNear );
+		float pixelsPerUnit = camera.viewport.y/(2*dist*t);
+		float texelsPerPixel = mesh.uvDensity/scale*texSize/pixelsPerUnit;
+		return std::max( 0.f, log2f( texelsPerPixel ) );
+	}
+	void request( TextureLib& lib, int texID, const TriMesh& mesh, const Camera& camera ) {
+		if( !lib.ready( texID ) ) return;
+		Texture& tex = lib[texID];
+		if( !tex.streamed ) return;
+		float level = mipLevel( mesh, camera, std::max( tex.width, tex.height ) );
+		if( level<0 ) return;
+		tex.wantedBase = std::min( tex.wantedBase, int( level ) );
+		tex.lastUsed = frame;
+	}
+	void request( TextureLib& lib, const TriMesh& mesh, const Camera& camera ) {
+		if( !mesh.visible ) return;
+		const Material& m = mesh.material;
+		for( int id: { m.diffTexID, m.specTexID, m.bumpMapID, m.normMapID, m.emissionMapID,
+			m.roughnessMapID, m.opacityMapID, m.metalnessMapID, m.ambOccMatID } )
+			request( lib, id, mesh, camera );
+	}
+
+	// Requests the most under-resolved textures one level at a time, evicting the
+	// least recently used surplus levels to stay within the budget.
+	void update( TextureLib& lib ) {
+		std::vector<int> live;
+		residentBytes = 0;
+		for( int i=0; i<int(lib.size()); i++ ) {
+			Texture& tex = lib.textures[i];
+			if( lib.aliases[i]!=i || !tex.streamed || tex.texID<1 ) continue;
+			live.push_back( i );
+			residentBytes += tex.residentBytes();
+		}
+		std::vector<int> victims = live;
+		std::sort( victims.begin(), victims.end(), [&]( int a, int b ) {
+			return lib.textures[a].lastUsed<lib.textures[b].lastUsed;
+		} );
+		size_t v = 0;
+		auto evict = [&]( size_t need ) {
+			size_t freed = 0;
+			while( freed<need && v<victims.size() ) {
+				Texture& t = lib.textures[victims[v]];
+				bool surplus = t.residentBase<t.wantedBase && t.requestedBase==t.residentBase;
+				if( !surplus || t.residentBase>=t.tailBase( tailSize ) ) { v++; continue; }
+				freed += t.levelBytes( t.residentBase );
+				t.setResidentBase( t.residentBase+1 );
+			}
+			residentBytes -= std::min( freed, residentBytes );
+			return freed>=need;
+		};
+
+		std::vector<int> wants;
+		for( int i: live ) if( lib.textures[i].wantedBase<lib.textures[i].requestedBase ) wants.push_back( i );
+		std::sort( wants.begin(), wants.end(), [&]( int a, int b ) {
+			const Texture& ta = lib.textures[a], & tb = lib.textures[b];
+			return ta.requestedBase-ta.wantedBase>tb.requestedBase-tb.wantedBase;
+		} );
+		size_t requested = 0;
+		for( int i: wants ) {
+			Texture& t = lib.textures[i];
+			while( t.wantedBase<t.requestedBase && requested<uploadBytesPerFrame ) {
+				int level = t.requestedBase-1;
+				size_t bytes = t.levelBytes( level );
+				if( residentBytes+bytes>budget && !evict( residentBytes+bytes-budget ) ) break;
+				if( t.asyncUpload )	lib.requestLevel( i, level );
+				else				t.setResidentBase( level );
+				residentBytes += bytes;
+				requested += bytes;
+			}
+		}
+		if( residentBytes>budget ) evict( residentBytes-budget );
+	}
+};
+
+}
+
+#endif /* TextureStreamer_hpp */
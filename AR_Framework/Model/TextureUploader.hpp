@@ -0,0 +1,234 @@
+//
+//  TextureUploader.hpp
+//  AR_Framework
+//
+
+#ifndef TextureUploader_hpp
+#define TextureUploader_hpp
+
+#include "TextureFormat.hpp"
+#include "Tools/ThreadPool.hpp"
+#include <cstring>
+
+namespace AR {
+
+// Ring of pixel unpack buffers. Mip levels are copied into a slot on the thread
+// pool and specified from the buffer on the GL thread; a fence recycles the slot.
+// Buffers are persistently mapped where GL 4.4 / ARB_buffer_storage exists,
+// otherwise (macOS GL 4.1) each slot is mapped unsynchronized while it is filled.
+// Textures whose storage was made with allocate() get their levels by SubImage;
+// streamed ones are specified level by level since eviction frees single levels,
+// which immutable storage cannot.
+struct TextureUploader {
+	struct Slot {
+		GLuint pbo = 0;
+		unsigned char* ptr = nullptr;
+		GLsync fence = 0;
+		bool busy = false;
+	};
+	struct Job {
+		int slot;
+		GLuint texID;
+		GLint level;
+		GLsizei width, height;
+		const PixelFormat* pf;
+		size_t bytes;
+		bool allocated;
+		std::future<void> copied;
+		std::function<void()> done;
+	};
+	int nSlots = 4;
+	size_t slotSize = size_t(16)<<20;
+	size_t frameBudget = size_t(32)<<20;		// bytes handed to GL per update()
+	std::vector<Slot> slots;
+	std::deque<Job> jobs;
+	bool persistent = false;
+
+	~TextureUploader() { release(); }
+
+	static bool isPersistentMappingSupported() {
+#if defined(__APPLE__) || !defined(GL_MAP_PERSISTENT_BIT)
+		return false;
+#else
+		GLint major=0, minor=0;
+		glGetIntegerv( GL_MAJOR_VERSION, &major );
+		glGetIntegerv( GL_MINOR_VERSION, &minor );
+		return major>4 || (major==4 && minor>=4) || GLEW_ARB_buffer_storage;
+#endif
+	}
+	void init() {
+		if( !slots.empty() ) return;
+		persistent = isPersistentMappingSupported();
+		slots.resize( nSlots );
+		for( auto& s: slots ) {
+			glGenBuffers( 1, &s.pbo );
+			glBindBuffer( GL_PIXEL_UNPACK_BUFFER, s.pbo );
+#if !defined(__APPLE__) && defined(GL_MAP_PERSISTENT_BIT)
+			if( persistent ) {
+				GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+				glBufferStorage( GL_PIXEL_UNPACK_BUFFER, slotSize, nullptr, flags );
+				s.ptr = (unsigned char*)glMapBufferRange( GL_PIXEL_UNPACK_BUFFER, 0, slotSize, flags );
+			}
+			else
+#endif
+			glBufferData( GL_PIXEL_UNPACK_BUFFER, slotSize, nullptr, GL_STREAM_DRAW );
+		}
+		glBindBuffer( GL_PIXEL_UNPACK_BUFFER, 0 );
+	}
+	void release() {
+		cancel();
+		for( auto& s: slots ) {
+			if( s.fence ) glDeleteSync( s.fence );
+			if( s.pbo ) glDeleteBuffers( 1, &s.pbo );
+		}
+		slots.clear();
+	}
+
+	// glTexStorage2D is core from GL 4.2, so macOS (4.1) allocates mutable levels instead.
+	static bool isTexStorageSupported() {
+#ifdef __APPLE__
+		return false;
+#else
+		static int supported = -1;
+		if( supported<0 ) {
+			GLint major=0, minor=0;
+			glGetIntegerv( GL_MAJOR_VERSION, &major );
+			glGetIntegerv( GL_MINOR_VERSION, &minor );
+			supported = ( major>4 || (major==4 && minor>=2) || GLEW_ARB_texture_storage )?1:0;
+		}
+		return supported>0;
+#endif
+	}
+	// Allocates every level of the bound texture up front, so levels only copy pixels.
+	static void allocate( const PixelFormat* pf, GLsizei levels, GLsizei w, GLsizei h ) {
+#ifndef __APPLE__
+		if( isTexStorageSupported() ) {
+			glTexStorage2D( GL_TEXTURE_2D, levels, pf->internal, w, h );
+			return;
+		}
+#endif
+		for( GLint l=0; l<levels; l++, w=std::max( w/2, 1 ), h=std::max( h/2, 1 ) ) {
+			if( pf->compressed() )
+				glCompressedTexImage2D( GL_TEXTURE_2D, l, pf->internal, w, h, 0, GLsizei(pf->levelBytes( w, h )), nullptr );
+			else
+				glTexImage2D( GL_TEXTURE_2D, l, pf->internal, w, h, 0, pf->format, pf->type, nullptr );
+		}
+	}
+
+	// Queues one level. 'src' has to stay alive until 'done' runs, which happens on
+	// the GL thread with the texture bound, right after the level is specified.
+	// 'allocated' when the texture's storage came from allocate().
+	// Returns false when the ring is full; try again next frame.
+	bool enqueue( GLuint texID, int level, const MipLevel& src, const PixelFormat* pf, bool allocated, std::function<void()> done ) {
+		init();
+		size_t bytes = src.data.size();
+		if( bytes>slotSize ) {
+			if( !jobs.empty() ) return false;		// keep the order of levels
+			GLint oldTex = 0, oldAlign = 4;
+			glGetIntegerv( GL_TEXTURE_BINDING_2D, &oldTex );
+			glGetIntegerv( GL_UNPACK_ALIGNMENT, &oldAlign );
+			glPixelStorei( GL_UNPACK_ALIGNMENT, 1 );
+			glBindTexture( GL_TEXTURE_2D, texID );
+			specify( pf, level, src.width, src.height, src.data.data(), bytes, allocated );
+			if( done ) done();
+			glPixelStorei( GL_UNPACK_ALIGNMENT, oldAlign );
+			glBindTexture( GL_TEXTURE_2D, oldTex );
+			return true;
+		}
+		int si = freeSlot();
+		if( si<0 ) return false;
+		Slot& s = slots[si];
+		if( !persistent ) {
+			glBindBuffer( GL_PIXEL_UNPACK_BUFFER, s.pbo );
+			s.ptr = (unsigned char*)glMapBufferRange( GL_PIXEL_UNPACK_BUFFER, 0, bytes,
+				GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT | GL_MAP_UNSYNCHRONIZED_BIT );
+			glBindBuffer( GL_PIXEL_UNPACK_BUFFER, 0 );
+			if( !s.ptr ) return false;
+		}
+		s.busy = true;
+		unsigned char* dst = s.ptr;
+		const unsigned char* data = src.data.data();
+		jobs.push_back( { si, texID, level, src.width, src.height, pf, bytes, allocated,
+			ThreadPool::shared().push( [dst, data, bytes](){ memcpy( dst, data, bytes ); } ), std::move( done ) } );
+		return true;
+	}
+
+	// Specifies the levels whose copies have finished, in queue order, up to frameBudget bytes.
+	void update() {
+		if( jobs.empty() ) return;
+		GLint oldTex = 0, oldAlign = 4;
+		glGetIntegerv( GL_TEXTURE_BINDING_2D, &oldTex );
+		glGetIntegerv( GL_UNPACK_ALIGNMENT, &oldAlign );
+		glPixelStorei( GL_UNPACK_ALIGNMENT, 1 );
+		size_t submitted = 0;
+		while( !jobs.empty() && (submitted==0 || submitted+jobs.front().bytes<=frameBudget) ) {
+			Job& j = jobs.front();
+			if( j.copied.wait_for( std::chrono::seconds(0) )!=std::future_status::ready ) break;
+			Slot& s = slots[j.slot];
+			glBindBuffer( GL_PIXEL_UNPACK_BUFFER, s.pbo );
+			if( !persistent ) {
+				glUnmapBuffer( GL_PIXEL_UNPACK_BUFFER );
+				s.ptr = nullptr;
+			}
+			glBindTexture( GL_TEXTURE_2D, j.texID );
+			specify( j.pf, j.level, j.width, j.height, nullptr, j.bytes, j.allocated );
+			glBindBuffer( GL_PIXEL_UNPACK_BUFFER, 0 );
+			if( j.done ) j.done();
+			s.fence = glFenceSync( GL_SYNC_GPU_COMMANDS_COMPLETE, 0 );
+			s.busy = false;
+			submitted += j.bytes;
+			jobs.pop_front();
+		}
+		glPixelStorei( GL_UNPACK_ALIGNMENT, oldAlign );
+		glBindTexture( GL_TEXTURE_2D, oldTex );
+	}
+
+	// Waits for running copies and drops everything queued, e.g. before the
+	// textures the jobs point at are deleted.
+	void cancel() {
+		for( auto& j: jobs ) {
+			j.copied.wait();
+			Slot& s = slots[j.slot];
+			if( !persistent ) {
+				glBindBuffer( GL_PIXEL_UNPACK_BUFFER, s.pbo );
+				glUnmapBuffer( GL_PIXEL_UNPACK_BUFFER );
+				glBindBuffer( GL_PIXEL_UNPACK_BUFFER, 0 );
+				s.ptr = nullptr;
+			}
+			s.busy = false;
+		}
+		jobs.clear();
+	}
+	size_t pending() const { return jobs.size(); }
+	static void specify( const PixelFormat* pf, GLint level, GLsizei w, GLsizei h, const void* data, size_t bytes, bool allocated ) {
+		if( allocated ) {
+			if( pf->compressed() )
+				glCompressedTexSubImage2D( GL_TEXTURE_2D, level, 0, 0, w, h, pf->internal, GLsizei(bytes), data );
+			else
+				glTexSubImage2D( GL_TEXTURE_2D, level, 0, 0, w, h, pf->format, pf->type, data );
+		}
+		else if( pf->compressed() )
+			glCompressedTexImage2D( GL_TEXTURE_2D, level, pf->internal, w, h, 0, GLsizei(bytes), data );
+		else
+			glTexImage2D( GL_TEXTURE_2D, level, pf->internal, w, h, 0, pf->format, pf->type, data );
+	}
+
+protected:
+	int freeSlot() {
+		for( int i=0; i<int(slots.size()); i++ ) {
+			Slot& s = slots[i];
+			if( s.busy ) continue;
+			if( s.fence ) {
+				if( glClientWaitSync( s.fence, 0, 0 )==GL_TIMEOUT_EXPIRED ) continue;
+				glDeleteSync( s.fence );
+				s.fence = 0;
+			}
+			return i;
+		}
+		return -1;
+	}
+};
+
+}
+
+#endif /* TextureUploader_hpp */
@@ -16,23 +16,32 @@
 
 namespace AR {
 
+// Up to four bone influences of a vertex: slots of the mesh's Skin and UNORM8
+// weights adding up to 255. Unused influences have weight 0.
+struct VertexSkin {
+	uint8_t bones[4];
+	uint8_t weights[4];
+};
+
 struct MeshData {
 	std::vector<vec3> verts;
 	std::vector<vec3> norms;
 	std::vector<vec2> tcoords;
 	std::vector<uvec3> tris;
+	std::vector<VertexSkin> skin;		// per vertex, empty for static meshes
 	
 	MeshData() {}
 	MeshData(MeshData& a)
-	: verts(a.verts), norms(a.norms), tcoords(a.tcoords), tris(a.tris){}
+	: verts(a.verts), norms(a.norms), tcoords(a.tcoords), tris(a.tris), skin(a.skin){}
 	MeshData(MeshData&& a)
 	: verts(std::move(a.verts)), norms(std::move(a.norms)),
-	tcoords(std::move(a.tcoords)), tris(std::move(a.tris)){}
+	tcoords(std::move(a.tcoords)), tris(std::move(a.tris)), skin(std::move(a.skin)){}
 	MeshData& operator = (MeshData&& a) {
 		verts = std::move(a.verts);
 		norms = std::move(a.norms);
 		tcoords = std::move(a.tcoords);
 		tris = std::move(a.tris);
+		skin = std::move(a.skin);
 		return *this;
 	}
 	MeshData& operator = (const MeshData& a) {
@@ -40,6 +49,7 @@ struct MeshData {
 		norms = a.norms;
 		tcoords = a.tcoords;
 		tris = a.tris;
+		skin = a.skin;
 		return *this;
 	}
 	virtual void clear() {
@@ -47,6 +57,7 @@ struct MeshData {
 		norms.clear();
 		tcoords.clear();
 		tris.clear();
+		skin.clear();
 	}
 	static void computeNormals( const std::vector<vec3>& vertices, const std::vector<ivec3>& ftris, std::vector<vec3>& normals  ) {
 		normals.resize( vertices.size(), {0,0,0} );
@@ -58,7 +69,7 @@ struct MeshData {
 			normals[t.y]+=n;
 			normals[t.z]+=n;
 		}
-		for( auto& n: normals ) n = normalize( n );
+		normalizeArray( normals.data(), normals.size() );
 	}
 	static void computeNormals( const std::vector<vec3>& vertices, const std::vector<uvec3>& ftris, std::vector<vec3>& normals  ) {
 		normals.resize( vertices.size(), {0,0,0} );
@@ -70,7 +81,7 @@ struct MeshData {
 			normals[t.y]+=n;
 			normals[t.z]+=n;
 		}
-		for( auto& n: normals ) n = normalize( n );
+		normalizeArray( normals.data(), normals.size() );
 	}
 	virtual void build(const std::vector<vec3>& vertices,
 					   const std::vector<vec2>& txcoords,
@@ -133,27 +144,37 @@ struct TriMesh {
 	MeshData data;
 	bool dataDirty = false;
 
-	GLuint vao = 0, vBuf = 0, eBuf = 0, tBuf = 0, nBuf = 0;
+	GLuint vao = 0, vBuf = 0, eBuf = 0, tBuf = 0, nBuf = 0, sBuf = 0, aoBuf = 0;
 	GLsizei nTris = 0, nVerts = 0;
 	
 	mat4 modelMat = mat4(1);
 	mat3 texMat = mat3(1);
 	bool visible = true;
 	Material material;
+	vec3 boundMin = vec3(0), boundMax = vec3(0);	// object space, kept after the data is uploaded
+	float uvDensity = 0;							// texture coordinate units per object space unit
+	bool uploading = false;							// buffers are being created off the render thread
+	int boneOffset = -1;							// first bone of the palette in Animator's buffer, -1 when not skinned
+	int node = -1;									// SceneGraph node giving modelMat, -1 when set by hand
+	std::vector<uint8_t> vertexAO;					// baked occlusion per vertex waiting for prepareGL(), 255 open
 		
 	TriMesh()
-	: vao(0), vBuf(0), eBuf(0), tBuf(0), nBuf(0), nTris(0), nVerts(0), modelMat(1), texMat(1), material(Material()), visible(true) {}
+	: vao(0), vBuf(0), eBuf(0), tBuf(0), nBuf(0), nTris(0), nVerts(0), modelMat(1), texMat(1), visible(true), material(Material()) {}
 	
 	TriMesh(TriMesh&&a)
-	: vao(a.vao), vBuf(a.vBuf), eBuf(a.eBuf), nBuf(a.nBuf), tBuf(a.tBuf), nTris(a.nTris), nVerts(a.nVerts),
-	modelMat(a.modelMat), texMat(a.texMat), material(a.material), visible(a.visible),
-	data(std::move(a.data)), dataDirty(true) {
+	: data(std::move(a.data)), dataDirty(true),
+	vao(a.vao), vBuf(a.vBuf), eBuf(a.eBuf), tBuf(a.tBuf), nBuf(a.nBuf), sBuf(a.sBuf), aoBuf(a.aoBuf), nTris(a.nTris), nVerts(a.nVerts),
+	modelMat(a.modelMat), texMat(a.texMat), visible(a.visible), material(a.material),
+	boundMin(a.boundMin), boundMax(a.boundMax), uvDensity(a.uvDensity), uploading(a.uploading), boneOffset(a.boneOffset), node(a.node),
+	vertexAO(std::move(a.vertexAO)) {
 		a.dataDirty = false;
 		a.vao	= 0;
 		a.eBuf	= 0;
 		a.tBuf	= 0;
 		a.vBuf	= 0;
 		a.nBuf	= 0;
+		a.sBuf	= 0;
+		a.aoBuf	= 0;
 	}
 	
 	virtual void setData( MeshData&& d ) {
@@ -171,12 +192,115 @@ struct TriMesh {
 		if( nBuf ) glDeleteBuffers( 1, &nBuf ); nBuf = 0;
 		if( tBuf ) glDeleteBuffers( 1, &tBuf ); tBuf = 0;
 		if( eBuf ) glDeleteBuffers( 1, &eBuf ); eBuf = 0;
+		if( sBuf ) glDeleteBuffers( 1, &sBuf ); sBuf = 0;
+		if( aoBuf ) glDeleteBuffers( 1, &aoBuf ); aoBuf = 0;
 		data.clear();
 		nTris = 0;
 		nVerts = 0;
 	}
-	virtual void createMeshGL() {
+	virtual void computeBounds() {
+		if( data.verts.empty() ) return;
+		computeBounds( data, boundMin, boundMax, uvDensity );
+	}
+	static void computeBounds( const MeshData& data, vec3& boundMin, vec3& boundMax, float& uvDensity ) {
+		if( data.verts.empty() ) return;
+		boundMin = boundMax = data.verts[0];
+		bounds( data.verts.data(), data.verts.size(), boundMin, boundMax );
+		double uvArea = 0, area = 0;
+		if( data.tcoords.size()==data.verts.size() ) for( auto& t: data.tris ) {
+			vec2 a = data.tcoords[t.y]-data.tcoords[t.x], b = data.tcoords[t.z]-data.tcoords[t.x];
+			uvArea += fabs( a.x*b.y-a.y*b.x );
+			area += length( cross( data.verts[t.y]-data.verts[t.x], data.verts[t.z]-data.verts[t.x] ) );
+		}
+		uvDensity = area>0?float( sqrt( uvArea/area ) ):0.f;
+	}
+	// World space bounding sphere, centre in xyz and radius in w.
+	vec4 boundingSphere() const {
+		vec3 center = vec3( modelMat*vec4( (boundMin+boundMax)*.5f, 1 ) );
+		float scale = std::max( length( vec3( modelMat[0] ) ), std::max( length( vec3( modelMat[1] ) ), length( vec3( modelMat[2] ) ) ) );
+		return vec4( center, length( boundMax-boundMin )*.5f*scale );
+	}
+	// Buffer objects of one mesh. They can be created on any context sharing
+	// objects with the render thread's (see UploadWorker), the vertex array
+	// is built around them later by adoptBuffers() on the render thread.
+	struct Buffers {
+		GLuint vBuf = 0, nBuf = 0, tBuf = 0, eBuf = 0, sBuf = 0;
+		GLsizei nTris = 0, nVerts = 0;
+		vec3 boundMin = vec3(0), boundMax = vec3(0);
+		float uvDensity = 0;
+	};
+	static Buffers createBuffers( const MeshData& data ) {
+		Buffers b;
+		computeBounds( data, b.boundMin, b.boundMax, b.uvDensity );
+		b.nTris  = GLsizei(data.tris.size());
+		b.nVerts = GLsizei(data.verts.size());
+		auto create = [&]( GLuint& buf, GLenum target, size_t bytes, const void* ptr ) {
+			glGenBuffers( 1, &buf );
+			glBindBuffer( target, buf );
+			glBufferData( target, bytes, ptr, GL_STATIC_DRAW );
+			glBindBuffer( target, 0 );
+		};
+		create( b.vBuf, GL_ARRAY_BUFFER, sizeof(vec3) * b.nVerts, data.verts.data() );
+		if( data.norms.size()>0 )
+			create( b.nBuf, GL_ARRAY_BUFFER, sizeof(vec3) * b.nVerts, data.norms.data() );
+		if( data.tcoords.size()>0 )
+			create( b.tBuf, GL_ARRAY_BUFFER, sizeof(vec2) * b.nVerts, data.tcoords.data() );
+		if( data.skin.size()>0 )
+			create( b.sBuf, GL_ARRAY_BUFFER, sizeof(VertexSkin) * b.nVerts, data.skin.data() );
+		create( b.eBuf, GL_ELEMENT_ARRAY_BUFFER, sizeof(uvec3) * b.nTris, data.tris.data() );
+		return b;
+	}
+	static void deleteBuffers( Buffers& b ) {
+		GLuint bufs[] = { b.vBuf, b.nBuf, b.tBuf, b.eBuf, b.sBuf };
+		for( GLuint buf: bufs ) if( buf ) glDeleteBuffers( 1, &buf );
+		b = Buffers();
+	}
+	// Takes over the buffers, replacing the current ones, and clears pending data.
+	virtual void adoptBuffers( const Buffers& b ) {
+		if( vao ) glDeleteVertexArrays(1, &vao);
+		if( vBuf ) glDeleteBuffers(1, &vBuf);
+		if( nBuf ) glDeleteBuffers(1, &nBuf);
+		if( tBuf ) glDeleteBuffers(1, &tBuf);
+		if( eBuf ) glDeleteBuffers(1, &eBuf);
+		if( sBuf ) glDeleteBuffers(1, &sBuf);
+		if( aoBuf ) glDeleteBuffers(1, &aoBuf);		// baked for the old vertices
+		aoBuf = 0;
+		vBuf = b.vBuf; nBuf = b.nBuf; tBuf = b.tBuf; eBuf = b.eBuf; sBuf = b.sBuf;
+		nTris = b.nTris; nVerts = b.nVerts;
+		boundMin = b.boundMin; boundMax = b.boundMax; uvDensity = b.uvDensity;
 		
+		glGenVertexArrays(1, &vao );
+		glBindVertexArray( vao );
+		glBindBuffer( GL_ARRAY_BUFFER, vBuf);
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
+		if( nBuf ) {
+			glBindBuffer(GL_ARRAY_BUFFER, nBuf);
+			glEnableVertexAttribArray(1);
+			glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, 0);
+		}
+		if( tBuf ) {
+			glBindBuffer(GL_ARRAY_BUFFER, tBuf);
+			glEnableVertexAttribArray(2);
+			glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 0, 0);
+		}
+		if( sBuf ) {
+			glBindBuffer(GL_ARRAY_BUFFER, sBuf);
+			glEnableVertexAttribArray(3);
+			glVertexAttribIPointer(3, 4, GL_UNSIGNED_BYTE, sizeof(VertexSkin), (void*)offsetof(VertexSkin, bones));
+			glEnableVertexAttribArray(4);
+			glVertexAttribPointer(4, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(VertexSkin), (void*)offsetof(VertexSkin, weights));
+		}
+		glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, eBuf);
+		glBindVertexArray( 0 );
+		glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, 0 );
+		glBindBuffer( GL_ARRAY_BUFFER, 0 );
+		data.clear();
+		dataDirty = false;
+		uploading = false;
+	}
+	virtual void createMeshGL() {
+		computeBounds();
 		if( data.tris.size() == nTris && data.verts.size() == nVerts && vao>0 && eBuf>0 ) {
 			printf("Updating mesh\n");
 			glBindBuffer( GL_ARRAY_BUFFER, vBuf);
@@ -190,64 +314,60 @@ struct TriMesh {
 				glBindBuffer(GL_ARRAY_BUFFER, tBuf);
 				glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(vec2) * nVerts, data.tcoords.data() );
 			}
-			glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, eBuf);
-			glBufferSubData( GL_ELEMENT_ARRAY_BUFFER, 0, sizeof(uvec3) * nTris, data.tris.data()  );
-		}
-		else {
-			if( vao ) glDeleteVertexArrays(1, &vao);
-			if( vBuf ) glDeleteBuffers(1, &vBuf);
-			if( nBuf ) glDeleteBuffers(1, &nBuf);
-			if( tBuf ) glDeleteBuffers(1, &tBuf);
-			if( eBuf ) glDeleteBuffers(1, &eBuf);
-			nTris  = GLsizei(data.tris.size());
-			nVerts = GLsizei(data.verts.size());
-			
-			glGenVertexArrays(1, &vao );
-			glBindVertexArray( vao );
-			
-			glGenBuffers(1, &vBuf);
-			glBindBuffer( GL_ARRAY_BUFFER, vBuf);
-			glBufferData( GL_ARRAY_BUFFER, sizeof(vec3) * nVerts, data.verts.data(), GL_STATIC_DRAW );
-			glEnableVertexAttribArray(0);
-			glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
-			
-			if( data.norms.size()>0 ) {
-				glGenBuffers(1, &nBuf);
-				glBindBuffer(GL_ARRAY_BUFFER, nBuf);
-				glBufferData(GL_ARRAY_BUFFER, sizeof(vec3) * nVerts, data.norms.data(), GL_STATIC_DRAW);
-				glEnableVertexAttribArray(1);
-				glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, 0);
-			}
-			
-			if( data.tcoords.size()>0 ) {
-				glGenBuffers(1, &tBuf);
-				glBindBuffer(GL_ARRAY_BUFFER, tBuf);
-				glBufferData(GL_ARRAY_BUFFER, sizeof(vec2) * nVerts, data.tcoords.data(), GL_STATIC_DRAW);
-				glEnableVertexAttribArray(2);
-				glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 0, 0);
+			if( data.skin.size()>0 && sBuf>0 ) {
+				glBindBuffer(GL_ARRAY_BUFFER, sBuf);
+				glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(VertexSkin) * nVerts, data.skin.data() );
 			}
-			glGenBuffers(1, &eBuf);
 			glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, eBuf);
-			glBufferData( GL_ELEMENT_ARRAY_BUFFER, sizeof(uvec3) * nTris, data.tris.data(), GL_STATIC_DRAW );
-			glBindVertexArray( 0 );
-			
+			glBufferSubData( GL_ELEMENT_ARRAY_BUFFER, 0, sizeof(uvec3) * nTris, data.tris.data()  );
 		}
+		else adoptBuffers( createBuffers( data ) );
 		glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, 0 );
 		glBindBuffer( GL_ARRAY_BUFFER, 0 );
 		data.clear();
 		dataDirty = false;
 	}
-	virtual void render( const Program& program, const mat4& modelMat_=mat4(1) ) {
-		if( !visible ) return;
-		
+	// Uploads pending data; false when there is nothing to draw.
+	virtual bool prepareGL() {
 		if( vBuf<1 || eBuf<1 || dataDirty ) {
 			if( data.verts.size()<1 ) {
 				clear();
-				return;
+				return false;
 			}
 			else createMeshGL();
 			glErr("Create MeshGL");
 		}
+		if( vertexAO.size() ) uploadVertexAO();
+		return true;
+	}
+	// Adds the baked occlusion to the vertex array as attribute 5.
+	void uploadVertexAO() {
+		if( GLsizei(vertexAO.size())==nVerts && vao ) adoptVertexAO( createVertexAOBuffer( vertexAO ) );
+		std::vector<uint8_t>().swap( vertexAO );
+	}
+	// Like createBuffers(), on any context sharing objects with the render thread's.
+	static GLuint createVertexAOBuffer( const std::vector<uint8_t>& ao ) {
+		GLuint buf = 0;
+		glGenBuffers( 1, &buf );
+		glBindBuffer( GL_ARRAY_BUFFER, buf );
+		glBufferData( GL_ARRAY_BUFFER, ao.size(), ao.data(), GL_STATIC_DRAW );
+		glBindBuffer( GL_ARRAY_BUFFER, 0 );
+		return buf;
+	}
+	void adoptVertexAO( GLuint buf ) {
+		if( aoBuf ) glDeleteBuffers( 1, &aoBuf );
+		aoBuf = buf;
+		glBindVertexArray( vao );
+		glBindBuffer( GL_ARRAY_BUFFER, aoBuf );
+		glEnableVertexAttribArray(5);
+		glVertexAttribPointer(5, 1, GL_UNSIGNED_BYTE, GL_TRUE, 0, 0);
+		glBindVertexArray( 0 );
+		glBindBuffer( GL_ARRAY_BUFFER, 0 );
+		glErr("Upload vertex AO");
+	}
+	virtual void render( const Program& program, const mat4& modelMat_=mat4(1) ) {
+		if( !visible ) return;
+		if( !prepareGL() ) return;
 		glBindVertexArray( vao );
 		program.setUniform( "modelMat", modelMat_*modelMat );
 		glErr("set uniform modelMat");
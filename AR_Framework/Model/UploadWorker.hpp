@@ -0,0 +1,133 @@
+//
+//  UploadWorker.hpp
+//  AR_Framework
+//
+
+#ifndef UploadWorker_hpp
+#define UploadWorker_hpp
+
+#include "Tools/gl.hpp"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <deque>
+
+namespace AR {
+
+// Thread with its own GL context, shared with the window's, that creates and
+// fills buffers and textures. Each job is followed by a fence; its 'publish'
+// part runs on the render thread in poll() once the fence has signalled, so
+// the render thread only ever sees finished objects. Vertex arrays are not
+// shared between contexts and stay on the render thread.
+// The context itself comes from the window system, see main.cpp.
+struct UploadWorker {
+	struct Job {
+		std::function<void()> work, publish;
+	};
+	struct Done {
+		GLsync fence;
+		std::function<void()> publish;
+	};
+	std::function<void()> makeCurrent;
+	std::thread thread;
+	std::mutex mtx;
+	std::condition_variable cv, idle;
+	std::deque<Job> jobs;
+	std::deque<Done> done;
+	int running = 0;						// jobs taken by the worker, not in 'done' yet
+	bool quit = false;
+
+	UploadWorker() {}
+	UploadWorker( const UploadWorker& ) = delete;
+	~UploadWorker() { stop(); }
+
+	// 'bindContext' runs first on the worker thread and makes a context current
+	// that shares objects with the render thread's.
+	void start( std::function<void()> bindContext ) {
+		if( isRunning() ) return;
+		makeCurrent = std::move( bindContext );
+		quit = false;
+		thread = std::thread( [this](){ workerLoop(); } );
+	}
+	// Finishes what is queued and joins the thread; the context can be destroyed after.
+	void stop() {
+		if( !isRunning() ) return;
+		finish();
+		{
+			std::lock_guard<std::mutex> lock( mtx );
+			quit = true;
+		}
+		cv.notify_all();
+		thread.join();
+	}
+	bool isRunning() const { return thread.joinable(); }
+
+	void push( std::function<void()> work, std::function<void()> publish=nullptr ) {
+		{
+			std::lock_guard<std::mutex> lock( mtx );
+			jobs.push_back( { std::move( work ), std::move( publish ) } );
+		}
+		cv.notify_one();
+	}
+	// Render thread, once a frame: publishes finished jobs in order without blocking.
+	void poll() { publish( false ); }
+	// Render thread: waits for every queued job and publishes it, e.g. before
+	// freeing data the jobs read from.
+	void finish() {
+		{
+			std::unique_lock<std::mutex> lock( mtx );
+			idle.wait( lock, [this](){ return jobs.empty() && running==0; } );
+		}
+		publish( true );
+	}
+	size_t pending() {
+		std::lock_guard<std::mutex> lock( mtx );
+		return jobs.size()+running+done.size();
+	}
+
+protected:
+	void publish( bool wait ) {
+		while( true ) {
+			Done d;
+			{
+				std::lock_guard<std::mutex> lock( mtx );
+				if( done.empty() ) return;
+				GLenum r = glClientWaitSync( done.front().fence, 0, wait?GLuint64(1e10):0 );
+				if( r==GL_TIMEOUT_EXPIRED ) return;
+				d = std::move( done.front() );
+				done.pop_front();
+			}
+			glDeleteSync( d.fence );
+			if( d.publish ) d.publish();
+		}
+	}
+	void workerLoop() {
+		makeCurrent();
+		glPixelStorei( GL_UNPACK_ALIGNMENT, 1 );
+		while( true ) {
+			Job job;
+			{
+				std::unique_lock<std::mutex> lock( mtx );
+				cv.wait( lock, [this](){ return quit || !jobs.empty(); } );
+				if( jobs.empty() ) break;
+				job = std::move( jobs.front() );
+				jobs.pop_front();
+				running++;
+			}
+			if( job.work ) job.work();
+			GLsync fence = glFenceSync( GL_SYNC_GPU_COMMANDS_COMPLETE, 0 );
+			glFlush();			// the fence has to reach the GPU before another context waits on it
+			{
+				std::lock_guard<std::mutex> lock( mtx );
+				done.push_back( { fence, std::move( job.publish ) } );
+				running--;
+			}
+			idle.notify_all();
+		}
+	}
+};
+
+}
+
+#endif /* UploadWorker_hpp */
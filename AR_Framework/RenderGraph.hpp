@@ -0,0 +1,470 @@
+//
+//  RenderGraph.hpp
+//  AR_Framework
+//
+
+#ifndef RenderGraph_hpp
+#define RenderGraph_hpp
+
+#include "FrameBuffer.hpp"
+#include <climits>
+#include <map>
+#include <array>
+
+namespace AR {
+
+// Size and storage of a graph attachment. Transients with equal descriptions
+// share pooled textures.
+struct RGTextureDesc {
+	int width = 0, height = 0;
+	GLenum internal = GL_RGBA8;
+
+	bool operator==( const RGTextureDesc& a ) const { return width==a.width && height==a.height && internal==a.internal; }
+	bool operator!=( const RGTextureDesc& a ) const { return !(*this==a); }
+	bool isDepth() const {
+		return internal==GL_DEPTH_COMPONENT16 || internal==GL_DEPTH_COMPONENT24 || internal==GL_DEPTH_COMPONENT32F
+			|| internal==GL_DEPTH24_STENCIL8 || internal==GL_DEPTH32F_STENCIL8;
+	}
+	bool hasStencil() const { return internal==GL_DEPTH24_STENCIL8 || internal==GL_DEPTH32F_STENCIL8; }
+	// Upload format/type for glTexImage2D and bytes per pixel; false if not renderable here.
+	bool transferFormat( GLenum& format, GLenum& type, int& bytes ) const {
+		switch( internal ) {
+			case GL_DEPTH_COMPONENT16:	format = GL_DEPTH_COMPONENT; type = GL_UNSIGNED_SHORT; bytes = 2; return true;
+			case GL_DEPTH_COMPONENT24:	format = GL_DEPTH_COMPONENT; type = GL_UNSIGNED_INT; bytes = 4; return true;
+			case GL_DEPTH_COMPONENT32F:	format = GL_DEPTH_COMPONENT; type = GL_FLOAT; bytes = 4; return true;
+			case GL_DEPTH24_STENCIL8:	format = GL_DEPTH_STENCIL; type = GL_UNSIGNED_INT_24_8; bytes = 4; return true;
+			case GL_DEPTH32F_STENCIL8:	format = GL_DEPTH_STENCIL; type = GL_FLOAT_32_UNSIGNED_INT_24_8_REV; bytes = 8; return true;
+		}
+		for( auto& f: pixelFormats() ) if( f.internal==internal && !f.compressed() ) {
+			format = f.format; type = f.type; bytes = f.blockBytes;
+			return true;
+		}
+		return false;
+	}
+	size_t bytes() const {
+		GLenum f, t; int b = 0;
+		transferFormat( f, t, b );
+		return size_t(width)*height*b;
+	}
+};
+
+// Frame graph over GL framebuffers. Each frame:
+//
+//	graph.reset();
+//	int color = graph.create( "color", { w, h, GL_RGBA16F } );
+//	int depth = graph.create( "depth", { w, h, GL_DEPTH_COMPONENT32F } );
+//	int back  = graph.importBackbuffer( w, h );
+//	graph.addPass( "scene", [&](RenderGraph& g){ ... } ).write( color ).depth( depth ).clear( clearColor );
+//	graph.addPass( "tonemap", [&](RenderGraph& g){ g.bind( color, 0, prog, "colorTex" ); ... } ).read( color ).write( back );
+//	graph.execute();
+//
+// Passes whose results are never read (and that write nothing imported) are
+// culled, the rest are ordered by their dependencies. Transient attachments
+// come from a pool keyed by description and are aliased when their lifetimes
+// do not overlap; FBOs are cached per attachment set and only rebound when a
+// pass targets a different one. GL state is captured once per execute().
+struct RenderGraph {
+	struct Resource {
+		std::string name;
+		RGTextureDesc desc;
+		GLuint texID = 0;				// imported, or the pooled texture during execute()
+		bool imported = false;
+		bool backbuffer = false;		// the framebuffer bound when execute() is called
+		int first = INT_MAX, last = -1;	// positions in 'order'
+		int physical = -1;
+	};
+	struct Pass {
+		std::string name;
+		std::vector<int> reads, colors;
+		int depth = -1;
+		bool clearColorBuffer = false, clearDepthBuffer = false;
+		vec4 clearColor = vec4(0);
+		float clearDepth = 1.f;
+		bool sideEffect = false;
+		bool culled = false;
+		std::function<void(RenderGraph&)> exec;
+	};
+	// Returned by addPass() to declare what the pass touches.
+	struct PassBuilder {
+		RenderGraph& graph;
+		int pass;
+		PassBuilder& read( int r )		{ graph.passes[pass].reads.push_back( r ); return *this; }
+		PassBuilder& write( int r )		{ graph.passes[pass].colors.push_back( r ); return *this; }
+		PassBuilder& depth( int r )		{ graph.passes[pass].depth = r; return *this; }
+		// Clears the colour attachments (and depth) before the pass; without it they are loaded.
+		PassBuilder& clear( const vec4& color, float depth=1.f ) {
+			Pass& p = graph.passes[pass];
+			p.clearColorBuffer = p.clearDepthBuffer = true;
+			p.clearColor = color;
+			p.clearDepth = depth;
+			return *this;
+		}
+		PassBuilder& clearDepth( float depth=1.f ) {
+			graph.passes[pass].clearDepthBuffer = true;
+			graph.passes[pass].clearDepth = depth;
+			return *this;
+		}
+		// Never culled, e.g. a pass writing to a buffer outside the graph.
+		PassBuilder& sideEffect()		{ graph.passes[pass].sideEffect = true; return *this; }
+	};
+	struct Physical {
+		RGTextureDesc desc;
+		GLuint texID = 0;
+		int busyUntil = -1;				// order position of the last user this frame
+		int idleFrames = 0;
+	};
+	struct Stats {
+		int passes = 0, culled = 0, transients = 0, textures = 0, fboBinds = 0;
+		size_t bytes = 0, bytesUnaliased = 0;
+	};
+
+	std::vector<Resource> resources;
+	std::vector<Pass> passes;
+	std::vector<int> order;				// executed passes
+	std::vector<Physical> pool;
+	std::map<std::array<GLuint,5>,GLuint> fbos;
+	int maxIdleFrames = 3;				// pooled textures unused this long are freed
+	Stats stats;
+
+	RenderGraph() {}
+	RenderGraph( const RenderGraph& ) = delete;
+	~RenderGraph() { release(); }
+
+	// Drops the passes and resources of the previous frame, keeps the pool.
+	void reset() {
+		resources.clear();
+		passes.clear();
+		order.clear();
+	}
+	void release() {
+		reset();
+		for( auto& f: fbos ) glDeleteFramebuffers( 1, &f.second );
+		fbos.clear();
+		for( auto& p: pool ) glDeleteTextures( 1, &p.texID );
+		pool.clear();
+	}
+
+	int create( const std::string& name, const RGTextureDesc& desc ) {
+		Resource r;
+		r.name = name;
+		r.desc = desc;
+		resources.push_back( r );
+		return int(resources.size())-1;
+	}
+	int import( const std::string& name, GLuint texID, const RGTextureDesc& desc ) {
+		int h = create( name, desc );
+		resources[h].texID = texID;
+		resources[h].imported = true;
+		return h;
+	}
+	int import( const std::string& name, const Texture& tex ) {
+		auto [internal,format,type] = Texture::getTextureType( tex.dataType, tex.nChannels, false );
+		return import( name, tex.texID, { tex.width, tex.height, GLenum(internal) } );
+	}
+	int importBackbuffer( int w, int h ) {
+		int r = import( "backbuffer", 0, { w, h, GL_RGBA8 } );
+		resources[r].backbuffer = true;
+		return r;
+	}
+	PassBuilder addPass( const std::string& name, const std::function<void(RenderGraph&)>& exec ) {
+		Pass p;
+		p.name = name;
+		p.exec = exec;
+		passes.push_back( p );
+		return { *this, int(passes.size())-1 };
+	}
+
+	// Valid inside a pass.
+	GLuint texture( int r ) const { return resources[r].texID; }
+	const RGTextureDesc& desc( int r ) const { return resources[r].desc; }
+	void bind( int r, int slot, const Program& prog, const std::string& name ) const {
+		glActiveTexture( GL_TEXTURE0+slot );
+		glBindTexture( GL_TEXTURE_2D, resources[r].texID );
+		prog.setUniform( name, slot );
+	}
+
+	// Culls, orders and assigns textures. execute() calls it.
+	bool compile() {
+		stats = Stats();
+		for( auto& p: passes ) {
+			for( int r: p.reads ) if( r<0 || r>=int(resources.size()) ) return error( p, "reads an unknown resource" );
+			for( int r: p.colors ) if( r<0 || r>=int(resources.size()) ) return error( p, "writes an unknown resource" );
+			if( p.depth>=int(resources.size()) ) return error( p, "uses an unknown depth buffer" );
+			if( p.colors.size()>4 ) return error( p, "writes more than four colour attachments" );
+		}
+		std::vector<std::vector<int>> deps = dependencies();
+		cull( deps );
+		if( !schedule( deps ) ) return false;
+		assignTextures();
+		return true;
+	}
+
+	void execute() {
+		if( !compile() ) return;
+		_PREV_STATE_ state;
+		state.capture();
+		glDisable( GL_SCISSOR_TEST );
+		GLuint bound = GLuint(state.drawFboId);
+		for( int pi: order ) {
+			Pass& p = passes[pi];
+			GLuint fbo = framebufferFor( p, GLuint(state.drawFboId) );
+			if( fbo!=bound ) {
+				glBindFramebuffer( GL_FRAMEBUFFER, fbo );
+				bound = fbo;
+				stats.fboBinds++;
+			}
+			int target = p.colors.empty() ? p.depth : p.colors[0];
+			if( target>=0 ) glViewport( 0, 0, resources[target].desc.width, resources[target].desc.height );
+			GLbitfield mask = 0;
+			if( p.clearColorBuffer && !p.colors.empty() ) {
+				glClearColor( p.clearColor.r, p.clearColor.g, p.clearColor.b, p.clearColor.a );
+				mask |= GL_COLOR_BUFFER_BIT;
+			}
+			if( p.clearDepthBuffer && p.depth>=0 ) {
+				glDepthMask( GL_TRUE );
+				glClearDepth( p.clearDepth );
+				mask |= GL_DEPTH_BUFFER_BIT;
+				if( resources[p.depth].desc.hasStencil() ) mask |= GL_STENCIL_BUFFER_BIT;
+			}
+			if( mask ) glClear( mask );
+			if( p.exec ) p.exec( *this );
+		}
+		state.restore();
+		for( auto& r: resources ) if( !r.imported ) r.texID = 0;
+	}
+
+	void printStats() const {
+		printf( "render graph: %d passes (%d culled), %d transients in %d textures, %.1f MB (%.1f MB without aliasing), %d FBO binds\n",
+			   stats.passes, stats.culled, stats.transients, stats.textures,
+			   stats.bytes/1048576.0, stats.bytesUnaliased/1048576.0, stats.fboBinds );
+	}
+
+protected:
+	bool error( const Pass& p, const char* msg ) const {
+		fprintf( stderr, "[ERROR] Render pass %s %s\n", p.name.c_str(), msg );
+		return false;
+	}
+	bool clearsTarget( const Pass& p, int r ) const {
+		if( r==p.depth ) return p.clearDepthBuffer;
+		return p.clearColorBuffer;
+	}
+	// A read sees the last earlier write or, if the resource is only written by
+	// passes declared after it, their final result. A write waits for the reads
+	// of the previous contents (and for earlier writes, unless it clears).
+	std::vector<std::vector<int>> dependencies() const {
+		std::vector<std::vector<int>> deps( passes.size() );
+		std::vector<int> lastWriter( resources.size(), -1 ), finalWriter( resources.size(), -1 );
+		std::vector<std::vector<int>> readers( resources.size() );
+		for( int i=0; i<int(passes.size()); i++ ) {
+			for( int r: passes[i].colors ) finalWriter[r] = i;
+			if( passes[i].depth>=0 ) finalWriter[passes[i].depth] = i;
+		}
+		for( int i=0; i<int(passes.size()); i++ ) {
+			const Pass& p = passes[i];
+			for( int r: p.reads ) {
+				if( lastWriter[r]>=0 ) {
+					deps[i].push_back( lastWriter[r] );
+					readers[r].push_back( i );
+				}
+				else if( finalWriter[r]>i ) deps[i].push_back( finalWriter[r] );
+				else if( !resources[r].imported )
+					fprintf( stderr, "[ERROR] Render pass %s reads %s, which nothing writes\n", p.name.c_str(), resources[r].name.c_str() );
+				else readers[r].push_back( i );
+			}
+			std::vector<int> targets = p.colors;
+			if( p.depth>=0 ) targets.push_back( p.depth );
+			for( int r: targets ) {
+				if( lastWriter[r]>=0 && (!clearsTarget( p, r ) || resources[r].imported) ) deps[i].push_back( lastWriter[r] );
+				for( int q: readers[r] ) if( q!=i ) deps[i].push_back( q );
+				readers[r].clear();
+				lastWriter[r] = i;
+			}
+		}
+		return deps;
+	}
+	// Keeps passes writing imported resources (or marked sideEffect) and whatever they depend on.
+	void cull( const std::vector<std::vector<int>>& deps ) {
+		std::vector<int> stack;
+		for( int i=0; i<int(passes.size()); i++ ) {
+			Pass& p = passes[i];
+			p.culled = true;
+			bool root = p.sideEffect || (p.depth>=0 && resources[p.depth].imported);
+			for( int r: p.colors ) root |= resources[r].imported;
+			if( root ) stack.push_back( i );
+		}
+		while( !stack.empty() ) {
+			int i = stack.back();
+			stack.pop_back();
+			if( !passes[i].culled ) continue;
+			passes[i].culled = false;
+			for( int d: deps[i] ) if( passes[d].culled ) stack.push_back( d );
+		}
+		for( auto& p: passes ) {
+			stats.passes++;
+			if( p.culled ) stats.culled++;
+		}
+	}
+	// Topological order; among ready passes the one rendering into the current
+	// attachments goes first, then declaration order. False if passes depend on
+	// each other in a cycle.
+	bool schedule( const std::vector<std::vector<int>>& deps ) {
+		int n = int(passes.size());
+		std::vector<int> indegree( n, 0 );
+		std::vector<std::vector<int>> users( n );
+		for( int i=0; i<n; i++ ) {
+			if( passes[i].culled ) continue;
+			for( int d: deps[i] ) {
+				indegree[i]++;
+				users[d].push_back( i );
+			}
+		}
+		std::vector<int> ready;
+		for( int i=0; i<n; i++ ) if( !passes[i].culled && indegree[i]==0 ) ready.push_back( i );
+		order.clear();
+		while( !ready.empty() ) {
+			int pick = 0;
+			for( int k=1; k<int(ready.size()); k++ ) if( ready[k]<ready[pick] ) pick = k;
+			if( !order.empty() ) {
+				for( int k=0; k<int(ready.size()); k++ ) if( sameTargets( passes[order.back()], passes[ready[k]] ) ) {
+					pick = k;
+					break;
+				}
+			}
+			int i = ready[pick];
+			ready.erase( ready.begin()+pick );
+			order.push_back( i );
+			for( int u: users[i] ) if( --indegree[u]==0 ) ready.push_back( u );
+		}
+		if( int(order.size())==stats.passes-stats.culled ) return true;
+		for( int i=0; i<n; i++ )
+			if( !passes[i].culled && indegree[i]>0 ) error( passes[i], "is in a dependency cycle" );
+		order.clear();
+		return false;
+	}
+	static bool sameTargets( const Pass& a, const Pass& b ) {
+		return a.colors==b.colors && a.depth==b.depth && !b.clearColorBuffer && !b.clearDepthBuffer;
+	}
+	// Lifetimes over 'order', then first-fit from the pool; a texture is free
+	// again after the last pass using its current resource.
+	void assignTextures() {
+		for( auto& r: resources ) {
+			r.first = INT_MAX;
+			r.last = -1;
+			r.physical = -1;
+		}
+		for( int k=0; k<int(order.size()); k++ ) {
+			const Pass& p = passes[order[k]];
+			auto touch = [&]( int r ) {
+				resources[r].first = std::min( resources[r].first, k );
+				resources[r].last = std::max( resources[r].last, k );
+			};
+			for( int r: p.reads ) touch( r );
+			for( int r: p.colors ) touch( r );
+			if( p.depth>=0 ) touch( p.depth );
+		}
+		for( auto& t: pool ) t.busyUntil = -1;
+		std::vector<int> byFirst;
+		for( int i=0; i<int(resources.size()); i++ )
+			if( !resources[i].imported && resources[i].last>=0 ) byFirst.push_back( i );
+		std::stable_sort( byFirst.begin(), byFirst.end(), [&]( int a, int b ){ return resources[a].first<resources[b].first; } );
+		std::vector<bool> used( pool.size(), false );
+		for( int i: byFirst ) {
+			Resource& r = resources[i];
+			int found = -1;
+			for( int t=0; t<int(pool.size()); t++ )
+				if( pool[t].desc==r.desc && pool[t].busyUntil<r.first ) { found = t; break; }
+			if( found<0 ) {
+				found = allocate( r.desc );
+				used.push_back( false );
+			}
+			pool[found].busyUntil = r.last;
+			used[found] = true;
+			r.physical = found;
+			stats.transients++;
+			stats.bytesUnaliased += r.desc.bytes();
+		}
+		// Age out what this frame did not need.
+		for( int t=int(pool.size())-1; t>=0; t-- ) {
+			if( used[t] ) {
+				pool[t].idleFrames = 0;
+				continue;
+			}
+			if( ++pool[t].idleFrames<=maxIdleFrames ) continue;
+			dropFramebuffers( pool[t].texID );
+			glDeleteTextures( 1, &pool[t].texID );
+			pool.erase( pool.begin()+t );
+			for( auto& r: resources ) if( r.physical>t ) r.physical--;
+		}
+		for( auto& r: resources ) if( r.physical>=0 ) r.texID = pool[r.physical].texID;
+		for( auto& t: pool ) {
+			stats.textures++;
+			stats.bytes += t.desc.bytes();
+		}
+	}
+	int allocate( const RGTextureDesc& desc ) {
+		Physical t;
+		t.desc = desc;
+		GLenum format = GL_RGBA, type = GL_UNSIGNED_BYTE;
+		int bytes = 4;
+		if( !desc.transferFormat( format, type, bytes ) )
+			fprintf( stderr, "[ERROR] Render graph: unsupported attachment format 0x%04X\n", desc.internal );
+		GLint oldTex = Texture::getBinding();
+		glGenTextures( 1, &t.texID );
+		glBindTexture( GL_TEXTURE_2D, t.texID );
+		Texture::setTexParam( desc.isDepth()?GL_NEAREST:GL_LINEAR, GL_CLAMP_TO_EDGE, GL_CLAMP_TO_EDGE );
+		if( desc.isDepth() ) glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST );
+		glTexImage2D( GL_TEXTURE_2D, 0, desc.internal, desc.width, desc.height, 0, format, type, nullptr );
+		Texture::restoreBinding( oldTex );
+		pool.push_back( t );
+		return int(pool.size())-1;
+	}
+	GLuint framebufferFor( const Pass& p, GLuint backbuffer ) {
+		bool toBackbuffer = false;
+		for( int r: p.colors ) toBackbuffer |= resources[r].backbuffer;
+		if( toBackbuffer ) return backbuffer;
+		std::array<GLuint,5> key = { 0, 0, 0, 0, 0 };
+		for( int i=0; i<int(p.colors.size()); i++ ) key[i] = resources[p.colors[i]].texID;
+		if( p.depth>=0 ) key[4] = resources[p.depth].texID;
+		if( key==std::array<GLuint,5>{ 0, 0, 0, 0, 0 } ) return backbuffer;
+		auto it = fbos.find( key );
+		if( it!=fbos.end() ) return it->second;
+
+		GLint oldFbo = 0;
+		glGetIntegerv( GL_FRAMEBUFFER_BINDING, &oldFbo );
+		GLuint fbo = 0;
+		glGenFramebuffers( 1, &fbo );
+		glBindFramebuffer( GL_FRAMEBUFFER, fbo );
+		std::vector<GLenum> drawBuffers;
+		for( int i=0; i<int(p.colors.size()); i++ ) {
+			glFramebufferTexture2D( GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0+i, GL_TEXTURE_2D, key[i], 0 );
+			drawBuffers.push_back( GL_COLOR_ATTACHMENT0+i );
+		}
+		if( p.depth>=0 ) {
+			GLenum attachment = resources[p.depth].desc.hasStencil()?GL_DEPTH_STENCIL_ATTACHMENT:GL_DEPTH_ATTACHMENT;
+			glFramebufferTexture2D( GL_FRAMEBUFFER, attachment, GL_TEXTURE_2D, key[4], 0 );
+		}
+		if( drawBuffers.empty() ) {
+			glDrawBuffer( GL_NONE );
+			glReadBuffer( GL_NONE );
+		}
+		else glDrawBuffers( GLsizei(drawBuffers.size()), drawBuffers.data() );
+		if( glCheckFramebufferStatus( GL_FRAMEBUFFER )!=GL_FRAMEBUFFER_COMPLETE )
+			fprintf( stderr, "[ERROR] Render pass %s: framebuffer is not complete\n", p.name.c_str() );
+		glBindFramebuffer( GL_FRAMEBUFFER, oldFbo );
+		fbos[key] = fbo;
+		return fbo;
+	}
+	void dropFramebuffers( GLuint texID ) {
+		for( auto it=fbos.begin(); it!=fbos.end(); ) {
+			if( std::find( it->first.begin(), it->first.end(), texID )!=it->first.end() ) {
+				glDeleteFramebuffers( 1, &it->second );
+				it = fbos.erase( it );
+			}
+			else it++;
+		}
+	}
+};
+
+}
+
+#endif /* RenderGraph_hpp */
@@ -0,0 +1,41 @@
+//
+//  Hash.hpp
+//  AR_Framework
+//
+
+#ifndef Hash_hpp
+#define Hash_hpp
+
+#include <cstdint>
+#include <cstring>
+#include <cstddef>
+
+namespace AR {
+
+inline uint64_t hashMix( uint64_t h ) {
+	h ^= h>>33;
+	h *= 0xff51afd7ed558ccdull;
+	h ^= h>>33;
+	h *= 0xc4ceb9fe1a85ec53ull;
+	h ^= h>>33;
+	return h;
+}
+
+// 64 bit content hash, eight bytes per step. Not cryptographic.
+inline uint64_t hashBytes( const void* data, size_t size, uint64_t seed=0 ) {
+	const unsigned char* p = (const unsigned char*)data;
+	uint64_t h = seed ^ (size*0x9e3779b97f4a7c15ull);
+	size_t i = 0;
+	for( ; i+8<=size; i+=8 ) {
+		uint64_t k;
+		memcpy( &k, p+i, 8 );
+		h = (h ^ hashMix( k ))*0x9e3779b97f4a7c15ull;
+	}
+	uint64_t k = 0;
+	memcpy( &k, p+i, size-i );
+	return hashMix( h ^ k );
+}
+
+}
+
+#endif /* Hash_hpp */
@@ -0,0 +1,106 @@
+//
+//  SIMD.hpp
+//  AR_Framework
+//
+
+#ifndef SIMD_hpp
+#define SIMD_hpp
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64) || (defined(_M_IX86_FP) && _M_IX86_FP>=2)
+#define AR_SIMD_SSE 1
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define AR_SIMD_NEON 1
+#include <arm_neon.h>
+#endif
+#include <cmath>
+#include <cstring>
+
+namespace AR {
+
+// Four-wide float used by the CPU texture kernels. Falls back to scalar code
+// when neither SSE2 nor NEON is available.
+struct float4 {
+#if defined(AR_SIMD_SSE)
+	__m128 v;
+	float4() {}
+	float4( __m128 a ): v(a) {}
+	float4( float a ): v(_mm_set1_ps(a)) {}
+	float4( float a, float b, float c, float d ): v(_mm_setr_ps(a,b,c,d)) {}
+	static float4 load( const float* p ) { return _mm_loadu_ps(p); }
+	void store( float* p ) const { _mm_storeu_ps(p, v); }
+	friend float4 operator+( const float4& a, const float4& b ) { return _mm_add_ps(a.v,b.v); }
+	friend float4 operator-( const float4& a, const float4& b ) { return _mm_sub_ps(a.v,b.v); }
+	friend float4 operator*( const float4& a, const float4& b ) { return _mm_mul_ps(a.v,b.v); }
+	friend float4 operator/( const float4& a, const float4& b ) { return _mm_div_ps(a.v,b.v); }
+	friend float4 min( const float4& a, const float4& b ) { return _mm_min_ps(a.v,b.v); }
+	friend float4 max( const float4& a, const float4& b ) { return _mm_max_ps(a.v,b.v); }
+	friend float4 sqrt( const float4& a ) { return _mm_sqrt_ps(a.v); }
+	friend float4 lessThan( const float4& a, const float4& b ) { return _mm_cmplt_ps(a.v,b.v); }
+	// mask ? b : a
+	friend float4 select( const float4& a, const float4& b, const float4& mask ) {
+		return _mm_or_ps( _mm_andnot_ps(mask.v,a.v), _mm_and_ps(mask.v,b.v) );
+	}
+	// Sign bits, lane i in bit i.
+	friend int moveMask( const float4& a ) { return _mm_movemask_ps(a.v); }
+#elif defined(AR_SIMD_NEON)
+	float32x4_t v;
+	float4() {}
+	float4( float32x4_t a ): v(a) {}
+	float4( float a ): v(vdupq_n_f32(a)) {}
+	float4( float a, float b, float c, float d ) { float t[4]={a,b,c,d}; v=vld1q_f32(t); }
+	static float4 load( const float* p ) { return vld1q_f32(p); }
+	void store( float* p ) const { vst1q_f32(p, v); }
+	friend float4 operator+( const float4& a, const float4& b ) { return vaddq_f32(a.v,b.v); }
+	friend float4 operator-( const float4& a, const float4& b ) { return vsubq_f32(a.v,b.v); }
+	friend float4 operator*( const float4& a, const float4& b ) { return vmulq_f32(a.v,b.v); }
+	friend float4 operator/( const float4& a, const float4& b ) {
+		float32x4_t r = vrecpeq_f32(b.v);
+		r = vmulq_f32( vrecpsq_f32(b.v, r), r );
+		r = vmulq_f32( vrecpsq_f32(b.v, r), r );
+		return vmulq_f32(a.v, r);
+	}
+	friend float4 min( const float4& a, const float4& b ) { return vminq_f32(a.v,b.v); }
+	friend float4 max( const float4& a, const float4& b ) { return vmaxq_f32(a.v,b.v); }
+	friend float4 sqrt( const float4& a ) {
+		float t[4]; vst1q_f32(t, a.v);
+		return float4( sqrtf(t[0]), sqrtf(t[1]), sqrtf(t[2]), sqrtf(t[3]) );
+	}
+	friend float4 lessThan( const float4& a, const float4& b ) { return vreinterpretq_f32_u32(vcltq_f32(a.v,b.v)); }
+	friend float4 select( const float4& a, const float4& b, const float4& mask ) {
+		return vbslq_f32( vreinterpretq_u32_f32(mask.v), b.v, a.v );
+	}
+	friend int moveMask( const float4& a ) {
+		uint32_t t[4]; vst1q_u32(t, vshrq_n_u32( vreinterpretq_u32_f32(a.v), 31 ));
+		return int( t[0] | t[1]<<1 | t[2]<<2 | t[3]<<3 );
+	}
+#else
+	float v[4];
+	float4() {}
+	float4( float a ) { v[0]=v[1]=v[2]=v[3]=a; }
+	float4( float a, float b, float c, float d ) { v[0]=a; v[1]=b; v[2]=c; v[3]=d; }
+	static float4 load( const float* p ) { return float4(p[0],p[1],p[2],p[3]); }
+	void store( float* p ) const { for( int i=0; i<4; i++ ) p[i]=v[i]; }
+	friend float4 operator+( const float4& a, const float4& b ) { return float4(a.v[0]+b.v[0],a.v[1]+b.v[1],a.v[2]+b.v[2],a.v[3]+b.v[3]); }
+	friend float4 operator-( const float4& a, const float4& b ) { return float4(a.v[0]-b.v[0],a.v[1]-b.v[1],a.v[2]-b.v[2],a.v[3]-b.v[3]); }
+	friend float4 operator*( const float4& a, const float4& b ) { return float4(a.v[0]*b.v[0],a.v[1]*b.v[1],a.v[2]*b.v[2],a.v[3]*b.v[3]); }
+	friend float4 operator/( const float4& a, const float4& b ) { return float4(a.v[0]/b.v[0],a.v[1]/b.v[1],a.v[2]/b.v[2],a.v[3]/b.v[3]); }
+	friend float4 min( const float4& a, const float4& b ) { return float4(fminf(a.v[0],b.v[0]),fminf(a.v[1],b.v[1]),fminf(a.v[2],b.v[2]),fminf(a.v[3],b.v[3])); }
+	friend float4 max( const float4& a, const float4& b ) { return float4(fmaxf(a.v[0],b.v[0]),fmaxf(a.v[1],b.v[1]),fmaxf(a.v[2],b.v[2]),fmaxf(a.v[3],b.v[3])); }
+	friend float4 sqrt( const float4& a ) { return float4(sqrtf(a.v[0]),sqrtf(a.v[1]),sqrtf(a.v[2]),sqrtf(a.v[3])); }
+	friend float4 lessThan( const float4& a, const float4& b ) {
+		float4 r; for( int i=0; i<4; i++ ) { unsigned m = a.v[i]<b.v[i]?~0u:0u; memcpy(&r.v[i],&m,4); } return r;
+	}
+	friend float4 select( const float4& a, const float4& b, const float4& mask ) {
+		float4 r; for( int i=0; i<4; i++ ) { unsigned m; memcpy(&m,&mask.v[i],4); r.v[i] = m?b.v[i]:a.v[i]; } return r;
+	}
+	friend int moveMask( const float4& a ) {
+		int r = 0; for( int i=0; i<4; i++ ) { unsigned m; memcpy(&m,&a.v[i],4); r |= int(m>>31)<<i; } return r;
+	}
+#endif
+	float operator[]( int i ) const { float t[4]; store(t); return t[i]; }
+};
+
+}
+
+#endif /* SIMD_hpp */
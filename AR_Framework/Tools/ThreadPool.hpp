@@ -0,0 +1,118 @@
+//
+//  ThreadPool.hpp
+//  AR_Framework
+//
+
+#ifndef ThreadPool_hpp
+#define ThreadPool_hpp
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <deque>
+#include <vector>
+#include <atomic>
+#include <algorithm>
+
+namespace AR {
+
+struct ThreadPool {
+	std::vector<std::thread> workers;
+	std::deque<std::function<void()>> jobs;
+	std::mutex mtx;
+	std::condition_variable cv;
+	bool quit = false;
+
+	ThreadPool( int nThreads=0 ) {
+		if( nThreads<1 ) nThreads = std::max( 1, int(std::thread::hardware_concurrency())-1 );
+		for( int i=0; i<nThreads; i++ )
+			workers.emplace_back( [this](){ workerLoop(); } );
+	}
+	~ThreadPool() {
+		{
+			std::lock_guard<std::mutex> lock( mtx );
+			quit = true;
+		}
+		cv.notify_all();
+		for( auto& w: workers ) if( w.joinable() ) w.join();
+	}
+	int size() const { return int(workers.size()); }
+
+	template<typename F> auto push( F&& f ) -> std::future<decltype(f())> {
+		using R = decltype(f());
+		auto task = std::make_shared<std::packaged_task<R()>>( std::forward<F>(f) );
+		std::future<R> ret = task->get_future();
+		{
+			std::lock_guard<std::mutex> lock( mtx );
+			jobs.emplace_back( [task](){ (*task)(); } );
+		}
+		cv.notify_one();
+		return ret;
+	}
+
+	// Runs func(i) for i in [begin,end) in chunks of 'grain'. The calling thread takes part,
+	// so it is safe to call from inside a job.
+	void parallelFor( int begin, int end, const std::function<void(int)>& func, int grain=1 ) {
+		if( end<=begin ) return;
+		grain = std::max( 1, grain );
+		int nChunks = (end-begin+grain-1)/grain;
+		if( nChunks==1 || workers.empty() ) {
+			for( int i=begin; i<end; i++ ) func( i );
+			return;
+		}
+		struct State {
+			std::atomic<int> next{0};
+			std::atomic<int> done{0};
+			std::mutex mtx;
+			std::condition_variable cv;
+		};
+		auto state = std::make_shared<State>();
+		auto run = [state, begin, end, grain, nChunks, func]() {
+			int c;
+			while( (c=state->next.fetch_add(1))<nChunks ) {
+				int b = begin+c*grain, e = std::min( end, b+grain );
+				for( int i=b; i<e; i++ ) func( i );
+				if( state->done.fetch_add(1)+1==nChunks ) {
+					std::lock_guard<std::mutex> lock( state->mtx );
+					state->cv.notify_all();
+				}
+			}
+		};
+		int nHelpers = std::min( size(), nChunks-1 );
+		{
+			std::lock_guard<std::mutex> lock( mtx );
+			for( int i=0; i<nHelpers; i++ ) jobs.emplace_back( run );
+		}
+		cv.notify_all();
+		run();
+		std::unique_lock<std::mutex> lock( state->mtx );
+		state->cv.wait( lock, [&](){ return state->done.load()>=nChunks; } );
+	}
+
+	static ThreadPool& shared() {
+		static ThreadPool pool;
+		return pool;
+	}
+
+protected:
+	void workerLoop() {
+		while( true ) {
+			std::function<void()> job;
+			{
+				std::unique_lock<std::mutex> lock( mtx );
+				cv.wait( lock, [this](){ return quit || !jobs.empty(); } );
+				if( quit && jobs.empty() ) return;
+				job = std::move( jobs.front() );
+				jobs.pop_front();
+			}
+			job();
+		}
+	}
+};
+
+}
+
+#endif /* ThreadPool_hpp */
@@ -33,6 +33,7 @@
 #include <fstream>
 #include <iostream>
 #include <string>
+#include <vector>
 
 namespace AR {
 
@@ -116,6 +117,12 @@ inline unsigned long loadText( const std::string& fn, char*& buf ) {
 	return len;
 }
 
+inline std::vector<unsigned char> loadBinary( const std::string& filename ) {
+	std::ifstream t(utf82Unicode(backToFrontSlash(filename)), std::ios::binary);
+	if( !t.is_open() ) return {};
+	return std::vector<unsigned char>((std::istreambuf_iterator<char>(t)), std::istreambuf_iterator<char>());
+}
+
 inline bool testFile( const std::string& fn ) {
 	std::string filename = backToFrontSlash( fn );
 	if( filename.back()=='/' ) return false;
@@ -14,6 +14,13 @@
 #include "Renderer.hpp"
 #include "FileLoader.hpp"
 #include "Light.hpp"
+#include "Model/TextureStreamer.hpp"
+#include "Model/IBL.hpp"
+#include "BatchRender.hpp"
+#include "CommandList.hpp"
+#include "FramePipeline.hpp"
+#include "Model/UploadWorker.hpp"
+#include "Model/AOBaker.hpp"
 #include <GLFW/glfw3.h>
 #pragma comment (lib, "glfw3")
 
@@ -23,9 +30,17 @@ AutoLoadProgram renderProg("render.vert","render.frag");
 
 MeshSet meshSet;
 TextureLib texLib;
+TextureStreamer texStreamer;
 Range3 range;
 Renderer* renderer = nullptr;
 Light light;
+UploadWorker uploadWorker;
+Animator animator;
+SceneGraph sceneGraph;
+SceneBVH sceneBVH;
+int selectedMesh = -1;					// picked by pullFunc(), tinted when drawn
+float animationStep = 0;				// fixed seconds per frame, 0 follows the clock
+int sceneGeneration = 0;				// tells stale uploads from the current scene's
 
 float roughness = 0.5f;
 float lightFactor = .5f;
@@ -36,23 +51,77 @@ float emissionStrength = 1.0f;
 float iblDiffuseIntensity = 0.3f;
 float iblSpecularIntensity = 1.0f;
 
-Texture environmentMapTex;
-Texture irradianceMapTex;
-Texture prefilterMapTex;
+TextureCube environmentMapTex;
+TextureCube irradianceMapTex;
+TextureCube prefilterMapTex;
 Texture brdfLUTTex;
 bool environmentMapLoaded = false;
 bool irradianceMapLoaded = false;
 bool prefilterMapLoaded = false;
 bool brdfLUTLoaded = false;
+bool shIrradianceLoaded = false;
+vec3 shIrradiance[9];
 float prefilterMaxLod = 0.0f;
+std::future<IBLResult> iblJob;
+struct AOJob {
+	int generation;
+	std::future<VertexAO> result;
+};
+std::vector<AOJob> aoJobs;
+std::shared_ptr<std::atomic<bool>> aoCancel = std::make_shared<std::atomic<bool>>( false );
+
+// Per-vertex AO of the meshes from firstMesh on: read from the cache next to
+// the file, or baked on the pool against a snapshot of the trees, written
+// there and handed to the meshes by resolveAO().
+static void startAOBake( const std::string& fn, int firstMesh ) {
+	std::vector<AOBakeMesh> input;
+	for( int i=firstMesh; i<int(meshSet.size()); i++ ) {
+		const TriMesh& mesh = meshSet[i];
+		if( i>=int(sceneBVH.meshes.size()) || !sceneBVH.meshes[i] || mesh.data.norms.size()!=mesh.data.verts.size() ) continue;
+		input.push_back( { i, mesh.modelMat, mesh.data.verts, mesh.data.norms } );
+	}
+	if( input.empty() ) return;
+	VertexAO cached;
+	if( loadVertexAO( fn, input, cached ) ) {
+		for( size_t m=0; m<cached.meshes.size(); m++ ) meshSet[cached.meshes[m]].vertexAO = std::move( cached.values[m] );
+		printf("AO: %s, cached\n", getFilenameFromAbsPath( fn ).c_str());
+		return;
+	}
+	sceneBVH.update( meshSet );
+	auto bvh = std::make_shared<SceneBVH>( sceneBVH );		// shares the meshes' trees
+	auto meshes = std::make_shared<std::vector<AOBakeMesh>>( std::move( input ) );
+	auto cancel = aoCancel;
+	aoJobs.push_back( { sceneGeneration, ThreadPool::shared().push( [fn, bvh, meshes, cancel](){
+		auto t0 = std::chrono::steady_clock::now();
+		VertexAO ao = bakeVertexAO( *bvh, *meshes, AOOptions(), cancel.get() );
+		if( ao.empty() ) return ao;
+		saveVertexAO( fn, ao );
+		float ms = std::chrono::duration<float,std::milli>( std::chrono::steady_clock::now()-t0 ).count();
+		printf("AO: %s in %.0f ms\n", getFilenameFromAbsPath( fn ).c_str(), ms);
+		return ao;
+	} ) } );
+}
 
 void loadFile( const std::string& fn, bool clearPrev=true ) {
 	if( clearPrev ) {
+		sceneGeneration++;
+		uploadWorker.finish();
+		aoCancel->store( true );
+		for( auto& job: aoJobs ) job.result.wait();
+		aoJobs.clear();
+		aoCancel = std::make_shared<std::atomic<bool>>( false );
 		meshSet.clear();
+		animator.clear();
+		sceneGraph.clear();
+		sceneBVH.clear();
+		selectedMesh = -1;
 		texLib.clear();
 		range = Range3();
 	}
-	range += loadMesh( backToFrontSlash(fn), meshSet, texLib);
+	int firstMesh = int(meshSet.size());
+	range += loadMesh( backToFrontSlash(fn), meshSet, texLib, &animator.characters, &sceneGraph );
+	sceneBVH.add( meshSet, firstMesh );			// while the data is still here, uploads clear it
+	startAOBake( backToFrontSlash(fn), firstMesh );
 	printf("Range: %f %f\n", range.minVal.z, range.maxVal.z);
 	renderer->setSceneBound(range.minVal, range.maxVal);
 	vec3 sceneSize = (range.maxVal - range.minVal);
@@ -63,6 +132,8 @@ void loadFile( const std::string& fn, bool clearPrev=true ) {
 
 
 void initFunc() {
+	// Context state, not texture state: cubes made on the upload context rely on it here.
+	glEnable( GL_TEXTURE_CUBE_MAP_SEAMLESS );
 	renderer->ui->add(new nanoSliderF(0,0,200,"Roughness",0,1,roughness));
 	renderer->ui->add(new nanoSliderF(0,0,200,"Metallic",0,1,metallic));
 	// renderer->ui->add(new nanoSliderF(0,0,200,"Parallax Height",0,0.1f,heightScale));
@@ -71,13 +142,18 @@ void initFunc() {
 	renderer->ui->add(new nanoSliderF(0,0,200,"Light Int.",0.5,10,lightFactor,true));
 }
 
-// Precompute LOD range for split-sum prefilter sampling.
-static float computePrefilterMaxLod(const Texture& tex) {
-	int w = tex.width;
-	int h = tex.height;
-	if( w<=0 || h<=0 ) return 0.0f;
-	int size = std::max(w,h);
-	return float(std::max(0, int(std::log2(float(size)))));
+// Runs 'create' on the upload worker and 'publish' on the render thread once
+// its objects are complete, or both right away without an upload context.
+static void createOnUploadContext( std::function<void()> create, std::function<void()> publish ) {
+	if( uploadWorker.isRunning() ) uploadWorker.push( [create](){
+		create();
+		glBindTexture( GL_TEXTURE_2D, 0 );
+		glBindTexture( GL_TEXTURE_CUBE_MAP, 0 );
+	}, publish );
+	else {
+		create();
+		publish();
+	}
 }
 
 static std::string toLowerString(std::string s) {
@@ -90,43 +166,105 @@ void loadEnvironmentTexture( const std::string& fn ) {
 	std::string path = backToFrontSlash(fn);
 	std::string filename = getFilenameFromAbsPath(path);
 	std::string lower = toLowerString(filename);
+	// Explicit maps are equirect files and get converted to cube maps here,
+	// then created on the upload context like the derived ones.
+	std::vector<MipLevel> cube;
+	uint32_t rgb32f = findPixelFormat( GL_FLOAT, 3, false )->vkFormat;
 	if( lower.find("irr") != std::string::npos ) {
-		if( irradianceMapTex.load(path, false) ) {
-			irradianceMapLoaded = true;
-			irradianceMapTex.createGL();
+		auto map = std::make_shared<TextureCube>();
+		if( loadEquirectCube(path, Texture::maxTextureSize(), 32, cube) && map->setLevels(rgb32f, std::move(cube)) ) {
+			createOnUploadContext( [map](){ map->createGL(); }, [map](){
+				static_cast<Texture&>( irradianceMapTex ) = std::move( *map );
+				irradianceMapLoaded = true;
+				shIrradianceLoaded = false;
+			} );
 			printf("Loaded irradiance map: %s\n", filename.c_str());
 		}
 		return;
 	}
 	if( lower.find("pref") != std::string::npos || lower.find("rough") != std::string::npos ) {
-		if( prefilterMapTex.load(path, false) ) {
-			prefilterMapLoaded = true;
-			prefilterMapTex.createGL();
-			prefilterMaxLod = computePrefilterMaxLod(prefilterMapTex);
-			printf("Loaded prefiltered environment map: %s (max LOD %.2f)\n", filename.c_str(), prefilterMaxLod);
+		auto map = std::make_shared<TextureCube>();
+		if( loadEquirectCube(path, Texture::maxTextureSize(), 0, cube) ) {
+			float maxLod = float(cube.size()/6-1);
+			if( map->setLevels(rgb32f, std::move(cube)) )
+				createOnUploadContext( [map](){ map->createGL(); }, [map, maxLod](){
+					static_cast<Texture&>( prefilterMapTex ) = std::move( *map );
+					prefilterMaxLod = maxLod;
+					prefilterMapLoaded = true;
+				} );
+			printf("Loaded prefiltered environment map: %s (max LOD %.2f)\n", filename.c_str(), maxLod);
 		}
 		return;
 	}
 	if( lower.find("brdf") != std::string::npos ) {
-		if( brdfLUTTex.load(path, false) ) {
-			brdfLUTLoaded = true;
-			brdfLUTTex.createGL();
+		auto map = std::make_shared<Texture>();
+		if( map->load(path, false) ) {
+			createOnUploadContext( [map](){ map->createGL(); }, [map](){
+				brdfLUTTex = std::move( *map );
+				brdfLUTLoaded = true;
+			} );
 			printf("Loaded BRDF LUT: %s\n", filename.c_str());
 		}
 		return;
 	}
-	if( environmentMapTex.load(path, false) ) {
-		environmentMapLoaded = true;
-		environmentMapTex.createGL();
-		printf("Loaded environment map: %s\n", filename.c_str());
+	// Anything else is a plain environment; irradiance SH, prefiltered map and
+	// BRDF LUT are derived from it on the thread pool and picked up by resolveIBL().
+	int maxSize = Texture::maxTextureSize();
+	iblJob = ThreadPool::shared().push( [path, maxSize](){ return loadIBL( path, maxSize ); } );
+}
+
+static void resolveAO() {
+	for( size_t j=0; j<aoJobs.size(); ) {
+		AOJob& job = aoJobs[j];
+		if( job.result.wait_for( std::chrono::seconds(0) )!=std::future_status::ready ) {
+			j++;
+			continue;
+		}
+		VertexAO ao = job.result.get();
+		if( job.generation==sceneGeneration )
+			for( size_t m=0; m<ao.meshes.size(); m++ )
+				if( ao.meshes[m]<int(meshSet.size()) ) meshSet[ao.meshes[m]].vertexAO = std::move( ao.values[m] );
+		aoJobs.erase( aoJobs.begin()+j );
 	}
 }
 
-// Utility to bind optional textures while advancing slot counters.
-static int bindOptionalTexture(int slot, int texID, const char* uniformName, Program& prog) {
-	if( texID < 0 ) return slot;
-	texLib[texID].bind(slot, prog, uniformName);
-	return slot + 1;
+static void resolveIBL() {
+	if( !iblJob.valid() || iblJob.wait_for( std::chrono::seconds(0) )!=std::future_status::ready ) return;
+	IBLResult r = iblJob.get();
+	if( r.environment.empty() ) return;
+	// The maps are created on the upload context and swapped in once complete.
+	struct Maps {
+		TextureCube environment, prefiltered;
+		Texture brdfLUT;
+		vec3 sh[9];
+		float maxLod;
+	};
+	auto maps = std::make_shared<Maps>();
+	maps->environment.setLevels( r.environmentFormat, std::move( r.environment ) );
+	std::copy( r.maps.sh, r.maps.sh+9, maps->sh );
+	maps->maxLod = float(r.maps.prefiltered.size()/6-1);
+	maps->prefiltered.setLevels( r.maps.prefilteredFormat, std::move( r.maps.prefiltered ) );
+	maps->brdfLUT.setLevels( r.maps.brdfFormat, std::move( r.maps.brdfLUT ) );
+	maps->brdfLUT.inter = GL_LINEAR;
+	maps->brdfLUT.wrap_s = maps->brdfLUT.wrap_t = GL_CLAMP_TO_EDGE;
+	auto create = [maps](){
+		maps->environment.createGL();
+		maps->prefiltered.createGL();
+		maps->brdfLUT.createGL();
+	};
+	auto publish = [maps](){
+		static_cast<Texture&>( environmentMapTex ) = std::move( maps->environment );
+		static_cast<Texture&>( prefilterMapTex ) = std::move( maps->prefiltered );
+		brdfLUTTex = std::move( maps->brdfLUT );
+		std::copy( maps->sh, maps->sh+9, shIrradiance );
+		prefilterMaxLod = maps->maxLod;
+		environmentMapLoaded = true;
+		shIrradianceLoaded = true;
+		irradianceMapLoaded = false;
+		prefilterMapLoaded = true;
+		brdfLUTLoaded = true;
+	};
+	createOnUploadContext( create, publish );
 }
 
 // Upload all scene lighting uniforms and IBL resources.
@@ -141,6 +279,8 @@ static void setLightingUniforms(Program& prog) {
 	prog.setUniform( "iblSpecularIntensity", iblSpecularIntensity );
 	prog.setUniform( "environmentEnabled", environmentMapLoaded?1:0 );
 	prog.setUniform( "irradianceEnabled", irradianceMapLoaded?1:0 );
+	prog.setUniform( "shEnabled", shIrradianceLoaded?1:0 );
+	if( shIrradianceLoaded ) prog.setUniform( "shIrradiance", shIrradiance, 9 );
 	prog.setUniform( "prefilterEnabled", prefilterMapLoaded?1:0 );
 	prog.setUniform( "brdfLUTEnabled", brdfLUTLoaded?1:0 );
 	prog.setUniform( "prefilterMaxLod", prefilterMaxLod );
@@ -152,47 +292,265 @@ static void setLightingUniforms(Program& prog) {
 	if( brdfLUTLoaded ) brdfLUTTex.bind( iblSlot++, prog, "brdfLUT" );
 }
 
-// Push per-material BRDF parameters and bind supporting textures.
-static void uploadMaterial(const Material& mat, Program& prog) {
-	prog.setUniform( "baseColor", mat.diffColor );
-	prog.setUniform( "specColor", mat.specColor );
-	prog.setUniform( "materialRoughness", mat.roughness );
-	prog.setUniform( "roughnessMapInverse", mat.roughnessMapInverse?1:0 );
-	prog.setUniform( "materialMetallic", 0.0f );	// per-material metalness map overrides this.
+// Per-draw block of render.vert/render.frag, std140.
+struct DrawParams {
+	mat4 modelMat;
+	vec4 baseColor;
+	vec3 specColor;
+	float materialRoughness;
+	float materialMetallic;
+	int roughnessMapInverse;
+	int diffTexEnabled;
+	int normalMapEnabled;
+	int normalMapRG;
+	int roughnessMapEnabled;
+	int metalnessMapEnabled;
+	int aoMapEnabled;
+	int heightMapEnabled;
+	int emissionMapEnabled;
+	int boneOffset;				// TriMesh::boneOffset
+	int vertexAOEnabled;		// TriMesh::aoBuf
+	int selected;				// selectedMesh, tinted
+	int pad[3];
+};
+static_assert( sizeof(DrawParams)==160, "DrawParams must match the std140 block in render.frag" );
+const GLuint DRAW_PARAMS_BINDING = 0;
+
+// Material maps sit on fixed units so recorded binds stay valid, IBL maps use 8 and up.
+enum { DIFF_UNIT, NORMAL_UNIT, ROUGHNESS_UNIT, METALNESS_UNIT, AO_UNIT, HEIGHT_UNIT, EMISSION_UNIT, MATERIAL_UNITS };
+static const char* materialSamplers[MATERIAL_UNITS] = {
+	"diffTex", "normalMap", "roughnessMap", "metalnessMap", "aoMap", "heightMap", "emissionMap" };
+const int BONE_UNIT = MATERIAL_UNITS;		// Animator's palette buffer
+
+CommandList drawList( sizeof(DrawParams) );
+
+// Built on the workers, one per mesh that survives culling.
+struct DrawRecord {
+	uint64_t key;				// see buildDrawRecord()
+	int mesh;
+	bool prepared;				// mesh and textures exist in GL
+	GLuint tex[MATERIAL_UNITS];
+	DrawParams params;
+	uint64_t signature;
+};
+FramePipeline<DrawRecord> framePipeline;
+std::vector<const DrawRecord*> frameDraws;
+std::vector<int> drawOrder;
+
+static void materialMaps( const Material& mat, int ids[MATERIAL_UNITS] ) {
+	int m[MATERIAL_UNITS] = { mat.diffTexID, mat.normMapID, mat.roughnessMapID, mat.metalnessMapID,
+		mat.ambOccMatID, mat.bumpMapID, mat.emissionMapID };
+	std::copy( m, m+MATERIAL_UNITS, ids );
 }
 
-void renderFunc( Program& prog ) {
-	setLightingUniforms(prog);
+// Runs on the workers, so it only reads the mesh and the texture library.
+// Returns false for culled meshes; meshes not uploaded yet are never culled
+// since their bounds are not known.
+static bool buildDrawRecord( int i, const Frustum& frustum, const mat4& viewMat, float zFar, GLuint program, DrawRecord& r ) {
+	const TriMesh& mesh = meshSet[i];
+	const Material& mat = mesh.material;
+	if( !mesh.visible ) return false;
+	r.mesh = i;
+	r.prepared = mesh.vBuf>0 && mesh.eBuf>0 && !mesh.dataDirty && mesh.vertexAO.empty();
+	int ids[MATERIAL_UNITS];
+	materialMaps( mat, ids );
+	for( int u=0; u<MATERIAL_UNITS; u++ ) {
+		r.tex[u] = 0;
+		if( !texLib.ready(ids[u]) ) continue;
+		const Texture& tex = texLib[ids[u]];
+		if( tex.texID<1 || tex.texDataDirty ) r.prepared = false;
+		else r.tex[u] = tex.texID;
+	}
+	vec4 sphere = mesh.boundingSphere();
+	if( r.prepared && !frustum.intersectsSphere( vec3(sphere), sphere.w ) ) return false;
+
+	DrawParams& p = r.params;
+	p = {};
+	p.modelMat = mesh.modelMat;
+	p.baseColor = mat.diffColor;
+	p.specColor = mat.specColor;
+	p.materialRoughness = mat.roughness;
+	p.materialMetallic = 0.0f;	// per-material metalness map overrides this.
+	p.roughnessMapInverse = mat.roughnessMapInverse?1:0;
+	p.diffTexEnabled = r.tex[DIFF_UNIT]>0;
+	p.normalMapEnabled = r.tex[NORMAL_UNIT]>0;
+	p.normalMapRG = r.tex[NORMAL_UNIT]>0 && texLib[mat.normMapID].nChannels==2;
+	p.roughnessMapEnabled = r.tex[ROUGHNESS_UNIT]>0;
+	p.metalnessMapEnabled = r.tex[METALNESS_UNIT]>0;
+	p.aoMapEnabled = r.tex[AO_UNIT]>0;
+	p.heightMapEnabled = r.tex[HEIGHT_UNIT]>0;
+	p.emissionMapEnabled = r.tex[EMISSION_UNIT]>0;
+	p.boneOffset = mesh.sBuf>0?mesh.boneOffset:-1;
+	p.vertexAOEnabled = mesh.aoBuf>0;
+	p.selected = i==selectedMesh;
+
+	GLuint draw[4] = { program, mesh.vao, GLuint(mesh.nTris), p.boneOffset>=0?animator.texture:0 };
+	uint64_t state = hashBytes( r.tex, sizeof(r.tex), program );
+	r.signature = hashBytes( &p, sizeof(p), hashBytes( draw, sizeof(draw), state ) );
+
+	// Opaque draws group by textures, then vertex array, then front to back;
+	// translucent ones follow, back to front.
+	float depth = -(viewMat*vec4( vec3(sphere), 1 )).z;
+	uint64_t d = uint64_t( std::min( 1.f, std::max( 0.f, depth/zFar ) )*0xffffff );
+	if( mat.diffColor.a<1 ) r.key = (uint64_t(1)<<63) | ((0xffffff-d)<<16);
+	else r.key = ((state&0x7fffff)<<40) | (uint64_t(mesh.vao&0xffff)<<24) | d;
+	return true;
+}
 
-	for( auto& mesh: meshSet ) {
-		const Material& mat = mesh.material;
+static GLuint materialTexture( int texID, int unit ) {
+	if( !texLib.ready(texID) ) return 0;
+	Texture& tex = texLib[texID];
+	if( tex.texID<1 || tex.texDataDirty ) tex.bind( unit );
+	return tex.texID;
+}
+
+// Moves the mesh's data to the upload worker; the mesh is drawn from the
+// frame after its buffers are published.
+static void uploadMesh( int i ) {
+	TriMesh& mesh = meshSet[i];
+	mesh.uploading = true;
+	auto data = std::make_shared<MeshData>( std::move( mesh.data ) );
+	auto buffers = std::make_shared<TriMesh::Buffers>();
+	int generation = sceneGeneration;
+	uploadWorker.push( [data, buffers](){
+		*buffers = TriMesh::createBuffers( *data );
+	}, [i, buffers, generation](){
+		if( generation==sceneGeneration && i<int(meshSet.size()) ) meshSet[i].adoptBuffers( *buffers );
+		else TriMesh::deleteBuffers( *buffers );
+	} );
+}
 
-		// Bind colour / attribute texture set.
-		int texSlot = 0;
-		prog.setUniform( "diffTexEnabled", mat.diffTexID>=0?1:0 );
-		if( mat.diffTexID>=0 )
-			texLib[mat.diffTexID].bind( texSlot++, prog, "diffTex" );
-		int slot = texSlot;
-		slot = bindOptionalTexture(slot, mat.normMapID, "normalMap", prog);
-		slot = bindOptionalTexture(slot, mat.roughnessMapID, "roughnessMap", prog);
-		slot = bindOptionalTexture(slot, mat.metalnessMapID, "metalnessMap", prog);
-		slot = bindOptionalTexture(slot, mat.ambOccMatID, "aoMap", prog);
-		slot = bindOptionalTexture(slot, mat.bumpMapID, "heightMap", prog);
-		bindOptionalTexture(slot, mat.emissionMapID, "emissionMap", prog);
+// Same for the baked occlusion, attached to the vertex array once published.
+static void uploadMeshAO( int i ) {
+	TriMesh& mesh = meshSet[i];
+	auto ao = std::make_shared<std::vector<uint8_t>>();
+	ao->swap( mesh.vertexAO );
+	if( GLsizei(ao->size())!=mesh.nVerts || !mesh.vao ) return;
+	auto buf = std::make_shared<GLuint>( 0 );
+	int generation = sceneGeneration;
+	uploadWorker.push( [ao, buf](){
+		*buf = TriMesh::createVertexAOBuffer( *ao );
+	}, [i, buf, generation, vao=mesh.vao](){
+		if( generation==sceneGeneration && i<int(meshSet.size()) && meshSet[i].vao==vao ) meshSet[i].adoptVertexAO( *buf );
+		else glDeleteBuffers( 1, buf.get() );
+	} );
+}
 
-		prog.setUniform( "normalMapEnabled", mat.normMapID>=0?1:0 );
-		prog.setUniform( "roughnessMapEnabled", mat.roughnessMapID>=0?1:0 );
-		prog.setUniform( "metalnessMapEnabled", mat.metalnessMapID>=0?1:0 );
-		prog.setUniform( "aoMapEnabled", mat.ambOccMatID>=0?1:0 );
-		prog.setUniform( "heightMapEnabled", mat.bumpMapID>=0?1:0 );
-		prog.setUniform( "emissionMapEnabled", mat.emissionMapID>=0?1:0 );
-		prog.setUniform( "roughness", roughness);
+// GL thread: creates what the record found missing. With an upload context
+// new or replaced data goes through the worker, never through prepareGL().
+static bool prepareDraw( int i ) {
+	TriMesh& mesh = meshSet[i];
+	if( mesh.uploading ) return false;
+	if( uploadWorker.isRunning() ) {
+		if( (mesh.vBuf<1 || mesh.dataDirty) && mesh.data.verts.size()>0 ) {
+			uploadMesh( i );
+			return false;
+		}
+		if( mesh.vertexAO.size() ) uploadMeshAO( i );
+	}
+	if( !mesh.prepareGL() ) return false;
+	int ids[MATERIAL_UNITS];
+	materialMaps( mesh.material, ids );
+	for( int u=0; u<MATERIAL_UNITS; u++ ) materialTexture( ids[u], u );
+	return true;
+}
 
-		uploadMaterial(mat, prog);
+// Re-records the mesh's draw only when its inputs changed since the last frame.
+static void recordDraw( const DrawRecord& r, GLuint program ) {
+	if( !drawList.changed( r.mesh, r.signature ) ) return;
+	const TriMesh& mesh = meshSet[r.mesh];
+	auto rec = drawList.record( r.mesh, r.signature );
+	rec.useProgram( program );
+	for( int u=0; u<MATERIAL_UNITS; u++ ) if( r.tex[u] ) rec.bindTexture( u, GL_TEXTURE_2D, r.tex[u] );
+	if( r.params.boneOffset>=0 ) rec.bindTexture( BONE_UNIT, GL_TEXTURE_BUFFER, animator.texture );
+	rec.uniforms( &r.params, DRAW_PARAMS_BINDING );
+	rec.bindVertexArray( mesh.vao );
+	rec.drawElements( mesh.nTris*3 );
+}
 
-		prog.setUniform( "modelMat", mesh.modelMat );
-		mesh.render( prog );
+void renderFunc( Program& prog ) {
+	uploadWorker.poll();
+	texLib.resolve();
+	resolveIBL();
+	resolveAO();
+
+	sceneGraph.update( meshSet );
+
+	// Poses on the workers, skinning in render.vert.
+	if( !animator.empty() ) {
+		static double lastTime = glfwGetTime();
+		double now = glfwGetTime();
+		animator.update( animationStep>0?animationStep:float( now-lastTime ), meshSet );
+		animator.upload();
+		lastTime = now;
 	}
+
+	// Culling, sort keys and per-draw data on the workers.
+	const Camera& camera = renderer->camera;
+	Frustum frustum( camera );
+	mat4 viewMat = camera.viewMat();
+	GLuint program = prog.programID;
+	auto& order = framePipeline.build( int(meshSet.size()), [&]( int begin, int end, std::vector<DrawRecord>& out ) {
+		DrawRecord r;
+		for( int i=begin; i<end; i++ )
+			if( buildDrawRecord( i, frustum, viewMat, camera.zFar, program, r ) ) out.push_back( r );
+	} );
+
+	texStreamer.beginFrame( texLib );
+	frameDraws.clear();
+	for( auto& ref: order ) {
+		DrawRecord& r = framePipeline[ref];
+		if( !r.prepared && (!prepareDraw( r.mesh ) || !buildDrawRecord( r.mesh, frustum, viewMat, camera.zFar, program, r )) )
+			continue;
+		texStreamer.request( texLib, meshSet[r.mesh], camera );
+		frameDraws.push_back( &r );
+	}
+	texStreamer.update( texLib );
+	texLib.pumpUploads();
+	setLightingUniforms(prog);
+	prog.setUniform( "roughness", roughness );
+
+	static GLuint setupProgram = 0;
+	if( program!=setupProgram ) {
+		for( int u=0; u<MATERIAL_UNITS; u++ ) prog.setUniform( materialSamplers[u], u );
+		prog.setUniform( "bonePalette", BONE_UNIT );
+		GLuint block = glGetUniformBlockIndex( program, "DrawParams" );
+		if( block!=GL_INVALID_INDEX ) glUniformBlockBinding( program, block, DRAW_PARAMS_BINDING );
+		setupProgram = program;
+	}
+	drawList.resize( int(meshSet.size()) );
+	drawOrder.clear();
+	for( auto r: frameDraws ) {
+		recordDraw( *r, program );
+		drawOrder.push_back( r->mesh );
+	}
+	drawList.replay( drawOrder );
+}
+
+// Closest triangle under the cursor, window coordinates.
+static Hit pick( const vec2& pt ) {
+	int ww, wh;
+	glfwGetWindowSize( renderer->window, &ww, &wh );
+	const Camera& camera = renderer->camera;
+	mat4 inv = inverse( camera.projMat()*camera.viewMat() );
+	vec2 ndc( pt.x/ww*2-1, 1-pt.y/wh*2 );
+	vec4 a = inv*vec4( ndc.x, ndc.y, -1, 1 ), b = inv*vec4( ndc.x, ndc.y, 1, 1 );
+	vec3 org = vec3( a )/a.w;
+	sceneBVH.update( meshSet );
+	return sceneBVH.closestHit( Ray( org, vec3( b )/b.w-org ) );
+}
+
+static vec2 pressPt;
+
+void pushFunc( int ) {
+	pressPt = renderer->mousePt;
+}
+
+// A click selects the mesh under the cursor, or clears the selection.
+void pullFunc( int button ) {
+	if( button!=GLFW_MOUSE_BUTTON_1 || length( renderer->mousePt-pressPt )>3 ) return;	// dragged the camera
+	Hit hit = pick( renderer->mousePt );
+	selectedMesh = hit.valid()?hit.mesh:-1;
 }
 
 void dropFunc( const std::string& fn ) {
@@ -208,7 +566,21 @@ void dropFunc( const std::string& fn ) {
 	
 
 
+// Everything queued by the loaders has reached the GPU.
+static bool sceneReady() {
+	return texLib.pending.empty() && texLib.uploadQueue.empty() && texLib.uploader.pending()==0 && !iblJob.valid()
+		&& uploadWorker.pending()==0 && aoJobs.empty();
+}
+
 int main(int argc, const char * argv[]) {
+	BatchRenderOptions batch;
+	std::vector<std::string> files;
+	bool batchMode = batch.parse( argc, argv, files );
+#if defined(__linux__) && defined(GLFW_PLATFORM_NULL)
+	// No display on CI: GLFW's null platform with an OSMesa (software) context.
+	bool headless = batchMode && !getenv("DISPLAY") && !getenv("WAYLAND_DISPLAY");
+	if( headless ) glfwInitHint( GLFW_PLATFORM, GLFW_PLATFORM_NULL );
+#endif
 	if ( !glfwInit() )  {
 		printf("FAil\n");
 		exit(EXIT_FAILURE);
@@ -222,17 +594,56 @@ int main(int argc, const char * argv[]) {
 	glfwWindowHint( GLFW_COCOA_RETINA_FRAMEBUFFER, GLFW_FALSE );
 #endif
 	
-	glfwWindowHint( GLFW_SAMPLES, 32 );
+	// Batch frames go to their own framebuffer, the window only carries the context.
+	glfwWindowHint( GLFW_SAMPLES, batchMode?0:32 );
+	glfwWindowHint( GLFW_VISIBLE, batchMode?GLFW_FALSE:GLFW_TRUE );
+#if defined(__linux__) && defined(GLFW_PLATFORM_NULL)
+	if( headless ) glfwWindowHint( GLFW_CONTEXT_CREATION_API, GLFW_OSMESA_CONTEXT_API );
+#endif
 	GLFWwindow* window = glfwCreateWindow( 800, 600, "Hello", NULL, NULL );
+	if( !window ) {
+		fprintf( stderr, "[ERROR] Cannot create an OpenGL context\n" );
+		glfwTerminate();
+		exit(EXIT_FAILURE);
+	}
 	glfwMakeContextCurrent( window );
 #ifndef __APPLE__
 	glewInit();
 #endif
 
+	// Buffers and textures are created on a second, hidden context sharing
+	// objects with the window's, so frames never wait on allocations.
+	glfwWindowHint( GLFW_VISIBLE, GLFW_FALSE );
+	GLFWwindow* uploadContext = glfwCreateWindow( 1, 1, "Upload", NULL, window );
+	if( uploadContext ) {
+		uploadWorker.start( [uploadContext](){ glfwMakeContextCurrent( uploadContext ); } );
+		texLib.worker = &uploadWorker;
+	}
+	else fprintf( stderr, "[ERROR] Cannot create the upload context, uploading on the render thread\n" );
+
 	renderer = new Renderer(window);
 	renderer->initFunc = initFunc;
 	renderer->renderFunc = renderFunc;
 	renderer->dropFunc = dropFunc;
+	renderer->pushFunc = pushFunc;
+	renderer->pullFunc = pullFunc;
+
+	if( batchMode ) {
+		texLib.streamMips = false;		// offline frames want every level
+		renderer->camera.viewport = vec2( batch.width, batch.height );	// the scene is framed for the batch, not the hidden window
+		animationStep = 1/30.f;
+	}
+	for( auto& fn: files ) dropFunc( fn );
+
+	if( batchMode ) {
+		bool ok = BatchRender::run( *renderer, batch, sceneReady );
+		aoCancel->store( true );
+		uploadWorker.stop();
+		if( uploadContext ) glfwDestroyWindow( uploadContext );
+		glfwDestroyWindow( window );
+		glfwTerminate();
+		return ok?0:1;
+	}
 
 	while ( !glfwWindowShouldClose( window ) ) {
 		int fw, fh, ww, wh;
@@ -248,6 +659,9 @@ int main(int argc, const char * argv[]) {
 		glfwSwapBuffers( window );
 		glfwPollEvents();
 	}
+	aoCancel->store( true );
+	uploadWorker.stop();
+	if( uploadContext ) glfwDestroyWindow( uploadContext );
 	glfwDestroyWindow( window );
 	glfwTerminate();
 	return 0;
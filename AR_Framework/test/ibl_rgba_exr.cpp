@@ -0,0 +1,119 @@
+//
+//  ibl_rgba_exr.cpp
+//  AR_Framework
+//
+
+// Runs loadIBL on an RGBA EXR, which the EXR reader returns with four channels,
+// and checks that the cube maps come out packed, first decoded, then from the
+// caches. Standalone, from the repository root:
+//
+//	g++ -std=c++17 -O2 -Iinclude -IAR_Framework AR_Framework/test/ibl_rgba_exr.cpp AR_Framework/Model/IBL.cpp \
+//		AR_Framework/Model/EXR.cpp AR_Framework/Model/HDRFormat.cpp AR_Framework/Model/KTX2.cpp AR_Framework/Model/MipGen.cpp \
+//		AR_Framework/Model/BlockCompress.cpp AR_Framework/Model/Texture.cpp AR_Framework/Model/TriMesh.cpp -lGLEW -lGL -lpthread -o ibl_rgba_exr && ./ibl_rgba_exr
+//
+// No GL context is needed. Exits with 1 on failure.
+
+#include "Model/IBL.hpp"
+#include <cstdio>
+#include <filesystem>
+
+using namespace AR;
+
+// Uncompressed single-part scanline EXR with FLOAT A, B, G, R channels.
+static bool writeRGBAEXR( const std::string& fn, int w, int h, const float* rgba ) {
+	std::vector<unsigned char> out;
+	auto bytes = [&]( const void* p, size_t n ) { out.insert( out.end(), (const unsigned char*)p, (const unsigned char*)p+n ); };
+	auto i32 = [&]( int32_t v ) { bytes( &v, 4 ); };
+	auto str = [&]( const char* s ) { bytes( s, strlen( s )+1 ); };
+	auto attr = [&]( const char* name, const char* type, int32_t size ) { str( name ); str( type ); i32( size ); };
+	const char* names[] = { "A", "B", "G", "R" };				// channels are sorted by name
+	const int source[] = { 3, 2, 1, 0 };
+	i32( 20000630 );
+	i32( 2 );
+	attr( "channels", "chlist", 4*(2+16)+1 );
+	for( auto name: names ) {
+		str( name );
+		i32( 2 );												// FLOAT
+		i32( 0 );												// pLinear and reserved
+		i32( 1 );
+		i32( 1 );
+	}
+	out.push_back( 0 );
+	attr( "compression", "compression", 1 );
+	out.push_back( 0 );
+	int32_t window[4] = { 0, 0, w-1, h-1 };
+	attr( "dataWindow", "box2i", 16 );
+	bytes( window, 16 );
+	attr( "displayWindow", "box2i", 16 );
+	bytes( window, 16 );
+	attr( "lineOrder", "lineOrder", 1 );
+	out.push_back( 0 );
+	float one = 1, center[2] = { 0, 0 };
+	attr( "pixelAspectRatio", "float", 4 );
+	bytes( &one, 4 );
+	attr( "screenWindowCenter", "v2f", 8 );
+	bytes( center, 8 );
+	attr( "screenWindowWidth", "float", 4 );
+	bytes( &one, 4 );
+	out.push_back( 0 );
+
+	uint64_t offset = out.size()+size_t(h)*8;
+	for( int y=0; y<h; y++, offset += 8+size_t(w)*4*4 ) bytes( &offset, 8 );
+	for( int y=0; y<h; y++ ) {
+		i32( y );
+		i32( w*4*4 );
+		for( int c: source ) for( int x=0; x<w; x++ ) bytes( &rgba[(size_t(y)*w+x)*4+c], 4 );
+	}
+	FILE* f = fopen( fn.c_str(), "wb" );
+	if( !f ) return false;
+	bool ok = fwrite( out.data(), 1, out.size(), f )==out.size();
+	fclose( f );
+	return ok;
+}
+
+int main() {
+	int failures = 0;
+	auto check = [&]( bool ok, const char* what ) {
+		printf( "%-48s %s\n", what, ok?"ok":"FAILED" );
+		if( !ok ) failures++;
+	};
+	namespace fs = std::filesystem;
+	fs::path dir = fs::temp_directory_path()/"ar_ibl_rgba_exr";
+	fs::remove_all( dir );
+	fs::create_directories( dir );
+	std::string fn = (dir/"sky.exr").string();
+
+	int w = 64, h = 32;
+	std::vector<float> rgba( size_t(w)*h*4 );
+	for( int y=0; y<h; y++ ) for( int x=0; x<w; x++ ) {
+		float* p = &rgba[(size_t(y)*w+x)*4];
+		p[0] = 1+x*.1f; p[1] = .5f+y*.05f; p[2] = .25f; p[3] = 1;
+	}
+	if( !writeRGBAEXR( fn, w, h, rgba.data() ) ) {
+		printf( "cannot write %s\n", fn.c_str() );
+		return 1;
+	}
+	std::vector<unsigned char> bytes = loadBinary( fn );
+	int iw = 0, ih = 0, n = 0;
+	check( infoEXR( bytes.data(), bytes.size(), &iw, &ih, &n ) && n==4, "EXR reader sees four channels" );
+
+	IBLOptions opt;
+	opt.environmentSize = 16;
+	opt.prefilterSize = 8;
+	opt.prefilterLevels = 3;
+	opt.prefilterSamples = 16;
+	opt.brdfSize = 8;
+	opt.brdfSamples = 16;
+	uint32_t cubeFormat = hdrPixelFormat( opt.format, 3 )->vkFormat;
+	for( const char* pass: { "decoded", "cached" } ) {
+		IBLResult r = loadIBL( fn, 4096, opt );
+		std::string what = std::string( pass )+": ";
+		check( !r.environment.empty() && r.environmentFormat!=0 && r.environmentFormat==cubeFormat,
+			  (what+"environment packed").c_str() );
+		check( !r.maps.prefiltered.empty() && r.maps.prefilteredFormat==cubeFormat, (what+"prefiltered map packed").c_str() );
+		check( fs::exists( fn+".cube.ktx2" ) && fs::exists( fn+".prefilter.ktx2" ), (what+"caches written").c_str() );
+	}
+	fs::remove_all( dir );
+	printf( failures?"%d checks FAILED\n":"all passed\n", failures );
+	return failures?1:0;
+}
@@ -0,0 +1,63 @@
+//
+//  mipgen_normal_rg.cpp
+//  AR_Framework
+//
+
+// Builds the mip chain of a constant, tilted two channel normal map, 8-bit and
+// float, and checks that every level keeps the xy of the source. Standalone,
+// from the repository root:
+//
+//	g++ -std=c++17 -O2 -Iinclude -IAR_Framework AR_Framework/test/mipgen_normal_rg.cpp AR_Framework/Model/MipGen.cpp \
+//		AR_Framework/Model/HDRFormat.cpp -lpthread -o mipgen_normal_rg && ./mipgen_normal_rg
+//
+// Exits with 1 on failure.
+
+#include "Model/MipGen.hpp"
+#include <cmath>
+#include <cstdio>
+#include <string>
+
+using namespace AR;
+
+int main() {
+	int failures = 0;
+	auto check = [&]( bool ok, const std::string& what ) {
+		printf( "%-48s %s\n", what.c_str(), ok?"ok":"FAILED" );
+		if( !ok ) failures++;
+	};
+	const int size = 64;
+	const float nx = .5f, ny = -.3f;				// z is .81, well away from flat
+	MipOptions opt;
+	opt.normalMap = true;
+
+	std::vector<unsigned char> rg8( size_t(size)*size*2 );
+	std::vector<float> rg32( rg8.size() );
+	for( size_t i=0; i<size_t(size)*size; i++ ) {
+		rg8[i*2] = (unsigned char)( (nx*.5f+.5f)*255.f+.5f );
+		rg8[i*2+1] = (unsigned char)( (ny*.5f+.5f)*255.f+.5f );
+		rg32[i*2] = nx*.5f+.5f;
+		rg32[i*2+1] = ny*.5f+.5f;
+	}
+
+	std::vector<MipLevel> levels = generateMips( rg8.data(), size, size, 2, opt );
+	check( levels.size()==7, "8-bit: full chain" );
+	for( size_t l=1; l<levels.size(); l++ ) {
+		int worst = 0;
+		for( size_t i=0; i<levels[l].data.size(); i++ )
+			worst = std::max( worst, std::abs( int(levels[l].data[i])-int(rg8[i%2]) ) );
+		check( worst<=1, "8-bit: level "+std::to_string( l )+" keeps xy" );
+	}
+
+	levels = generateMips( rg32.data(), size, size, 2, opt );
+	check( levels.size()==7, "float: full chain" );
+	for( size_t l=1; l<levels.size(); l++ ) {
+		const float* d = (const float*)levels[l].data.data();
+		float worst = 0;
+		for( size_t i=0; i<levels[l].data.size()/sizeof(float); i++ )
+			worst = std::max( worst, std::fabs( d[i]-rg32[i%2] ) );
+		check( worst<=1e-4f, "float: level "+std::to_string( l )+" keeps xy" );
+	}
+
+	printf( failures?"%d checks FAILED\n":"all passed\n", failures );
+	return failures?1:0;
+}
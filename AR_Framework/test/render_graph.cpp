@@ -0,0 +1,74 @@
+//
+//  render_graph.cpp
+//  AR_Framework
+//
+
+// Compiles small render graphs and checks the pass order, culling, aliasing
+// of transients and that a dependency cycle is refused. Only compile() runs,
+// so no GL context is needed: the pooled textures are allocated but never
+// drawn to. Standalone, from the repository root:
+//
+//	g++ -std=c++17 -O2 -Iinclude -IAR_Framework AR_Framework/test/render_graph.cpp AR_Framework/Model/Texture.cpp \
+//		AR_Framework/Model/TriMesh.cpp -lGLEW -lGL -lpthread -o render_graph && ./render_graph
+//
+// Exits with 1 on failure.
+
+#include "RenderGraph.hpp"
+#include <cstdio>
+
+using namespace AR;
+
+int main() {
+	int failures = 0;
+	auto check = [&]( bool ok, const char* what ) {
+		printf( "%-48s %s\n", what, ok?"ok":"FAILED" );
+		if( !ok ) failures++;
+	};
+	auto none = []( RenderGraph& ){};
+
+	// shadow -> scene -> bright -> blur -> blur2 -> tonemap, plus a debug pass nobody reads.
+	{
+		RenderGraph g;
+		int back = g.importBackbuffer( 64, 64 );
+		int shadow = g.create( "shadow", { 32, 32, GL_DEPTH_COMPONENT32F } );
+		int debug = g.create( "debug", { 64, 64, GL_RGBA8 } );
+		int hdr = g.create( "hdr", { 64, 64, GL_RGBA16F } );
+		int depth = g.create( "depth", { 64, 64, GL_DEPTH_COMPONENT32F } );
+		int b1 = g.create( "bright", { 16, 16, GL_RGBA8 } );
+		int b2 = g.create( "blurX", { 16, 16, GL_RGBA8 } );
+		int b3 = g.create( "blurY", { 16, 16, GL_RGBA8 } );
+		g.addPass( "shadow", none ).depth( shadow ).clearDepth();
+		g.addPass( "debug", none ).write( debug ).clear( vec4( 0 ) );
+		g.addPass( "scene", none ).read( shadow ).write( hdr ).depth( depth ).clear( vec4( 0 ) );
+		g.addPass( "bright", none ).read( hdr ).write( b1 ).clear( vec4( 0 ) );
+		g.addPass( "blurX", none ).read( b1 ).write( b2 ).clear( vec4( 0 ) );
+		g.addPass( "blurY", none ).read( b2 ).write( b3 ).clear( vec4( 0 ) );
+		g.addPass( "tonemap", none ).read( hdr ).read( b3 ).write( back );
+
+		check( g.compile(), "graph compiles" );
+		check( g.order==std::vector<int>( { 0, 2, 3, 4, 5, 6 } ), "passes in dependency order" );
+		check( g.passes[1].culled && g.stats.culled==1, "unread pass culled" );
+		check( g.resources[debug].physical<0, "culled pass gets no texture" );
+		check( g.resources[b3].physical==g.resources[b1].physical, "blurY aliases bright" );
+		check( g.resources[b2].physical!=g.resources[b1].physical, "blurX does not alias bright" );
+		check( g.resources[shadow].physical!=g.resources[depth].physical, "different sizes are not aliased" );
+		check( g.stats.transients==6 && g.stats.textures==5, "six transients in five textures" );
+
+		// Same graph again: the pool is reused, nothing new is allocated.
+		size_t pooled = g.pool.size();
+		check( g.compile() && g.pool.size()==pooled, "pool reused on the next compile" );
+	}
+
+	// A reads what B writes later, B reads what A writes: no valid order.
+	{
+		RenderGraph g;
+		int x = g.create( "x", { 16, 16, GL_RGBA8 } );
+		int y = g.create( "y", { 16, 16, GL_RGBA8 } );
+		g.addPass( "a", none ).read( x ).write( y ).sideEffect();
+		g.addPass( "b", none ).read( y ).write( x ).sideEffect();
+		check( !g.compile() && g.order.empty(), "dependency cycle refused" );
+	}
+
+	printf( failures?"%d checks FAILED\n":"all passed\n", failures );
+	return failures?1:0;
+}
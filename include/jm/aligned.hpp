@@ -0,0 +1,252 @@
+//
+//  aligned.hpp
+//  jm
+//
+
+#ifndef jm_aligned_h
+#define jm_aligned_h
+
+#include "batch.hpp"
+#include <new>
+#include <vector>
+
+// Over-aligned versions of the float types and an allocator for aligned arrays.
+// avec4 and amat4 have the layout of vec4 and mat4 and convert both ways;
+// vec3a is a vec3 padded to 16 bytes, so a vertex fills exactly one register.
+// The _32 variants are aligned for AVX.
+
+namespace jm {
+
+template<size_t A> struct alignas(A) avec4_t: mvec4_t<float> {
+	using mvec4_t<float>::mvec4_t;
+	constexpr avec4_t() {}
+	constexpr avec4_t( const mvec4_t<float>& a ): mvec4_t<float>( a ) {}
+};
+
+template<size_t A> struct alignas(A) vec3a_t: mvec3_t<float> {
+	float pad = 0;
+	using mvec3_t<float>::mvec3_t;
+	constexpr vec3a_t() {}
+	constexpr vec3a_t( const mvec3_t<float>& a ): mvec3_t<float>( a ) {}
+};
+
+template<size_t A> struct alignas(A) amat4_t: mmat_t<float,4,4> {
+	using mmat_t<float,4,4>::mmat_t;
+	constexpr amat4_t() {}
+	constexpr amat4_t( const mmat_t<float,4,4>& a ): mmat_t<float,4,4>( a ) {}
+};
+
+template<size_t A> struct _elmt_< avec4_t<A> >: _type_<float> {};
+template<size_t A> struct _lngt_< avec4_t<A> >: _cnt_<4> {};
+template<size_t A> struct _elmt_< vec3a_t<A> >: _type_<float> {};
+template<size_t A> struct _lngt_< vec3a_t<A> >: _cnt_<3> {};
+template<size_t A> struct _elmt_< amat4_t<A> >: _type_<float> {};
+template<size_t A> struct _cols_< amat4_t<A> >: _cnt_<4> {};
+template<size_t A> struct _rows_< amat4_t<A> >: _cnt_<4> {};
+
+typedef avec4_t<16> avec4;
+typedef avec4_t<32> avec4_32;
+typedef vec3a_t<16> vec3a;
+typedef vec3a_t<32> vec3a_32;
+typedef amat4_t<16> amat4;
+typedef amat4_t<32> amat4_32;
+
+static_assert( sizeof(avec4)==16 && sizeof(vec3a)==16 && sizeof(amat4)==64 && sizeof(amat4_32)==64, "aligned types are padded" );
+
+template<size_t A> inline float* value_ptr( avec4_t<A>& a )				{ return a.v; }
+template<size_t A> inline float* value_ptr( vec3a_t<A>& a )				{ return a.v; }
+template<size_t A> inline float* value_ptr( amat4_t<A>& a )				{ return (float*)a.v; }
+template<size_t A> inline const float* value_ptr( const avec4_t<A>& a )	{ return a.v; }
+template<size_t A> inline const float* value_ptr( const vec3a_t<A>& a )	{ return a.v; }
+template<size_t A> inline const float* value_ptr( const amat4_t<A>& a )	{ return (const float*)a.v; }
+
+// Allocator handing out A-aligned blocks, for arrays of types that are not
+// over-aligned themselves: std::vector<float,aligned_allocator<float,32>>.
+template<typename T, size_t A=32> struct aligned_allocator {
+	static_assert( A>=alignof(T) && (A&(A-1))==0, "alignment has to be a power of two" );
+	typedef T value_type;
+	template<typename U> struct rebind { typedef aligned_allocator<U,A> other; };
+
+	aligned_allocator() noexcept {}
+	template<typename U> aligned_allocator( const aligned_allocator<U,A>& ) noexcept {}
+
+	T* allocate( size_t n ) { return (T*)::operator new( n*sizeof(T), std::align_val_t( A ) ); }
+	void deallocate( T* p, size_t ) noexcept { ::operator delete( p, std::align_val_t( A ) ); }
+
+	template<typename U> bool operator==( const aligned_allocator<U,A>& ) const noexcept { return true; }
+	template<typename U> bool operator!=( const aligned_allocator<U,A>& ) const noexcept { return false; }
+};
+
+template<typename T, size_t A=32> using aligned_vector = std::vector<T,aligned_allocator<T,A>>;
+
+// Packed <-> padded copies of vertex arrays.
+template<size_t A> inline void pad( const vec3* in, vec3a_t<A>* out, size_t n ) {
+	for( size_t i=0; i<n; i++ ) out[i] = vec3a_t<A>( in[i] );
+}
+template<size_t A> inline void unpad( const vec3a_t<A>* in, vec3* out, size_t n ) {
+	for( size_t i=0; i<n; i++ ) out[i] = in[i];
+}
+inline std::vector<vec3a> padded( const vec3* v, size_t n ) {
+	std::vector<vec3a> ret( n );
+	pad( v, ret.data(), n );
+	return ret;
+}
+template<typename Alloc> inline std::vector<vec3a> padded( const std::vector<vec3,Alloc>& v ) { return padded( v.data(), v.size() ); }
+template<size_t A> inline std::vector<vec3> packed( const vec3a_t<A>* v, size_t n ) {
+	std::vector<vec3> ret( n );
+	unpad( v, ret.data(), n );
+	return ret;
+}
+template<size_t A, typename Alloc> inline std::vector<vec3> packed( const std::vector<vec3a_t<A>,Alloc>& v ) { return packed( v.data(), v.size() ); }
+
+// The batch kernels over padded arrays. The overloads matter: a vec3a* would
+// otherwise convert to vec3* and be walked with the packed stride. The pad of
+// the output is zero.
+namespace batch {
+
+#if defined(JM_SIMD_SSE) || defined(JM_SIMD_NEON)
+// Four padded vertices, 'stride' floats apart, <-> x, y and z lanes.
+inline void load4( const float* p, size_t stride, f4& x, f4& y, f4& z ) {
+#if defined(JM_SIMD_SSE)
+	f4 a = _mm_load_ps( p ), b = _mm_load_ps( p+stride ), c = _mm_load_ps( p+2*stride ), d = _mm_load_ps( p+3*stride );
+	_MM_TRANSPOSE4_PS( a, b, c, d );
+	x = a; y = b; z = c;
+#else
+	if( stride==4 ) {
+		float32x4x4_t v = vld4q_f32( p );
+		x = v.val[0]; y = v.val[1]; z = v.val[2];
+		return;
+	}
+	float32x4x2_t ab = vtrnq_f32( vld1q_f32( p ), vld1q_f32( p+stride ) );
+	float32x4x2_t cd = vtrnq_f32( vld1q_f32( p+2*stride ), vld1q_f32( p+3*stride ) );
+	x = vcombine_f32( vget_low_f32( ab.val[0] ), vget_low_f32( cd.val[0] ) );
+	y = vcombine_f32( vget_low_f32( ab.val[1] ), vget_low_f32( cd.val[1] ) );
+	z = vcombine_f32( vget_high_f32( ab.val[0] ), vget_high_f32( cd.val[0] ) );
+#endif
+}
+inline void store4( float* p, size_t stride, f4 x, f4 y, f4 z ) {
+#if defined(JM_SIMD_SSE)
+	f4 w = _mm_setzero_ps();
+	_MM_TRANSPOSE4_PS( x, y, z, w );
+	_mm_store_ps( p, x ); _mm_store_ps( p+stride, y ); _mm_store_ps( p+2*stride, z ); _mm_store_ps( p+3*stride, w );
+#else
+	float32x4_t w = vdupq_n_f32( 0 );
+	if( stride==4 ) {
+		float32x4x4_t v = { { x, y, z, w } };
+		vst4q_f32( p, v );
+		return;
+	}
+	float32x4x2_t xy = vtrnq_f32( x, y ), zw = vtrnq_f32( z, w );
+	vst1q_f32( p,          vcombine_f32( vget_low_f32( xy.val[0] ), vget_low_f32( zw.val[0] ) ) );
+	vst1q_f32( p+stride,   vcombine_f32( vget_low_f32( xy.val[1] ), vget_low_f32( zw.val[1] ) ) );
+	vst1q_f32( p+2*stride, vcombine_f32( vget_high_f32( xy.val[0] ), vget_high_f32( zw.val[0] ) ) );
+	vst1q_f32( p+3*stride, vcombine_f32( vget_high_f32( xy.val[1] ), vget_high_f32( zw.val[1] ) ) );
+#endif
+}
+#endif
+
+template<size_t A, typename Op, typename Tail>
+inline size_t forEach4( const vec3a_t<A>* in, vec3a_t<A>* out, size_t n, Op&& op, Tail&& tail ) {
+	size_t i = 0;
+#if defined(JM_SIMD_SSE) || defined(JM_SIMD_NEON)
+	const size_t stride = sizeof(vec3a_t<A>)/sizeof(float);
+	for( ; i+4<=n; i+=4 ) {
+		f4 x, y, z;
+		load4( in[i].v, stride, x, y, z );
+		op( x, y, z );
+		if( out ) store4( out[i].v, stride, x, y, z );
+	}
+#endif
+	for( ; i<n; i++ ) {
+		vec3 v = tail( in[i] );
+		if( out ) out[i] = v;
+	}
+	return i;
+}
+
+} // namespace batch
+
+template<size_t A> inline void transformPoints( const mat4& m, const vec3a_t<A>* in, vec3a_t<A>* out, size_t n ) {
+	batch::Affine a( m );
+#if defined(JM_SIMD_SSE) || defined(JM_SIMD_NEON)
+	batch::forEach4( in, out, n, [&]( batch::f4& x, batch::f4& y, batch::f4& z ) { batch::apply( a, x, y, z, true ); },
+					[&]( const vec3& v ) { return batch::apply( a, v, true ); } );
+#else
+	batch::forEach4( in, out, n, 0, [&]( const vec3& v ) { return batch::apply( a, v, true ); } );
+#endif
+}
+
+template<size_t A> inline void transformPoints( const mat4& m, const vec3a_t<A>* in, vec3a_t<A>* out, size_t n, vec3& bmin, vec3& bmax ) {
+	batch::Affine a( m );
+	vec3 lo = bmin, hi = bmax;
+	auto tail = [&]( const vec3& v ) {
+		vec3 r = batch::apply( a, v, true );
+		lo = jm::min( lo, r );
+		hi = jm::max( hi, r );
+		return r;
+	};
+#if defined(JM_SIMD_SSE) || defined(JM_SIMD_NEON)
+	using namespace batch;
+	f4 lx = set1( lo.x ), ly = set1( lo.y ), lz = set1( lo.z );
+	f4 hx = set1( hi.x ), hy = set1( hi.y ), hz = set1( hi.z );
+	forEach4( in, out, n, [&]( f4& x, f4& y, f4& z ) {
+		apply( a, x, y, z, true );
+		lx = batch::min( lx, x ); ly = batch::min( ly, y ); lz = batch::min( lz, z );
+		hx = batch::max( hx, x ); hy = batch::max( hy, y ); hz = batch::max( hz, z );
+	}, tail );
+	lo = jm::min( lo, vec3( first( hmin( lx ) ), first( hmin( ly ) ), first( hmin( lz ) ) ) );
+	hi = jm::max( hi, vec3( first( hmax( hx ) ), first( hmax( hy ) ), first( hmax( hz ) ) ) );
+#else
+	batch::forEach4( in, out, n, 0, tail );
+#endif
+	bmin = lo;
+	bmax = hi;
+}
+
+template<size_t A> inline void transformNormals( const mat4& m, const vec3a_t<A>* in, vec3a_t<A>* out, size_t n ) {
+	batch::Affine a( transpose( inverse( mat3( m ) ) ) );
+#if defined(JM_SIMD_SSE) || defined(JM_SIMD_NEON)
+	batch::forEach4( in, out, n, [&]( batch::f4& x, batch::f4& y, batch::f4& z ) {
+		batch::apply( a, x, y, z, false );
+		batch::normalize( x, y, z );
+	}, [&]( const vec3& v ) { return batch::normalized( batch::apply( a, v, false ) ); } );
+#else
+	batch::forEach4( in, out, n, 0, [&]( const vec3& v ) { return batch::normalized( batch::apply( a, v, false ) ); } );
+#endif
+}
+
+template<size_t A> inline void normalizeArray( vec3a_t<A>* v, size_t n ) {
+#if defined(JM_SIMD_SSE) || defined(JM_SIMD_NEON)
+	batch::forEach4( v, v, n, []( batch::f4& x, batch::f4& y, batch::f4& z ) { batch::normalize( x, y, z ); }, batch::normalized );
+#else
+	batch::forEach4( v, v, n, 0, batch::normalized );
+#endif
+}
+
+template<size_t A> inline void bounds( const vec3a_t<A>* v, size_t n, vec3& bmin, vec3& bmax ) {
+	vec3 lo = bmin, hi = bmax;
+	auto tail = [&]( const vec3& p ) {
+		lo = jm::min( lo, p );
+		hi = jm::max( hi, p );
+		return p;
+	};
+#if defined(JM_SIMD_SSE) || defined(JM_SIMD_NEON)
+	using namespace batch;
+	f4 lx = set1( lo.x ), ly = set1( lo.y ), lz = set1( lo.z );
+	f4 hx = set1( hi.x ), hy = set1( hi.y ), hz = set1( hi.z );
+	forEach4( v, (vec3a_t<A>*)nullptr, n, [&]( f4& x, f4& y, f4& z ) {
+		lx = batch::min( lx, x ); ly = batch::min( ly, y ); lz = batch::min( lz, z );
+		hx = batch::max( hx, x ); hy = batch::max( hy, y ); hz = batch::max( hz, z );
+	}, tail );
+	lo = jm::min( lo, vec3( first( hmin( lx ) ), first( hmin( ly ) ), first( hmin( lz ) ) ) );
+	hi = jm::max( hi, vec3( first( hmax( hx ) ), first( hmax( hy ) ), first( hmax( hz ) ) ) );
+#else
+	batch::forEach4( v, (vec3a_t<A>*)nullptr, n, 0, tail );
+#endif
+	bmin = lo;
+	bmax = hi;
+}
+
+} // namespace jm
+
+#endif /* jm_aligned_h */
@@ -0,0 +1,256 @@
+//
+//  batch.hpp
+//  jm
+//
+
+#ifndef jm_batch_h
+#define jm_batch_h
+
+#include "mat_simd.hpp"
+#include <stddef.h>
+
+// Kernels over arrays of vec3, for vertex data. Four vertices are handled per
+// step: packed xyz triples are loaded as three registers and shuffled to x, y
+// and z lanes, so the arrays need no padding or alignment. The tail, and
+// builds without SIMD, go through the same arithmetic in scalar code.
+// Input and output arrays may be the same.
+
+namespace jm {
+
+static_assert( sizeof(vec3)==12, "vec3 arrays have to be packed" );
+
+namespace batch {
+
+// Affine part of a 4x4 matrix (the last row is ignored) and the 3x3 used for normals.
+struct Affine {
+	float m[12];		// column-major 3x4
+	Affine( const mat4& a ) { for( int c=0; c<4; c++ ) for( int r=0; r<3; r++ ) m[c*3+r] = a[c][r]; }
+	Affine( const mat3& a ) { for( int c=0; c<3; c++ ) for( int r=0; r<3; r++ ) m[c*3+r] = a[c][r]; m[9]=m[10]=m[11]=0; }
+};
+
+#if defined(JM_SIMD_SSE) || defined(JM_SIMD_NEON)
+using simd::f4;
+#if defined(JM_SIMD_SSE)
+inline f4 set1( float a )		{ return _mm_set1_ps( a ); }
+inline f4 add( f4 a, f4 b )		{ return _mm_add_ps( a, b ); }
+inline f4 min( f4 a, f4 b )		{ return _mm_min_ps( a, b ); }
+inline f4 max( f4 a, f4 b )		{ return _mm_max_ps( a, b ); }
+inline f4 hmin( f4 a ) {
+	a = _mm_min_ps( a, _mm_movehl_ps( a, a ) );
+	return _mm_min_ss( a, _mm_shuffle_ps( a, a, 1 ) );
+}
+inline f4 hmax( f4 a ) {
+	a = _mm_max_ps( a, _mm_movehl_ps( a, a ) );
+	return _mm_max_ss( a, _mm_shuffle_ps( a, a, 1 ) );
+}
+inline float first( f4 a )		{ return _mm_cvtss_f32( a ); }
+// 1/|v|, 0 for zero vectors.
+inline f4 invLength( f4 len2 ) {
+	f4 inv = _mm_div_ps( _mm_set1_ps( 1.f ), _mm_sqrt_ps( len2 ) );
+	return _mm_and_ps( inv, _mm_cmpgt_ps( len2, _mm_setzero_ps() ) );
+}
+// x0y0z0x1 y1z1x2y2 z2x3y3z3 <-> x0x1x2x3 y0y1y2y3 z0z1z2z3
+inline void load3( const float* p, f4& x, f4& y, f4& z ) {
+	f4 a = _mm_loadu_ps( p ), b = _mm_loadu_ps( p+4 ), c = _mm_loadu_ps( p+8 );
+	x = _mm_shuffle_ps( a, _mm_shuffle_ps( b, c, _MM_SHUFFLE(1,1,2,2) ), _MM_SHUFFLE(2,0,3,0) );
+	y = _mm_shuffle_ps( _mm_shuffle_ps( a, b, _MM_SHUFFLE(0,0,1,1) ), _mm_shuffle_ps( b, c, _MM_SHUFFLE(2,2,3,3) ), _MM_SHUFFLE(2,0,2,0) );
+	z = _mm_shuffle_ps( _mm_shuffle_ps( a, b, _MM_SHUFFLE(1,1,2,2) ), _mm_shuffle_ps( c, c, _MM_SHUFFLE(3,3,0,0) ), _MM_SHUFFLE(2,0,2,0) );
+}
+inline void store3( float* p, f4 x, f4 y, f4 z ) {
+	_mm_storeu_ps( p,   _mm_shuffle_ps( _mm_shuffle_ps( x, y, 0x00 ), _mm_shuffle_ps( z, x, _MM_SHUFFLE(1,1,0,0) ), _MM_SHUFFLE(2,0,2,0) ) );
+	_mm_storeu_ps( p+4, _mm_shuffle_ps( _mm_shuffle_ps( y, z, 0x55 ), _mm_shuffle_ps( x, y, 0xaa ), _MM_SHUFFLE(2,0,2,0) ) );
+	_mm_storeu_ps( p+8, _mm_shuffle_ps( _mm_shuffle_ps( z, x, _MM_SHUFFLE(3,3,2,2) ), _mm_shuffle_ps( y, z, 0xff ), _MM_SHUFFLE(2,0,2,0) ) );
+}
+inline f4 load( const float* p )		{ return _mm_loadu_ps( p ); }
+inline void store( float* p, f4 a )		{ _mm_storeu_ps( p, a ); }
+#else
+inline f4 set1( float a )		{ return vdupq_n_f32( a ); }
+inline f4 add( f4 a, f4 b )		{ return vaddq_f32( a, b ); }
+inline f4 min( f4 a, f4 b )		{ return vminq_f32( a, b ); }
+inline f4 max( f4 a, f4 b )		{ return vmaxq_f32( a, b ); }
+inline f4 hmin( f4 a ) {
+	float32x2_t m = vpmin_f32( vget_low_f32( a ), vget_high_f32( a ) );
+	return vcombine_f32( vpmin_f32( m, m ), m );
+}
+inline f4 hmax( f4 a ) {
+	float32x2_t m = vpmax_f32( vget_low_f32( a ), vget_high_f32( a ) );
+	return vcombine_f32( vpmax_f32( m, m ), m );
+}
+inline float first( f4 a )		{ return vgetq_lane_f32( a, 0 ); }
+inline f4 invLength( f4 len2 ) {
+#if defined(__aarch64__)
+	f4 inv = vdivq_f32( vdupq_n_f32( 1.f ), vsqrtq_f32( len2 ) );
+#else
+	f4 inv = vrsqrteq_f32( len2 );
+	inv = vmulq_f32( inv, vrsqrtsq_f32( vmulq_f32( len2, inv ), inv ) );
+	inv = vmulq_f32( inv, vrsqrtsq_f32( vmulq_f32( len2, inv ), inv ) );
+#endif
+	return vreinterpretq_f32_u32( vandq_u32( vreinterpretq_u32_f32( inv ), vcgtq_f32( len2, vdupq_n_f32( 0 ) ) ) );
+}
+inline void load3( const float* p, f4& x, f4& y, f4& z ) {
+	float32x4x3_t v = vld3q_f32( p );
+	x = v.val[0]; y = v.val[1]; z = v.val[2];
+}
+inline void store3( float* p, f4 x, f4 y, f4 z ) {
+	float32x4x3_t v = { { x, y, z } };
+	vst3q_f32( p, v );
+}
+inline f4 load( const float* p )		{ return vld1q_f32( p ); }
+inline void store( float* p, f4 a )		{ vst1q_f32( p, a ); }
+#endif
+
+// x' = m*(x,y,z,w) for four vertices, w being 1 for points and 0 for directions.
+inline void apply( const Affine& a, f4& x, f4& y, f4& z, bool point ) {
+	const float* m = a.m;
+	f4 ox = simd::mul( set1( m[0] ), x ), oy = simd::mul( set1( m[1] ), x ), oz = simd::mul( set1( m[2] ), x );
+	ox = simd::madd( set1( m[3] ), y, ox ); oy = simd::madd( set1( m[4] ), y, oy ); oz = simd::madd( set1( m[5] ), y, oz );
+	ox = simd::madd( set1( m[6] ), z, ox ); oy = simd::madd( set1( m[7] ), z, oy ); oz = simd::madd( set1( m[8] ), z, oz );
+	if( point ) {
+		ox = add( ox, set1( m[9] ) ); oy = add( oy, set1( m[10] ) ); oz = add( oz, set1( m[11] ) );
+	}
+	x = ox; y = oy; z = oz;
+}
+inline void normalize( f4& x, f4& y, f4& z ) {
+	f4 inv = invLength( simd::madd( x, x, simd::madd( y, y, simd::mul( z, z ) ) ) );
+	x = simd::mul( x, inv ); y = simd::mul( y, inv ); z = simd::mul( z, inv );
+}
+#endif
+
+inline vec3 apply( const Affine& a, const vec3& v, bool point ) {
+	const float* m = a.m;
+	vec3 r( m[0]*v.x+m[3]*v.y+m[6]*v.z, m[1]*v.x+m[4]*v.y+m[7]*v.z, m[2]*v.x+m[5]*v.y+m[8]*v.z );
+	return point?r+vec3( m[9], m[10], m[11] ):r;
+}
+inline vec3 normalized( const vec3& v ) {
+	float l2 = dot( v, v );
+	return l2>0?v*(1.f/sqrtf( l2 )):vec3( 0 );
+}
+
+// The common loop: 'op' gets SoA lanes, 'tail' one vertex at a time.
+template<typename Op, typename Tail>
+inline size_t forEach4( const vec3* in, vec3* out, size_t n, Op&& op, Tail&& tail ) {
+	size_t i = 0;
+#if defined(JM_SIMD_SSE) || defined(JM_SIMD_NEON)
+	for( ; i+4<=n; i+=4 ) {
+		f4 x, y, z;
+		load3( in[i].v, x, y, z );
+		op( x, y, z );
+		if( out ) store3( out[i].v, x, y, z );
+	}
+#endif
+	for( ; i<n; i++ ) {
+		vec3 v = tail( in[i] );
+		if( out ) out[i] = v;
+	}
+	return i;
+}
+
+} // namespace batch
+
+// out[i] = vec3( m*vec4( in[i], 1 ) )
+inline void transformPoints( const mat4& m, const vec3* in, vec3* out, size_t n ) {
+	batch::Affine a( m );
+#if defined(JM_SIMD_SSE) || defined(JM_SIMD_NEON)
+	batch::forEach4( in, out, n, [&]( batch::f4& x, batch::f4& y, batch::f4& z ) { batch::apply( a, x, y, z, true ); },
+					[&]( const vec3& v ) { return batch::apply( a, v, true ); } );
+#else
+	batch::forEach4( in, out, n, 0, [&]( const vec3& v ) { return batch::apply( a, v, true ); } );
+#endif
+}
+
+// transformPoints() that also extends [bmin,bmax] by the transformed points.
+inline void transformPoints( const mat4& m, const vec3* in, vec3* out, size_t n, vec3& bmin, vec3& bmax ) {
+	batch::Affine a( m );
+	vec3 lo = bmin, hi = bmax;
+	auto tail = [&]( const vec3& v ) {
+		vec3 r = batch::apply( a, v, true );
+		lo = jm::min( lo, r );
+		hi = jm::max( hi, r );
+		return r;
+	};
+#if defined(JM_SIMD_SSE) || defined(JM_SIMD_NEON)
+	using namespace batch;
+	f4 lx = set1( lo.x ), ly = set1( lo.y ), lz = set1( lo.z );
+	f4 hx = set1( hi.x ), hy = set1( hi.y ), hz = set1( hi.z );
+	forEach4( in, out, n, [&]( f4& x, f4& y, f4& z ) {
+		apply( a, x, y, z, true );
+		lx = batch::min( lx, x ); ly = batch::min( ly, y ); lz = batch::min( lz, z );
+		hx = batch::max( hx, x ); hy = batch::max( hy, y ); hz = batch::max( hz, z );
+	}, tail );
+	lo = jm::min( lo, vec3( first( hmin( lx ) ), first( hmin( ly ) ), first( hmin( lz ) ) ) );
+	hi = jm::max( hi, vec3( first( hmax( hx ) ), first( hmax( hy ) ), first( hmax( hz ) ) ) );
+#else
+	batch::forEach4( in, out, n, 0, tail );
+#endif
+	bmin = lo;
+	bmax = hi;
+}
+
+// Normals by the inverse transpose of m's upper 3x3, normalised; zero vectors stay zero.
+inline void transformNormals( const mat4& m, const vec3* in, vec3* out, size_t n ) {
+	batch::Affine a( transpose( inverse( mat3( m ) ) ) );
+#if defined(JM_SIMD_SSE) || defined(JM_SIMD_NEON)
+	batch::forEach4( in, out, n, [&]( batch::f4& x, batch::f4& y, batch::f4& z ) {
+		batch::apply( a, x, y, z, false );
+		batch::normalize( x, y, z );
+	}, [&]( const vec3& v ) { return batch::normalized( batch::apply( a, v, false ) ); } );
+#else
+	batch::forEach4( in, out, n, 0, [&]( const vec3& v ) { return batch::normalized( batch::apply( a, v, false ) ); } );
+#endif
+}
+
+// Normalises in place; zero vectors stay zero.
+inline void normalizeArray( vec3* v, size_t n ) {
+#if defined(JM_SIMD_SSE) || defined(JM_SIMD_NEON)
+	batch::forEach4( v, v, n, []( batch::f4& x, batch::f4& y, batch::f4& z ) { batch::normalize( x, y, z ); }, batch::normalized );
+#else
+	batch::forEach4( v, v, n, 0, batch::normalized );
+#endif
+}
+
+// Extends [bmin,bmax] by the points.
+inline void bounds( const vec3* v, size_t n, vec3& bmin, vec3& bmax ) {
+	vec3 lo = bmin, hi = bmax;
+	size_t i = 0;
+#if defined(JM_SIMD_SSE) || defined(JM_SIMD_NEON)
+	using namespace batch;
+	f4 lx = set1( lo.x ), ly = set1( lo.y ), lz = set1( lo.z );
+	f4 hx = set1( hi.x ), hy = set1( hi.y ), hz = set1( hi.z );
+	for( ; i+4<=n; i+=4 ) {
+		f4 x, y, z;
+		load3( v[i].v, x, y, z );
+		lx = batch::min( lx, x ); ly = batch::min( ly, y ); lz = batch::min( lz, z );
+		hx = batch::max( hx, x ); hy = batch::max( hy, y ); hz = batch::max( hz, z );
+	}
+	lo = vec3( first( hmin( lx ) ), first( hmin( ly ) ), first( hmin( lz ) ) );
+	hi = vec3( first( hmax( hx ) ), first( hmax( hy ) ), first( hmax( hz ) ) );
+#endif
+	for( ; i<n; i++ ) {
+		lo = jm::min( lo, v[i] );
+		hi = jm::max( hi, v[i] );
+	}
+	bmin = lo;
+	bmax = hi;
+}
+
+// Structure-of-arrays version of transformPoints(), for data already split in x, y and z.
+inline void transformPoints( const mat4& m, const float* x, const float* y, const float* z,
+							 float* ox, float* oy, float* oz, size_t n ) {
+	batch::Affine a( m );
+	size_t i = 0;
+#if defined(JM_SIMD_SSE) || defined(JM_SIMD_NEON)
+	for( ; i+4<=n; i+=4 ) {
+		batch::f4 vx = batch::load( x+i ), vy = batch::load( y+i ), vz = batch::load( z+i );
+		batch::apply( a, vx, vy, vz, true );
+		batch::store( ox+i, vx ); batch::store( oy+i, vy ); batch::store( oz+i, vz );
+	}
+#endif
+	for( ; i<n; i++ ) {
+		vec3 r = batch::apply( a, vec3( x[i], y[i], z[i] ), true );
+		ox[i] = r.x; oy[i] = r.y; oz[i] = r.z;
+	}
+}
+
+} // namespace jm
+
+#endif /* jm_batch_h */
@@ -0,0 +1,348 @@
+//
+//  fast.hpp
+//  jm
+//
+
+#ifndef jm_fast_h
+#define jm_fast_h
+
+#include "aligned.hpp"
+#include <stdint.h>
+#include <string.h>
+
+// Approximate versions of the costlier functions, for hot loops that can live
+// with a few ulps. Every function comes as a scalar and as a four lane
+// (simd::f4) version; the lane versions are the fast ones, the scalar ones
+// mostly keep loops that already work on floats consistent with them.
+// Maximum errors against the double precision functions:
+//
+//	inversesqrt			relative 3.6e-7 (SSE/NEON estimate plus one Newton step)
+//	length, normalize	relative 3.6e-7; zero vectors give 0
+//	sin, cos			absolute 1.2e-7 for |x| <= 8192
+//	atan2				absolute 2.8e-7
+//	exp					relative 2.4e-7 for x in [-87.3, 88.3], clamped outside
+//	log					absolute 1.2e-7 for x in [0.5, 2], relative 1.2e-7 elsewhere; x > 0, normal
+//
+// NaN and infinity are not handled. test/fast_accuracy.cpp checks these bounds.
+
+namespace jm {
+namespace fast {
+
+inline float inversesqrt( float x ) {
+#if defined(JM_SIMD_SSE)
+	float r = _mm_cvtss_f32( _mm_rsqrt_ss( _mm_set_ss( x ) ) );
+	return r*( 1.5f-.5f*x*r*r );
+#elif defined(JM_SIMD_NEON)
+	float32x2_t v = vdup_n_f32( x ), r = vrsqrte_f32( v );
+	return vget_lane_f32( vmul_f32( r, vrsqrts_f32( vmul_f32( v, r ), r ) ), 0 );
+#else
+	return 1/sqrtf( x );
+#endif
+}
+
+template<typename T, typename=std::enable_if_t<is_vector_v<T> && is_float_v<T>>>
+inline float length( const T& v ) {
+	float l2 = dot( v, v );
+	return l2>0?l2*inversesqrt( l2 ):0;
+}
+
+template<typename T, typename=std::enable_if_t<is_vector_v<T> && is_float_v<T>>>
+inline auto normalize( const T& v ) {
+	float l2 = dot( v, v );
+	return comp_vec_type_t<T>( v*( l2>0?inversesqrt( l2 ):0.f ) );
+}
+
+// x = k*pi/2 + r, |r| <= pi/4. pi/2 is split in three so that k*pi/2 is exact
+// for the first two parts.
+inline float reduceHalfPi( float x, int& k ) {
+	k = int( x*0.636619772f+copysignf( .5f, x ) );
+	float fk = float( k );
+	return ( ( x-fk*1.5703125f )-fk*4.837512969970703125e-4f )-fk*7.54978995489188216e-8f;
+}
+// Minimax polynomials on [-pi/4,pi/4] (Cephes).
+inline float sinPoly( float r ) {
+	float z = r*r;
+	return ( ( -1.9515295891e-4f*z+8.3321608736e-3f )*z-1.6666654611e-1f )*z*r+r;
+}
+inline float cosPoly( float r ) {
+	float z = r*r;
+	return ( ( 2.443315711809948e-5f*z-1.388731625493765e-3f )*z+4.166664568298827e-2f )*z*z-.5f*z+1;
+}
+// Quadrant k of sin: sin r, cos r, -sin r, -cos r.
+inline float quadrant( int k, float s, float c ) {
+	float v = ( k&1 )?c:s;
+	return ( k&2 )?-v:v;
+}
+
+inline float sin( float x ) {
+	int k;
+	float r = reduceHalfPi( x, k );
+	return quadrant( k, sinPoly( r ), cosPoly( r ) );
+}
+inline float cos( float x ) {
+	int k;
+	float r = reduceHalfPi( x, k );
+	return quadrant( k+1, sinPoly( r ), cosPoly( r ) );
+}
+inline void sincos( float x, float& s, float& c ) {
+	int k;
+	float r = reduceHalfPi( x, k );
+	float sp = sinPoly( r ), cp = cosPoly( r );
+	s = quadrant( k, sp, cp );
+	c = quadrant( k+1, sp, cp );
+}
+
+// atan of the smaller over the larger magnitude, reduced once more around
+// tan(pi/8) for the Cephes polynomial, then moved to the right octant.
+inline float atan2( float y, float x ) {
+	float ax = fabsf( x ), ay = fabsf( y );
+	float hi = ax>ay?ax:ay, lo = ax>ay?ay:ax;
+	float a = hi>0?lo/hi:0;
+	bool big = a>0.414213562f;
+	float t = big?( a-1 )/( a+1 ):a, z = t*t;
+	float r = ( ( ( 8.05374449538e-2f*z-1.38776856032e-1f )*z+1.99777106478e-1f )*z-3.33329491539e-1f )*z*t+t;
+	r += big?0.785398163f:0;
+	r = ay>ax?1.57079633f-r:r;
+	r = x<0?3.14159265f-r:r;
+	return copysignf( r, y );
+}
+
+inline float exp( float x ) {
+	x = x<-87.3f?-87.3f:x>88.3f?88.3f:x;
+	int n = int( x*1.44269504f+copysignf( .5f, x ) );
+	float fn = float( n );
+	float r = ( x-fn*0.693359375f )+fn*2.12194440e-4f;
+	float p = ( ( ( ( 1.9875691500e-4f*r+1.3981999507e-3f )*r+8.3334519073e-3f )*r+4.1665795894e-2f )*r+1.6666665459e-1f )*r+5.0000001201e-1f;
+	int32_t bits = ( n+127 )<<23;
+	float scale;
+	memcpy( &scale, &bits, 4 );
+	return ( p*r*r+r+1 )*scale;
+}
+
+inline float log( float x ) {
+	int32_t bits;
+	memcpy( &bits, &x, 4 );
+	int e = ( ( bits>>23 )&0xff )-126;
+	bits = ( bits&0x807fffff )|0x3f000000;		// mantissa in [0.5,1)
+	float m;
+	memcpy( &m, &bits, 4 );
+	bool small = m<0.707106781f;
+	e -= small;
+	m = small?m+m-1:m-1;
+	float z = m*m, fe = float( e );
+	float p = ( ( ( ( ( ( ( 7.0376836292e-2f*m-1.1514610310e-1f )*m+1.1676998740e-1f )*m-1.2420140846e-1f )*m+1.4249322787e-1f )*m
+			   -1.6668057665e-1f )*m+2.0000714765e-1f )*m-2.4999993993e-1f )*m+3.3333331174e-1f;
+	float y = p*m*z-2.12194440e-4f*fe-.5f*z;
+	return m+y+0.693359375f*fe;
+}
+
+GEN_UNARY_V__V_FUNC( sin, is_float_v<T> );
+GEN_UNARY_V__V_FUNC( cos, is_float_v<T> );
+GEN_UNARY_V__V_FUNC( exp, is_float_v<T> );
+GEN_UNARY_V__V_FUNC( log, is_float_v<T> );
+
+// normalizeArray() with the estimate instead of the division.
+inline void normalizeArray( vec3* v, size_t n ) {
+#if defined(JM_SIMD_SSE) || defined(JM_SIMD_NEON)
+	batch::forEach4( v, v, n, []( batch::f4& x, batch::f4& y, batch::f4& z ) {
+		batch::f4 l2 = simd::madd( x, x, simd::madd( y, y, simd::mul( z, z ) ) );
+#if defined(JM_SIMD_SSE)
+		batch::f4 r = _mm_rsqrt_ps( l2 );
+		r = _mm_mul_ps( r, _mm_sub_ps( _mm_set1_ps( 1.5f ), _mm_mul_ps( _mm_mul_ps( _mm_set1_ps( .5f ), l2 ), _mm_mul_ps( r, r ) ) ) );
+		r = _mm_and_ps( r, _mm_cmpgt_ps( l2, _mm_setzero_ps() ) );
+#else
+		batch::f4 r = vrsqrteq_f32( l2 );
+		r = vmulq_f32( r, vrsqrtsq_f32( vmulq_f32( l2, r ), r ) );
+		r = vreinterpretq_f32_u32( vandq_u32( vreinterpretq_u32_f32( r ), vcgtq_f32( l2, vdupq_n_f32( 0 ) ) ) );
+#endif
+		x = simd::mul( x, r ); y = simd::mul( y, r ); z = simd::mul( z, r );
+	}, []( const vec3& a ) { return fast::normalize( a ); } );
+#else
+	jm::normalizeArray( v, n );
+#endif
+}
+
+} // namespace fast
+
+#if defined(JM_SIMD_SSE) || defined(JM_SIMD_NEON)
+// Four lane versions, same constants and steps as the scalar code above.
+namespace simd {
+#if defined(JM_SIMD_SSE)
+using i4 = __m128i;
+inline f4 set1( float a )				{ return _mm_set1_ps( a ); }
+inline f4 add( f4 a, f4 b )				{ return _mm_add_ps( a, b ); }
+inline f4 sub( f4 a, f4 b )				{ return _mm_sub_ps( a, b ); }
+inline f4 div( f4 a, f4 b )				{ return _mm_div_ps( a, b ); }
+inline f4 min( f4 a, f4 b )				{ return _mm_min_ps( a, b ); }
+inline f4 max( f4 a, f4 b )				{ return _mm_max_ps( a, b ); }
+inline f4 lessThan( f4 a, f4 b )		{ return _mm_cmplt_ps( a, b ); }
+inline f4 bitAnd( f4 a, f4 b )			{ return _mm_and_ps( a, b ); }
+inline f4 bitOr( f4 a, f4 b )			{ return _mm_or_ps( a, b ); }
+inline f4 bitXor( f4 a, f4 b )			{ return _mm_xor_ps( a, b ); }
+inline f4 select( f4 mask, f4 a, f4 b )	{ return _mm_or_ps( _mm_and_ps( mask, a ), _mm_andnot_ps( mask, b ) ); }	// mask ? a : b
+inline i4 roundToInt( f4 a )			{ return _mm_cvtps_epi32( a ); }
+inline f4 toFloat( i4 a )				{ return _mm_cvtepi32_ps( a ); }
+inline f4 asFloat( i4 a )				{ return _mm_castsi128_ps( a ); }
+inline i4 asInt( f4 a )					{ return _mm_castps_si128( a ); }
+inline i4 set1i( int a )				{ return _mm_set1_epi32( a ); }
+inline i4 addi( i4 a, i4 b )			{ return _mm_add_epi32( a, b ); }
+inline i4 andi( i4 a, i4 b )			{ return _mm_and_si128( a, b ); }
+inline i4 ori( i4 a, i4 b )				{ return _mm_or_si128( a, b ); }
+inline i4 equali( i4 a, i4 b )			{ return _mm_cmpeq_epi32( a, b ); }
+template<int n> inline i4 shiftLeft( i4 a )	{ return _mm_slli_epi32( a, n ); }
+template<int n> inline i4 shiftRight( i4 a ){ return _mm_srli_epi32( a, n ); }
+#else
+using i4 = int32x4_t;
+inline f4 set1( float a )				{ return vdupq_n_f32( a ); }
+inline f4 add( f4 a, f4 b )				{ return vaddq_f32( a, b ); }
+inline f4 sub( f4 a, f4 b )				{ return vsubq_f32( a, b ); }
+#if defined(__aarch64__)
+inline f4 div( f4 a, f4 b )				{ return vdivq_f32( a, b ); }
+#else
+inline f4 div( f4 a, f4 b ) {
+	f4 r = vrecpeq_f32( b );
+	r = vmulq_f32( vrecpsq_f32( b, r ), r );
+	r = vmulq_f32( vrecpsq_f32( b, r ), r );
+	return vmulq_f32( a, r );
+}
+#endif
+inline f4 min( f4 a, f4 b )				{ return vminq_f32( a, b ); }
+inline f4 max( f4 a, f4 b )				{ return vmaxq_f32( a, b ); }
+inline f4 lessThan( f4 a, f4 b )		{ return vreinterpretq_f32_u32( vcltq_f32( a, b ) ); }
+inline f4 bitAnd( f4 a, f4 b )			{ return vreinterpretq_f32_u32( vandq_u32( vreinterpretq_u32_f32( a ), vreinterpretq_u32_f32( b ) ) ); }
+inline f4 bitOr( f4 a, f4 b )			{ return vreinterpretq_f32_u32( vorrq_u32( vreinterpretq_u32_f32( a ), vreinterpretq_u32_f32( b ) ) ); }
+inline f4 bitXor( f4 a, f4 b )			{ return vreinterpretq_f32_u32( veorq_u32( vreinterpretq_u32_f32( a ), vreinterpretq_u32_f32( b ) ) ); }
+inline f4 select( f4 mask, f4 a, f4 b )	{ return vbslq_f32( vreinterpretq_u32_f32( mask ), a, b ); }
+#if defined(__aarch64__)
+inline i4 roundToInt( f4 a )			{ return vcvtnq_s32_f32( a ); }
+#else
+inline i4 roundToInt( f4 a ) {
+	f4 half = vreinterpretq_f32_u32( vorrq_u32( vandq_u32( vreinterpretq_u32_f32( a ), vdupq_n_u32( 0x80000000u ) ), vreinterpretq_u32_f32( vdupq_n_f32( .5f ) ) ) );
+	return vcvtq_s32_f32( vaddq_f32( a, half ) );
+}
+#endif
+inline f4 toFloat( i4 a )				{ return vcvtq_f32_s32( a ); }
+inline f4 asFloat( i4 a )				{ return vreinterpretq_f32_s32( a ); }
+inline i4 asInt( f4 a )					{ return vreinterpretq_s32_f32( a ); }
+inline i4 set1i( int a )				{ return vdupq_n_s32( a ); }
+inline i4 addi( i4 a, i4 b )			{ return vaddq_s32( a, b ); }
+inline i4 andi( i4 a, i4 b )			{ return vandq_s32( a, b ); }
+inline i4 ori( i4 a, i4 b )				{ return vorrq_s32( a, b ); }
+inline i4 equali( i4 a, i4 b )			{ return vreinterpretq_s32_u32( vceqq_s32( a, b ) ); }
+template<int n> inline i4 shiftLeft( i4 a )	{ return vshlq_n_s32( a, n ); }
+template<int n> inline i4 shiftRight( i4 a ){ return vreinterpretq_s32_u32( vshrq_n_u32( vreinterpretq_u32_s32( a ), n ) ); }
+#endif
+} // namespace simd
+
+namespace fast {
+using simd::f4;
+
+inline f4 inversesqrt( f4 x ) {
+#if defined(JM_SIMD_SSE)
+	f4 r = _mm_rsqrt_ps( x );
+	return _mm_mul_ps( r, _mm_sub_ps( _mm_set1_ps( 1.5f ), _mm_mul_ps( _mm_mul_ps( _mm_set1_ps( .5f ), x ), _mm_mul_ps( r, r ) ) ) );
+#else
+	f4 r = vrsqrteq_f32( x );
+	return vmulq_f32( r, vrsqrtsq_f32( vmulq_f32( x, r ), r ) );
+#endif
+}
+
+inline f4 reduceHalfPi( f4 x, simd::i4& k ) {
+	using namespace simd;
+	k = roundToInt( mul( x, set1( 0.636619772f ) ) );
+	f4 fk = toFloat( k );
+	x = sub( x, mul( fk, set1( 1.5703125f ) ) );
+	x = sub( x, mul( fk, set1( 4.837512969970703125e-4f ) ) );
+	return sub( x, mul( fk, set1( 7.54978995489188216e-8f ) ) );
+}
+inline f4 sinPoly( f4 r, f4 z ) {
+	using namespace simd;
+	f4 p = madd( madd( set1( -1.9515295891e-4f ), z, set1( 8.3321608736e-3f ) ), z, set1( -1.6666654611e-1f ) );
+	return madd( mul( p, z ), r, r );
+}
+inline f4 cosPoly( f4 z ) {
+	using namespace simd;
+	f4 p = madd( madd( set1( 2.443315711809948e-5f ), z, set1( -1.388731625493765e-3f ) ), z, set1( 4.166664568298827e-2f ) );
+	return madd( mul( p, z ), z, madd( set1( -.5f ), z, set1( 1.f ) ) );
+}
+inline f4 quadrant( simd::i4 k, f4 s, f4 c ) {
+	using namespace simd;
+	f4 odd = asFloat( equali( andi( k, set1i( 1 ) ), set1i( 1 ) ) );
+	f4 sign = asFloat( shiftLeft<30>( andi( k, set1i( 2 ) ) ) );
+	return bitXor( select( odd, c, s ), sign );
+}
+
+inline f4 sin( f4 x ) {
+	simd::i4 k;
+	f4 r = reduceHalfPi( x, k ), z = simd::mul( r, r );
+	return quadrant( k, sinPoly( r, z ), cosPoly( z ) );
+}
+inline f4 cos( f4 x ) {
+	simd::i4 k;
+	f4 r = reduceHalfPi( x, k ), z = simd::mul( r, r );
+	return quadrant( simd::addi( k, simd::set1i( 1 ) ), sinPoly( r, z ), cosPoly( z ) );
+}
+inline void sincos( f4 x, f4& s, f4& c ) {
+	simd::i4 k;
+	f4 r = reduceHalfPi( x, k ), z = simd::mul( r, r );
+	f4 sp = sinPoly( r, z ), cp = cosPoly( z );
+	s = quadrant( k, sp, cp );
+	c = quadrant( simd::addi( k, simd::set1i( 1 ) ), sp, cp );
+}
+
+inline f4 atan2( f4 y, f4 x ) {
+	using namespace simd;
+	f4 signBit = asFloat( set1i( int( 0x80000000u ) ) ), zero = set1( 0.f );
+	f4 ax = bitXor( x, bitAnd( x, signBit ) ), ay = bitXor( y, bitAnd( y, signBit ) );
+	f4 hi = max( ax, ay ), lo = min( ax, ay );
+	f4 a = bitAnd( div( lo, hi ), lessThan( zero, hi ) );
+	f4 big = lessThan( set1( 0.414213562f ), a );
+	f4 t = select( big, div( sub( a, set1( 1.f ) ), add( a, set1( 1.f ) ) ), a ), z = mul( t, t );
+	f4 p = madd( madd( madd( set1( 8.05374449538e-2f ), z, set1( -1.38776856032e-1f ) ), z, set1( 1.99777106478e-1f ) ), z, set1( -3.33329491539e-1f ) );
+	f4 r = madd( mul( p, z ), t, t );
+	r = add( r, bitAnd( big, set1( 0.785398163f ) ) );
+	r = select( lessThan( ax, ay ), sub( set1( 1.57079633f ), r ), r );
+	r = select( lessThan( x, zero ), sub( set1( 3.14159265f ), r ), r );
+	return bitOr( r, bitAnd( y, signBit ) );
+}
+
+inline f4 exp( f4 x ) {
+	using namespace simd;
+	x = min( max( x, set1( -87.3f ) ), set1( 88.3f ) );
+	i4 n = roundToInt( mul( x, set1( 1.44269504f ) ) );
+	f4 fn = toFloat( n );
+	f4 r = add( sub( x, mul( fn, set1( 0.693359375f ) ) ), mul( fn, set1( 2.12194440e-4f ) ) );
+	f4 p = madd( madd( madd( madd( madd( set1( 1.9875691500e-4f ), r, set1( 1.3981999507e-3f ) ), r, set1( 8.3334519073e-3f ) ), r,
+						 set1( 4.1665795894e-2f ) ), r, set1( 1.6666665459e-1f ) ), r, set1( 5.0000001201e-1f ) );
+	f4 y = add( madd( mul( p, r ), r, r ), set1( 1.f ) );
+	return mul( y, asFloat( shiftLeft<23>( addi( n, set1i( 127 ) ) ) ) );
+}
+
+inline f4 log( f4 x ) {
+	using namespace simd;
+	i4 bits = asInt( x );
+	i4 e = addi( andi( shiftRight<23>( bits ), set1i( 0xff ) ), set1i( -126 ) );
+	f4 m = asFloat( ori( andi( bits, set1i( 0x807fffff ) ), set1i( 0x3f000000 ) ) );
+	f4 small = lessThan( m, set1( 0.707106781f ) );
+	e = addi( e, asInt( small ) );						// -1 where small
+	m = sub( add( m, bitAnd( small, m ) ), set1( 1.f ) );
+	f4 z = mul( m, m ), fe = toFloat( e );
+	f4 p = set1( 7.0376836292e-2f );
+	p = madd( p, m, set1( -1.1514610310e-1f ) );
+	p = madd( p, m, set1( 1.1676998740e-1f ) );
+	p = madd( p, m, set1( -1.2420140846e-1f ) );
+	p = madd( p, m, set1( 1.4249322787e-1f ) );
+	p = madd( p, m, set1( -1.6668057665e-1f ) );
+	p = madd( p, m, set1( 2.0000714765e-1f ) );
+	p = madd( p, m, set1( -2.4999993993e-1f ) );
+	p = madd( p, m, set1( 3.3333331174e-1f ) );
+	f4 y = madd( mul( p, m ), z, madd( fe, set1( -2.12194440e-4f ), mul( set1( -.5f ), z ) ) );
+	return madd( fe, set1( 0.693359375f ), add( m, y ) );
+}
+
+} // namespace fast
+#endif
+
+} // namespace jm
+
+#endif /* jm_fast_h */
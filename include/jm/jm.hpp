@@ -11,6 +11,10 @@
 #include "vec.hpp"
 #include "vec_func.hpp"
 #include "mat.hpp"
+#include "mat_simd.hpp"
+#include "batch.hpp"
+#include "aligned.hpp"
+#include "fast.hpp"
 #ifndef JM_CORE_ONLY
 #include "rect.hpp"
 #include "transf.hpp"
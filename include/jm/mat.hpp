@@ -17,32 +17,32 @@ template<typename T,size_t COL, size_t ROW> struct MatType {
 	using VecType = vec_type_t<T,ROW>;
 	VecType v[COL];
 	
-	MatType() { for( int i=0; i<COL; i++ ) v[i]=VecType(0); }
+	constexpr MatType(): v{} {}
 	
 	template<typename T1, typename=std::enable_if_t<!is_vector_v<T1>>>		// Single vector constructor is not allowed
-	MatType(const T1& a);
+	constexpr MatType(const T1& a);
 
 	template<typename T1,typename T2,typename=std::enable_if_t<COL==2&&vec_length<T1> ==ROW&&vec_length<T2> ==ROW>>
-	MatType(const T1& a0, const T2& a1) {
+	constexpr MatType(const T1& a0, const T2& a1): v{} {
 		v[0]=VecType(a0); v[1]=VecType(a1);
 	}
 	template<typename T1,typename T2,typename T3,typename=std::enable_if_t<COL==3&&vec_length<T1> ==ROW&&vec_length<T2> ==ROW&&vec_length<T3> ==ROW>>
-	MatType(const T1& a0, const T2& a1, const T3& a2) {
+	constexpr MatType(const T1& a0, const T2& a1, const T3& a2): v{} {
 		v[0]=VecType(a0); v[1]=VecType(a1); v[2]=VecType(a2);
 	}
 	template<typename T1,typename T2,typename T3,typename T4,typename=std::enable_if_t<COL==4&&vec_length<T1> ==ROW&&vec_length<T2> ==ROW&&vec_length<T3> ==ROW&&vec_length<T4> ==ROW>>
-	MatType(const T1& a0, const T2& a1, const T3& a2, const T4& a3) {
+	constexpr MatType(const T1& a0, const T2& a1, const T3& a2, const T4& a3): v{} {
 		v[0]=VecType(a0); v[1]=VecType(a1); v[2]=VecType(a2); v[3]=VecType(a3);
 	}
 	template<typename T00, typename T01, typename T10, typename T11,
 	typename=std::enable_if_t<COL==2&&ROW==2&&!is_vector_v<T00>&&!is_vector_v<T01>&&!is_vector_v<T10>&&!is_vector_v<T11>>>
-	MatType(T00 a00, T10 a10, T01 a01, T11 a11) {	// 2x2
+	constexpr MatType(T00 a00, T10 a10, T01 a01, T11 a11): v{} {	// 2x2
 		v[0][0]=T(a00); v[1][0]=T(a01);
 		v[0][1]=T(a10); v[1][1]=T(a11);
 	}
 	template<typename T00, typename T01, typename T02, typename T10, typename T11, typename T12,
 	typename=std::enable_if_t<((COL==3&&ROW==2)||(COL==2&&ROW==3))&&!is_vector_v<T00>&&!is_vector_v<T01>&&!is_vector_v<T02>&&!is_vector_v<T10>&&!is_vector_v<T11>&&!is_vector_v<T12>>>
-	MatType(T00 a00, T10 a10, T01 a01, T11 a11, T02 a02, T12 a12 ) {
+	constexpr MatType(T00 a00, T10 a10, T01 a01, T11 a11, T02 a02, T12 a12 ): v{} {
 		if constexpr ( COL==3 ) {									 // 3x2
 			v[0][0]=T(a00); v[1][0]=T(a01); v[2][0]=T(a02);
 			v[0][1]=T(a10); v[1][1]=T(a11); v[2][1]=T(a12);
@@ -55,7 +55,7 @@ template<typename T,size_t COL, size_t ROW> struct MatType {
 	}
 	template<typename T00, typename T01, typename T02, typename T03, typename T10, typename T11, typename T12, typename T13,
 	typename=std::enable_if_t<((COL==4&&ROW==2)||(COL==2&&ROW==4))&&!is_vector_v<T00>&&!is_vector_v<T01>&&!is_vector_v<T02>&&!is_vector_v<T03>&&!is_vector_v<T10>&&!is_vector_v<T11>&&!is_vector_v<T12>&&!is_vector_v<T13>>>
-	MatType(T00 a00, T10 a10, T01 a01, T11 a11, T02 a02, T12 a12, T03 a03, T13 a13 ) { // 4x2
+	constexpr MatType(T00 a00, T10 a10, T01 a01, T11 a11, T02 a02, T12 a12, T03 a03, T13 a13 ): v{} { // 4x2
 		if constexpr ( COL==4 ) {
 			v[0][0]=T(a00); v[1][0]=T(a01); v[2][0]=T(a02); v[3][0]=T(a03);
 			v[0][1]=T(a10); v[1][1]=T(a11); v[2][1]=T(a12); v[3][1]=T(a13);
@@ -69,7 +69,7 @@ template<typename T,size_t COL, size_t ROW> struct MatType {
 	}
 	template<typename T00, typename T01, typename T02, typename T10, typename T11, typename T12, typename T20, typename T21, typename T22,
 	typename=std::enable_if_t<COL==3&&ROW==3&&!is_vector_v<T00>&&!is_vector_v<T01>&&!is_vector_v<T02>&&!is_vector_v<T10>&&!is_vector_v<T11>&&!is_vector_v<T12>&&!is_vector_v<T20>&&!is_vector_v<T21>&&!is_vector_v<T22>>>
-	MatType(T00 a00, T10 a10, T20 a20, T01 a01, T11 a11, T21 a21, T02 a02, T12 a12, T22 a22 ) {	 // 3x3
+	constexpr MatType(T00 a00, T10 a10, T20 a20, T01 a01, T11 a11, T21 a21, T02 a02, T12 a12, T22 a22 ): v{} {	 // 3x3
 		v[0][0]=T(a00); v[1][0]=T(a01); v[2][0]=T(a02);
 		v[0][1]=T(a10); v[1][1]=T(a11); v[2][1]=T(a12);
 		v[0][2]=T(a20); v[1][2]=T(a21); v[2][2]=T(a22);
@@ -79,7 +79,7 @@ template<typename T,size_t COL, size_t ROW> struct MatType {
 	&&!is_vector_v<T00>&&!is_vector_v<T01>&&!is_vector_v<T02>&&!is_vector_v<T03>
 	&&!is_vector_v<T10>&&!is_vector_v<T11>&&!is_vector_v<T12>&&!is_vector_v<T13>
 	&&!is_vector_v<T20>&&!is_vector_v<T21>&&!is_vector_v<T22>&&!is_vector_v<T23> >>
-	MatType(T00 a00, T10 a10, T20 a20, T01 a01, T11 a11, T21 a21, T02 a02, T12 a12, T22 a22, T03 a03, T13 a13, T23 a23 ) {
+	constexpr MatType(T00 a00, T10 a10, T20 a20, T01 a01, T11 a11, T21 a21, T02 a02, T12 a12, T22 a22, T03 a03, T13 a13, T23 a23 ): v{} {
 		if constexpr ( COL==4 ) {												 // 4x3
 			v[0][0]=T(a00); v[1][0]=T(a01); v[2][0]=T(a02); v[3][0]=T(a03);
 			v[0][1]=T(a10); v[1][1]=T(a11); v[2][1]=T(a12); v[3][1]=T(a13);
@@ -98,34 +98,34 @@ template<typename T,size_t COL, size_t ROW> struct MatType {
 	&&!is_vector_v<T10>&&!is_vector_v<T11>&&!is_vector_v<T12>&&!is_vector_v<T13>
 	&&!is_vector_v<T20>&&!is_vector_v<T21>&&!is_vector_v<T22>&&!is_vector_v<T23>
 	&&!is_vector_v<T30>&&!is_vector_v<T31>&&!is_vector_v<T32>&&!is_vector_v<T33> >>
-	MatType(T00 a00, T10 a10, T20 a20, T30 a30, T01 a01, T11 a11, T21 a21, T31 a31, T02 a02, T12 a12, T22 a22, T32 a32, T03 a03, T13 a13, T23 a23, T33 a33 ) { // 4x4
+	constexpr MatType(T00 a00, T10 a10, T20 a20, T30 a30, T01 a01, T11 a11, T21 a21, T31 a31, T02 a02, T12 a12, T22 a22, T32 a32, T03 a03, T13 a13, T23 a23, T33 a33 ): v{} { // 4x4
 		v[0][0]=T(a00); v[1][0]=T(a01); v[2][0]=T(a02); v[3][0]=T(a03);
 		v[0][1]=T(a10); v[1][1]=T(a11); v[2][1]=T(a12); v[3][1]=T(a13);
 		v[0][2]=T(a20); v[1][2]=T(a21); v[2][2]=T(a22); v[3][2]=T(a23);
 		v[0][3]=T(a30); v[1][3]=T(a31); v[2][3]=T(a32); v[3][3]=T(a33);
 	}
 
-	VecType& operator[] ( size_t i ) { return v[i]; }
-	const VecType& operator[] ( size_t i ) const { return v[i]; }
-	template<typename T2> MatType& operator += ( const MatType<T2,COL,ROW>& a ) { for(int i=0; i<COL; i++ ) v[i]+=a[i]; return *this; }
-	template<typename T2> MatType& operator -= ( const MatType<T2,COL,ROW>& a ) { for(int i=0; i<COL; i++ ) v[i]-=a[i]; return *this; }
+	constexpr VecType& operator[] ( size_t i ) { return v[i]; }
+	constexpr const VecType& operator[] ( size_t i ) const { return v[i]; }
+	template<typename T2> constexpr MatType& operator += ( const MatType<T2,COL,ROW>& a ) { for(int i=0; i<COL; i++ ) v[i]+=a[i]; return *this; }
+	template<typename T2> constexpr MatType& operator -= ( const MatType<T2,COL,ROW>& a ) { for(int i=0; i<COL; i++ ) v[i]-=a[i]; return *this; }
 //	template<typename T2> MatType& operator *= ( const MatType<T2,COL,ROW>& a ) { for(int i=0; i<COL; i++ ) v[i]*=a[i]; return *this; }
 //	template<typename T2> MatType& operator /= ( const MatType<T2,COL,ROW>& a ) { for(int i=0; i<COL; i++ ) v[i]/=a[i]; return *this; }
 	
 	template<typename T2,typename=std::enable_if_t<!is_vector_v<T2>>>
-	MatType& operator += ( const T2& a ) {
+	constexpr MatType& operator += ( const T2& a ) {
 		for(int i=0; i<COL; i++ ) v[i]+=a; return *this;
 	}
 	template<typename T2,typename=std::enable_if_t<!is_vector_v<T2>>>
-	MatType& operator -= ( const T2& a ) {
+	constexpr MatType& operator -= ( const T2& a ) {
 		for(int i=0; i<COL; i++ ) v[i]-=a; return *this;
 	}
 	template<typename T2,typename=std::enable_if_t<!is_vector_v<T2>>>
-	MatType& operator *= ( const T2& a ) {
+	constexpr MatType& operator *= ( const T2& a ) {
 		for(int i=0; i<COL; i++ ) v[i]*=a; return *this;
 	}
 	template<typename T2,typename=std::enable_if_t<!is_vector_v<T2>>>
-	MatType& operator /= ( const T2& a ) {
+	constexpr MatType& operator /= ( const T2& a ) {
 		for(int i=0; i<COL; i++ ) v[i]/=a; return *this;
 	}
 
@@ -169,9 +169,9 @@ template<typename T,size_t R> struct _rows_< _mvec_<T,R>> : _cnt_<R> {};
 
 
 
-template<typename T, size_t C, size_t R> auto operator +(const mmat_t<T,C,R>& a, const mmat_t<T,C,R>& b ) { auto ret = a; ret+=b; return ret; }
-template<typename T, size_t C, size_t R> auto operator -(const mmat_t<T,C,R>& a, const mmat_t<T,C,R>& b ) { auto ret = a; ret-=b; return ret; }
-template<typename T, size_t C, size_t R> auto operator *(const mmat_t<T,C,R>& a, const mmat_t<T,R,C>& b ) {
+template<typename T, size_t C, size_t R> constexpr auto operator +(const mmat_t<T,C,R>& a, const mmat_t<T,C,R>& b ) { auto ret = a; ret+=b; return ret; }
+template<typename T, size_t C, size_t R> constexpr auto operator -(const mmat_t<T,C,R>& a, const mmat_t<T,C,R>& b ) { auto ret = a; ret-=b; return ret; }
+template<typename T, size_t C, size_t R> constexpr auto operator *(const mmat_t<T,C,R>& a, const mmat_t<T,R,C>& b ) {
 	mmat_t<T,R,R> ret;
 	for( int c=0; c<R; c++) for( int r=0; r<R; r++ ) {
 		ret[c][r]=0;
@@ -179,7 +179,7 @@ template<typename T, size_t C, size_t R> auto operator *(const mmat_t<T,C,R>& a,
 	}
 	return ret;
 }
-template<typename T, size_t C, size_t R> auto operator *(const mmat_t<T,C,R>& a, const vec_type_t<T,C>& b ) {
+template<typename T, size_t C, size_t R> constexpr auto operator *(const mmat_t<T,C,R>& a, const vec_type_t<T,C>& b ) {
 	vec_type_t<T,R> ret;
 	for( int r=0; r<R; r++) {
 		ret[r]=0;
@@ -187,7 +187,7 @@ template<typename T, size_t C, size_t R> auto operator *(const mmat_t<T,C,R>& a,
 	}
 	return ret;
 }
-template<typename T, size_t C, size_t R> auto operator *(const vec_type_t<T,R>& b,const mmat_t<T,C,R>& a) {
+template<typename T, size_t C, size_t R> constexpr auto operator *(const vec_type_t<T,R>& b,const mmat_t<T,C,R>& a) {
 	vec_type_t<T,C> ret;
 	for( int c=0; c<C; c++) {
 		ret[c]=0;
@@ -195,11 +195,11 @@ template<typename T, size_t C, size_t R> auto operator *(const vec_type_t<T,R>&
 	}
 	return ret;
 }
-template<typename T, size_t C, size_t R> auto operator *(const mmat_t<T,C,R>& a, T b ) { auto ret = a; ret*=b; return ret; }
-template<typename T, size_t C, size_t R> auto operator /(const mmat_t<T,C,R>& a, T b ) { auto ret = a; ret/=b; return ret; }
-template<typename T, size_t C, size_t R> auto operator *(T b, const mmat_t<T,C,R>& a ) { auto ret = a; ret*=b; return ret; }
+template<typename T, size_t C, size_t R> constexpr auto operator *(const mmat_t<T,C,R>& a, T b ) { auto ret = a; ret*=b; return ret; }
+template<typename T, size_t C, size_t R> constexpr auto operator /(const mmat_t<T,C,R>& a, T b ) { auto ret = a; ret/=b; return ret; }
+template<typename T, size_t C, size_t R> constexpr auto operator *(T b, const mmat_t<T,C,R>& a ) { auto ret = a; ret*=b; return ret; }
 
-template<typename T, size_t C, size_t R> auto transpose(const mmat_t<T,C,R>& a) {
+template<typename T, size_t C, size_t R> constexpr auto transpose(const mmat_t<T,C,R>& a) {
 	mmat_t<T,R,C> ret;
 	for( int r=0; r<R; r++) for( int c=0; c<C; c++) {
 		ret[r][c]=a[c][r];
@@ -207,7 +207,7 @@ template<typename T, size_t C, size_t R> auto transpose(const mmat_t<T,C,R>& a)
 	return ret;
 }
 
-template<typename T, size_t C, size_t R> auto matrixCompMult(const mmat_t<T,C,R>& a, const mmat_t<T,C,R>& b ) {
+template<typename T, size_t C, size_t R> constexpr auto matrixCompMult(const mmat_t<T,C,R>& a, const mmat_t<T,C,R>& b ) {
 	mmat_t<T,C,R> ret;
 	for( int c=0; c<C; c++) {
 		ret[c]=a[c]*b[c];
@@ -215,13 +215,13 @@ template<typename T, size_t C, size_t R> auto matrixCompMult(const mmat_t<T,C,R>
 	return ret;
 }
 
-template<typename T, size_t C, size_t R> auto outerProduct(const vec_type_t<T,R>& a, const vec_type_t<T,C>& b) {
+template<typename T, size_t C, size_t R> constexpr auto outerProduct(const vec_type_t<T,R>& a, const vec_type_t<T,C>& b) {
 	mmat_t<T,C,R> ret;
 	for( int c=0; c<C; c++) for( int r=0; r<R; r++) ret[c][r] = a[r]*b[c];
 	return ret;
 }
 
-template<typename T, size_t C> scalar_t determinant( const mmat_t<T,C,C>& a ) {
+template<typename T, size_t C> constexpr scalar_t determinant( const mmat_t<T,C,C>& a ) {
 	if constexpr ( C==2 ) {
 		return a[0][0]*a[1][1]
 			-  a[0][1]*a[1][0];
@@ -241,7 +241,7 @@ template<typename T, size_t C> scalar_t determinant( const mmat_t<T,C,C>& a ) {
 	}
 }
 // inverse
-template<typename T, size_t C> auto inverse( const mmat_t<T,C,C>& a ) {
+template<typename T, size_t C> constexpr auto inverse( const mmat_t<T,C,C>& a ) {
 	if constexpr ( C==2 ) {
 		mmat_t<T,C,C> r;
 		r[0][0] = a[1][1];
@@ -295,7 +295,7 @@ template<> inline mmat_t<double,2,2>::mmat_t(double a) { for( int i=0; i<2; i++
 template<> inline mmat_t<double,3,3>::mmat_t(double a) { for( int i=0; i<3; i++ ) { v[i]=dvec3(0); v[i][i]=a; } }
 template<> inline mmat_t<double,4,4>::mmat_t(double a) { for( int i=0; i<4; i++ ) { v[i]=dvec4(0); v[i][i]=a; } }
 */
-template<typename T,size_t C, size_t R> template<typename T1,typename> mmat_t<T,C,R>::mmat_t(const T1& a) {
+template<typename T,size_t C, size_t R> template<typename T1,typename> constexpr mmat_t<T,C,R>::mmat_t(const T1& a): v{} {
 	using VecType = vec_type_t<T,R>;
 	if constexpr ( _rows_<T1>::n ==1 && _cols_<T1>::n ==1 ) {				// is scalar
 		if constexpr (C == R) {										// square matrix
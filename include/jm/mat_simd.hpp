@@ -0,0 +1,189 @@
+//
+//  mat_simd.hpp
+//  jm
+//
+
+#ifndef jm_mat_simd_h
+#define jm_mat_simd_h
+
+// SSE/AVX and NEON versions of the float 4x4 matrix operations. They are plain
+// overloads of the templates in mat.hpp, so overload resolution picks them for
+// mat4 and everything else keeps the scalar loops. Define JM_NO_SIMD to get the
+// scalar code everywhere. Constant expressions also take the templates, the
+// intrinsics can't be evaluated at compile time. test/mat_simd_bench.cpp times
+// both and checks that they agree.
+
+#ifndef JM_NO_SIMD
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64) || (defined(_M_IX86_FP) && _M_IX86_FP>=2)
+#define JM_SIMD_SSE 1
+#include <immintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define JM_SIMD_NEON 1
+#include <arm_neon.h>
+#endif
+#endif
+
+#include "mat.hpp"
+
+namespace jm {
+
+#if defined(JM_SIMD_SSE) || defined(JM_SIMD_NEON)
+
+static_assert( sizeof(mvec4_t<float>)==16 && sizeof(mat4)==64, "mat4 columns have to be packed" );
+
+namespace simd {
+
+#if defined(JM_SIMD_SSE)
+using f4 = __m128;
+inline f4 load( const mvec4_t<float>& a )		{ return _mm_loadu_ps( a.v ); }
+inline void store( mvec4_t<float>& a, f4 x )	{ _mm_storeu_ps( a.v, x ); }
+#define JM_SPLAT( x, i ) _mm_shuffle_ps( x, x, _MM_SHUFFLE( i, i, i, i ) )
+#if defined(__FMA__)
+inline f4 madd( f4 a, f4 b, f4 c )	{ return _mm_fmadd_ps( a, b, c ); }
+#else
+inline f4 madd( f4 a, f4 b, f4 c )	{ return _mm_add_ps( _mm_mul_ps( a, b ), c ); }
+#endif
+inline f4 mul( f4 a, f4 b )			{ return _mm_mul_ps( a, b ); }
+#else
+using f4 = float32x4_t;
+inline f4 load( const mvec4_t<float>& a )		{ return vld1q_f32( a.v ); }
+inline void store( mvec4_t<float>& a, f4 x )	{ vst1q_f32( a.v, x ); }
+#define JM_SPLAT( x, i ) vdupq_n_f32( vgetq_lane_f32( x, i ) )
+inline f4 madd( f4 a, f4 b, f4 c )	{ return vmlaq_f32( c, a, b ); }
+inline f4 mul( f4 a, f4 b )			{ return vmulq_f32( a, b ); }
+#endif
+
+// a[0]*b.x + a[1]*b.y + a[2]*b.z + a[3]*b.w, a being the columns of a matrix.
+inline f4 combine( const f4 a[4], f4 b ) {
+	f4 r = mul( a[0], JM_SPLAT( b, 0 ) );
+	r = madd( a[1], JM_SPLAT( b, 1 ), r );
+	r = madd( a[2], JM_SPLAT( b, 2 ), r );
+	return madd( a[3], JM_SPLAT( b, 3 ), r );
+}
+
+inline mat4 mat4Mul( const mat4& a, const mat4& b ) {
+	mat4 ret;
+#if defined(JM_SIMD_SSE) && defined(__AVX__)
+	// Two result columns per step: each 128-bit lane broadcasts from its own column of b.
+	__m256 a0 = _mm256_broadcast_ps( (const __m128*)a[0].v ), a1 = _mm256_broadcast_ps( (const __m128*)a[1].v );
+	__m256 a2 = _mm256_broadcast_ps( (const __m128*)a[2].v ), a3 = _mm256_broadcast_ps( (const __m128*)a[3].v );
+	for( int c=0; c<4; c+=2 ) {
+		__m256 bc = _mm256_loadu_ps( b[c].v );
+		__m256 r = _mm256_mul_ps( a0, _mm256_shuffle_ps( bc, bc, 0x00 ) );
+#if defined(__FMA__)
+		r = _mm256_fmadd_ps( a1, _mm256_shuffle_ps( bc, bc, 0x55 ), r );
+		r = _mm256_fmadd_ps( a2, _mm256_shuffle_ps( bc, bc, 0xaa ), r );
+		r = _mm256_fmadd_ps( a3, _mm256_shuffle_ps( bc, bc, 0xff ), r );
+#else
+		r = _mm256_add_ps( r, _mm256_mul_ps( a1, _mm256_shuffle_ps( bc, bc, 0x55 ) ) );
+		r = _mm256_add_ps( r, _mm256_mul_ps( a2, _mm256_shuffle_ps( bc, bc, 0xaa ) ) );
+		r = _mm256_add_ps( r, _mm256_mul_ps( a3, _mm256_shuffle_ps( bc, bc, 0xff ) ) );
+#endif
+		_mm256_storeu_ps( ret[c].v, r );
+	}
+#else
+	f4 cols[4] = { load( a[0] ), load( a[1] ), load( a[2] ), load( a[3] ) };
+	for( int c=0; c<4; c++ ) store( ret[c], combine( cols, load( b[c] ) ) );
+#endif
+	return ret;
+}
+
+inline vec4 mat4VecMul( const mat4& a, const vec4& b ) {
+	f4 cols[4] = { load( a[0] ), load( a[1] ), load( a[2] ), load( a[3] ) };
+	vec4 ret;
+	store( ret, combine( cols, load( b ) ) );
+	return ret;
+}
+
+inline mat4 mat4Transpose( const mat4& a ) {
+	mat4 ret;
+#if defined(JM_SIMD_SSE)
+	__m128 c0 = load( a[0] ), c1 = load( a[1] ), c2 = load( a[2] ), c3 = load( a[3] );
+	_MM_TRANSPOSE4_PS( c0, c1, c2, c3 );
+	store( ret[0], c0 ); store( ret[1], c1 ); store( ret[2], c2 ); store( ret[3], c3 );
+#else
+	float32x4x4_t t = vld4q_f32( a[0].v );		// de-interleaving load is the transpose
+	store( ret[0], t.val[0] ); store( ret[1], t.val[1] );
+	store( ret[2], t.val[2] ); store( ret[3], t.val[3] );
+#endif
+	return ret;
+}
+
+#if defined(JM_SIMD_SSE)
+// 2x2 matrices packed as (m00,m01,m10,m11) in one register.
+#define JM_SHUF( a, b, x, y, z, w ) _mm_shuffle_ps( a, b, _MM_SHUFFLE( w, z, y, x ) )
+#define JM_SWZ( a, x, y, z, w ) JM_SHUF( a, a, x, y, z, w )
+inline __m128 mat2Mul( __m128 a, __m128 b ) {			// a*b
+	return _mm_add_ps( _mm_mul_ps( a, JM_SWZ( b, 0,3,0,3 ) ), _mm_mul_ps( JM_SWZ( a, 1,0,3,2 ), JM_SWZ( b, 2,1,2,1 ) ) );
+}
+inline __m128 mat2AdjMul( __m128 a, __m128 b ) {		// adj(a)*b
+	return _mm_sub_ps( _mm_mul_ps( JM_SWZ( a, 3,3,0,0 ), b ), _mm_mul_ps( JM_SWZ( a, 1,1,2,2 ), JM_SWZ( b, 2,3,0,1 ) ) );
+}
+inline __m128 mat2MulAdj( __m128 a, __m128 b ) {		// a*adj(b)
+	return _mm_sub_ps( _mm_mul_ps( a, JM_SWZ( b, 3,0,3,0 ) ), _mm_mul_ps( JM_SWZ( a, 1,0,3,2 ), JM_SWZ( b, 2,1,2,1 ) ) );
+}
+
+// Block-wise inverse through 2x2 adjugates. The columns are handled as rows,
+// which is fine since inverse(transpose(M)) == transpose(inverse(M)).
+inline mat4 mat4Inverse( const mat4& m ) {
+	__m128 r0 = load( m[0] ), r1 = load( m[1] ), r2 = load( m[2] ), r3 = load( m[3] );
+	__m128 A = _mm_movelh_ps( r0, r1 ), B = _mm_movehl_ps( r1, r0 );
+	__m128 C = _mm_movelh_ps( r2, r3 ), D = _mm_movehl_ps( r3, r2 );
+	// (|A|, |B|, |C|, |D|)
+	__m128 det = _mm_sub_ps( _mm_mul_ps( JM_SHUF( r0, r2, 0,2,0,2 ), JM_SHUF( r1, r3, 1,3,1,3 ) ),
+							 _mm_mul_ps( JM_SHUF( r0, r2, 1,3,1,3 ), JM_SHUF( r1, r3, 0,2,0,2 ) ) );
+	__m128 detA = JM_SPLAT( det, 0 ), detB = JM_SPLAT( det, 1 ), detC = JM_SPLAT( det, 2 ), detD = JM_SPLAT( det, 3 );
+	__m128 DC = mat2AdjMul( D, C );
+	__m128 AB = mat2AdjMul( A, B );
+	__m128 X = _mm_sub_ps( _mm_mul_ps( detD, A ), mat2Mul( B, DC ) );
+	__m128 W = _mm_sub_ps( _mm_mul_ps( detA, D ), mat2Mul( C, AB ) );
+	__m128 Y = _mm_sub_ps( _mm_mul_ps( detB, C ), mat2MulAdj( D, AB ) );
+	__m128 Z = _mm_sub_ps( _mm_mul_ps( detC, B ), mat2MulAdj( A, DC ) );
+	// |M| = |A||D| + |B||C| - tr(adj(A)B adj(D)C)
+	__m128 tr = _mm_mul_ps( AB, JM_SWZ( DC, 0,2,1,3 ) );
+	tr = _mm_add_ps( tr, _mm_movehl_ps( tr, tr ) );
+	tr = _mm_add_ss( tr, JM_SWZ( tr, 1,1,1,1 ) );
+	__m128 detM = _mm_sub_ps( _mm_add_ps( _mm_mul_ps( detA, detD ), _mm_mul_ps( detB, detC ) ), JM_SPLAT( tr, 0 ) );
+	__m128 rDet = _mm_div_ps( _mm_setr_ps( 1.f, -1.f, -1.f, 1.f ), detM );
+	X = _mm_mul_ps( X, rDet );
+	Y = _mm_mul_ps( Y, rDet );
+	Z = _mm_mul_ps( Z, rDet );
+	W = _mm_mul_ps( W, rDet );
+	mat4 ret;
+	store( ret[0], JM_SHUF( X, Y, 3,1,3,1 ) );
+	store( ret[1], JM_SHUF( X, Y, 2,0,2,0 ) );
+	store( ret[2], JM_SHUF( Z, W, 3,1,3,1 ) );
+	store( ret[3], JM_SHUF( Z, W, 2,0,2,0 ) );
+	return ret;
+}
+#undef JM_SWZ
+#undef JM_SHUF
+#endif
+
+} // namespace simd
+#undef JM_SPLAT
+
+constexpr mat4 operator *( const mat4& a, const mat4& b ) {
+	if( JM_CONSTANT_EVALUATED() ) return operator*<float,4,4>( a, b );
+	return simd::mat4Mul( a, b );
+}
+constexpr vec4 operator *( const mat4& a, const vec4& b ) {
+	if( JM_CONSTANT_EVALUATED() ) return operator*<float,4,4>( a, b );
+	return simd::mat4VecMul( a, b );
+}
+constexpr mat4 transpose( const mat4& a ) {
+	if( JM_CONSTANT_EVALUATED() ) return transpose<float,4,4>( a );
+	return simd::mat4Transpose( a );
+}
+#if defined(JM_SIMD_SSE)
+constexpr mat4 inverse( const mat4& m ) {
+	if( JM_CONSTANT_EVALUATED() ) return inverse<float,4>( m );
+	return simd::mat4Inverse( m );
+}
+#endif
+
+#endif
+
+} // namespace jm
+
+#endif /* jm_mat_simd_h */
@@ -12,10 +12,10 @@
 
 namespace jm {
 
-const scalar_t PI = 3.14159265358979f;
+constexpr scalar_t PI = 3.14159265358979f;
 
-template<typename T,typename = std::enable_if_t<!is_vector_v<T>>>	auto degrees		( T d )	{ return d*180/PI; }
-template<typename T,typename = std::enable_if_t<!is_vector_v<T>>>	auto radians		( T d )	{ return d*PI/180; }
+template<typename T,typename = std::enable_if_t<!is_vector_v<T>>>	constexpr auto degrees		( T d )	{ return d*180/PI; }
+template<typename T,typename = std::enable_if_t<!is_vector_v<T>>>	constexpr auto radians		( T d )	{ return d*PI/180; }
 template<typename T,typename = std::enable_if_t<!is_vector_v<T>>>	auto sin			( T a ) { return ::sinf(float(a)); }
 template<typename T,typename = std::enable_if_t<!is_vector_v<T>>>	auto cos			( T a )	{ return ::cosf(float(a)); }
 template<typename T,typename = std::enable_if_t<!is_vector_v<T>>>	auto tan			( T a ) { return ::tanf(float(a)); }
@@ -42,7 +42,7 @@ template<typename T,typename = std::enable_if_t<!is_vector_v<T>>>	auto ceil			(
 
 template<typename T,typename = std::enable_if_t<!is_vector_v<T>>>	auto fract			( T d )	{ return d-floor(d); }
 template<typename T,typename = std::enable_if_t<!is_vector_v<T>>>	auto inversesqrt	( T d )	{ return 1.f/sqrt(d); }
-template<typename T,typename = std::enable_if_t<!is_vector_v<T>>>	auto sign			( T d )	{ return d>0?T(1):(d<0?T(-1):T(0)); }
+template<typename T,typename = std::enable_if_t<!is_vector_v<T>>>	constexpr auto sign			( T d )	{ return d>0?T(1):(d<0?T(-1):T(0)); }
 template<typename T,typename = std::enable_if_t<!is_vector_v<T>>> 	auto roundEven		( T x ) { return floor(x*2) == ceil(x*2) ? ( int(round(x))%2==0?ceil(x):floor(x) ) : round(x); }
 
 template<> inline		auto sin<double>	( double a ) { return ::sin(a); }
@@ -70,17 +70,17 @@ template<> inline		auto round<double>	( double a ) { return ::round(a); }
 template<> inline		auto ceil<double>	( double a ) { return ::ceil(a); }
 
 template<typename T0, typename T1, typename=std::enable_if_t<!is_vector_v<T0> && !is_vector_v<T1>>>
-bool lessThan( T0 a, T1 b ) { return a <  b; }		
+constexpr bool lessThan( T0 a, T1 b ) { return a <  b; }		
 template<typename T0, typename T1, typename=std::enable_if_t<!is_vector_v<T0> && !is_vector_v<T1>>>
-bool lessThanEqual( T0 a, T1 b ) { return a <= b; }	
+constexpr bool lessThanEqual( T0 a, T1 b ) { return a <= b; }	
 template<typename T0, typename T1, typename=std::enable_if_t<!is_vector_v<T0> && !is_vector_v<T1>>>
-bool greaterThan( T0 a, T1 b ) { return a >  b; }	
+constexpr bool greaterThan( T0 a, T1 b ) { return a >  b; }	
 template<typename T0, typename T1, typename=std::enable_if_t<!is_vector_v<T0> && !is_vector_v<T1>>>
-bool greaterThanEqua( T0 a, T1 b ) { return a >= b; }
+constexpr bool greaterThanEqua( T0 a, T1 b ) { return a >= b; }
 template<typename T0, typename T1, typename=std::enable_if_t<!is_vector_v<T0> && !is_vector_v<T1>>>
-bool equal( T0 a, T1 b ) { return a == b; }			
+constexpr bool equal( T0 a, T1 b ) { return a == b; }			
 template<typename T0, typename T1, typename=std::enable_if_t<!is_vector_v<T0> && !is_vector_v<T1>>>
-bool notEqual( T0 a, T1 b ) { return a != b; }		
+constexpr bool notEqual( T0 a, T1 b ) { return a != b; }		
 
 
 
@@ -105,62 +105,62 @@ auto modf	( T0 x, T1& y) {
 }
 
 template<typename T0, typename T1,typename = std::enable_if_t<!is_vector_v<T0> && !is_vector_v<T1>>>
-auto min	( T0 a, T1 b ) {
+constexpr auto min	( T0 a, T1 b ) {
 	using scalar = typename std::common_type_t<T0,T1>;
 	return a<b?scalar(a):scalar(b);
 }
 
 template<typename T0, typename T1,typename = std::enable_if_t<!is_vector_v<T0> && !is_vector_v<T1>>>
-auto max	( T0 a, T1 b ) {
+constexpr auto max	( T0 a, T1 b ) {
 	using scalar = typename std::common_type_t<T0,T1>;
 	return a>b?scalar(a):scalar(b);
 }
 
 template<typename T0, typename T1,typename = std::enable_if_t<!is_vector_v<T0> && !is_vector_v<T1>>>
-auto clamp		( float  d, T0 e1, T1 e2 ) {
+constexpr auto clamp		( float  d, T0 e1, T1 e2 ) {
 	using scalar = typename std::common_type_t< T0, T1, float>;
 	return d>e2?scalar(e2):(d<e1?scalar(e1):d);
 }
 
 template<typename T0, typename T1,typename = std::enable_if_t<!is_vector_v<T0> && !is_vector_v<T1>>>
-auto clamp		( double d, T0 e1, T1 e2 ) {
+constexpr auto clamp		( double d, T0 e1, T1 e2 ) {
 	using scalar = double;
 	return d>e2?scalar(e2):(d<e1?scalar(e1):d);
 }
 
 template<typename T0, typename T1,typename = std::enable_if_t<!is_vector_v<T0> && !is_vector_v<T1>>>
-auto	mix	(T0  d1, T1 d2, float t ) {
+constexpr auto	mix	(T0  d1, T1 d2, float t ) {
 	using scalar = typename std::common_type_t<T0,T1>;
 	return scalar ((1-t)*scalar(d1)+t*scalar(d2));
 }
 
 template<typename T0, typename T1,typename = std::enable_if_t<!is_vector_v<T0> && !is_vector_v<T1>>>
-auto	mix	(T0  d1, T1 d2, double t ) {
+constexpr auto	mix	(T0  d1, T1 d2, double t ) {
 	using scalar = double;
 	return scalar ((1-t)*scalar(d1)+t*scalar(d2));
 }
 
 template<typename T0, typename T1,typename = std::enable_if_t<!is_vector_v<T0> && !is_vector_v<T1>>>
-auto	mix	(T0  d1, T1 d2, bool t ) {
+constexpr auto	mix	(T0  d1, T1 d2, bool t ) {
 	using scalar = typename std::common_type_t<T0,T1>;
 	return t?scalar(d2):scalar(d1);
 }
 
 template<typename T0, typename T1,typename = std::enable_if_t<!is_vector_v<T0> && !is_vector_v<T1>>>
-auto step		( T0 a, T1 b ) {
+constexpr auto step		( T0 a, T1 b ) {
 	using scalar = typename std::common_type_t<T0,T1>;
 	return scalar(b)<scalar(a)?scalar(0):scalar(1);
 }
 
 template<typename T0, typename T1,typename = std::enable_if_t<!is_vector_v<T0> && !is_vector_v<T1>>>
-auto	smoothstep	(T0 xx1, T1 xx2, float yy ) {
+constexpr auto	smoothstep	(T0 xx1, T1 xx2, float yy ) {
 	using scalar = typename std::common_type_t<T0, T1, float>;
 	scalar t = clamp(scalar(yy-xx1)/scalar(xx2-xx1),scalar(0),scalar(1));
 	return t*t*(scalar(3)-scalar(2)*t);
 }
 
 template<typename T0, typename T1,typename = std::enable_if_t<!is_vector_v<T0> && !is_vector_v<T1>>>
-auto	smoothstep	(T0 xx1, T1 xx2, double yy ) {
+constexpr auto	smoothstep	(T0 xx1, T1 xx2, double yy ) {
 	using scalar = double;
 	scalar t = clamp(scalar(yy-xx1)/scalar(xx2-xx1),scalar(0),scalar(1));
 	return t*t*(scalar(3)-scalar(2)*t);
@@ -183,19 +183,19 @@ inline float  ldexp(float xx, int expr) { return xx * ::exp2f(float(expr)); }
 inline double  ldexp(double xx, int expr) { return xx * ::exp2(expr); }
 
 template<typename T0, typename T1,typename = std::enable_if_t<!is_vector_v<T0> && !is_vector_v<T1>>>
-auto fma( float a, T0 b, T1 c) {
+constexpr auto fma( float a, T0 b, T1 c) {
 	using scalar = typename std::common_type_t<float, T0, T1>;
 	return scalar(a)*scalar(b)+scalar(c);
 }
 
 template<typename T0, typename T1,typename = std::enable_if_t<!is_vector_v<T0> && !is_vector_v<T1>>>
-double fma( double a, T0 b, T1 c) {
+constexpr double fma( double a, T0 b, T1 c) {
 	using scalar = double;
 	return scalar(a)*scalar(b)+scalar(c);
 }
 
 template<typename T0, typename T1,typename = std::enable_if_t<!is_vector_v<T0> && !is_vector_v<T1>>>
-auto fma( int a, T0 b, T1 c) {
+constexpr auto fma( int a, T0 b, T1 c) {
 	using scalar = typename std::common_type_t<float, T0, T1>;
 	return scalar(a)*scalar(b)+scalar(c);
 }
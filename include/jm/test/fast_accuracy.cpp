@@ -0,0 +1,179 @@
+//
+//  fast_accuracy.cpp
+//  jm
+//
+
+// Checks jm::fast against the double precision functions and against the
+// bounds listed in fast.hpp, scalar and four lane versions on the same inputs.
+// Standalone, from the repository root:
+//
+//	g++ -std=c++17 -O2 -Iinclude include/jm/test/fast_accuracy.cpp -o fast_accuracy && ./fast_accuracy
+//
+// Add -mavx2 -mfma or -DJM_NO_SIMD to check the other paths. Exits with 1 when
+// a bound is exceeded.
+
+#include "../jm.hpp"
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace jm;
+
+static int failures = 0;
+
+enum ErrorKind { ABSOLUTE, RELATIVE };
+
+struct Result {
+	double maxError = 0, worstX = 0;
+	void add( double error, double x ) {
+		if( !(error<=maxError) ) { maxError = error; worstX = x; }		// keeps NaN
+	}
+};
+
+static void report( const char* name, const char* range, const Result& r, double bound ) {
+	bool ok = r.maxError<=bound;
+	printf( "%-18s %-24s %10.3g  (bound %.2g, worst at %.9g)%s\n", name, range, r.maxError, bound, r.worstX, ok?"":"  FAILED" );
+	if( !ok ) failures++;
+}
+
+static double error( double value, double ref, ErrorKind kind ) {
+	double e = fabs( value-ref );
+	return kind==RELATIVE?e/fabs( ref ):e;
+}
+
+// Runs 'fast' on every input, one at a time and, where available, four at a
+// time, and compares both with 'ref'.
+template<typename Fast, typename Ref
+#if defined(JM_SIMD_SSE) || defined(JM_SIMD_NEON)
+		 , typename Fast4
+#endif
+		 >
+static void check( const char* name, const char* range, const std::vector<float>& xs, double bound, ErrorKind kind, Fast fast, Ref ref
+#if defined(JM_SIMD_SSE) || defined(JM_SIMD_NEON)
+				   , Fast4 fast4
+#endif
+				   ) {
+	Result scalar;
+	for( float x: xs ) scalar.add( error( fast( x ), ref( x ), kind ), x );
+	report( name, range, scalar, bound );
+#if defined(JM_SIMD_SSE) || defined(JM_SIMD_NEON)
+	Result lanes;
+	for( size_t i=0; i+4<=xs.size(); i+=4 ) {
+		vec4 in( xs[i], xs[i+1], xs[i+2], xs[i+3] ), out;
+		simd::store( out, fast4( simd::load( in ) ) );
+		for( int l=0; l<4; l++ ) lanes.add( error( out[l], ref( in[l] ), kind ), in[l] );
+	}
+	report( (std::string( name )+" f4").c_str(), range, lanes, bound );
+#endif
+}
+
+#if defined(JM_SIMD_SSE) || defined(JM_SIMD_NEON)
+#define LANES( ... ) , __VA_ARGS__
+#else
+#define LANES( ... )
+#endif
+
+int main() {
+	const size_t N = size_t(1)<<21;
+	std::mt19937 rng( 1234 );
+	auto uniform = [&]( double a, double b ) {
+		std::vector<float> xs( N );
+		std::uniform_real_distribution<double> d( a, b );
+		for( auto& x: xs ) x = float( d( rng ) );
+		return xs;
+	};
+	// Uniform in the exponent, so every binade gets the same share.
+	auto logUniform = [&]( double a, double b ) {
+		std::vector<float> xs( N );
+		std::uniform_real_distribution<double> d( ::log( a ), ::log( b ) );
+		for( auto& x: xs ) x = float( ::exp( d( rng ) ) );
+		return xs;
+	};
+
+	check( "inversesqrt", "[1e-30, 1e30]", logUniform( 1e-30, 1e30 ), 3.6e-7, RELATIVE,
+		  []( float x ) { return fast::inversesqrt( x ); }, []( double x ) { return 1/::sqrt( x ); }
+		  LANES( []( simd::f4 x ) { return fast::inversesqrt( x ); } ) );
+
+	std::vector<float> angles = uniform( -8192, 8192 ), small = uniform( -2*PI, 2*PI );
+	angles.insert( angles.end(), small.begin(), small.end() );
+	check( "sin", "[-8192, 8192]", angles, 1.2e-7, ABSOLUTE,
+		  []( float x ) { return fast::sin( x ); }, []( double x ) { return ::sin( x ); }
+		  LANES( []( simd::f4 x ) { return fast::sin( x ); } ) );
+	check( "cos", "[-8192, 8192]", angles, 1.2e-7, ABSOLUTE,
+		  []( float x ) { return fast::cos( x ); }, []( double x ) { return ::cos( x ); }
+		  LANES( []( simd::f4 x ) { return fast::cos( x ); } ) );
+	check( "sincos, sin", "[-8192, 8192]", angles, 1.2e-7, ABSOLUTE,
+		  []( float x ) { float s, c; fast::sincos( x, s, c ); return s; }, []( double x ) { return ::sin( x ); }
+		  LANES( []( simd::f4 x ) { simd::f4 s, c; fast::sincos( x, s, c ); return s; } ) );
+	check( "sincos, cos", "[-8192, 8192]", angles, 1.2e-7, ABSOLUTE,
+		  []( float x ) { float s, c; fast::sincos( x, s, c ); return c; }, []( double x ) { return ::cos( x ); }
+		  LANES( []( simd::f4 x ) { simd::f4 s, c; fast::sincos( x, s, c ); return c; } ) );
+
+	check( "exp", "[-87.3, 88.3]", uniform( -87.3, 88.3 ), 2.4e-7, RELATIVE,
+		  []( float x ) { return fast::exp( x ); }, []( double x ) { return ::exp( x ); }
+		  LANES( []( simd::f4 x ) { return fast::exp( x ); } ) );
+	check( "log", "[0.5, 2]", uniform( .5, 2 ), 1.2e-7, ABSOLUTE,
+		  []( float x ) { return fast::log( x ); }, []( double x ) { return ::log( x ); }
+		  LANES( []( simd::f4 x ) { return fast::log( x ); } ) );
+	std::vector<float> wide = logUniform( FLT_MIN, .5 ), above = logUniform( 2, FLT_MAX );
+	wide.insert( wide.end(), above.begin(), above.end() );
+	check( "log", "normal, outside [0.5,2]", wide, 1.2e-7, RELATIVE,
+		  []( float x ) { return fast::log( x ); }, []( double x ) { return ::log( x ); }
+		  LANES( []( simd::f4 x ) { return fast::log( x ); } ) );
+
+	// atan2 over points at every angle and a wide range of radii, plus the axes.
+	{
+		std::vector<float> ys( N ), xs( N );
+		std::uniform_real_distribution<double> angle( -PI, PI ), radius( ::log( 1e-20 ), ::log( 1e20 ) );
+		for( size_t i=0; i<N; i++ ) {
+			double a = angle( rng ), r = ::exp( radius( rng ) );
+			ys[i] = float( r*::sin( a ) );
+			xs[i] = float( r*::cos( a ) );
+		}
+		float axes[][2] = { { 0, 1 }, { 1, 0 }, { 0, -1 }, { -1, 0 }, { 1, 1 }, { -1, -1 }, { 1, -1 }, { -1, 1 } };
+		for( size_t i=0; i<8; i++ ) { ys[i] = axes[i][0]; xs[i] = axes[i][1]; }
+		Result scalar;
+		for( size_t i=0; i<N; i++ ) scalar.add( fabs( fast::atan2( ys[i], xs[i] )-::atan2( double( ys[i] ), double( xs[i] ) ) ), ys[i] );
+		report( "atan2", "all angles", scalar, 2.8e-7 );
+#if defined(JM_SIMD_SSE) || defined(JM_SIMD_NEON)
+		Result lanes;
+		for( size_t i=0; i+4<=N; i+=4 ) {
+			vec4 y( ys[i], ys[i+1], ys[i+2], ys[i+3] ), x( xs[i], xs[i+1], xs[i+2], xs[i+3] ), out;
+			simd::store( out, fast::atan2( simd::load( y ), simd::load( x ) ) );
+			for( int l=0; l<4; l++ ) lanes.add( fabs( out[l]-::atan2( double( y[l] ), double( x[l] ) ) ), y[l] );
+		}
+		report( "atan2 f4", "all angles", lanes, 2.8e-7 );
+#endif
+	}
+
+	// length and normalize, relative to the exact length.
+	{
+		std::uniform_real_distribution<double> d( -1e3, 1e3 );
+		Result len, nrm;
+		for( size_t i=0; i<N; i++ ) {
+			vec3 v( float( d( rng ) ), float( d( rng ) ), float( d( rng ) ) );
+			double l = ::sqrt( double( v.x )*v.x+double( v.y )*v.y+double( v.z )*v.z );
+			len.add( fabs( fast::length( v )-l )/l, l );
+			vec3 n = fast::normalize( v );
+			for( int c=0; c<3; c++ ) nrm.add( fabs( n[c]-v[c]/l ), l );
+		}
+		report( "length", "|v_i| <= 1e3", len, 3.6e-7 );
+		report( "normalize", "|v_i| <= 1e3", nrm, 3.6e-7 );
+		if( fast::length( vec3( 0 ) )!=0 || fast::normalize( vec3( 0 ) )!=vec3( 0 ) ) {
+			printf( "length/normalize of a zero vector is not zero  FAILED\n" );
+			failures++;
+		}
+	}
+
+	// Outside the range exp clamps instead of overflowing.
+	if( fast::exp( -100.f )!=fast::exp( -87.3f ) || fast::exp( 100.f )!=fast::exp( 88.3f ) || !std::isfinite( fast::exp( 100.f ) ) ) {
+		printf( "exp does not clamp  FAILED\n" );
+		failures++;
+	}
+
+	printf( failures?"%d checks FAILED\n":"all within bounds\n", failures );
+	return failures?1:0;
+}
@@ -13,7 +13,7 @@
 namespace jm {
 
 template<typename T, typename=std::enable_if_t< is_length_v<T, 3> && is_floatd_v<T>> >
-auto translate( const T& v ) {
+constexpr auto translate( const T& v ) {
 	using elmType = vec_element<T>;
 	mmat_t<elmType,4,4> ret(1);
 	ret[3]=mvec4_t<elmType>(v,1);
@@ -21,7 +21,7 @@ auto translate( const T& v ) {
 }
 
 template<typename T0, typename T,typename=std::enable_if_t< is_length_v<T, 3> && is_floatd_v<T>>>
-auto translate( const mmat_t<T0,4,4>& m, const T& v ) {
+constexpr auto translate( const mmat_t<T0,4,4>& m, const T& v ) {
 	mmat_t<T0,4,4> ret = m;
 	ret[3] = m[0] * v[0] + m[1] * v[1] + m[2] * v[2] + m[3];
 	return ret;
@@ -95,12 +95,12 @@ auto rotate( const mmat_t<T0,4,4>& m, const T& v) {
 }
 
 template<typename T,typename=std::enable_if_t< is_length_v<T, 3> && is_floatd_v<T>>>
-auto scale( const T& v ) {
+constexpr auto scale( const T& v ) {
 	return mmat_t<vec_element<T>,4,4>(v[0],0,0,0, 0,v[1],0,0, 0,0,v[2],0, 0,0,0,1);
 }
 
 template<typename T0, typename T,typename=std::enable_if_t< !is_vector_v<T0> && is_length_v<T, 3> && is_floatd_v<T>>>
-auto scale( const mmat_t<T0,4,4>& m, const T& v ) {
+constexpr auto scale( const mmat_t<T0,4,4>& m, const T& v ) {
 	mmat_t<T0,4,4> ret;
 	ret[0] = m[0] * v[0];
 	ret[1] = m[1] * v[1];
@@ -110,7 +110,7 @@ auto scale( const mmat_t<T0,4,4>& m, const T& v ) {
 }
 
 template<typename T0, typename T1, typename T2, typename T3, typename T4, typename T5>
-auto frustum(T0 left, T1 right, T2 bottom, T3 top, T4 zNear, T5 zFar) {
+constexpr auto frustum(T0 left, T1 right, T2 bottom, T3 top, T4 zNear, T5 zFar) {
 	using scalar = float;
 	const scalar l=scalar(left);
 	const scalar r=scalar(right);
@@ -126,7 +126,7 @@ auto frustum(T0 left, T1 right, T2 bottom, T3 top, T4 zNear, T5 zFar) {
 }
 
 template<typename T0, typename T1, typename T2, typename T3, typename T4, typename T5>
-auto ortho(T0 left, T1 right, T2 bottom, T3 top, T4 zNear, T5 zFar) {
+constexpr auto ortho(T0 left, T1 right, T2 bottom, T3 top, T4 zNear, T5 zFar) {
 	using scalar = float;
 	const scalar l=scalar(left);
 	const scalar r=scalar(right);
@@ -148,10 +148,12 @@ auto lookAt(T0 const& eye, T1 const& center, T2 const& up) {
 	mvec3_t<scalar> U = normalize( up );
 	mvec3_t<scalar> s = normalize( cross( f, U ) );
 	mvec3_t<scalar> u = cross( s, f );
+	// The rotation times translate(-eye), with the translation folded in directly.
+	mvec3_t<scalar> e( eye );
 	return mmat_t<scalar,4,4>(s[0],u[0],-f[0],0,
 							  s[1],u[1],-f[1],0,
 							  s[2],u[2],-f[2],0,
-							  0,0,0,1) * translate(-eye);
+							  -dot(s,e),-dot(u,e),dot(f,e),1);
 }
 
 template<typename T0, typename T1, typename T2, typename T3, typename T4, typename T5, typename T6, typename T7, typename T8>
@@ -160,7 +162,7 @@ auto lookAt(T0 eyeX, T1 eyeY, T2 eyeZ, T3 centerX, T4 centerY, T5 centerZ, T6 up
 }
 
 template<typename T0, typename T1, typename T2, typename T3>
-auto ortho2D(T0 left, T1 right, T2 bottom, T3 top) {
+constexpr auto ortho2D(T0 left, T1 right, T2 bottom, T3 top) {
 	return ortho(left,right,bottom,top,-1,1);
 }
 
@@ -11,6 +11,14 @@
 #include <math.h>
 #include <type_traits>
 
+// True while the compiler evaluates a constant expression. Element access then
+// has to go through x,y,z,w, the union members that are actually active.
+#if (defined(__GNUC__) && __GNUC__>=9) || defined(__clang__) || (defined(_MSC_VER) && _MSC_VER>=1925)
+#define JM_CONSTANT_EVALUATED() __builtin_is_constant_evaluated()
+#else
+#define JM_CONSTANT_EVALUATED() false
+#endif
+
 namespace jm {
 
 typedef float scalar_t;
@@ -389,6 +397,15 @@ GEN_SWIZZLE_DEF_4_(mvec4_wwyx,4,3,3,1,0);	GEN_SWIZZLE_DEF_4_(mvec4_wwyy,4,3,3,1,
 GEN_SWIZZLE_DEF_4_(mvec4_wwzx,4,3,3,2,0);	GEN_SWIZZLE_DEF_4_(mvec4_wwzy,4,3,3,2,1);	GEN_SWIZZLE_DEF_4_(mvec4_wwzz,4,3,3,2,2);	GEN_SWIZZLE_DEF_4_(mvec4_wwzw,4,3,3,2,3);
 GEN_SWIZZLE_DEF_4_(mvec4_wwwx,4,3,3,3,0);	GEN_SWIZZLE_DEF_4_(mvec4_wwwy,4,3,3,3,1);	GEN_SWIZZLE_DEF_4_(mvec4_wwwz,4,3,3,3,2);	GEN_SWIZZLE_DEF_4_(mvec4_wwww,4,3,3,3,3);
 
+// I-th element of the arguments laid end to end; a lone scalar is broadcast.
+template<int I, typename A> constexpr auto _elem_( const A& a ) {
+	if constexpr ( is_vector_v<A> )	return a[I];
+	else							return a;
+}
+template<int I, typename A, typename... R> constexpr auto _cat_( const A& a, const R&... r ) {
+	if constexpr ( I<vec_length<A> || sizeof...(R)==0 )	return _elem_<I>( a );
+	else												return _cat_<I-vec_length<A>>( r... );
+}
 
 template<typename T> struct mvec2_t {
 	union {
@@ -429,42 +446,42 @@ template<typename T> struct mvec2_t {
 	};
 	using TYPE = mvec2_t<T>;
 	
-	mvec2_t(): x(0),y(0) {}
+	constexpr mvec2_t(): x(0),y(0) {}
 	template<typename T1>
-	mvec2_t(const T1& v);
+	constexpr mvec2_t(const T1& v);
 	
 	template<typename T1,typename T2,typename=std::enable_if_t<!is_vector_v<T1>&&!is_vector_v<T2>>>
-	mvec2_t(T1 _x, T2 _y): x(T(_x)), y(T(_y)) {}
+	constexpr mvec2_t(T1 _x, T2 _y): x(T(_x)), y(T(_y)) {}
 	
-	T& operator [] (int n) { return v[n]; }
-	const T& operator [] (int n) const { return v[n]; }
-	size_t length() const { return 2; }
+	constexpr T& operator [] (int n) { if( JM_CONSTANT_EVALUATED() ) return n==0?x:y; return v[n]; }
+	constexpr const T& operator [] (int n) const { if( JM_CONSTANT_EVALUATED() ) return n==0?x:y; return v[n]; }
+	constexpr size_t length() const { return 2; }
 
 	template<typename F,typename=std::enable_if_t<!is_vector_v<F> || (vec_length<F> ==2 && is_same_element_v<TYPE,F>)>>
-	TYPE& operator+=(const F& f) {
+	constexpr TYPE& operator+=(const F& f) {
 		if constexpr( is_vector_v<F> )	{ x+=f[0]; y+=f[1]; return *this; }
 		else							{ x+=f; y+=f; return *this; }
 	}
 	template<typename F,typename=std::enable_if_t<!is_vector_v<F> || (vec_length<F> ==2 && is_same_element_v<TYPE,F>)>>
-	TYPE& operator-=(const F& f) {
+	constexpr TYPE& operator-=(const F& f) {
 		if constexpr( is_vector_v<F> )	{ x-=f[0]; y-=f[1]; return *this; }
 		else							{ x-=f; y-=f; return *this; }
 	}
 	template<typename F,typename=std::enable_if_t<!is_vector_v<F> || (vec_length<F> ==2 && is_same_element_v<TYPE,F>)>>
-	TYPE& operator*=(const F& f) {
+	constexpr TYPE& operator*=(const F& f) {
 		if constexpr( is_vector_v<F> )	{ x*=f[0]; y*=f[1]; return *this; }
 		else							{ x*=f; y*=f; return *this; }
 	}
 	template<typename F,typename=std::enable_if_t<!is_vector_v<F> || (vec_length<F> ==2 && is_same_element_v<TYPE,F>)>>
-	TYPE& operator/=(const F& f) {
+	constexpr TYPE& operator/=(const F& f) {
 		if constexpr( is_vector_v<F> )	{ x/=f[0]; y/=f[1]; return *this; }
 		else							{ x/=f; y/=f; return *this; }
 	}
 	
-	TYPE& operator++() { x+=1; y+=1; return *this; }
-	TYPE& operator--() { x-=1; y-=1; return *this; }
-	TYPE operator++(int) { TYPE a=*this; operator++(); return a; }
-	TYPE operator--(int) { TYPE a=*this; operator--(); return a; }
+	constexpr TYPE& operator++() { x+=1; y+=1; return *this; }
+	constexpr TYPE& operator--() { x-=1; y-=1; return *this; }
+	constexpr TYPE operator++(int) { TYPE a=*this; operator++(); return a; }
+	constexpr TYPE operator--(int) { TYPE a=*this; operator--(); return a; }
 };
 
 template<typename T> struct mvec3_t {
@@ -597,46 +614,46 @@ template<typename T> struct mvec3_t {
 	
 	using TYPE = mvec3_t<T>;
 		
-	mvec3_t(): x(0),y(0),z(0) {}
+	constexpr mvec3_t(): x(0),y(0),z(0) {}
 	template<typename T1,typename=std::enable_if_t<!is_vector_v<T1>||vec_length<T1> ==3||vec_length<T1> ==4 >>
-	mvec3_t(const T1& a);
+	constexpr mvec3_t(const T1& a);
 	
 	template<typename T1,typename T2,typename=std::enable_if_t<vec_length<T1>+vec_length<T2> == 3>>
-	mvec3_t(const T1& a, const T2& b);
+	constexpr mvec3_t(const T1& a, const T2& b);
 	
 	template<typename T1,typename T2,typename T3,typename=std::enable_if_t<!is_vector_v<T1>&&!is_vector_v<T2>&&!is_vector_v<T3>>>
-	mvec3_t(T1 _x, T2 _y, T3 _z): x(T(_x)), y(T(_y)), z(T(_z)) {}
+	constexpr mvec3_t(T1 _x, T2 _y, T3 _z): x(T(_x)), y(T(_y)), z(T(_z)) {}
 
 
-	T& operator [] (int n) { return v[n]; }
-	const T& operator [] (int n) const { return v[n]; }
-	size_t length() const { return 3; }
+	constexpr T& operator [] (int n) { if( JM_CONSTANT_EVALUATED() ) return n==0?x:n==1?y:z; return v[n]; }
+	constexpr const T& operator [] (int n) const { if( JM_CONSTANT_EVALUATED() ) return n==0?x:n==1?y:z; return v[n]; }
+	constexpr size_t length() const { return 3; }
 
 	template<typename F,typename=std::enable_if_t<!is_vector_v<F> || (vec_length<F> ==3 && is_same_element_v<TYPE,F>)>>
-	TYPE& operator+=(const F& f) {
+	constexpr TYPE& operator+=(const F& f) {
 		if constexpr( is_vector_v<F> )	{ x+=f[0]; y+=f[1]; z+=f[2]; return *this; }
 		else							{ x+=f; y+=f; z+=f; return *this; }
 	}
 	template<typename F,typename=std::enable_if_t<!is_vector_v<F> || (vec_length<F> ==3 && is_same_element_v<TYPE,F>)>>
-	TYPE& operator-=(const F& f) {
+	constexpr TYPE& operator-=(const F& f) {
 		if constexpr( is_vector_v<F> )	{ x-=f[0]; y-=f[1]; z-=f[2]; return *this; }
 		else							{ x-=f; y-=f; z-=f; return *this; }
 	}
 	template<typename F,typename=std::enable_if_t<!is_vector_v<F> || (vec_length<F> ==3 && is_same_element_v<TYPE,F>)>>
-	TYPE& operator*=(const F& f) {
+	constexpr TYPE& operator*=(const F& f) {
 		if constexpr( is_vector_v<F> )	{ x*=f[0]; y*=f[1]; z*=f[2]; return *this; }
 		else							{ x*=f; y*=f; z*=f; return *this; }
 	}
 	template<typename F,typename=std::enable_if_t<!is_vector_v<F> || (vec_length<F> ==3 && is_same_element_v<TYPE,F>)>>
-	TYPE& operator/=(const F& f) {
+	constexpr TYPE& operator/=(const F& f) {
 		if constexpr( is_vector_v<F> )	{ x/=f[0]; y/=f[1]; z/=f[2]; return *this; }
 		else							{ x/=f; y/=f; z/=f; return *this; }
 	}
 
-	TYPE& operator++() { x+=1; y+=1; z+=1; return *this; }
-	TYPE& operator--() { x-=1; y-=1; z-=1; return *this; }
-	TYPE operator++(int) { TYPE a=*this; operator++(); return a; }
-	TYPE operator--(int) { TYPE a=*this; operator--(); return a; }
+	constexpr TYPE& operator++() { x+=1; y+=1; z+=1; return *this; }
+	constexpr TYPE& operator--() { x-=1; y-=1; z-=1; return *this; }
+	constexpr TYPE operator++(int) { TYPE a=*this; operator++(); return a; }
+	constexpr TYPE operator--(int) { TYPE a=*this; operator--(); return a; }
 };
 
 template<typename T> struct mvec4_t {
@@ -985,120 +1002,71 @@ template<typename T> struct mvec4_t {
 	};
 	using TYPE = mvec4_t<T>;
 	
-	mvec4_t(): x(0),y(0),z(0),w(0) {}
+	constexpr mvec4_t(): x(0),y(0),z(0),w(0) {}
 	template<typename T1,typename=std::enable_if_t<!is_vector_v<T1>||vec_length<T1> ==4>>
-	mvec4_t(const T1& a);
+	constexpr mvec4_t(const T1& a);
 	
 	template<typename T1,typename T2,typename=std::enable_if_t<vec_length<T1>+vec_length<T2> ==4 >>
-	mvec4_t(const T1& a, const T2& b);
+	constexpr mvec4_t(const T1& a, const T2& b);
 	
 	template<typename T1,typename T2,typename T3, typename=std::enable_if_t<vec_length<T1>+vec_length<T2>+vec_length<T3> ==4 >>
-	mvec4_t(const T1& a, const T2& b, const T3& c );
+	constexpr mvec4_t(const T1& a, const T2& b, const T3& c );
 	
 	template<typename T1,typename T2,typename T3,typename T4,typename=std::enable_if_t<!is_vector_v<T1>&&!is_vector_v<T2>&&!is_vector_v<T3>&&!is_vector_v<T4>>>
-	inline mvec4_t(T1 _x, T2 _y, T3 _z, T4 _w): x(T(_x)), y(T(_y)), z(T(_z)), w(T(_w))  {}
+	constexpr mvec4_t(T1 _x, T2 _y, T3 _z, T4 _w): x(T(_x)), y(T(_y)), z(T(_z)), w(T(_w))  {}
 
 	
 //	template<typename T2> mvec4_t(const mvec4_t<T2>& a):x(static_cast<T>(a.x)),y(static_cast<T>(a.y)),z(static_cast<T>(a.z)),w(static_cast<T>(a.w)){}
 	
-	T& operator [] (int n) { return v[n]; }
-	const T& operator [] (int n) const { return v[n]; }
-	size_t length() const { return 4; }
+	constexpr T& operator [] (int n) { if( JM_CONSTANT_EVALUATED() ) return n==0?x:n==1?y:n==2?z:w; return v[n]; }
+	constexpr const T& operator [] (int n) const { if( JM_CONSTANT_EVALUATED() ) return n==0?x:n==1?y:n==2?z:w; return v[n]; }
+	constexpr size_t length() const { return 4; }
 	
 	template<typename F,typename=std::enable_if_t<!is_vector_v<F> || (vec_length<F> ==4 && is_same_element_v<TYPE,F>)>>
-	TYPE& operator+=(const F& f) {
+	constexpr TYPE& operator+=(const F& f) {
 		if constexpr( is_vector_v<F> )	{ x+=f[0]; y+=f[1]; z+=f[2]; w+=f[3]; return *this; }
 		else							{ x+=f; y+=f; z+=f; w+=f; return *this; }
 	}
 	template<typename F,typename=std::enable_if_t<!is_vector_v<F> || (vec_length<F> ==4 && is_same_element_v<TYPE,F>)>>
-	TYPE& operator-=(const F& f) {
+	constexpr TYPE& operator-=(const F& f) {
 		if constexpr( is_vector_v<F> )	{ x-=f[0]; y-=f[1]; z-=f[2]; w-=f[3]; return *this; }
 		else							{ x-=f; y-=f; z-=f; w-=f; return *this; }
 	}
 	template<typename F,typename=std::enable_if_t<!is_vector_v<F> || (vec_length<F> ==4 && is_same_element_v<TYPE,F>)>>
-	TYPE& operator*=(const F& f) {
+	constexpr TYPE& operator*=(const F& f) {
 		if constexpr( is_vector_v<F> )	{ x*=f[0]; y*=f[1]; z*=f[2]; w*=f[3]; return *this; }
 		else							{ x*=f; y*=f; z*=f; w*=f; return *this; }
 	}
 	template<typename F,typename=std::enable_if_t<!is_vector_v<F> || (vec_length<F> ==4 && is_same_element_v<TYPE,F>)>>
-	TYPE& operator/=(const F& f) {
+	constexpr TYPE& operator/=(const F& f) {
 		if constexpr( is_vector_v<F> )	{ x/=f[0]; y/=f[1]; z/=f[2]; w/=f[3]; return *this; }
 		else							{ x/=f; y/=f; z/=f; w/=f; return *this; }
 	}
 
-	TYPE& operator++() { x+=1; y+=1; z+=1; w+=1; return *this; }
-	TYPE& operator--() { x-=1; y-=1; z-=1; w-=1; return *this; }
-	TYPE operator++(int) { TYPE a=*this; operator++(); return a; }
-	TYPE operator--(int) { TYPE a=*this; operator--(); return a; }
+	constexpr TYPE& operator++() { x+=1; y+=1; z+=1; w+=1; return *this; }
+	constexpr TYPE& operator--() { x-=1; y-=1; z-=1; w-=1; return *this; }
+	constexpr TYPE operator++(int) { TYPE a=*this; operator++(); return a; }
+	constexpr TYPE operator--(int) { TYPE a=*this; operator--(); return a; }
 };
 
 
 template<typename T> template<typename T1>
-inline mvec2_t<T>::mvec2_t(const T1& a) {
-	if constexpr ( !is_vector_v<T1> ) {
-		x = T(a); y = T(a);
-	}
-	else {
-		x = T(a[0]); y = T(a[1]);
-	}
-}
+constexpr mvec2_t<T>::mvec2_t(const T1& a): mvec2_t( _cat_<0>(a), _cat_<1>(a) ) {}
+
 template<typename T> template<typename T1,typename>
-inline mvec3_t<T>::mvec3_t(const T1& a){
-	if constexpr ( !is_vector_v<T1> ) {
-		x = T(a); y = T(a); z = T(a);
-	}
-	else {
-		x = T(a[0]); y = T(a[1]); z = T(a[2]);
-	}
-}
+constexpr mvec3_t<T>::mvec3_t(const T1& a): mvec3_t( _cat_<0>(a), _cat_<1>(a), _cat_<2>(a) ) {}
 
 template<typename T> template<typename T1, typename T2, typename>
-inline mvec3_t<T>::mvec3_t(const T1& a, const T2& b){
-	if constexpr ( !is_vector_v<T1> ) {
-		x = T(a); y = T(b[0]); z = T(b[1]);
-	}
-	else {
-		x = T(a[0]); y = T(a[1]); z = T(b);
-	}
-}
+constexpr mvec3_t<T>::mvec3_t(const T1& a, const T2& b): mvec3_t( _cat_<0>(a,b), _cat_<1>(a,b), _cat_<2>(a,b) ) {}
 
 template<typename T> template<typename T1,typename>
-inline mvec4_t<T>::mvec4_t(const T1& a){
-	if constexpr ( !is_vector_v<T1> ) {
-		x = T(a); y = T(a); z = T(a); w = T(a);
-	}
-	else {
-		x = T(a[0]); y = T(a[1]); z = T(a[2]); w = T(a[3]);
-	}
-}
+constexpr mvec4_t<T>::mvec4_t(const T1& a): mvec4_t( _cat_<0>(a), _cat_<1>(a), _cat_<2>(a), _cat_<3>(a) ) {}
 
 template<typename T> template<typename T1, typename T2,typename>
-inline mvec4_t<T>::mvec4_t(const T1& a, const T2& b){
-	if constexpr ( !is_vector_v<T1> ) {
-		x = T(a); y = T(b[0]); z = T(b[1]); w = T(b[2]);
-	}
-	else if constexpr ( vec_length<T1> == 2) {
-		x = T(a[0]); y = T(a[1]); z = T(b[0]); w = T(b[1]);
-	}
-	else {
-		x = T(a[0]); y = T(a[1]); z = T(a[2]); w = T(b);
-	}
-}
+constexpr mvec4_t<T>::mvec4_t(const T1& a, const T2& b): mvec4_t( _cat_<0>(a,b), _cat_<1>(a,b), _cat_<2>(a,b), _cat_<3>(a,b) ) {}
 
 template<typename T> template<typename T1, typename T2, typename T3,typename>
-inline mvec4_t<T>::mvec4_t(const T1& a, const T2& b, const T3& c){
-	if constexpr ( !is_vector_v<T1> ) {
-		if constexpr ( !is_vector_v<T2> ) {
-			x = T(a); y = T(b); z = T(c[0]); w = T(c[1]);
-		}
-		else {
-			x = T(a); y = T(b[0]); z = T(b[1]); w = T(c);
-		}
-	}
-	else {
-		x = T(a[0]); y = T(a[1]); z = T(b); w = T(c);
-	}
-}
+constexpr mvec4_t<T>::mvec4_t(const T1& a, const T2& b, const T3& c): mvec4_t( _cat_<0>(a,b,c), _cat_<1>(a,b,c), _cat_<2>(a,b,c), _cat_<3>(a,b,c) ) {}
 
 
 
@@ -1372,8 +1340,9 @@ template<typename T> vec_element<T>* value_ptr(T& a) {
 
 #define GEN_OPERATOR( OP ) \
 template<typename T1, typename T2, \
-typename=std::enable_if_t<(!is_vector_v<T1>||!is_vector_v<T2>||is_same_length_v<T1,T2>)&&(is_vector_v<T1>||is_vector_v<T2>)>> \
-auto operator OP ( const T1& a, const T2& b ) { \
+typename=std::enable_if_t<(!is_vector_v<T1>||!is_vector_v<T2>||is_same_length_v<T1,T2>)&&(is_vector_v<T1>||is_vector_v<T2>) \
+&&(is_vector_v<T1>||std::is_arithmetic_v<T1>)&&(is_vector_v<T2>||std::is_arithmetic_v<T2>)>> \
+constexpr auto operator OP ( const T1& a, const T2& b ) { \
 	if constexpr ( is_vector_v<T1> ) { \
 		if constexpr ( is_vector_v<T2> ) { \
 			using scalar = common_element_type_t<T1,T2>; \
@@ -1402,25 +1371,25 @@ GEN_OPERATOR( * );
 GEN_OPERATOR( / );
 
 template<typename T, typename=std::enable_if_t<is_vector_v<T>>>
-auto operator - ( const T& a ) {
+constexpr auto operator - ( const T& a ) {
 	if constexpr ( vec_length<T> == 4)		return comp_vec_type_t<T>(-a[0],-a[1],-a[2],-a[3]);
 	else if constexpr ( vec_length<T> == 3)	return comp_vec_type_t<T>(-a[0],-a[1],-a[2]);
 	else									return comp_vec_type_t<T>(-a[0],-a[1]);
 }
 template<typename T, typename=std::enable_if_t<is_vector_v<T>>>
-auto operator + ( const T& a ) {
+constexpr auto operator + ( const T& a ) {
 	if constexpr ( vec_length<T> == 4)		return comp_vec_type_t<T>(a[0],a[1],a[2],a[3]);
 	else if constexpr ( vec_length<T> == 3) return comp_vec_type_t<T>(a[0],a[1],a[2]);
 	else									return comp_vec_type_t<T>(a[0],a[1]);
 }
 template<typename T1,typename T2, typename=std::enable_if_t<is_vector_v<T1> && is_same_length_v<T1, T2>>>
-auto operator == ( const T1& a, const T2& b ) { \
+constexpr auto operator == ( const T1& a, const T2& b ) {
 	if constexpr ( vec_length<T1> == 4)		return a[0]==b[0]&&a[1]==b[1]&&a[2]==b[2]&&a[3]==b[3];
 	else if constexpr ( vec_length<T1> ==3)	return a[0]==b[0]&&a[1]==b[1]&&a[2]==b[2];
 	else									return a[0]==b[0]&&a[1]==b[1];
 }
 template<typename T1,typename T2, typename=std::enable_if_t<is_vector_v<T1> && is_same_length_v<T1, T2>>>
-auto operator != ( const T1& a, const T2& b ) { \
+constexpr auto operator != ( const T1& a, const T2& b ) {
 	if constexpr ( vec_length<T1> ==4)		return a[0]!=b[0]||a[1]!=b[1]||a[2]!=b[2]||a[3]!=b[3];
 	else if constexpr ( vec_length<T1> ==3)	return a[0]!=b[0]||a[1]!=b[1]||a[2]!=b[2];
 	else									return a[0]!=b[0]||a[1]!=b[1];
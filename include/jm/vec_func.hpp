@@ -15,7 +15,7 @@ namespace jm {
 
 #define GEN_UNARY_V__V_FUNC( FUN_NAME, TYPE_COND ) \
 template<typename T, typename = std::enable_if_t<TYPE_COND && is_vector_v<T>> > \
-auto FUN_NAME ( const T& x ) { \
+constexpr auto FUN_NAME ( const T& x ) { \
 	if constexpr( vec_length<T> ==4 )		{ return comp_vec_type_t<T>(FUN_NAME(x[0]),FUN_NAME(x[1]),FUN_NAME(x[2]),FUN_NAME(x[3])); } \
 	else if constexpr( vec_length<T> ==3 )	{ return comp_vec_type_t<T>(FUN_NAME(x[0]),FUN_NAME(x[1]),FUN_NAME(x[2])); } \
 	else									{ return comp_vec_type_t<T>(FUN_NAME(x[0]),FUN_NAME(x[1])); } \
@@ -23,7 +23,7 @@ auto FUN_NAME ( const T& x ) { \
 
 #define GEN_BINARY_V_V__V_FUNC( FUN_NAME, TYPE_COND ) \
 template<typename T1,typename T2, typename=std::enable_if_t<TYPE_COND && is_vector_v<T1> && is_same_length_v<T1,T2> > > \
-auto FUN_NAME ( const T1& x, const T2& y ) { \
+constexpr auto FUN_NAME ( const T1& x, const T2& y ) { \
 	using scalar = common_element_type_t<T1,T2>; \
 	if constexpr( vec_length<T1> == 4 )		{ return vec_type_t<scalar,4>(FUN_NAME(x[0],y[0]),FUN_NAME(x[1],y[1]),FUN_NAME(x[2],y[2]),FUN_NAME(x[3],y[3])); } \
 	else if constexpr( vec_length<T1> ==3 )	{ return vec_type_t<scalar,3>(FUN_NAME(x[0],y[0]),FUN_NAME(x[1],y[1]),FUN_NAME(x[2],y[2])); } \
@@ -32,7 +32,7 @@ auto FUN_NAME ( const T1& x, const T2& y ) { \
 
 #define GEN_BINARY_V_VS_V_FUNC( FUN_NAME, TYPE_COND ) \
 template<typename T1, typename T2, typename=std::enable_if_t<TYPE_COND&&is_vector_v<T1> && (!is_vector_v<T2>||is_same_length_v<T1,T2>)> > \
-auto FUN_NAME ( const T1& x, const T2& y ) { \
+constexpr auto FUN_NAME ( const T1& x, const T2& y ) { \
 	if constexpr ( is_vector_v<T2> ) { \
 		using scalar = common_element_type_t<T1,T2>; \
 		if constexpr( vec_length<T1> == 4 )		{ return vec_type_t<scalar,4>(FUN_NAME(x[0],y[0]),FUN_NAME(x[1],y[1]),FUN_NAME(x[2],y[2]),FUN_NAME(x[3],y[3])); } \
@@ -50,7 +50,7 @@ auto FUN_NAME ( const T1& x, const T2& y ) { \
 #define GEN_BINARY_VS_VS_V_FUNC( FUN_NAME, TYPE_COND ) \
 template<typename T1,typename T2, \
 typename=std::enable_if_t<(!is_vector_v<T1>||!is_vector_v<T2>||is_same_length_v<T1,T2>)&&(is_vector_v<T1>||is_vector_v<T2>)>> \
-auto FUN_NAME ( const T1& x, const T2& y ) { \
+constexpr auto FUN_NAME ( const T1& x, const T2& y ) { \
 	if constexpr ( is_vector_v<T1> ) { \
 		if constexpr ( is_vector_v<T2> ) { \
 			using scalar = common_element_type_t<T1,T2>; \
@@ -75,7 +75,7 @@ auto FUN_NAME ( const T1& x, const T2& y ) { \
 
 #define GEN_BINARY_V__B_FUNC( FUN_NAME, TYPE_COND ) \
 template<typename T,typename=std::enable_if_t<TYPE_COND && is_vector_v<T>> > \
-auto FUN_NAME ( const T& x ) { \
+constexpr auto FUN_NAME ( const T& x ) { \
 	if constexpr( vec_length<T> == 4 ) 		{ return comp_vec_type_t<T>(FUN_NAME(x[0]),FUN_NAME(x[1]),FUN_NAME(x[2]),FUN_NAME(x[3])); } \
 	else if constexpr( vec_length<T> == 3 ) { return comp_vec_type_t<T>(FUN_NAME(x[0]),FUN_NAME(x[1]),FUN_NAME(x[2])); } \
 	else									{ return comp_vec_type_t<T>(FUN_NAME(x[0]),FUN_NAME(x[1])); } \
@@ -142,13 +142,13 @@ GEN_BINARY_VS_VS_V_FUNC( min, is_number_v<T1> );
 GEN_BINARY_VS_VS_V_FUNC( max, is_number_v<T1> );
 
 template<typename T1,typename T2,typename T3, typename=std::enable_if_t<is_vector_v<T1> || is_vector_v<T2> || is_vector_v<T3>> >
-auto clamp ( const T1& x, const T2& minVal, const T3& maxVal ) {
+constexpr auto clamp ( const T1& x, const T2& minVal, const T3& maxVal ) {
 	return min(max(x, minVal), maxVal);
 }
 
 template<typename T1,typename T2,typename T3,
 typename=std::enable_if_t<(is_vector_v<T1> || is_vector_v<T3>) && is_same_length_v<T1,T2> && is_floatd_v<T1>> >
-auto mix ( const T1& x, const T2& y, const T3& a ) {
+constexpr auto mix ( const T1& x, const T2& y, const T3& a ) {
 	if constexpr ( is_element_type_v<T3, bool> ) {
 		if constexpr ( is_vector_v<T3> )	{
 			if constexpr( vec_length<T3> ==4 )		return common_vec_type_t<T1,T2>(a[0]?y[0]:x[0],a[1]?y[1]:x[1],a[2]?y[2]:x[2],a[3]?y[3]:x[3]);
@@ -170,7 +170,7 @@ template<typename T1,typename T2, typename T3,
 typename=std::enable_if_t<(is_vector_v<T1> || is_vector_v<T2> || is_vector_v<T3>)
 && is_same_length_v<T2,T3>
 && ( !is_vector_v<T1> || !is_vector_v<T2> || is_same_length_v<T1,T2> )>>
-auto smoothstep ( const T2& x1, const T3& x2, const T1& y ) { \
+constexpr auto smoothstep ( const T2& x1, const T3& x2, const T1& y ) { \
 	if constexpr ( is_vector_v<T2> ) {
 		using vecType = comp_vec_type_t<T2>;
 		auto t = clamp((y-x1)/(x2-x1),vecType(0),vecType(1));
@@ -219,7 +219,7 @@ auto uintBitsToFloat(const T& v) {
 
 template<typename T,typename T2, typename T3,
 typename=std::enable_if_t<is_vector_v<T> && is_same_length_v<T,T2> && is_same_length_v<T,T3> && is_floatd_v<T> >>
-auto fma(const T& a, const T2& b, const T3& c) {
+constexpr auto fma(const T& a, const T2& b, const T3& c) {
 	return a*b+c;
 }
 
@@ -264,7 +264,7 @@ auto ldexp(const T0& x, const T1& expr) {
 // ********************************
 
 template<typename T0,typename T1,typename=std::enable_if_t<is_same_length_v<T0,T1>>>
-auto dot ( const T0& x, const T1& y ) {
+constexpr auto dot ( const T0& x, const T1& y ) {
 	using scalar = common_element_type_t<T0,T1>;
 	if constexpr ( is_vector_v<T0> ) {
 		if constexpr( vec_length<T0> ==4 )		return scalar(x[0]*y[0]+x[1]*y[1]+x[2]*y[2]+x[3]*y[3]);
@@ -290,7 +290,7 @@ auto normalize(const T& x) {
 }
 
 template<typename T0,typename T1,typename=std::enable_if_t<is_length_v<T0,3> && is_length_v<T1,3>>>
-auto cross(const T0& a, const T1& b) {
+constexpr auto cross(const T0& a, const T1& b) {
 	using scalar = common_element_type_t<T0,T1>;
 	return vec_type_t<scalar,3>(scalar(a[1]) * scalar(b[2]) - scalar(a[2]) * scalar(b[1]),
 								scalar(a[2]) * scalar(b[0]) - scalar(a[0]) * scalar(b[2]),
@@ -298,13 +298,13 @@ auto cross(const T0& a, const T1& b) {
 }
 
 template<typename T1,typename T2,typename T3,typename=std::enable_if_t<is_vector_v<T2> && is_same_length_v<T2,T3>> >
-comp_vec_type_t<T1> faceforward(const T1& N, const T2& I, const T3& ref) {
+constexpr comp_vec_type_t<T1> faceforward(const T1& N, const T2& I, const T3& ref) {
 	comp_vec_type_t<T1> n=N;
 	return dot(ref,I)<0?n:-n;
 }
 
 template<typename T1,typename T2,typename=std::enable_if_t<is_vector_v<T1> && is_same_length_v<T1,T2>>>
-comp_vec_type_t<T1> reflect(const T1& I, const T2& N) {
+constexpr comp_vec_type_t<T1> reflect(const T1& I, const T2& N) {
 	using scalar = std::common_type_t<vec_element<T1>,vec_element<T2>>;
 	using vecType = vec_type_t<scalar,vec_length<T1>>;
 	vecType n = N;
@@ -330,7 +330,7 @@ comp_vec_type_t<T1> refract(const T1& I, const T2& N, T3 eta) {
 
 #define GEN_BINARY_V_V__B_FUNC( FUN_NAME, TYPE_COND ) \
 template<typename T0,typename T1,typename=std::enable_if_t<TYPE_COND && is_vector_v<T0> && is_same_length_v<T0,T1>>> \
-auto FUN_NAME ( const T0& x, const T1& y ) { \
+constexpr auto FUN_NAME ( const T0& x, const T1& y ) { \
 	if constexpr ( vec_length<T0> ==4 ) \
 		return vec_type_t<bool,vec_length<T0>>(FUN_NAME(x[0],y[0]),FUN_NAME(x[1],y[1]),FUN_NAME(x[2],y[2]),FUN_NAME(x[3],y[3])); \
 	else if constexpr ( vec_length<T0> ==3 ) \
@@ -347,7 +347,7 @@ GEN_BINARY_V_V__B_FUNC( equal,				is_number_v<T0> && is_number_v<T1> );
 GEN_BINARY_V_V__B_FUNC( notEqual,			is_number_v<T0> && is_number_v<T1> );
 
 template<typename T,typename=std::enable_if_t<is_vector_v<T>&&is_element_type_v<T, bool>>>
-auto any(const T& x) {
+constexpr auto any(const T& x) {
 	if constexpr ( vec_length<T> ==4 )
 		return x[0]||x[1]||x[2]||x[3];
 	else if constexpr ( vec_length<T> ==3 )
@@ -357,14 +357,14 @@ auto any(const T& x) {
 }
 
 template<typename T,typename=std::enable_if_t<is_vector_v<T>&&is_element_type_v<T, bool>>>
-auto all(const T& x) {
+constexpr auto all(const T& x) {
 	if constexpr ( vec_length<T> ==4 )		return x[0]&&x[1]&&x[2]&&x[3];
 	else if constexpr ( vec_length<T> ==3 )	return x[0]&&x[1]&&x[2];
 	else									return x[0]&&x[1];
 }
 
 template<typename T,typename=std::enable_if_t<is_vector_v<T>&&is_element_type_v<T, bool>>>
-auto not_(const T& x) {
+constexpr auto not_(const T& x) {
 	if constexpr ( vec_length<T> ==4 )		return comp_vec_type_t<T>(!x[0],!x[1],!x[2],!x[3]);
 	else if constexpr ( vec_length<T> ==3 )	return comp_vec_type_t<T>(!x[0],!x[1],!x[2]);
 	else									return comp_vec_type_t<T>(!x[0],!x[1]);
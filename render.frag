@@ -4,22 +4,38 @@ const float PI = 3.1415926535;
 in vec3 normal;
 in vec3 worldPos;
 in vec2 texCoord;
+in float vertexAO;
 
 uniform vec2 viewport;
 uniform sampler2D diffTex;
-uniform int  diffTexEnabled=0;
 uniform vec3 lightColor;
 uniform vec3 lightPosition;
 uniform vec3 cameraPosition;
 uniform float roughness;
-uniform vec4 baseColor;
-uniform vec3 specColor;
-uniform float materialRoughness;
-uniform float materialMetallic;
 uniform float globalMetallic;
 uniform float heightScale;
 uniform float aoStrength;
 uniform float emissionStrength;
+// Per draw, one std140 slice of CommandList's buffer (DrawParams in main.cpp).
+layout(std140) uniform DrawParams {
+	mat4 modelMat;
+	vec4 baseColor;
+	vec3 specColor;
+	float materialRoughness;
+	float materialMetallic;
+	int roughnessMapInverse;
+	int diffTexEnabled;
+	int normalMapEnabled;
+	int normalMapRG;
+	int roughnessMapEnabled;
+	int metalnessMapEnabled;
+	int aoMapEnabled;
+	int heightMapEnabled;
+	int emissionMapEnabled;
+	int boneOffset;
+	int vertexAOEnabled;
+	int selected;
+};
 
 uniform sampler2D normalMap;
 uniform sampler2D roughnessMap;
@@ -27,20 +43,15 @@ uniform sampler2D metalnessMap;
 uniform sampler2D aoMap;
 uniform sampler2D heightMap;
 uniform sampler2D emissionMap;
-uniform sampler2D environmentMap;
-uniform sampler2D irradianceMap;
-uniform sampler2D prefilterMap;
+uniform samplerCube environmentMap;
+uniform samplerCube irradianceMap;
+uniform samplerCube prefilterMap;
 uniform sampler2D brdfLUT;
 
-uniform int normalMapEnabled;
-uniform int roughnessMapEnabled;
-uniform int metalnessMapEnabled;
-uniform int aoMapEnabled;
-uniform int heightMapEnabled;
-uniform int emissionMapEnabled;
-uniform int roughnessMapInverse;
 uniform int environmentEnabled;
 uniform int irradianceEnabled;
+uniform int shEnabled;
+uniform vec3 shIrradiance[9];		// irradiance/PI in SH9, see Model/IBL.cpp
 uniform int prefilterEnabled;
 uniform int brdfLUTEnabled;
 uniform float iblDiffuseIntensity;
@@ -149,36 +160,37 @@ vec2 parallaxMapping(vec2 uv, vec3 V, mat3 TBN){
 //***************************************************
 //               Environment Sampling
 //***************************************************
-// Sample equirectangular environment textures for IBL fallback paths.
-vec2 sphericalUV(vec3 dir){
-	dir = normalize(dir);
-	float phi = atan(dir.z, dir.x);
-	float theta = acos(clamp(dir.y, -1.0, 1.0));
-	float u = (phi + PI) / (2.0 * PI);
-	float v = theta / PI;
-	return vec2(u, v);
-}
-
+// Environment maps are cube maps converted from equirect HDRs at load time.
 vec3 sampleEnvironment(vec3 dir){
 	if( environmentEnabled<=0 ) return vec3(0);
-	vec2 uv = sphericalUV(dir);
-	return texture(environmentMap, uv).rgb;
+	return texture(environmentMap, dir).rgb;
+}
+
+vec3 evalSHIrradiance(vec3 d){
+	d = normalize(d);
+	vec3 e = shIrradiance[0] * 0.282095;
+	e += shIrradiance[1] * (0.488603 * d.y);
+	e += shIrradiance[2] * (0.488603 * d.z);
+	e += shIrradiance[3] * (0.488603 * d.x);
+	e += shIrradiance[4] * (1.092548 * d.x * d.y);
+	e += shIrradiance[5] * (1.092548 * d.y * d.z);
+	e += shIrradiance[6] * (0.315392 * (3.0 * d.z * d.z - 1.0));
+	e += shIrradiance[7] * (1.092548 * d.x * d.z);
+	e += shIrradiance[8] * (0.546274 * (d.x * d.x - d.y * d.y));
+	return max(e, vec3(0));
 }
 
 vec3 sampleIrradiance(vec3 dir){
-	if( irradianceEnabled>0 ) {
-		vec2 uv = sphericalUV(dir);
-		return texture(irradianceMap, uv).rgb;
-	}
+	if( shEnabled>0 )
+		return evalSHIrradiance(dir);
+	if( irradianceEnabled>0 )
+		return textureLod(irradianceMap, dir, 0.0).rgb;
 	return sampleEnvironment(dir);
 }
 
 vec3 samplePrefilter(vec3 dir, float rough){
-	if( prefilterEnabled>0 ) {
-		vec2 uv = sphericalUV(dir);
-		float lod = rough * prefilterMaxLod;
-		return textureLod(prefilterMap, uv, lod).rgb;
-	}
+	if( prefilterEnabled>0 )
+		return textureLod(prefilterMap, dir, rough * prefilterMaxLod).rgb;
 	return sampleEnvironment(dir);
 }
 
@@ -216,6 +228,8 @@ void main() {
 	vec3 sampledNormal = N;
 	if( normalMapEnabled>0 ) {
 		vec3 tangentNormal = texture( normalMap, uv ).xyz * 2.0 - 1.0;
+		if( normalMapRG>0 )		// two channel (BC5) maps store xy only
+			tangentNormal.z = sqrt( saturate( 1.0 - dot( tangentNormal.xy, tangentNormal.xy ) ) );
 		sampledNormal = normalize( TBN * tangentNormal );
 	}
 	N = normalize(sampledNormal);
@@ -249,13 +263,11 @@ void main() {
 	vec3 kD = (vec3(1.0) - kS) * (1.0 - metallicValue);
 	vec3 diffuse = albedoLinear / PI;
 
-	float ao = 1.0;
-	if( aoMapEnabled>0 ) {
-		float aoSample = texture( aoMap, uv ).r;
-		ao = mix(1.0, aoSample, saturate(aoStrength));
-	}
+	float aoSample = vertexAO;		// baked per vertex, 1 without
+	if( aoMapEnabled>0 ) aoSample *= texture( aoMap, uv ).r;
+	float ao = mix(1.0, aoSample, saturate(aoStrength));
 
-	vec3 ambient = (environmentEnabled>0 || irradianceEnabled>0)?vec3(0):0.03 * albedoLinear * ao;
+	vec3 ambient = (environmentEnabled>0 || irradianceEnabled>0 || shEnabled>0)?vec3(0):0.03 * albedoLinear * ao;
 	vec3 lightContribution = vec3(0);
 	if( NdotL>0.0 && NdotV>0.0 ) {
 		lightContribution = (kD * diffuse + specular) * radiance * NdotL;
@@ -281,5 +293,6 @@ void main() {
 	vec3 iblContribution = kD_IBL * diffuseIBL * ao * iblDiffuseIntensity + specularIBL * iblSpecularIntensity * ao;
 
 	vec3 colorLinear = ambient + lightContribution + emission + iblContribution;
+	if( selected>0 ) colorLinear = mix(colorLinear, vec3(1.0,0.6,0.1), 0.3);
 	outColor = vec4(tonemap(colorLinear,mat3(1),2.4), alpha);
 }
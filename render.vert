@@ -3,21 +3,60 @@
 layout(location=0) in vec3 inPosition;
 layout(location=1) in vec3 inNormal;
 layout(location=2) in vec2 inTexCoord;
+layout(location=3) in uvec4 inBones;
+layout(location=4) in vec4 inWeights;
+layout(location=5) in float inAO;
 uniform mat4 viewMat;
 uniform mat4 projMat;
-uniform mat4 modelMat = mat4(1);
 uniform mat3 textureMat = mat3(1);
 uniform mat4 shadowProjMat;
 uniform mat4 shadowViewMat;
+// Per draw, one std140 slice of CommandList's buffer (DrawParams in main.cpp).
+layout(std140) uniform DrawParams {
+	mat4 modelMat;
+	vec4 baseColor;
+	vec3 specColor;
+	float materialRoughness;
+	float materialMetallic;
+	int roughnessMapInverse;
+	int diffTexEnabled;
+	int normalMapEnabled;
+	int normalMapRG;
+	int roughnessMapEnabled;
+	int metalnessMapEnabled;
+	int aoMapEnabled;
+	int heightMapEnabled;
+	int emissionMapEnabled;
+	int boneOffset;
+	int vertexAOEnabled;
+	int selected;
+};
+// Animator's palettes, the rows of a 3x4 matrix in three texels per bone.
+uniform samplerBuffer bonePalette;
 out vec3 worldPos;
 out vec3 normal;
 out vec2 texCoord;
 out vec4 shadowCoord;
+out float vertexAO;
 void main() {
-	vec4 world_Pos = modelMat * vec4( inPosition, 1. );
+	vec4 position = vec4( inPosition, 1. );
+	vec3 norm = inNormal;
+	if( boneOffset>=0 ) {
+		vec4 r0 = vec4(0), r1 = vec4(0), r2 = vec4(0);
+		for( int i=0; i<4; i++ ) {
+			int b = ( boneOffset+int(inBones[i]) )*3;
+			r0 += inWeights[i]*texelFetch( bonePalette, b );
+			r1 += inWeights[i]*texelFetch( bonePalette, b+1 );
+			r2 += inWeights[i]*texelFetch( bonePalette, b+2 );
+		}
+		position = vec4( dot( r0, position ), dot( r1, position ), dot( r2, position ), 1. );
+		norm = vec3( dot( r0.xyz, norm ), dot( r1.xyz, norm ), dot( r2.xyz, norm ) );
+	}
+	vec4 world_Pos = modelMat * position;
 	worldPos = world_Pos.xyz;
-	normal = normalize( (modelMat*vec4(inNormal,0)).xyz );
+	normal = normalize( (modelMat*vec4(norm,0)).xyz );
 	texCoord = ( textureMat * vec3( inTexCoord, 1 ) ).xy;
 	shadowCoord = shadowProjMat * shadowViewMat * world_Pos;
+	vertexAO = vertexAOEnabled>0?inAO:1.;
 	gl_Position= projMat * viewMat * world_Pos;
 }